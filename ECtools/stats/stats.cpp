@@ -37,7 +37,7 @@ using std::cerr;
 using std::cout;
 using std::endl;
 
-enum eTableType { INVALID_STATS = -1, SYSTEM_STATS, SESSION_STATS, USER_STATS, COMPANY_STATS, SERVER_STATS, SESSION_TOP, OPTION_HOST, OPTION_USER, OPTION_DUMP };
+enum eTableType { INVALID_STATS = -1, SYSTEM_STATS, SESSION_STATS, USER_STATS, COMPANY_STATS, SERVER_STATS, SOAP_STATS, SLOW_STATS, SESSION_TOP, OPTION_HOST, OPTION_USER, OPTION_DUMP };
 
 static const struct option long_options[] = {
 		{ "system", 0, NULL, SYSTEM_STATS },
@@ -45,6 +45,8 @@ static const struct option long_options[] = {
 		{ "users", 0, NULL, USER_STATS },
 		{ "company", 0, NULL, COMPANY_STATS },
 		{ "servers", 0, NULL, SERVER_STATS },
+		{ "soap", 0, NULL, SOAP_STATS },
+		{ "slow", 0, NULL, SLOW_STATS },
 		{ "top", 0, NULL, SESSION_TOP },
 		{ "host", 1, NULL, OPTION_HOST },
 		{ "user", 1, NULL, OPTION_USER },
@@ -90,13 +92,31 @@ static constexpr const SizedSSortOrderSet(2, tableSortServers) =
   }
 };
 
+/* the methods that took the most time first */
+static constexpr const SizedSSortOrderSet(2, tableSortSoap) =
+{ 1, 0, 0,
+  {
+	  { PR_EC_STATS_SOAP_WALL, TABLE_SORT_DESCEND }
+  }
+};
+
+/* the latest request first */
+static constexpr const SizedSSortOrderSet(2, tableSortSlow) =
+{ 1, 0, 0,
+  {
+	  { PR_EC_STATS_SLOW_TIME, TABLE_SORT_DESCEND }
+  }
+};
+
 static const SSortOrderSet *const sortorders[] = {
 	tableSortSystem, tableSortSession,
-	tableSortUser, tableSortCompany, tableSortServers
+	tableSortUser, tableSortCompany, tableSortServers, tableSortSoap,
+	tableSortSlow
 };
 static const ULONG ulTableProps[] = {
 	PR_EC_STATSTABLE_SYSTEM, PR_EC_STATSTABLE_SESSIONS,
-	PR_EC_STATSTABLE_USERS, PR_EC_STATSTABLE_COMPANY, PR_EC_STATSTABLE_SERVERS
+	PR_EC_STATSTABLE_USERS, PR_EC_STATSTABLE_COMPANY, PR_EC_STATSTABLE_SERVERS,
+	PR_EC_STATSTABLE_SOAP, PR_EC_STATSTABLE_SLOW
 };
 
 struct TIMES {
@@ -477,6 +497,12 @@ static std::string mapitable_ToString(const SPropValue *lpProp)
 		return stringify_double(lpProp->Value.flt);
 	case PT_I8: {
 		char buf[HXSIZEOF_Z64+2];
+		if ((PROP_ID(lpProp->ulPropTag) >= PROP_ID(PR_EC_STATS_SOAP_CALLS) &&
+		    PROP_ID(lpProp->ulPropTag) <= PROP_ID(PR_EC_STATS_SOAP_BYTES)) ||
+		    PROP_ID(lpProp->ulPropTag) == PROP_ID(PR_EC_STATS_SLOW_CACHE_LOOKUPS) ||
+		    PROP_ID(lpProp->ulPropTag) == PROP_ID(PR_EC_STATS_SLOW_CACHE_HITS))
+			/* counters */
+			return stringify_int64(lpProp->Value.li.QuadPart);
 		snprintf(buf, sizeof(buf), "0x%lx", lpProp->Value.li.QuadPart);
 		return buf;
 	}
@@ -536,6 +562,26 @@ static std::string getMapiPropertyString(ULONG ulPropTag)
 	PROP_TO_STRING(PR_EC_STATS_SESSION_CLIENT_APPLICATION_VERSION);
 	PROP_TO_STRING(PR_EC_STATS_SESSION_CLIENT_APPLICATION_MISC);
 
+	PROP_TO_STRING(PR_EC_STATS_SOAP_CALLS);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_ERRORS);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_WALL);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_WALL_P50);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_WALL_P99);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_CPU);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_CPU_P99);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_SQL_QUERIES);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_SQL_ROWS);
+	PROP_TO_STRING(PR_EC_STATS_SOAP_BYTES);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_TIME);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_WALL);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_SQL_TIME);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_LOCK_WAIT);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_OBJECT);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_TABLE);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_CACHE_LOOKUPS);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_CACHE_HITS);
+	PROP_TO_STRING(PR_EC_STATS_SLOW_QUERIES);
+
 	PROP_TO_STRING(PR_SMTP_ADDRESS);
 	PROP_TO_STRING(PR_EC_NONACTIVE);
 	PROP_TO_STRING(PR_EC_ADMINISTRATOR);
@@ -625,6 +671,8 @@ static void print_help(const char *name)
 	cout << "  --users" << "\tGives information about users, store sizes and quotas" << endl;
 	cout << "  --company" << "\tGives information about companies, company sizes and quotas" << endl;
 	cout << "  --servers" << "\tGives information about cluster nodes" << endl;
+	cout << "  --soap" << "\t\tGives information about server time and resources per SOAP method, busiest first" << endl;
+	cout << "  --slow" << "\t\tGives traces of the latest requests slower than slow_request_threshold, with their SQL queries" << endl;
 	cout << "  --top" << "\t\tShows top-like information about sessions" << endl;
 	cout << "Options:" << endl;
 	cout << "  --user, -u <user>" << "\tUse specified username to logon" << endl;
@@ -673,6 +721,8 @@ int main(int argc, char **argv)
 		case USER_STATS:
 		case COMPANY_STATS:
 		case SERVER_STATS:
+		case SOAP_STATS:
+		case SLOW_STATS:
 		case SESSION_TOP:
 			eTable = (eTableType)c;
 			break;
@@ -83,10 +83,13 @@ public:
 		m_ulMaxSize = ulMaxSize;
 	}
 
+	/* Lookups and hits in all caches by the calling thread so far */
+	static thread_local size_type tls_lookups, tls_hits;
+
 protected:
 	ECCacheBase(const std::string &strCachename, size_type ulMaxSize, long lMaxAge);
-	KC_HIDDEN void IncrementHitCount() { ++m_ulCacheHit; }
-	KC_HIDDEN void IncrementValidCount() { ++m_ulCacheValid; }
+	KC_HIDDEN void IncrementHitCount() { ++m_ulCacheHit; ++tls_lookups; }
+	KC_HIDDEN void IncrementValidCount() { ++m_ulCacheValid; ++tls_hits; }
 	KC_HIDDEN void ClearCounters() { m_ulCacheHit = m_ulCacheValid = 0; }
 
 private:
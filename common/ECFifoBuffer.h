@@ -4,37 +4,70 @@
  */
 #pragma once
 #include <kopano/zcdefs.h>
+#include <atomic>
 #include <condition_variable>
-#include <deque>
+#include <memory>
 #include <mutex>
+#include <cstddef>
 #include <kopano/kcodes.h>
 
 namespace KC {
 
-// Thread safe buffer for FIFO operations
+/*
+ * Thread safe buffer for FIFO operations between one writer and one reader.
+ *
+ * The data lives in a ring whose fill state is described by two positions,
+ * each of which is only advanced by one side, so moving data does not take
+ * a lock. A side only sleeps when the ring is full (writer) or empty
+ * (reader), and is only woken once the other side has made room for or
+ * produced enough to be worth the wakeup.
+ */
 class KC_EXPORT ECFifoBuffer KC_FINAL {
 public:
-	typedef std::deque<unsigned char>	storage_type;
-	typedef storage_type::size_type		size_type;
+	typedef size_t size_type;
 	enum close_flags { cfRead = 1, cfWrite = 2 };
 
 	ECFifoBuffer(size_type ulMaxSize = 131072);
 	ECRESULT Write(const void *lpBuf, size_type cbBuf, unsigned int ulTimeoutMs, size_type *lpcbWritten);
 	ECRESULT Read(void *lpBuf, size_type cbBuf, unsigned int ulTimeoutMs, size_type *lpcbRead);
+	/*
+	 * Zero-copy access: the Peek functions hand out the largest contiguous
+	 * region that can be written to or read from, the Commit functions
+	 * publish (part of) it to the other side.
+	 */
+	ECRESULT PeekWrite(void **lppBuf, size_type *lpcbBuf, unsigned int ulTimeoutMs);
+	void CommitWrite(size_type cbBuf);
+	ECRESULT PeekRead(const void **lppBuf, size_type *lpcbBuf, unsigned int ulTimeoutMs);
+	void CommitRead(size_type cbBuf);
 	ECRESULT Close(close_flags flags);
 	KC_HIDDEN ECRESULT Flush();
 	KC_HIDDEN bool IsClosed(unsigned int flags) const;
-	KC_HIDDEN bool IsEmpty() const { return m_storage.empty(); }
-	KC_HIDDEN bool IsFull() const { return m_storage.size() == m_ulMaxSize; }
+	KC_HIDDEN bool IsEmpty() const { return m_ulWritePos.load() == m_ulReadPos.load(); }
+	KC_HIDDEN bool IsFull() const { return m_ulWritePos.load() - m_ulReadPos.load() == m_ulMaxSize; }
 
 private:
 	// prohibit copy
 	ECFifoBuffer(const ECFifoBuffer &) = delete;
 	ECFifoBuffer &operator=(const ECFifoBuffer &) = delete;
 
-	storage_type	m_storage;
-	size_type		m_ulMaxSize;
-	bool m_bReaderClosed = false, m_bWriterClosed = false;
+	KC_HIDDEN ECRESULT WaitWritable(size_type, unsigned int timeout);
+	KC_HIDDEN ECRESULT WaitReadable(size_type, unsigned int timeout);
+	KC_HIDDEN void WakeReader();
+	KC_HIDDEN void WakeWriter();
+
+	std::unique_ptr<unsigned char[]> m_storage;
+	size_type m_ulMaxSize; /* power of two */
+	/*
+	 * Total bytes ever written and read; each is only advanced by its own
+	 * side. The padding keeps them on separate cache lines.
+	 */
+	std::atomic<size_type> m_ulWritePos{0};
+	char m_pad1[64];
+	std::atomic<size_type> m_ulReadPos{0};
+	char m_pad2[64];
+	/* Amount a sleeping side waits for; 0 if it is not sleeping. */
+	std::atomic<size_type> m_ulReaderWants{0}, m_ulWriterWants{0};
+	std::atomic<bool> m_bReaderClosed{false}, m_bWriterClosed{false};
 	std::mutex m_hMutex;
 	std::condition_variable m_hCondNotEmpty, m_hCondNotFull, m_hCondFlushed;
 };
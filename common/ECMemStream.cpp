@@ -3,6 +3,7 @@
  * Copyright 2005 - 2016 Zarafa and its licensors
  */
 #include <kopano/platform.h>
+#include <algorithm>
 #include <chrono>
 #include <new>
 #include <mapix.h>
@@ -372,8 +373,76 @@ char* ECMemStream::GetBuffer()
 }
 
 ECFifoBuffer::ECFifoBuffer(size_type ulMaxSize) :
-	m_ulMaxSize(ulMaxSize)
-{}
+	m_ulMaxSize(64)
+{
+	/* Positions map onto the ring with a mask. */
+	while (m_ulMaxSize < ulMaxSize)
+		m_ulMaxSize <<= 1;
+	m_storage.reset(new unsigned char[m_ulMaxSize]);
+}
+
+/*
+ * A side that has to wait announces how much it waits for, then checks
+ * again. The other side publishes its position before it looks at the
+ * announcement, so one of the two always sees the other (all sequentially
+ * consistent).
+ *
+ * Each waits for at most half of the ring, so that they cannot both be
+ * waiting for each other.
+ */
+ECRESULT ECFifoBuffer::WaitWritable(size_type cbNeeded, unsigned int ulTimeoutMs)
+{
+	cbNeeded = std::min(cbNeeded, m_ulMaxSize / 2);
+	auto ready = [&]() {
+		return m_ulMaxSize - (m_ulWritePos.load() - m_ulReadPos.load()) >= cbNeeded ||
+		       m_bReaderClosed.load();
+	};
+	ulock_normal locker(m_hMutex);
+	m_ulWriterWants = cbNeeded;
+	bool ok = true;
+	if (ulTimeoutMs == 0)
+		m_hCondNotFull.wait(locker, ready);
+	else
+		ok = m_hCondNotFull.wait_for(locker, std::chrono::milliseconds(ulTimeoutMs), ready);
+	m_ulWriterWants = 0;
+	return ok ? erSuccess : KCERR_TIMEOUT;
+}
+
+ECRESULT ECFifoBuffer::WaitReadable(size_type cbNeeded, unsigned int ulTimeoutMs)
+{
+	cbNeeded = std::min(cbNeeded, m_ulMaxSize / 2);
+	auto ready = [&]() {
+		return m_ulWritePos.load() - m_ulReadPos.load() >= cbNeeded ||
+		       m_bWriterClosed.load();
+	};
+	ulock_normal locker(m_hMutex);
+	m_ulReaderWants = cbNeeded;
+	bool ok = true;
+	if (ulTimeoutMs == 0)
+		m_hCondNotEmpty.wait(locker, ready);
+	else
+		ok = m_hCondNotEmpty.wait_for(locker, std::chrono::milliseconds(ulTimeoutMs), ready);
+	m_ulReaderWants = 0;
+	return ok ? erSuccess : KCERR_TIMEOUT;
+}
+
+void ECFifoBuffer::WakeReader()
+{
+	auto cbWanted = m_ulReaderWants.load();
+	if (cbWanted == 0 || m_ulWritePos.load() - m_ulReadPos.load() < cbWanted)
+		return;
+	scoped_lock locker(m_hMutex);
+	m_hCondNotEmpty.notify_one();
+}
+
+void ECFifoBuffer::WakeWriter()
+{
+	auto cbWanted = m_ulWriterWants.load();
+	if (cbWanted == 0 || m_ulMaxSize - (m_ulWritePos.load() - m_ulReadPos.load()) < cbWanted)
+		return;
+	scoped_lock locker(m_hMutex);
+	m_hCondNotFull.notify_one();
+}
 
 /**
  * Write data into the FIFO.
@@ -385,7 +454,6 @@ ECFifoBuffer::ECFifoBuffer(size_type ulMaxSize) :
  *
  * @retval	erSuccess		The data was successfully written.
  * @retval	KCERR_INVALID_PARAMETER	lpBuf is NULL.
- * @retval	KCERR_NOT_ENOUGH_MEMORY	There was not enough memory available to store the data.
  * @retval	KCERR_TIMEOUT		Not all data was written within the specified time limit.
  *					The amount of data that was written is returned in lpcbWritten.
  * @retval	KCERR_NETWORK_ERROR	The buffer was closed prior to this call.
@@ -407,35 +475,30 @@ ECRESULT ECFifoBuffer::Write(const void *lpBuf, size_type cbBuf,
 		return erSuccess;
 	}
 
-	ulock_normal locker(m_hMutex);
 	while (cbWritten < cbBuf) {
-		while (IsFull()) {
+		auto ulPos = m_ulWritePos.load(std::memory_order_relaxed);
+		auto cbRoom = m_ulMaxSize - (ulPos - m_ulReadPos.load(std::memory_order_acquire));
+		if (cbRoom == 0) {
 			if (IsClosed(cfRead)) {
 				er = KCERR_NETWORK_ERROR;
-				goto exit;
-			}
-			if (ulTimeoutMs == 0) {
-				m_hCondNotFull.wait(locker);
-			} else if (m_hCondNotFull.wait_for(locker,
-			    std::chrono::milliseconds(ulTimeoutMs)) == std::cv_status::timeout) {
-				er = KCERR_TIMEOUT;
-				goto exit;
+				break;
 			}
+			er = WaitWritable(cbBuf - cbWritten, ulTimeoutMs);
+			if (er != erSuccess)
+				break;
+			continue;
 		}
 
-		const size_type cbNow = std::min(cbBuf - cbWritten, m_ulMaxSize - m_storage.size());
-		try {
-			m_storage.insert(m_storage.end(), lpData + cbWritten, lpData + cbWritten + cbNow);
-		} catch (const std::bad_alloc &) {
-			er = KCERR_NOT_ENOUGH_MEMORY;
-			goto exit;
-		}
-		m_hCondNotEmpty.notify_one();
+		auto cbNow = std::min(cbBuf - cbWritten, cbRoom);
+		auto ulOffset = ulPos & (m_ulMaxSize - 1);
+		auto cbFirst = std::min(cbNow, m_ulMaxSize - ulOffset);
+		memcpy(&m_storage[ulOffset], lpData + cbWritten, cbFirst);
+		memcpy(&m_storage[0], lpData + cbWritten + cbFirst, cbNow - cbFirst);
+		m_ulWritePos = ulPos + cbNow;
 		cbWritten += cbNow;
+		WakeReader();
 	}
 
-exit:
-	locker.unlock();
 	if (lpcbWritten && (er == erSuccess || er == KCERR_TIMEOUT))
 		*lpcbWritten = cbWritten;
 	return er;
@@ -471,38 +534,121 @@ ECRESULT ECFifoBuffer::Read(void *lpBuf, size_type cbBuf,
 		return erSuccess;
 	}
 
-	ulock_normal locker(m_hMutex);
 	while (cbRead < cbBuf) {
-		while (IsEmpty()) {
-			if (IsClosed(cfWrite))
-				goto exit;
-
-			if (ulTimeoutMs == 0) {
-				m_hCondNotEmpty.wait(locker);
-			} else if (m_hCondNotEmpty.wait_for(locker,
-			    std::chrono::milliseconds(ulTimeoutMs)) == std::cv_status::timeout) {
-				er = KCERR_TIMEOUT;
-				goto exit;
-			}
+		auto ulPos = m_ulReadPos.load(std::memory_order_relaxed);
+		auto cbAvail = m_ulWritePos.load(std::memory_order_acquire) - ulPos;
+		if (cbAvail == 0) {
+			/* The writer closes after its last write; look once more. */
+			if (IsClosed(cfWrite) && m_ulWritePos.load() == ulPos)
+				break;
+			er = WaitReadable(cbBuf - cbRead, ulTimeoutMs);
+			if (er != erSuccess)
+				break;
+			continue;
 		}
 
-		const size_type cbNow = std::min(cbBuf - cbRead, m_storage.size());
-		auto iEndNow = m_storage.begin() + cbNow;
-		std::copy(m_storage.begin(), iEndNow, lpData + cbRead);
-		m_storage.erase(m_storage.begin(), iEndNow);
-		m_hCondNotFull.notify_one();
+		auto cbNow = std::min(cbBuf - cbRead, cbAvail);
+		auto ulOffset = ulPos & (m_ulMaxSize - 1);
+		auto cbFirst = std::min(cbNow, m_ulMaxSize - ulOffset);
+		memcpy(lpData + cbRead, &m_storage[ulOffset], cbFirst);
+		memcpy(lpData + cbRead + cbFirst, &m_storage[0], cbNow - cbFirst);
+		m_ulReadPos = ulPos + cbNow;
 		cbRead += cbNow;
+		WakeWriter();
 	}
 
-	if (IsEmpty() && IsClosed(cfWrite))
+	if (IsEmpty() && IsClosed(cfWrite)) {
+		scoped_lock locker(m_hMutex);
 		m_hCondFlushed.notify_one();
-exit:
-	locker.unlock();
+	}
 	if (lpcbRead != nullptr && (er == erSuccess || er == KCERR_TIMEOUT))
 		*lpcbRead = cbRead;
 	return er;
 }
 
+/**
+ * Get the free space at the write position, waiting until there is some.
+ *
+ * @param[out]	lppBuf		Where to write to.
+ * @param[out]	lpcbBuf		How much can be written there; commit it
+ *				(or less) with CommitWrite().
+ *
+ * @retval	KCERR_TIMEOUT		The buffer stayed full.
+ * @retval	KCERR_NETWORK_ERROR	Either end of the buffer was closed.
+ */
+ECRESULT ECFifoBuffer::PeekWrite(void **lppBuf, size_type *lpcbBuf,
+    unsigned int ulTimeoutMs)
+{
+	if (lppBuf == nullptr || lpcbBuf == nullptr)
+		return KCERR_INVALID_PARAMETER;
+	if (IsClosed(cfWrite))
+		return KCERR_NETWORK_ERROR;
+	while (true) {
+		auto ulPos = m_ulWritePos.load(std::memory_order_relaxed);
+		auto cbRoom = m_ulMaxSize - (ulPos - m_ulReadPos.load(std::memory_order_acquire));
+		if (cbRoom > 0) {
+			auto ulOffset = ulPos & (m_ulMaxSize - 1);
+			*lppBuf = &m_storage[ulOffset];
+			*lpcbBuf = std::min(cbRoom, m_ulMaxSize - ulOffset);
+			return erSuccess;
+		}
+		if (IsClosed(cfRead))
+			return KCERR_NETWORK_ERROR;
+		auto er = WaitWritable(1, ulTimeoutMs);
+		if (er != erSuccess)
+			return er;
+	}
+}
+
+void ECFifoBuffer::CommitWrite(size_type cbBuf)
+{
+	m_ulWritePos = m_ulWritePos.load(std::memory_order_relaxed) + cbBuf;
+	WakeReader();
+}
+
+/**
+ * Get the data at the read position, waiting until there is some.
+ *
+ * @param[out]	lppBuf		The data.
+ * @param[out]	lpcbBuf		Its size; 0 when the writer has closed the
+ *				buffer and all data has been read. Consume
+ *				it (or less) with CommitRead().
+ *
+ * @retval	KCERR_TIMEOUT		The buffer stayed empty.
+ * @retval	KCERR_NETWORK_ERROR	The buffer was closed for reading.
+ */
+ECRESULT ECFifoBuffer::PeekRead(const void **lppBuf, size_type *lpcbBuf,
+    unsigned int ulTimeoutMs)
+{
+	if (lppBuf == nullptr || lpcbBuf == nullptr)
+		return KCERR_INVALID_PARAMETER;
+	if (IsClosed(cfRead))
+		return KCERR_NETWORK_ERROR;
+	while (true) {
+		auto ulPos = m_ulReadPos.load(std::memory_order_relaxed);
+		auto cbAvail = m_ulWritePos.load(std::memory_order_acquire) - ulPos;
+		auto ulOffset = ulPos & (m_ulMaxSize - 1);
+		if (cbAvail > 0 || (IsClosed(cfWrite) && m_ulWritePos.load() == ulPos)) {
+			*lppBuf = &m_storage[ulOffset];
+			*lpcbBuf = std::min(cbAvail, m_ulMaxSize - ulOffset);
+			return erSuccess;
+		}
+		auto er = WaitReadable(1, ulTimeoutMs);
+		if (er != erSuccess)
+			return er;
+	}
+}
+
+void ECFifoBuffer::CommitRead(size_type cbBuf)
+{
+	m_ulReadPos = m_ulReadPos.load(std::memory_order_relaxed) + cbBuf;
+	WakeWriter();
+	if (IsEmpty() && IsClosed(cfWrite)) {
+		scoped_lock locker(m_hMutex);
+		m_hCondFlushed.notify_one();
+	}
+}
+
 /**
  * Close a buffer.
  * This causes new writes to the buffer to fail with KCERR_NETWORK_ERROR and
@@ -514,12 +660,13 @@ ECRESULT ECFifoBuffer::Close(close_flags flags)
 	if (flags & cfRead) {
 		m_bReaderClosed = true;
 		m_hCondNotFull.notify_one();
-		if(IsEmpty())
-			m_hCondFlushed.notify_one();
+		m_hCondFlushed.notify_one();
 	}
 	if (flags & cfWrite) {
 		m_bWriterClosed = true;
 		m_hCondNotEmpty.notify_one();
+		if (IsEmpty())
+			m_hCondFlushed.notify_one();
 	}
 	return erSuccess;
 }
@@ -539,7 +686,7 @@ ECRESULT ECFifoBuffer::Flush()
 
 	ulock_normal locker(m_hMutex);
 	m_hCondFlushed.wait(locker,
-		[this](void) { return IsClosed(cfWrite) || IsEmpty(); });
+		[this](void) { return IsClosed(cfRead) || IsEmpty(); });
 	return erSuccess;
 }
 
@@ -547,11 +694,11 @@ bool ECFifoBuffer::IsClosed(unsigned int flags) const
 {
 	switch (flags) {
 	case cfRead:
-		return m_bReaderClosed;
+		return m_bReaderClosed.load();
 	case cfWrite:
-		return m_bWriterClosed;
+		return m_bWriterClosed.load();
 	case cfRead | cfWrite:
-		return m_bReaderClosed && m_bWriterClosed;
+		return m_bReaderClosed.load() && m_bWriterClosed.load();
 	default:
 		assert(false);
 		return false;
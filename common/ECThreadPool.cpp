@@ -432,7 +432,29 @@ bool ECWaitableTask::wait(unsigned timeout, unsigned waitMask) const
 	}
 }
 
-ECScheduler::ECScheduler()
+constexpr std::chrono::milliseconds ECScheduler::TIMER_TICK;
+
+namespace {
+
+/* A job or timer callback of the scheduler, run on its worker pool */
+class sched_job final : public ECTask {
+	public:
+	sched_job(std::function<void()> &&f) : m_fn(std::move(f)) {}
+
+	protected:
+	void run() override { m_fn(); }
+
+	private:
+	std::function<void()> m_fn;
+};
+
+}
+
+ECScheduler::ECScheduler(unsigned int workers, std::chrono::milliseconds tick,
+    unsigned int slots) :
+	m_tick(std::max(tick, std::chrono::milliseconds(1))),
+	m_slots(std::max(slots, 1U)), m_wheel(m_slots),
+	m_pool(new ECThreadPool("scw", std::max(workers, 1U)))
 {
 	auto ret = pthread_create(&m_hMainThread, nullptr, ScheduleThread, this);
 	if (ret != 0) {
@@ -451,6 +473,11 @@ ECScheduler::~ECScheduler()
 	l_exit.unlock();
 	if (m_thread_active)
 		pthread_join(m_hMainThread, nullptr);
+	/* The pool does not run what is still queued when it goes away */
+	ulock_normal l_jobs(m_jobs_lock);
+	m_jobs_done.wait(l_jobs, [this]() { return m_jobs == 0; });
+	l_jobs.unlock();
+	m_pool.reset();
 }
 
 HRESULT ECScheduler::AddSchedule(eSchedulerType eType, unsigned int ulBeginCycle,
@@ -470,6 +497,114 @@ HRESULT ECScheduler::AddSchedule(eSchedulerType eType, unsigned int ulBeginCycle
 	return S_OK;
 }
 
+ECScheduler::timer_id ECScheduler::add_timer(std::chrono::milliseconds delay,
+    std::function<void()> fn, std::chrono::milliseconds period,
+    std::chrono::milliseconds jitter)
+{
+	timer t;
+	t.period = period;
+	t.jitter = jitter;
+	t.fn = std::make_shared<timer_fn>();
+	t.fn->fn = std::move(fn);
+	std::unique_lock<std::mutex> lk(m_timer_lock);
+	t.id = ++m_next_id;
+	auto id = t.id;
+	/*
+	 * Rounded up, and counted from the next tick, which can be less than
+	 * a tick away: a timer never fires early.
+	 */
+	insert_timer(std::move(t), (delay.count() + m_tick.count() - 1) / m_tick.count() + 1);
+	lk.unlock();
+	scoped_lock l_exit(m_hExitMutex);
+	m_wake = true;
+	m_hExitSignal.notify_one();
+	return id;
+}
+
+bool ECScheduler::cancel_timer(timer_id id)
+{
+	scoped_lock lk(m_timer_lock);
+	auto i = m_timers.find(id);
+	if (i == m_timers.end())
+		return false;
+	m_wheel[i->second.first].erase(i->second.second);
+	m_timers.erase(i);
+	return true;
+}
+
+/* Puts @t in the slot @ticks from now. Called with m_timer_lock held. */
+void ECScheduler::insert_timer(timer &&t, uint64_t ticks)
+{
+	if (ticks == 0)
+		ticks = 1;
+	auto slot = (m_cursor + ticks) % m_slots;
+	t.rounds = (ticks - 1) / m_slots;
+	auto id = t.id;
+	auto &sl = m_wheel[slot];
+	sl.emplace_back(std::move(t));
+	m_timers[id] = {slot, std::prev(sl.end())};
+}
+
+/* Moves the wheel one tick on and fires the timers that are due. */
+void ECScheduler::advance_timers()
+{
+	std::vector<std::shared_ptr<timer_fn>> due;
+	std::vector<timer> again;
+	std::unique_lock<std::mutex> lk(m_timer_lock);
+	m_cursor = (m_cursor + 1) % m_slots;
+	auto &sl = m_wheel[m_cursor];
+	for (auto i = sl.begin(); i != sl.end(); ) {
+		if (i->rounds > 0) {
+			--i->rounds;
+			++i;
+			continue;
+		}
+		due.emplace_back(i->fn);
+		auto t = std::move(*i);
+		m_timers.erase(t.id);
+		i = sl.erase(i);
+		if (t.period.count() != 0)
+			again.emplace_back(std::move(t));
+	}
+	/*
+	 * Put back after the walk: a period of a multiple of m_slots ticks
+	 * lands in the slot being walked.
+	 */
+	for (auto &t : again) {
+		auto delay = t.period;
+		if (t.jitter.count() > 0)
+			delay += std::chrono::milliseconds(rand_mt() % (t.jitter.count() + 1));
+		/*
+		 * Counted from when the run was due, so rounded to the nearest
+		 * tick to keep the period right on average.
+		 */
+		insert_timer(std::move(t), (delay.count() + m_tick.count() / 2) / m_tick.count());
+	}
+	lk.unlock();
+
+	for (auto &fn : due) {
+		if (fn->running.exchange(true))
+			continue;
+		run_job([fn]() {
+			fn->fn();
+			fn->running = false;
+		});
+	}
+}
+
+void ECScheduler::run_job(std::function<void()> &&fn)
+{
+	ulock_normal l_jobs(m_jobs_lock);
+	++m_jobs;
+	l_jobs.unlock();
+	m_pool->enqueue(new sched_job([this, fn = std::move(fn)]() {
+		fn();
+		scoped_lock lk(m_jobs_lock);
+		if (--m_jobs == 0)
+			m_jobs_done.notify_all();
+	}), true);
+}
+
 bool ECScheduler::hasExpired(time_t ttime, ECSCHEDULE *lpSchedule)
 {
 	struct tm tmLastRunTime, tmtime;
@@ -511,61 +646,61 @@ bool ECScheduler::hasExpired(time_t ttime, ECSCHEDULE *lpSchedule)
 	return false;
 }
 
+/* Hands the AddSchedule jobs that are due to the worker pool. */
+void ECScheduler::run_schedules()
+{
+	scoped_rlock l_sched(m_hSchedulerMutex);
+	/* TODO If load on server high, check only items with a high priority */
+	auto ttime = time(nullptr);
+	for (auto &sl : m_listScheduler) {
+		if (!hasExpired(ttime, &sl))
+			continue;
+		sl.tLastRunTime = ttime;
+		auto func = sl.lpFunction;
+		auto data = sl.lpData;
+		run_job([=]() { delete static_cast<HRESULT *>(func(data)); });
+	}
+}
+
 void *ECScheduler::ScheduleThread(void *lpTmpScheduler)
 {
 	kcsrv_blocksigs();
 	auto lpScheduler = static_cast<ECScheduler *>(lpTmpScheduler);
-	HRESULT *lperThread = nullptr;
-	pthread_t hThread;
-	time_t ttime;
-
 	if (lpScheduler == nullptr)
 		return nullptr;
 
+	using clock = std::chrono::steady_clock;
+	auto next_poll = clock::now() + std::chrono::seconds(SCHEDULER_POLL_FREQUENCY);
+	auto tick = lpScheduler->m_tick;
+	auto next_tick = clock::now() + tick;
+
 	while (true) {
-		/* Wait for a terminate signal or return after a few minutes */
+		std::unique_lock<std::mutex> l_timer(lpScheduler->m_timer_lock);
+		bool idle = lpScheduler->m_timers.empty();
+		l_timer.unlock();
+
+		/* Wait for a terminate signal, the next tick, or the next poll */
 		ulock_normal l_exit(lpScheduler->m_hExitMutex);
+		lpScheduler->m_hExitSignal.wait_until(l_exit, idle ? next_poll : std::min(next_tick, next_poll),
+			[=]() { return lpScheduler->m_bExit || lpScheduler->m_wake; });
 		if (lpScheduler->m_bExit)
 			break;
-		if (lpScheduler->m_hExitSignal.wait_for(l_exit, std::chrono::seconds(SCHEDULER_POLL_FREQUENCY)) !=
-		    std::cv_status::timeout)
-			break;
+		lpScheduler->m_wake = false;
 		l_exit.unlock();
 
-		for (auto &sl : lpScheduler->m_listScheduler) {
-			ulock_rec l_sched(lpScheduler->m_hSchedulerMutex);
-
-			/* TODO If load on server high, check only items with a high priority */
-			time(&ttime);
-			if (hasExpired(ttime, &sl)) {
-				auto err = pthread_create(&hThread, nullptr, sl.lpFunction, static_cast<void *>(sl.lpData));
-				if (err != 0) {
-					ec_log_err("Could not create ECScheduler worker thread: %s", strerror(err));
-					goto task_fail;
-				}
-				set_thread_name(hThread, "scw");
-				sl.tLastRunTime = ttime;
-				err = pthread_join(hThread, reinterpret_cast<void **>(&lperThread));
-				if (err != 0) {
-					ec_log_err("Could not join ECScheduler work thread: %s", strerror(err));
-					goto task_fail;
-				}
-				delete lperThread;
-				lperThread = nullptr;
-			}
-
- task_fail:
-			l_sched.unlock();
-			// check for a exit signal
-			l_exit.lock();
-			if (lpScheduler->m_bExit) {
-				l_exit.unlock();
-				break;
-			}
-			l_exit.unlock();
+		auto now = clock::now();
+		if (idle) {
+			/* Nothing in the wheel, so no need to catch up */
+			next_tick = now + tick;
+		} else {
+			for (; next_tick <= now; next_tick += tick)
+				lpScheduler->advance_timers();
+		}
+		if (now >= next_poll) {
+			lpScheduler->run_schedules();
+			next_poll = now + std::chrono::seconds(SCHEDULER_POLL_FREQUENCY);
 		}
 	}
-
 	return nullptr;
 }
 
@@ -161,6 +161,8 @@ HRESULT GetNonPortableObjectType(unsigned int eid_size,
 	return hrSuccess;
 }
 
+thread_local ECCacheBase::size_type ECCacheBase::tls_lookups, ECCacheBase::tls_hits;
+
 ECCacheBase::ECCacheBase(const std::string &name, size_type size, long age) :
 	m_strCachename(name), m_ulMaxSize(size), m_lMaxAge(age)
 {}
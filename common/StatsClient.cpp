@@ -5,6 +5,8 @@
 #ifdef HAVE_CONFIG_H
 #	include "config.h"
 #endif
+#include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <string>
 #include <pthread.h>
@@ -31,6 +33,60 @@ using namespace std::string_literals;
 
 namespace KC {
 
+/* Threads are spread over the shards in the order in which they first count. */
+static unsigned int sc_shard()
+{
+	static std::atomic<unsigned int> next{0};
+	static thread_local unsigned int id = next++ % SC_SHARDS;
+	return id;
+}
+
+static void sc_add(std::atomic<double> &f, double v)
+{
+	auto old = f.load(std::memory_order_relaxed);
+	while (!f.compare_exchange_weak(old, old + v, std::memory_order_relaxed))
+		/* retry */;
+}
+
+static void sc_max(std::atomic<LONGLONG> &a, LONGLONG v)
+{
+	auto old = a.load(std::memory_order_relaxed);
+	while (old < v && !a.compare_exchange_weak(old, v, std::memory_order_relaxed))
+		/* retry */;
+}
+
+unsigned int ECHistogram::index(uint64_t v)
+{
+	if (v < 4)
+		return v;
+	unsigned int e = 63 - __builtin_clzll(v);
+	return 4 + (e - 2) * 4 + ((v >> (e - 2)) & 3);
+}
+
+uint64_t ECHistogram::lower(unsigned int i)
+{
+	if (i < 4)
+		return i;
+	i -= 4;
+	return static_cast<uint64_t>(4 + i % 4) << (i / 4);
+}
+
+/* Upper bound of the bucket that holds the sample at fraction q. */
+uint64_t ECHistogram::quantile(double q) const
+{
+	if (count == 0)
+		return 0;
+	auto want = std::max<uint64_t>(1, q * count + 0.5);
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < n.size(); ++i) {
+		seen += n[i];
+		if (seen < want)
+			continue;
+		return i + 1 < BUCKETS ? std::min(max, lower(i + 1) - 1) : max;
+	}
+	return max;
+}
+
 static void *submitThread(void *p)
 {
 	kcsrv_blocksigs();
@@ -130,6 +186,24 @@ template<typename T> static void setleaf(Json::Value &leaf, const T &elem)
 		break;
 	}
 }
+
+static void setleaf(Json::Value &leaf, const ECHistogram &h)
+{
+	leaf["type"] = "histogram";
+	leaf["mode"] = "counter";
+	leaf["count"] = static_cast<Json::Value::UInt64>(h.count);
+	leaf["sum"] = static_cast<Json::Value::UInt64>(h.sum);
+	leaf["max"] = static_cast<Json::Value::UInt64>(h.max);
+	leaf["p50"] = static_cast<Json::Value::UInt64>(h.quantile(0.5));
+	leaf["p90"] = static_cast<Json::Value::UInt64>(h.quantile(0.9));
+	leaf["p99"] = static_cast<Json::Value::UInt64>(h.quantile(0.99));
+	leaf["p999"] = static_cast<Json::Value::UInt64>(h.quantile(0.999));
+	/* lower bound of each bucket => number of samples */
+	Json::Value &b = leaf["buckets"] = Json::Value(Json::objectValue);
+	for (unsigned int i = 0; i < h.n.size(); ++i)
+		if (h.n[i] != 0)
+			b[std::to_string(ECHistogram::lower(i))] = static_cast<Json::Value::UInt64>(h.n[i]);
+}
 #endif
 
 std::string ECStatsCollector::stats_as_text()
@@ -138,10 +212,12 @@ std::string ECStatsCollector::stats_as_text()
 	root["version"] = 2;
 
 	for (auto &i : m_StatData) {
-		scoped_lock lk(i.second.lock);
 		Json::Value leaf;
 		leaf["desc"] = i.second.description;
-		setleaf(leaf, i.second);
+		if (i.second.type == SCT_HISTOGRAM)
+			setleaf(leaf, snapshot_hist(i.second));
+		else
+			setleaf(leaf, snapshot(i.second));
 		root["stats"][i.second.name] = leaf;
 	}
 	std::unique_lock<std::mutex> lk(m_odm_lock);
@@ -166,10 +242,9 @@ std::string ECStatsCollector::survey_as_text()
 		auto i = m_StatData.find(key);
 		if (i == m_StatData.cend())
 			continue;
-		scoped_lock lk(i->second.lock);
 		Json::Value leaf;
 		leaf["desc"] = i->second.description;
-		setleaf(leaf, i->second);
+		setleaf(leaf, snapshot(i->second));
 		root["stats"][i->second.name] = leaf;
 	}
 	std::unique_lock<std::mutex> lk(m_odm_lock);
@@ -315,6 +390,59 @@ void ECStatsCollector::AddStat(SCName index, SCType type, const char *name,
 	newStat.type = type;
 	newStat.name = name;
 	newStat.description = description;
+	if (type == SCT_TIME || type == SCT_STRING)
+		return;
+	newStat.shards.reset(new ECStatShard[SC_SHARDS]);
+	if (type == SCT_HISTOGRAM)
+		for (unsigned int i = 0; i < SC_SHARDS; ++i) {
+			newStat.shards[i].hist.reset(new std::atomic<uint64_t>[ECHistogram::BUCKETS]);
+			for (unsigned int j = 0; j < ECHistogram::BUCKETS; ++j)
+				newStat.shards[i].hist[j] = 0;
+		}
+}
+
+ECStat2 ECStatsCollector::snapshot(const ECStat &st)
+{
+	ECStat2 out{st.description, {}, st.type};
+	out.data.ll = 0;
+	switch (st.type) {
+	case SCT_REAL:
+	case SCT_REALGAUGE:
+		out.data.f = 0;
+		for (unsigned int i = 0; i < SC_SHARDS; ++i)
+			out.data.f += st.shards[i].f.load(std::memory_order_relaxed);
+		break;
+	case SCT_INTEGER:
+	case SCT_INTGAUGE:
+	case SCT_HISTOGRAM:
+		for (unsigned int i = 0; i < SC_SHARDS; ++i)
+			out.data.ll += st.shards[i].ll.load(std::memory_order_relaxed);
+		break;
+	case SCT_TIME:
+	case SCT_STRING: {
+		scoped_lock lk(st.lock);
+		out.data = st.data;
+		out.strdata = st.strdata;
+		break;
+	}
+	}
+	return out;
+}
+
+ECHistogram ECStatsCollector::snapshot_hist(const ECStat &st)
+{
+	ECHistogram h;
+	h.n.assign(ECHistogram::BUCKETS, 0);
+	for (unsigned int i = 0; i < SC_SHARDS; ++i) {
+		const auto &sh = st.shards[i];
+		h.sum += sh.ll.load(std::memory_order_relaxed);
+		h.max = std::max<uint64_t>(h.max, sh.max.load(std::memory_order_relaxed));
+		for (unsigned int j = 0; j < ECHistogram::BUCKETS; ++j)
+			h.n[j] += sh.hist[j].load(std::memory_order_relaxed);
+	}
+	for (auto c : h.n)
+		h.count += c;
+	return h;
 }
 
 void ECStatsCollector::inc(SCName name, double inc)
@@ -323,8 +451,7 @@ void ECStatsCollector::inc(SCName name, double inc)
 	if (iSD == m_StatData.cend())
 		return;
 	assert(iSD->second.type == SCT_REAL || iSD->second.type == SCT_REALGAUGE);
-	scoped_lock lk(iSD->second.lock);
-	iSD->second.data.f += inc;
+	sc_add(iSD->second.shards[sc_shard()].f, inc);
 }
 
 void ECStatsCollector::inc(SCName name, int v)
@@ -338,8 +465,7 @@ void ECStatsCollector::inc(SCName name, LONGLONG inc)
 	if (iSD == m_StatData.cend())
 		return;
 	assert(iSD->second.type == SCT_INTEGER || iSD->second.type == SCT_INTGAUGE);
-	scoped_lock lk(iSD->second.lock);
-	iSD->second.data.ll += inc;
+	iSD->second.shards[sc_shard()].ll.fetch_add(inc, std::memory_order_relaxed);
 }
 
 void ECStatsCollector::set_dbl(enum SCName name, double set)
@@ -348,8 +474,12 @@ void ECStatsCollector::set_dbl(enum SCName name, double set)
 	if (iSD == m_StatData.cend())
 		return;
 	assert(iSD->second.type == SCT_REAL || iSD->second.type == SCT_REALGAUGE);
+	/*
+	 * Overwriting the shards would lose the inc() calls that go on
+	 * meanwhile; adding the difference counts them as made after this.
+	 */
 	scoped_lock lk(iSD->second.lock);
-	iSD->second.data.f = set;
+	sc_add(iSD->second.shards[0].f, set - snapshot(iSD->second).data.f);
 }
 
 void ECStatsCollector::set(enum SCName name, LONGLONG set)
@@ -358,8 +488,9 @@ void ECStatsCollector::set(enum SCName name, LONGLONG set)
 	if (iSD == m_StatData.cend())
 		return;
 	assert(iSD->second.type == SCT_INTEGER || iSD->second.type == SCT_INTGAUGE);
+	/* See set_dbl */
 	scoped_lock lk(iSD->second.lock);
-	iSD->second.data.ll = set;
+	iSD->second.shards[0].ll.fetch_add(set - snapshot(iSD->second).data.ll, std::memory_order_relaxed);
 }
 
 void ECStatsCollector::SetTime(enum SCName name, time_t set)
@@ -388,9 +519,8 @@ void ECStatsCollector::Max(SCName name, LONGLONG max)
 	if (iSD == m_StatData.cend())
 		return;
 	assert(iSD->second.type == SCT_INTEGER || iSD->second.type == SCT_INTGAUGE);
-	scoped_lock lk(iSD->second.lock);
-	if (iSD->second.data.ll < max)
-		iSD->second.data.ll = max;
+	/* Maxima live in the first shard only, so that the sum is the maximum. */
+	sc_max(iSD->second.shards[0].ll, max);
 }
 
 void ECStatsCollector::avg_dbl(SCName name, double add)
@@ -400,7 +530,8 @@ void ECStatsCollector::avg_dbl(SCName name, double add)
 		return;
 	assert(iSD->second.type == SCT_REALGAUGE);
 	scoped_lock lk(iSD->second.lock);
-	iSD->second.data.f = ((add - iSD->second.data.f) / iSD->second.avginc) + iSD->second.data.f;
+	auto &f = iSD->second.shards[0].f;
+	f = ((add - f) / iSD->second.avginc) + f;
 	++iSD->second.avginc;
 	if (iSD->second.avginc == 0)
 		iSD->second.avginc = 1;
@@ -413,33 +544,39 @@ void ECStatsCollector::avg(SCName name, LONGLONG add)
 		return;
 	assert(iSD->second.type == SCT_INTGAUGE);
 	scoped_lock lk(iSD->second.lock);
-	iSD->second.data.ll = ((add - iSD->second.data.ll) / iSD->second.avginc) + iSD->second.data.ll;
+	auto &ll = iSD->second.shards[0].ll;
+	ll = ((add - ll) / iSD->second.avginc) + ll;
 	++iSD->second.avginc;
 	if (iSD->second.avginc == 0)
 		iSD->second.avginc = 1;
 }
 
+void ECStatsCollector::sample(SCName name, LONGLONG v)
+{
+	auto iSD = m_StatData.find(name);
+	if (iSD == m_StatData.cend())
+		return;
+	assert(iSD->second.type == SCT_HISTOGRAM);
+	if (v < 0)
+		v = 0;
+	auto &sh = iSD->second.shards[sc_shard()];
+	sh.hist[ECHistogram::index(v)].fetch_add(1, std::memory_order_relaxed);
+	sh.ll.fetch_add(v, std::memory_order_relaxed);
+	sc_max(sh.max, v);
+}
+
 std::string ECStatsCollector::GetValue(const SCMap::const_iterator::value_type &iSD)
 {
-	switch (iSD.second.type) {
-	case SCT_REAL:
-	case SCT_REALGAUGE:
-		return stringify_double(iSD.second.data.f);
-	case SCT_INTEGER:
-	case SCT_INTGAUGE:
-		return stringify_int64(iSD.second.data.ll);
-	case SCT_TIME: {
-		if (iSD.second.data.ts <= 0)
-			break;
-		char timestamp[128]{};
-		struct tm *tm = localtime(&iSD.second.data.ts);
-		strftime(timestamp, sizeof timestamp, "%a %b %e %T %Y", tm);
-		return timestamp;
-	}
-	case SCT_STRING:
-		return iSD.second.strdata;
-	}
-	return "";
+	if (iSD.second.type != SCT_HISTOGRAM)
+		return GetValue(snapshot(iSD.second));
+	auto h = snapshot_hist(iSD.second);
+	return format("count=%llu avg=%llu p50=%llu p90=%llu p99=%llu max=%llu",
+	       static_cast<unsigned long long>(h.count),
+	       static_cast<unsigned long long>(h.count > 0 ? h.sum / h.count : 0),
+	       static_cast<unsigned long long>(h.quantile(0.5)),
+	       static_cast<unsigned long long>(h.quantile(0.9)),
+	       static_cast<unsigned long long>(h.quantile(0.99)),
+	       static_cast<unsigned long long>(h.max));
 }
 
 std::string ECStatsCollector::GetValue(const ECStat2 &i)
@@ -461,6 +598,8 @@ std::string ECStatsCollector::GetValue(const ECStat2 &i)
 	}
 	case SCT_STRING:
 		return i.strdata;
+	case SCT_HISTOGRAM:
+		break;
 	}
 	return "";
 }
@@ -475,10 +614,8 @@ std::string ECStatsCollector::GetValue(const SCName &name)
 
 void ECStatsCollector::ForEachStat(void(callback)(const std::string &, const std::string &, const std::string &, void *), void *obj)
 {
-	for (auto &i : m_StatData) {
-		scoped_lock lk(i.second.lock);
+	for (auto &i : m_StatData)
 		callback(i.second.name, i.second.description, GetValue(i), obj);
-	}
 	std::lock_guard<std::mutex> lk(m_odm_lock);
 	for (const auto &i : m_ondemand)
 		callback(i.first, i.second.desc, GetValue(i.second), obj);
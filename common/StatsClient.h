@@ -11,6 +11,7 @@
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <cstdint>
 #include <pthread.h>
 
@@ -21,25 +22,27 @@ class ECConfig;
 enum SCName {
 	/* server stats */
 	SCN_SERVER_STARTTIME, SCN_SERVER_LAST_CACHECLEARED, SCN_SERVER_LAST_CONFIGRELOAD,
-	SCN_SERVER_CONNECTIONS, SCN_MAX_SOCKET_NUMBER, SCN_REDIRECT_COUNT, SCN_SOAP_REQUESTS, SCN_RESPONSE_TIME, SCN_PROCESSING_TIME,
+	SCN_SERVER_CONNECTIONS, SCN_MAX_SOCKET_NUMBER, SCN_REDIRECT_COUNT, SCN_SOAP_REQUESTS, SCN_RESPONSE_TIME, SCN_PROCESSING_TIME, SCN_SOAP_LATENCY,
 	/* search folder stats */
 	SCN_SEARCHFOLDER_COUNT, SCN_SEARCHFOLDER_THREADS, SCN_SEARCHFOLDER_UPDATE_RETRY, SCN_SEARCHFOLDER_UPDATE_FAIL,
 	/* database stats */
 	SCN_DATABASE_CONNECTS, SCN_DATABASE_SELECTS, SCN_DATABASE_INSERTS, SCN_DATABASE_UPDATES, SCN_DATABASE_DELETES,
 	SCN_DATABASE_FAILED_CONNECTS, SCN_DATABASE_FAILED_SELECTS, SCN_DATABASE_FAILED_INSERTS, SCN_DATABASE_FAILED_UPDATES, SCN_DATABASE_FAILED_DELETES, SCN_DATABASE_LAST_FAILED,
-	SCN_DATABASE_MWOPS, SCN_DATABASE_MROPS, SCN_DATABASE_DEFERRED_FETCHES, SCN_DATABASE_MERGES, SCN_DATABASE_MERGED_RECORDS, SCN_DATABASE_ROW_READS, SCN_DATABASE_COUNTER_RESYNCS,
+	SCN_DATABASE_MWOPS, SCN_DATABASE_MROPS, SCN_DATABASE_DEFERRED_FETCHES, SCN_DATABASE_MERGES, SCN_DATABASE_MERGED_RECORDS, SCN_DATABASE_ROW_READS, SCN_DATABASE_COUNTER_RESYNCS, SCN_DATABASE_LATENCY,
 	/* logon stats */
 	SCN_LOGIN_PASSWORD, SCN_LOGIN_SSL, SCN_LOGIN_SSO, SCN_LOGIN_SOCKET, SCN_LOGIN_DENIED,
 	/* system session stats */
 	SCN_SESSIONS_CREATED, SCN_SESSIONS_DELETED, SCN_SESSIONS_TIMEOUT, SCN_SESSIONS_INTERNAL_CREATED, SCN_SESSIONS_INTERNAL_DELETED,
 	/* system session group stats */
 	SCN_SESSIONGROUPS_CREATED, SCN_SESSIONGROUPS_DELETED,
+	/* permission check stats */
+	SCN_SECURITY_CACHE_HITS, SCN_SECURITY_CACHE_MISSES,
 	/* LDAP stats */
 	SCN_LDAP_CONNECTS, SCN_LDAP_RECONNECTS, SCN_LDAP_CONNECT_FAILED, SCN_LDAP_CONNECT_TIME, SCN_LDAP_CONNECT_TIME_MAX,
 	SCN_LDAP_AUTH_LOGINS, SCN_LDAP_AUTH_DENIED, SCN_LDAP_AUTH_TIME, SCN_LDAP_AUTH_TIME_MAX, SCN_LDAP_AUTH_TIME_AVG,
 	SCN_LDAP_SEARCH, SCN_LDAP_SEARCH_FAILED, SCN_LDAP_SEARCH_TIME, SCN_LDAP_SEARCH_TIME_MAX,
 	/* indexer stats */
-	SCN_INDEXER_SEARCH_ERRORS, SCN_INDEXER_SEARCH_MAX, SCN_INDEXER_SEARCH_AVG, SCN_INDEXED_SEARCHES, SCN_DATABASE_SEARCHES,
+	SCN_INDEXER_SEARCH_ERRORS, SCN_INDEXER_SEARCH_MAX, SCN_INDEXER_SEARCH_AVG, SCN_INDEXED_SEARCHES, SCN_DATABASE_SEARCHES, SCN_INDEXER_LATENCY,
 
 	SCN_DAGENT_ATTACHMENT_COUNT,
 	SCN_DAGENT_AUTOACCEPT,
@@ -115,15 +118,50 @@ enum SCType {
 	SCT_REALGAUGE,
 	SCT_TIME,
 	SCT_STRING,
+	SCT_HISTOGRAM,
+};
+
+/*
+ * Distribution of samples (durations in µs) over log-linear buckets, like
+ * HdrHistogram with two bits of precision: each power of two is split in
+ * four, so that quantiles are off by at most 25%.
+ */
+struct KC_EXPORT ECHistogram {
+	static constexpr unsigned int BUCKETS = 4 + 62 * 4;
+	static unsigned int index(uint64_t);
+	/* smallest value that falls in a bucket */
+	static uint64_t lower(unsigned int);
+	uint64_t quantile(double) const;
+
+	uint64_t count = 0, sum = 0, max = 0;
+	std::vector<uint64_t> n;
+};
+
+#define SC_SHARDS 16
+
+/*
+ * One thread's part of a numeric stat. Threads update their own shard
+ * without locking; readers add up all shards.
+ *
+ * The padding puts the fields of two shards at least 64 bytes apart, so
+ * that they never share a cache line, whatever the alignment of the
+ * array. (alignas would only hold with C++17's aligned new.)
+ */
+struct ECStatShard {
+	std::atomic<LONGLONG> ll{0}, max{0};
+	std::atomic<double> f{0};
+	std::unique_ptr<std::atomic<uint64_t>[]> hist; /* SCT_HISTOGRAM bucket counts */
+	char pad[96];
 };
 
 struct ECStat {
 	const char *name, *description;
-	SCData data;
+	SCData data; /* SCT_TIME only */
 	LONGLONG avginc;
 	SCType type;
-	std::mutex lock;
+	mutable std::mutex lock; /* for strdata, data and averages */
 	std::string strdata;
+	std::unique_ptr<ECStatShard[]> shards;
 };
 
 struct ECStat2 {
@@ -146,6 +184,7 @@ class KC_EXPORT ECStatsCollector {
 	void inc(enum SCName, double inc);
 	void inc(enum SCName, int inc = 1);
 	void inc(enum SCName, LONGLONG inc);
+	/* Counters may be set while other threads inc() them. */
 	void set_dbl(enum SCName, double set);
 	void setg_dbl(const std::string &, const std::string &, double);
 	void set(const std::string &, const std::string &, int64_t);
@@ -157,6 +196,8 @@ class KC_EXPORT ECStatsCollector {
 	void Max(SCName name, LONGLONG max);
 	void avg_dbl(enum SCName, double add);
 	void avg(enum SCName, LONGLONG add);
+	/* Add a sample to an SCT_HISTOGRAM stat. */
+	void sample(enum SCName, LONGLONG value);
 
 	/* strings are separate, used by ECSerial */
 	std::string GetValue(const SCMap::const_iterator::value_type &);
@@ -170,6 +211,8 @@ class KC_EXPORT ECStatsCollector {
 	 */
 	void AddStat(enum SCName index, SCType type, const char *name, const char *desc = "");
 	std::string GetValue(const ECStat2 &);
+	static ECStat2 snapshot(const ECStat &);
+	static ECHistogram snapshot_hist(const ECStat &);
 
 	bool m_thread_running = false;
 
@@ -0,0 +1,56 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#include <algorithm>
+#include <cmath>
+#include <kopano/batchsize.hpp>
+
+namespace KC {
+
+/* Round trips may take up at most 1/RTT_SHARE of the time per batch. */
+static constexpr double RTT_SHARE = 8;
+/* Weight of the newest sample in the moving averages */
+static constexpr double EWMA_WEIGHT = 0.5;
+
+batch_sizer::batch_sizer(unsigned int initial, unsigned int lo,
+    unsigned int hi, size_t budget) :
+	m_min(std::max(lo, 1U)), m_max(std::max(hi, m_min)), m_budget(budget)
+{
+	m_size = std::min(std::max(initial, m_min), m_max);
+}
+
+void batch_sizer::add_sizes(unsigned int n, size_t bytes)
+{
+	if (n == 0)
+		return;
+	double item_bytes = static_cast<double>(bytes) / n;
+	if (m_item_bytes == 0)
+		m_item_bytes = item_bytes;
+	else
+		m_item_bytes += EWMA_WEIGHT * (item_bytes - m_item_bytes);
+}
+
+void batch_sizer::update(unsigned int n, double rtt, double work)
+{
+	if (n == 0)
+		return;
+	double item_work = work / n;
+	if (!m_primed) {
+		m_rtt = rtt;
+		m_item_work = item_work;
+		m_primed = true;
+	} else {
+		m_rtt += EWMA_WEIGHT * (rtt - m_rtt);
+		m_item_work += EWMA_WEIGHT * (item_work - m_item_work);
+	}
+
+	double want = m_item_work > 0 ? std::ceil(RTT_SHARE * m_rtt / m_item_work) : m_max;
+	if (m_item_bytes > 0)
+		want = std::min(want, std::floor(m_budget / m_item_bytes));
+	want = std::min(std::max(want, static_cast<double>(m_min)), static_cast<double>(m_max));
+	/* Grow gradually, shrink at once. */
+	m_size = std::min(static_cast<unsigned int>(want), m_size * 2);
+}
+
+} /* namespace */
@@ -6,11 +6,15 @@
 #include <kopano/charset/convert.h>
 #include <mapicode.h>
 #include <numeric>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <stdexcept>
 #include <string>
 #include <kopano/stringutil.h>
 #include <cerrno>
+#include <cstring>
+#include <langinfo.h>
 #define BUFSIZE 4096
 
 namespace KC {
@@ -51,6 +55,138 @@ private:
 	const char** m_ptr;
 };
 
+/*
+ * iconv_open has to load and set up the conversion steps every time, which
+ * easily costs more than converting a short string. Descriptors are
+ * therefore kept per thread once their context is done with them, and
+ * handed to the next context converting between the same charsets.
+ */
+#define ICONV_POOL_MAX 16
+
+namespace {
+struct iconv_pool {
+	~iconv_pool();
+	std::unordered_multimap<std::string, iconv_t> m_free;
+};
+}
+
+/* Set once the pool of the thread is gone, during thread or process exit */
+static thread_local bool t_pool_gone;
+static thread_local iconv_pool t_pool;
+
+iconv_pool::~iconv_pool()
+{
+	for (const auto &e : m_free)
+		iconv_close(e.second);
+	m_free.clear();
+	t_pool_gone = true;
+}
+
+static iconv_t iconv_pool_get(const std::string &key, const char *tocode,
+    const char *fromcode)
+{
+	if (!t_pool_gone) {
+		auto i = t_pool.m_free.find(key);
+		if (i != t_pool.m_free.end()) {
+			auto cd = i->second;
+			t_pool.m_free.erase(i);
+			return cd;
+		}
+	}
+	return iconv_open(tocode, fromcode);
+}
+
+static void iconv_pool_put(std::string &&key, iconv_t cd)
+{
+	if (t_pool_gone || t_pool.m_free.size() >= ICONV_POOL_MAX) {
+		iconv_close(cd);
+		return;
+	}
+	/* Back to the initial shift state, for whoever gets it next */
+	iconv(cd, nullptr, nullptr, nullptr, nullptr);
+	t_pool.m_free.emplace(std::move(key), cd);
+}
+
+/* The charset name of @code without options, the locale's one for "" */
+static std::string iconv_base_name(const char *code)
+{
+	std::string name = code;
+	auto pos = name.find("//");
+	if (pos != std::string::npos)
+		name.erase(pos);
+	if (name.empty())
+		name = nl_langinfo(CODESET);
+	return strToLower(std::move(name));
+}
+
+static bool iconv_is_utf8(const std::string &name)
+{
+	return name == "utf-8" || name == "utf8";
+}
+
+/* Whether @name is @prefix followed by one of 1250..1258 */
+static bool iconv_is_cp125x(const std::string &name, const char *prefix)
+{
+	auto n = strlen(prefix);
+	return name.size() == n + 4 && name.compare(0, n, prefix) == 0 &&
+	       name.compare(n, 3, "125") == 0 && name[n+3] >= '0' && name[n+3] <= '8';
+}
+
+/*
+ * Charsets in which every ASCII character is the byte of the same value.
+ * Only names known exactly: e.g. CP12712 is EBCDIC.
+ */
+static bool iconv_extends_ascii(const std::string &name)
+{
+	return iconv_is_utf8(name) || name == "us-ascii" || name == "ascii" ||
+	       name == "ansi_x3.4-1968" || name == "latin1" ||
+	       name.compare(0, 9, "iso-8859-") == 0 ||
+	       name.compare(0, 8, "iso8859-") == 0 ||
+	       iconv_is_cp125x(name, "windows-") || iconv_is_cp125x(name, "cp");
+}
+
+static bool is_ascii(const char *s, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		if (static_cast<unsigned char>(s[i]) >= 0x80)
+			return false;
+	return true;
+}
+
+/* Whether iconv would take @s as UTF-8 without complaint */
+static bool is_valid_utf8(const char *str, size_t n)
+{
+	auto s = reinterpret_cast<const unsigned char *>(str);
+	size_t i = 0;
+	while (i < n) {
+		unsigned int c = s[i], len;
+		if (c < 0x80) {
+			++i;
+			continue;
+		} else if (c >= 0xC2 && c <= 0xDF) {
+			len = 2;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			len = 3;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			len = 4;
+		} else {
+			return false;
+		}
+		if (n - i < len)
+			return false;
+		unsigned int c1 = s[i+1];
+		/* Overlong forms, surrogates, beyond U+10FFFF */
+		if ((c == 0xE0 && c1 < 0xA0) || (c == 0xED && c1 > 0x9F) ||
+		    (c == 0xF0 && c1 < 0x90) || (c == 0xF4 && c1 > 0x8F))
+			return false;
+		for (unsigned int j = 1; j < len; ++j)
+			if ((s[i+j] & 0xC0) != 0x80)
+				return false;
+		i += len;
+	}
+	return true;
+}
+
 /**
  * The conversion context for iconv charset conversions takes a fromcode and a tocode,
  * which are the source and destination charsets, respectively. The 'tocode' may take
@@ -111,15 +247,22 @@ iconv_context_base::iconv_context_base(const char* tocode, const char* fromcode)
 		}
 	}
 
-	m_cd = iconv_open(strto.c_str(), fromcode);
+	auto to_name = iconv_base_name(tocode), from_name = iconv_base_name(fromcode);
+	/* The names resolved, in case "" is used under different locales */
+	m_pool_key = strto + '\n' + fromcode + '\n' + to_name + '\n' + from_name;
+	m_cd = iconv_pool_get(m_pool_key, strto.c_str(), fromcode);
 	if (m_cd == (iconv_t)(-1))
 		throw unknown_charset_exception(strerror(errno));
+	if (iconv_extends_ascii(to_name) && iconv_extends_ascii(from_name))
+		m_fast |= FAST_ASCII;
+	if (iconv_is_utf8(to_name) && iconv_is_utf8(from_name))
+		m_fast |= FAST_UTF8;
 }
 
 iconv_context_base::~iconv_context_base()
 {
 	if (m_cd != (iconv_t)(-1))
-		iconv_close(m_cd);
+		iconv_pool_put(std::move(m_pool_key), m_cd);
 }
 
 void iconv_context_base::doconvert(const char *lpFrom, size_t cbFrom)
@@ -130,6 +273,12 @@ void iconv_context_base::doconvert(const char *lpFrom, size_t cbFrom)
 	size_t cbSrc = 0;
 	size_t cbDst = 0;
 
+	if (((m_fast & FAST_ASCII) && is_ascii(lpFrom, cbFrom)) ||
+	    ((m_fast & FAST_UTF8) && is_valid_utf8(lpFrom, cbFrom))) {
+		append(lpFrom, cbFrom);
+		return;
+	}
+
 	lpSrc = lpFrom;
 	cbSrc = cbFrom;
 
@@ -55,7 +55,11 @@ size_t DB_RESULT::get_num_rows(void) const
 
 DB_ROW DB_RESULT::fetch_row(void)
 {
-	return mysql_fetch_row(static_cast<MYSQL_RES *>(m_res));
+	auto row = mysql_fetch_row(static_cast<MYSQL_RES *>(m_res));
+	/* At the end of a streamed result, the connection is free again. */
+	if (row == nullptr && m_db != nullptr && m_db->m_stream == m_res)
+		m_db->m_stream = nullptr;
+	return row;
 }
 
 DB_LENGTHS DB_RESULT::fetch_row_lengths(void)
@@ -265,6 +269,7 @@ ECRESULT KDatabase::Close(void)
 {
 	/* No locking here */
 	m_bConnected = false;
+	m_stream = nullptr;
 	if (m_bMysqlInitialize)
 		mysql_close(&m_lpMySQL);
 	m_bMysqlInitialize = false;
@@ -321,6 +326,11 @@ ECRESULT KDatabase::DoInsert(const std::string &q, unsigned int *idp,
  * conserve memory and increase pipelining (the client can start processing
  * data before the server has completed the query)
  *
+ * Until a streamed result has been read to the end (or freed), no other
+ * query can be sent on this connection; Query() refuses them. Callers that
+ * stream must therefore not touch the database from within their fetch_row
+ * loop, and must not keep DB_ROW pointers past the next fetch_row.
+ *
  * Returns erSuccess or %KCERR_DATABASE_ERROR.
  */
 ECRESULT KDatabase::DoSelect(const std::string &q, DB_RESULT *res_p,
@@ -336,6 +346,8 @@ ECRESULT KDatabase::DoSelect(const std::string &q, DB_RESULT *res_p,
 
 	ECRESULT er = erSuccess;
 	DB_RESULT res(this, stream ? mysql_use_result(&m_lpMySQL) : mysql_store_result(&m_lpMySQL));
+	if (stream)
+		m_stream = res.get();
 	if (res == nullptr) {
 		if (!m_bSuppressLockErrorLogging ||
 		    GetLastError() == DB_E_UNKNOWN)
@@ -437,6 +449,9 @@ std::string KDatabase::EscapeBinary(const void *data, size_t len)
 void KDatabase::FreeResult_internal(void *r)
 {
 	assert(r != nullptr);
+	if (r == m_stream)
+		/* mysql_free_result reads whatever rows are left */
+		m_stream = nullptr;
 	if (r != nullptr)
 		mysql_free_result(static_cast<MYSQL_RES *>(r));
 }
@@ -519,10 +534,23 @@ ECRESULT KDatabase::IsEngineSupported(const char *engine)
 	return erSuccess;
 }
 
+/*
+ * Returns true (and logs the offending query) if a streamed result is still
+ * open on this connection, see DoSelect.
+ */
+bool KDatabase::stream_busy(const std::string &q)
+{
+	if (m_stream == nullptr)
+		return false;
+	ec_log_err("SQL [%08lu]: query issued while a streamed result is still open: \"%s\"",
+		m_lpMySQL.thread_id, q.c_str());
+	return true;
+}
+
 ECRESULT KDatabase::Query(const std::string &q)
 {
 	LOG_SQL_DEBUG("SQL [%08lu]: \"%s;\"", m_lpMySQL.thread_id, q.c_str());
-	if (!m_bMysqlInitialize)
+	if (!m_bMysqlInitialize || stream_busy(q))
 		return KCERR_DATABASE_ERROR;
 	/* Be binary safe (http://dev.mysql.com/doc/mysql/en/mysql-real-query.html) */
 	auto err = mysql_real_query(&m_lpMySQL, q.c_str(), q.length());
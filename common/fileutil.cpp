@@ -14,6 +14,7 @@
 #include <kopano/ECLogger.h>
 #include <mapicode.h>
 #include <mapidefs.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -97,6 +98,52 @@ HRESULT HrMapFileToString(FILE *f, std::string *lpstrBuffer)
 	return hrSuccess;
 }
 
+mapped_file::~mapped_file()
+{
+	unmap();
+}
+
+void mapped_file::unmap()
+{
+	if (m_map != nullptr)
+		munmap(m_map, m_size);
+	m_map = nullptr;
+	m_data = "";
+	m_size = 0;
+	m_copy.clear();
+}
+
+/**
+ * Map the whole of @f. Falls back to HrMapFileToString for pipes and other
+ * files that cannot be mapped.
+ */
+HRESULT mapped_file::map(FILE *f)
+{
+	struct stat sb;
+
+	unmap();
+	fflush(f);
+	int fd = fileno(f);
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+		auto addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr != MAP_FAILED) {
+			madvise(addr, sb.st_size, MADV_SEQUENTIAL);
+			m_map = addr;
+			m_data = static_cast<const char *>(addr);
+			m_size = sb.st_size;
+			return hrSuccess;
+		}
+		ec_log_debug("mapped_file/mmap: %s", strerror(errno));
+	}
+	rewind(f);
+	auto hr = HrMapFileToString(f, &m_copy);
+	if (hr != hrSuccess)
+		return hr;
+	m_data = m_copy.c_str();
+	m_size = m_copy.size();
+	return hrSuccess;
+}
+
 /**
  * Duplicate a file, to a given location
  *
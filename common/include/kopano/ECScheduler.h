@@ -4,8 +4,16 @@
  */
 #pragma once
 #include <kopano/zcdefs.h>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
 #include <kopano/memory.hpp>
 #include <pthread.h>
 #include <list>
@@ -31,22 +39,87 @@ struct ECSCHEDULE {
 
 typedef std::list<ECSCHEDULE> ECScheduleList;
 
+class ECThreadPool;
+
+/*
+ * Runs jobs at set times of the hour, day, or month (AddSchedule), and
+ * timers that fire after a delay, once or periodically (add_timer).
+ *
+ * Timers are kept in a hashed timing wheel: a list per tick (by default
+ * TIMER_SLOTS lists of TIMER_TICK), a timer sitting in the slot its
+ * expiry falls in with the number of full turns still to go. Setting and cancelling a timer is
+ * O(1) and each tick only looks at one slot, so large numbers of timers
+ * are cheap. Jobs and timer callbacks are run on a pool of worker threads,
+ * so a long job does not hold up the timers.
+ */
 class KC_EXPORT ECScheduler KC_FINAL {
 public:
-	ECScheduler();
+	typedef uint64_t timer_id;
+
+	/*
+	 * @tick and @slots size the timer wheel; a smaller wheel with a
+	 * shorter tick lets tests go through turns of it quickly.
+	 */
+	ECScheduler(unsigned int workers = 1, std::chrono::milliseconds tick = TIMER_TICK, unsigned int slots = TIMER_SLOTS);
 	~ECScheduler(void);
 	HRESULT AddSchedule(eSchedulerType eType, unsigned int ulBeginCycle, void* (*lpFunction)(void*), void* lpData = NULL);
+	/*
+	 * Calls @fn after @delay, and with @period set, every @period after
+	 * that. Each run of a periodic timer is postponed by a random amount
+	 * up to @jitter, so that timers set up at the same time spread out. A
+	 * periodic timer skips its turn while its previous run is still busy.
+	 */
+	timer_id add_timer(std::chrono::milliseconds delay, std::function<void()> fn, std::chrono::milliseconds period = {}, std::chrono::milliseconds jitter = {});
+	/* Returns false if the timer was not set (anymore). Does not wait for a run in progress. */
+	bool cancel_timer(timer_id);
+
+	static constexpr std::chrono::milliseconds TIMER_TICK{100};
+	static constexpr unsigned int TIMER_SLOTS = 512;
 
 private:
+	struct timer_fn {
+		std::function<void()> fn;
+		std::atomic<bool> running{false};
+	};
+
+	struct timer {
+		timer_id id;
+		unsigned int rounds; /* full turns of the wheel left */
+		std::chrono::milliseconds period, jitter;
+		std::shared_ptr<timer_fn> fn;
+	};
+
+	typedef std::list<timer> timer_slot;
+
 	KC_HIDDEN static bool hasExpired(time_t, ECSCHEDULE *);
 	KC_HIDDEN static void *ScheduleThread(void *tmp_scheduler);
+	KC_HIDDEN void insert_timer(timer &&, uint64_t ticks);
+	KC_HIDDEN void advance_timers();
+	KC_HIDDEN void run_schedules();
+	KC_HIDDEN void run_job(std::function<void()> &&);
 
 	ECScheduleList		m_listScheduler;
 	bool m_thread_active = false, m_bExit = false;
+	/* Set when a timer was added while the thread may be sleeping long */
+	bool m_wake = false;
 	std::mutex m_hExitMutex; /* Mutex needed for the release signal */
 	std::condition_variable m_hExitSignal; /* Signal that should be sent to the Scheduler when to exit */
 	std::recursive_mutex m_hSchedulerMutex; /* Mutex for the locking of the scheduler */
 	pthread_t			m_hMainThread;			// Thread that is used for the Scheduler
+
+	const std::chrono::milliseconds m_tick;
+	const unsigned int m_slots;
+	std::mutex m_timer_lock; /* protects the wheel, m_timers and m_cursor */
+	std::vector<timer_slot> m_wheel;
+	std::unordered_map<timer_id, std::pair<unsigned int, timer_slot::iterator>> m_timers;
+	unsigned int m_cursor = 0;
+	timer_id m_next_id = 0;
+
+	std::unique_ptr<ECThreadPool> m_pool;
+	/* Jobs handed to m_pool that have not finished yet */
+	std::mutex m_jobs_lock;
+	std::condition_variable m_jobs_done;
+	unsigned int m_jobs = 0;
 };
 
 } /* namespace */
@@ -0,0 +1,41 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <kopano/zcdefs.h>
+#include <cstddef>
+
+namespace KC {
+
+/*
+ * Picks the size of the next batch in a request/consume pipeline (e.g. ICS
+ * stream export) from what the previous batches cost. Batches grow until
+ * the request round trip is small against the time spent consuming a
+ * batch, so that fetching the next batch in the background hides it, and
+ * shrink so that one batch of average-sized items fits @budget bytes.
+ */
+class KC_EXPORT batch_sizer final {
+	public:
+	batch_sizer(unsigned int initial, unsigned int min, unsigned int max, size_t budget);
+	/*
+	 * Account for one finished batch of @n items; @rtt is the time (s)
+	 * until the request was answered, @work the time the consumer spent
+	 * on the batch.
+	 */
+	void update(unsigned int n, double rtt, double work);
+	/* Account for @n items of @bytes in total, where their size is known. */
+	void add_sizes(unsigned int n, size_t bytes);
+	unsigned int size() const { return m_size; }
+	size_t budget() const { return m_budget; }
+	double avg_item_size() const { return m_item_bytes; }
+
+	private:
+	unsigned int m_size, m_min, m_max;
+	size_t m_budget;
+	/* moving averages; per item for bytes and work */
+	double m_item_bytes = 0, m_rtt = 0, m_item_work = 0;
+	bool m_primed = false;
+};
+
+} /* namespace */
@@ -85,7 +85,17 @@ class KC_EXPORT iconv_context_base {
 	 */
 	KC_HIDDEN virtual void append(const char *buf, size_t bufsize) = 0;
 
+	/*
+	 * Inputs that convert to themselves and need not go through iconv:
+	 * plain ASCII between two charsets that both extend ASCII, and valid
+	 * UTF-8 when converting from UTF-8 to UTF-8.
+	 */
+	enum { FAST_ASCII = 1 << 0, FAST_UTF8 = 1 << 1 };
+
 	iconv_t	m_cd = reinterpret_cast<iconv_t>(-1);
+	/* Under which the descriptor goes back to the pool of the thread */
+	std::string m_pool_key;
+	unsigned int m_fast = 0;
 	bool m_bForce = true; /* Ignore illegal sequences by default. */
 	bool m_bHTML = false;
 
@@ -181,9 +191,9 @@ class KC_EXPORT_DYCAST iconv_context KC_FINAL :
  * @param[in] _from			The string that is to be converted to another charset.
  * @return					The converted string.
  *
- * @note	Since this method needs to create an iconv object internally
- *			it is better to use a convert_context when multiple conversions
- *			need to be performed.
+ * @note	iconv descriptors are reused per thread, so one-off conversions
+ *			are cheap; a convert_context still saves the lookup when
+ *			multiple conversions need to be performed.
  */
 template<typename To_Type, typename From_Type>
 inline To_Type convert_to(const From_Type &from)
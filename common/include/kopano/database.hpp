@@ -58,6 +58,10 @@ class KC_EXPORT DB_RESULT KC_FINAL {
 		return p;
 	}
 
+	/*
+	 * For a result from DoSelect(..., true), this is only the number of
+	 * rows fetched so far.
+	 */
 	size_t get_num_rows(void) const;
 	DB_ROW fetch_row(void);
 	DB_LENGTHS fetch_row_lengths(void);
@@ -148,6 +152,7 @@ class KC_EXPORT KDatabase : public kt_completion {
 	bool isConnected(void) const { return m_bConnected; }
 	ECRESULT IsEngineSupported(const char *);
 	virtual ECRESULT Query(const std::string &q);
+	bool stream_busy(const std::string &q);
 	ECRESULT I_Update(const std::string &q, unsigned int *affected);
 
 	MYSQL m_lpMySQL;
@@ -161,6 +166,12 @@ class KC_EXPORT KDatabase : public kt_completion {
 
 	std::recursive_mutex m_hMutexMySql;
 	bool m_bAutoLock = true;
+	/*
+	 * The streamed result that still has rows in transit. MySQL cannot
+	 * run another query on the connection until it is read to the end or
+	 * freed.
+	 */
+	void *m_stream = nullptr;
 
 	friend class DB_RESULT;
 };
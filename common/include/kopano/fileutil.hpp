@@ -28,6 +28,31 @@ class file_deleter {
 	void operator()(FILE *f) { fclose(f); }
 };
 
+/**
+ * Read-only view of a complete file. Regular files are mmap()ed, so the
+ * contents are paged in from the page cache instead of being copied onto the
+ * heap; anything else is read into memory.
+ */
+class KC_EXPORT mapped_file KC_FINAL {
+	public:
+	mapped_file() = default;
+	~mapped_file();
+	HRESULT map(FILE *);
+	const char *data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	private:
+	KC_HIDDEN void unmap();
+
+	void *m_map = nullptr;
+	const char *m_data = "";
+	size_t m_size = 0;
+	std::string m_copy;
+
+	mapped_file(const mapped_file &) = delete;
+	void operator=(const mapped_file &) = delete;
+};
+
 extern KC_EXPORT HRESULT HrFileLFtoCRLF(FILE *fin, FILE **fout);
 extern KC_EXPORT HRESULT HrMapFileToString(FILE *f, std::string *buf);
 extern KC_EXPORT bool DuplicateFile(FILE *, std::string &newname);
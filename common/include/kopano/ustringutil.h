@@ -6,6 +6,7 @@
 #include <kopano/zcdefs.h>
 #include <kopano/kcodes.h>
 #include <string>
+#include <vector>
 #include <unicode/coll.h>
 #include <unicode/sortkey.h>
 #include <unicode/unistr.h>
@@ -49,6 +50,7 @@ extern KC_EXPORT ECLocale createLocaleFromName(const char *);
 extern KC_EXPORT ECRESULT LocaleIdToLCID(const char *locale, unsigned int *id);
 extern KC_EXPORT ECRESULT LCIDToLocaleId(unsigned int id, const char **locale);
 extern KC_EXPORT std::string createSortKeyDataFromUTF8(const char *s, int ncap, const ECLocale &);
+extern KC_EXPORT std::vector<std::string> createSortKeysFromUTF8(const std::vector<const char *> &, int ncap, const ECLocale &);
 extern KC_EXPORT int compareSortKeys(const std::string &, const std::string &);
 extern KC_EXPORT std::string createSortKeyData(const char *s, int ncap, const ECLocale &);
 extern KC_EXPORT std::string createSortKeyData(const wchar_t *s, int ncap, const ECLocale &);
@@ -55,8 +55,11 @@ At some point we need to rewqrite these functions to do all the conversion on th
 #include <kopano/CommonUtil.h>
 #include <cassert>
 #include <clocale>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <unicode/unorm.h>
 #include <unicode/coll.h>
 #include <unicode/tblcoll.h>
@@ -82,6 +85,49 @@ typedef std::unique_ptr<Collator> unique_ptr_Collator;
 
 namespace KC {
 
+/**
+ * Get the collator for a locale.
+ *
+ * Creating a collator is expensive, far more than the comparison or sort
+ * key it is needed for. One is created per locale, and each thread uses
+ * its own clone of that (collators are not thread-safe), which it keeps.
+ *
+ * @param[in]	locale		The locale
+ *
+ * @return		The collator, owned by the calling thread
+ */
+static Collator *get_collator(const ECLocale &locale)
+{
+	static std::mutex proto_lock;
+	static std::map<std::string, unique_ptr_Collator> protos;
+	thread_local std::map<std::string, unique_ptr_Collator> cache;
+	thread_local std::string last_name;
+	thread_local Collator *last = nullptr;
+
+	const char *name = locale.getName();
+	if (last != nullptr && last_name == name)
+		return last;
+	auto i = cache.find(name);
+	if (i == cache.cend()) {
+		unique_ptr_Collator coll;
+		std::unique_lock<std::mutex> lk(proto_lock);
+		auto &proto = protos[name];
+		if (proto == nullptr) {
+			UErrorCode status = U_ZERO_ERROR;
+			proto.reset(Collator::createInstance(locale, status));
+		}
+		if (proto != nullptr)
+			coll.reset(proto->clone());
+		lk.unlock();
+		if (coll == nullptr)
+			return nullptr;
+		i = cache.emplace(name, std::move(coll)).first;
+	}
+	last_name = name;
+	last = i->second.get();
+	return last;
+}
+
 /**
  * ASCII version to find a case-insensitive string part in a
  * haystack.
@@ -259,7 +305,7 @@ int str_icompare(const char *s1, const char *s2, const ECLocale &locale)
 	assert(s1);
 	assert(s2);
 	UErrorCode status = U_ZERO_ERROR;
-	unique_ptr_Collator ptrCollator(Collator::createInstance(locale, status));
+	auto ptrCollator = get_collator(locale);
 
 	UnicodeString a = StringToUnicode(s1);
 	UnicodeString b = StringToUnicode(s2);
@@ -435,7 +481,7 @@ int wcs_icompare(const wchar_t *s1, const wchar_t *s2, const ECLocale &locale)
 	assert(s1);
 	assert(s2);
 	UErrorCode status = U_ZERO_ERROR;
-	unique_ptr_Collator ptrCollator(Collator::createInstance(locale, status));
+	auto ptrCollator = get_collator(locale);
 
 	UnicodeString a = WCHARToUnicode(s1);
 	UnicodeString b = WCHARToUnicode(s2);
@@ -590,7 +636,7 @@ int u8_icompare(const char *s1, const char *s2, const ECLocale &locale)
 	assert(s1);
 	assert(s2);
 	UErrorCode status = U_ZERO_ERROR;
-	unique_ptr_Collator ptrCollator(Collator::createInstance(locale, status));
+	auto ptrCollator = get_collator(locale);
 
 	UnicodeString a = UTF8ToUnicode(s1);
 	UnicodeString b = UTF8ToUnicode(s2);
@@ -988,18 +1034,17 @@ ECRESULT LCIDToLocaleId(ULONG ulLcid, const char **lppszLocaleID)
 }
 
 /**
- * Create a locale independent blob that can be used to sort
- * strings fast. This is used when a string would be compared
- * multiple times.
+ * Create a sort key for a string
  *
- * @param[in]	s			The string to compare.
+ * @param[in]	coll		The collator of the locale
+ * @param[in]	s			The string to create the sort key for.
  * @param[in]	nCap		Base the key on the first nCap characters of s (if larger than 0).
- * @param[in]	locale		The locale used to create the sort key.
+ * @param[in,out]	buf		Buffer for the key, reused between calls.
  *
- * @returns		ECUSortKey object containing the blob
+ * @returns		The key (same bytes as CollationKey::getByteArray)
  */
-static CollationKey createSortKey(UnicodeString &&s, int nCap,
-    const ECLocale &locale)
+static std::string createSortKey(const Collator &coll, UnicodeString &&s,
+    int nCap, std::vector<uint8_t> &buf)
 {
 	if (nCap > 1)
 		s.truncate(nCap);
@@ -1007,11 +1052,14 @@ static CollationKey createSortKey(UnicodeString &&s, int nCap,
 	if (s.startsWith("'") || s.startsWith("("))
 		s.remove(0, 1);
 
-	CollationKey key;
-	UErrorCode status = U_ZERO_ERROR;
-	unique_ptr_Collator ptrCollator(Collator::createInstance(locale, status));
-	ptrCollator->getCollationKey(std::move(s), key, status); // Create a collation key for sorting
-	return key;
+	if (buf.size() < 256)
+		buf.resize(256);
+	auto len = coll.getSortKey(s, buf.data(), buf.size());
+	if (len > static_cast<int32_t>(buf.size())) {
+		buf.resize(len);
+		len = coll.getSortKey(s, buf.data(), buf.size());
+	}
+	return std::string(reinterpret_cast<const char *>(buf.data()), len);
 }
 
 /**
@@ -1026,12 +1074,11 @@ static CollationKey createSortKey(UnicodeString &&s, int nCap,
 static std::string createSortKeyData(UnicodeString &&s, int nCap,
     const ECLocale &locale)
 {
-	auto key = createSortKey(std::move(s), nCap, locale);
-	int32_t 		cbKeyData = 0;
-	const uint8_t	*lpKeyData = key.getByteArray(cbKeyData);
-	if (lpKeyData == nullptr)
+	thread_local std::vector<uint8_t> buf;
+	auto coll = get_collator(locale);
+	if (coll == nullptr)
 		return {};
-	return std::string(reinterpret_cast<const char *>(lpKeyData), cbKeyData);
+	return createSortKey(*coll, std::move(s), nCap, buf);
 }
 
 /**
@@ -1079,6 +1126,30 @@ std::string createSortKeyDataFromUTF8(const char *s, int nCap,
 	return createSortKeyData(UTF8ToUnicode(s), nCap, locale);
 }
 
+/**
+ * Create the sort keys of many strings at once, as
+ * createSortKeyDataFromUTF8 would for each of them.
+ *
+ * @param[in]	strs		The UTF-8 strings; keys of NULL entries are left empty.
+ * @param[in]	nCap		Base the keys on the first nCap characters (if larger than 0).
+ * @param[in]	locale		The locale used to create the sort keys.
+ *
+ * @returns		The keys, in the order of @strs
+ */
+std::vector<std::string> createSortKeysFromUTF8(const std::vector<const char *> &strs,
+    int nCap, const ECLocale &locale)
+{
+	std::vector<std::string> keys(strs.size());
+	std::vector<uint8_t> buf;
+	auto coll = get_collator(locale);
+	if (coll == nullptr)
+		return keys;
+	for (size_t i = 0; i < strs.size(); ++i)
+		if (strs[i] != nullptr)
+			keys[i] = createSortKey(*coll, UTF8ToUnicode(strs[i]), nCap, buf);
+	return keys;
+}
+
 /**
  * Compare two sort keys previously created with createSortKey.
  *
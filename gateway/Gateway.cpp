@@ -325,6 +325,8 @@ int main(int argc, char *argv[]) {
 		{ "imap_max_messagesize", "128M", CONFIGSETTING_RELOADABLE | CONFIGSETTING_SIZE },
 		{ "imap_expunge_on_delete", "no", CONFIGSETTING_RELOADABLE },
 		{ "imap_ignore_command_idle", "no", CONFIGSETTING_RELOADABLE },
+		{ "imap_fetch_threads", "0" },
+		{ "imap_fetch_window", "32" },
 		{ "disable_plaintext_auth", "no", CONFIGSETTING_RELOADABLE },
 		{ "server_socket", "http://localhost:236/" },
 		{ "server_hostname", "" },
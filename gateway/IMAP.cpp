@@ -38,6 +38,7 @@
 #include <unordered_set>
 #include <map>
 #include <algorithm>
+#include <deque>
 #include <inetmapi/options.h>
 #include <edkmdb.h>
 #include <kopano/stringutil.h>
@@ -79,6 +80,8 @@ IMAP::IMAP(const char *szServerPath, std::shared_ptr<ECChannel> ch,
 #endif
 	bOnlyMailFolders = parseBool(lpConfig->GetSetting("imap_only_mailfolders"));
 	bShowPublicFolder = parseBool(lpConfig->GetSetting("imap_public_folders"));
+	m_fetch_threads = atoui(lpConfig->GetSetting("imap_fetch_threads"));
+	m_fetch_window = std::max(1U, atoui(lpConfig->GetSetting("imap_fetch_window")));
 }
 
 IMAP::~IMAP() {
@@ -3049,6 +3052,67 @@ HRESULT IMAP::HrGetDataItems(string strMsgDataItemNames, vector<string> &lstData
 	return HrSplitInput(strMsgDataItemNames, lstDataItems);
 }
 
+/**
+ * Generates the response for one message of a FETCH command on the
+ * connection's fetch pool.
+ */
+class IMAP::fetch_task final : public ECWaitableTask {
+	public:
+	fetch_task(IMAP *imap, ULONG mail, bool force_flags, const std::vector<std::string> &items) :
+		m_imap(imap), m_mail(mail), m_force_flags(force_flags), m_items(items)
+	{}
+
+	memory_ptr<SPropValue> m_props;
+	unsigned int m_nprops = 0;
+	HRESULT m_result = hrSuccess;
+	std::string m_response;
+
+	protected:
+	void run() override
+	{
+		m_result = m_imap->HrPropertyFetchRow(m_props, m_nprops,
+		           m_response, m_mail, m_force_flags, m_items);
+	}
+
+	private:
+	IMAP *m_imap;
+	ULONG m_mail;
+	bool m_force_flags;
+	const std::vector<std::string> &m_items;
+};
+
+/**
+ * Returns the worker pool for parallel FETCH processing, or %nullptr if the
+ * request should be processed serially on the connection thread.
+ *
+ * @param[in] nmails number of messages in the FETCH request
+ */
+ECThreadPool *IMAP::fetch_pool(size_t nmails)
+{
+	if (m_fetch_threads == 0 || nmails < 2)
+		return nullptr;
+	if (m_fetch_pool == nullptr)
+		m_fetch_pool.reset(new(std::nothrow) ECThreadPool("imapfetch", m_fetch_threads));
+	return m_fetch_pool.get();
+}
+
+bool IMAP::cache_lookup(ULONG uid, std::string *msg)
+{
+	std::lock_guard<std::mutex> lk(m_cache_lock);
+	if (m_ulCacheUID != uid)
+		return false;
+	if (msg != nullptr)
+		*msg = m_strCache;
+	return true;
+}
+
+void IMAP::cache_store(ULONG uid, const std::string &msg)
+{
+	std::lock_guard<std::mutex> lk(m_cache_lock);
+	m_ulCacheUID = uid;
+	m_strCache = msg;
+}
+
 /**
  * Do a FETCH based on table data for a specific list of
  * messages. Replies directly to the IMAP client with the result for
@@ -3195,7 +3259,31 @@ HRESULT IMAP::HrPropertyFetch(list<ULONG> &lstMails, vector<string> &lstDataItem
 	sPropVal.ulPropTag = PR_INSTANCE_KEY;
 	ECPropertyRestriction sRestriction(RELOP_EQ, PR_INSTANCE_KEY, &sPropVal, ECRestriction::Cheap);
 
-	// Loop through all requested rows, and get the data for each (FIXME: slow for large requests)
+	/*
+	 * With a worker pool, rows are still looked up on this thread, but
+	 * HrPropertyFetchRow runs on the pool. At most m_fetch_window tasks
+	 * are outstanding, and responses are written strictly in request
+	 * order from the front of the queue. The MAPI objects are used by one
+	 * thread at a time (m_mapi_lock); what runs in parallel is the work
+	 * on the converted messages: body structures, parts, responses.
+	 */
+	auto pool = fetch_pool(lstMails.size());
+	std::deque<std::unique_ptr<fetch_task>> inflight;
+	auto drain = make_scope_success([&]() {
+		for (const auto &task : inflight)
+			task->wait();
+	});
+	auto flush_front = [&]() {
+		auto &task = inflight.front();
+		task->wait();
+		if (task->m_result != hrSuccess)
+			ec_log_warn("{?} Error fetching mail");
+		else
+			HrResponse(RESP_UNTAGGED, task->m_response);
+		inflight.pop_front();
+	};
+
+	// Loop through all requested rows, and get the data for each
 	for (auto mail_idx : lstMails) {
 		const SPropValue *lpProp = NULL; // non-free // by default: no need to mark-as-read
 
@@ -3218,6 +3306,7 @@ HRESULT IMAP::HrPropertyFetch(list<ULONG> &lstMails, vector<string> &lstDataItem
 				lpRows.reset();
 
                 // Row was not found in our current data, request new data
+				std::unique_lock<std::mutex> mapi_lk(m_mapi_lock);
 				if (sRestriction.FindRowIn(m_lpTable, BOOKMARK_CURRENT, 0) == hrSuccess &&
 				    m_lpTable->QueryRows(ulReadAhead, 0, &~lpRows) == hrSuccess &&
 				    lpRows->cRows != 0) {
@@ -3248,11 +3337,34 @@ HRESULT IMAP::HrPropertyFetch(list<ULONG> &lstMails, vector<string> &lstDataItem
         }
 
         // Fetch the row data
-		if (HrPropertyFetchRow(lpProps, cValues, strResponse, mail_idx, lpProp != nullptr, lstDataItems) != hrSuccess)
-			ec_log_warn("{?} Error fetching mail");
-		else
-			HrResponse(RESP_UNTAGGED, strResponse);
+		if (pool == nullptr) {
+			if (HrPropertyFetchRow(lpProps, cValues, strResponse, mail_idx, lpProp != nullptr, lstDataItems) != hrSuccess)
+				ec_log_warn("{?} Error fetching mail");
+			else
+				HrResponse(RESP_UNTAGGED, strResponse);
+			continue;
+		}
+
+		/* The rowset is recycled by the read-ahead, so the task gets its own copy. */
+		auto task = make_unique_nt<fetch_task>(this, mail_idx, lpProp != nullptr, lstDataItems);
+		if (task == nullptr)
+			return MAPI_E_NOT_ENOUGH_MEMORY;
+		if (cValues > 0) {
+			auto hr = Util::HrCopyPropertyArray(lpProps, cValues, &~task->m_props, &task->m_nprops);
+			if (hr != hrSuccess)
+				return hr;
+		}
+		while (inflight.size() >= m_fetch_window)
+			flush_front();
+		if (!task->queue_on(pool))
+			return MAPI_E_CALL_FAILED;
+		inflight.emplace_back(std::move(task));
+		/* Send whatever is already done, to keep the client busy. */
+		while (!inflight.empty() && inflight.front()->done())
+			flush_front();
 	}
+	while (!inflight.empty())
+		flush_front();
 
 	if (lpEntryList && lpEntryList->cValues) {
 		// mark unread messages as read
@@ -3343,7 +3455,19 @@ HRESULT IMAP::HrPropertyFetchRow(LPSPropValue lpProps, ULONG cValues, string &st
 		else if (kc_starts_with(*iFetch, "BODY") || kc_starts_with(*iFetch, "RFC822"))
 			bSkipOpen = false;
 	}
-	if (!bSkipOpen && m_ulCacheUID != lstFolderMailEIDs[ulMailnr].ulUid) {
+	/*
+	 * Look at the cache only once; with parallel FETCH, other workers may
+	 * replace it while this message is being processed.
+	 */
+	std::string strCached;
+	bool bCached = cache_lookup(lstFolderMailEIDs[ulMailnr].ulUid, &strCached);
+	/* The message is let go of under m_mapi_lock, like it is used */
+	auto release = make_scope_success([&]() {
+		std::lock_guard<std::mutex> mapi_lk(m_mapi_lock);
+		lpMessage.reset();
+	});
+	if (!bSkipOpen && !bCached) {
+		std::lock_guard<std::mutex> mapi_lk(m_mapi_lock);
 		// ignore error, we can't print an error halfway to the imap client
 		hr = lpSession->OpenEntry(lstFolderMailEIDs[ulMailnr].sEntryID.cb, (LPENTRYID) lstFolderMailEIDs[ulMailnr].sEntryID.lpb,
 							 &IID_IMessage, MAPI_DEFERRED_ERRORS | MAPI_BEST_ACCESS, &ulObjType, &~lpMessage);
@@ -3388,6 +3512,7 @@ HRESULT IMAP::HrPropertyFetchRow(LPSPropValue lpProps, ULONG cValues, string &st
 			else if (lpMessage) {
 				/* Autogenerate envelope on the fly */
 				memory_ptr<SPropValue> prop;
+				std::lock_guard<std::mutex> mapi_lk(m_mapi_lock);
 				sopt.headers_only = false;
 				hr = IMToINet(lpSession, lpAddrBook, lpMessage, oss, sopt);
 				if (hr != hrSuccess)
@@ -3460,9 +3585,9 @@ HRESULT IMAP::HrPropertyFetchRow(LPSPropValue lpProps, ULONG cValues, string &st
 
 			strMessage.clear();
 			sopt.headers_only = strstr(strItem.c_str(), "HEADER") != NULL;
-			if (m_ulCacheUID == lstFolderMailEIDs[ulMailnr].ulUid) {
+			if (bCached) {
 				// Get message from cache
-				strMessage = m_strCache;
+				strMessage = strCached;
 			} else {
 				// We need to send headers or a body(part) to the client.
 				// For some clients, we need to make sure that headers match the bodies,
@@ -3480,6 +3605,7 @@ HRESULT IMAP::HrPropertyFetchRow(LPSPropValue lpProps, ULONG cValues, string &st
 					auto lpProp = PCpropFindProp(lpProps, cValues, PR_EC_IMAP_EMAIL_SIZE);
 					if (lpProp) {
 						// we have PR_EC_IMAP_EMAIL_SIZE, so we also have PR_EC_IMAP_EMAIL
+						std::lock_guard<std::mutex> mapi_lk(m_mapi_lock);
 						object_ptr<IStream> lpStream;
 						hr = lpMessage->OpenProperty(PR_EC_IMAP_EMAIL, &IID_IStream, 0, 0, &~lpStream);
 						if (hr == hrSuccess)
@@ -3492,6 +3618,7 @@ HRESULT IMAP::HrPropertyFetchRow(LPSPropValue lpProps, ULONG cValues, string &st
 				if (hr != hrSuccess) {
 					assert(lpMessage);
 					ec_log_debug("Generating message");
+					std::unique_lock<std::mutex> mapi_lk(m_mapi_lock);
 
 					if (oss.tellp() == std::ostringstream::pos_type(0)) {
 						// already converted in previous loop?
@@ -3522,9 +3649,10 @@ HRESULT IMAP::HrPropertyFetchRow(LPSPropValue lpProps, ULONG cValues, string &st
 				}
 
 				// Cache the generated message
-				if(!sopt.headers_only) {
-					m_ulCacheUID = lstFolderMailEIDs[ulMailnr].ulUid;
-					m_strCache = strMessage;
+				if (!sopt.headers_only) {
+					cache_store(lstFolderMailEIDs[ulMailnr].ulUid, strMessage);
+					strCached = strMessage;
+					bCached = true;
 				}
 			}
 
@@ -11,6 +11,7 @@
 #include <set>
 #include <cstring>
 #include <kopano/ECChannel.h>
+#include <kopano/ECThreadPool.h>
 #include <kopano/memory.hpp>
 #include <kopano/hl.hpp>
 #include "ClientProto.h"
@@ -241,6 +242,18 @@ private:
 	// Message cache
 	std::string m_strCache;
 	ULONG m_ulCacheUID = 0;
+	std::mutex m_cache_lock; /* protects m_strCache/m_ulCacheUID during parallel FETCH */
+
+	/* Parallel FETCH response generation */
+	class fetch_task;
+	/*
+	 * Serialises the use of the connection's MAPI objects (session,
+	 * address book, stores, tables, messages) during a parallel FETCH;
+	 * only the work on the converted messages runs concurrently.
+	 */
+	std::mutex m_mapi_lock;
+	std::unique_ptr<KC::ECThreadPool> m_fetch_pool;
+	unsigned int m_fetch_threads = 0, m_fetch_window = 0;
 
 	/* A command has sent a continuation response, and requires more
 	 * data from the client. This is currently only used in the
@@ -286,6 +299,9 @@ private:
 	HRESULT HrPropertyFetch(std::list<ULONG> &mails, std::vector<std::string> &data_items);
 	HRESULT save_generated_properties(const std::string &text, IMessage *message);
 	HRESULT HrPropertyFetchRow(LPSPropValue props, ULONG nprops, std::string &response, ULONG mail_nr, bool bounce_flags, const std::vector<std::string> &data_items);
+	KC::ECThreadPool *fetch_pool(size_t nmails);
+	bool cache_lookup(ULONG uid, std::string *msg);
+	void cache_store(ULONG uid, const std::string &msg);
 	HRESULT HrGetMessageFlags(std::string &response, LPMESSAGE msg, bool recent);
 	HRESULT HrGetMessagePart(std::string &message_part, std::string &msg, std::string part_name);
 	ULONG LastOrNumber(const char *szNr, bool bUID);
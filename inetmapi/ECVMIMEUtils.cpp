@@ -4,10 +4,16 @@
  */
 #include <kopano/platform.h>
 #include <exception>
+#include <iterator>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <iostream>
 #include <string>
+#include <utility>
 #include <climits>
+#include <ctime>
 #include "ECVMIMEUtils.h"
 #include "MAPISMTPTransport.h"
 #include <kopano/CommonUtil.h>
@@ -54,6 +60,79 @@ public:
 	};
 };
 
+/*
+ * Authenticated SMTP connections kept open between messages, per server,
+ * so that spooler threads sending one message after another need not go
+ * through TCP, TLS and AUTH every time.
+ */
+struct smtp_conn {
+	vmime::shared_ptr<vmime::net::session> session;
+	vmime::shared_ptr<MAPISMTPTransport> transport;
+	time_t created = 0;
+	unsigned int messages = 0;
+};
+
+static std::mutex smtp_pool_lock;
+static std::map<std::string, std::list<smtp_conn>> smtp_pool;
+static unsigned int smtp_pool_size, smtp_pool_max_msgs;
+static time_t smtp_pool_max_age;
+
+/* Connections are closed (QUIT) when the list is destroyed, after unlocking. */
+void smtp_pool_configure(unsigned int size, unsigned int max_msgs,
+    unsigned int max_age)
+{
+	std::list<smtp_conn> drop;
+	std::lock_guard<std::mutex> lk(smtp_pool_lock);
+	smtp_pool_size = size;
+	smtp_pool_max_msgs = max_msgs;
+	smtp_pool_max_age = max_age;
+	for (auto &p : smtp_pool)
+		while (p.second.size() > size)
+			drop.splice(drop.end(), p.second, p.second.begin());
+}
+
+static bool smtp_conn_spent(const smtp_conn &c, time_t now)
+{
+	return (smtp_pool_max_msgs != 0 && c.messages >= smtp_pool_max_msgs) ||
+	       (smtp_pool_max_age != 0 && now - c.created >= smtp_pool_max_age);
+}
+
+/* Take the most recently used idle connection to @key, if any. */
+static smtp_conn smtp_pool_get(const std::string &key)
+{
+	std::list<smtp_conn> drop;
+	smtp_conn c;
+	std::lock_guard<std::mutex> lk(smtp_pool_lock);
+	auto i = smtp_pool.find(key);
+	if (i == smtp_pool.end())
+		return c;
+	auto now = time(nullptr);
+	auto &idle = i->second;
+	while (!idle.empty()) {
+		drop.splice(drop.end(), idle, std::prev(idle.end()));
+		if (!smtp_conn_spent(drop.back(), now)) {
+			c = std::move(drop.back());
+			drop.pop_back();
+			break;
+		}
+	}
+	return c;
+}
+
+static void smtp_pool_put(const std::string &key, smtp_conn &&c)
+{
+	std::list<smtp_conn> drop;
+	std::lock_guard<std::mutex> lk(smtp_pool_lock);
+	drop.emplace_back(std::move(c));
+	if (smtp_pool_size == 0 || smtp_conn_spent(drop.back(), time(nullptr)) ||
+	    !drop.back().transport->isConnected())
+		return;
+	auto &idle = smtp_pool[key];
+	idle.splice(idle.end(), drop, drop.begin());
+	while (idle.size() > smtp_pool_size)
+		drop.splice(drop.end(), idle, idle.begin());
+}
+
 ECVMIMESender::ECVMIMESender(const std::string &host, int port) :
     ECSender(host, port)
 {
@@ -270,18 +349,6 @@ HRESULT ECVMIMESender::sendMail(LPADRBOOK lpAdrBook, LPMESSAGE lpMessage,
 	error.clear();
 
 	try {
-		// Session initialization (global properties)
-		auto vmSession = vmime::net::session::create();
-
-		// set the server address and port, plus type of service by use of url
-		// and get our special mapismtp mailer
-		vmime::utility::url url("mapismtp", smtphost, smtpport);
-		auto vmTransport = vmSession->getTransport(url);
-		vmTransport->setTimeoutHandlerFactory(vmime::make_shared<mapiTimeoutHandlerFactory>());
-
-		/* cast to access interface extras */
-		auto mapiTransport = vmime::dynamicCast<MAPISMTPTransport>(vmTransport);
-
 		// get expeditor for 'mail from:' smtp command
 		if (vmMessage->getHeader()->hasField(vmime::fields::FROM))
 			expeditor = *vmime::dynamicCast<vmime::mailbox>(vmMessage->getHeader()->findField(vmime::fields::FROM)->getValue());
@@ -312,10 +379,8 @@ HRESULT ECVMIMESender::sendMail(LPADRBOOK lpAdrBook, LPMESSAGE lpMessage,
 
 		// Delivery report request
 		SPropValuePtr ptrDeliveryReport;
-		if (mapiTransport != nullptr &&
-		    HrGetOneProp(lpMessage, PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED, &~ptrDeliveryReport) == hrSuccess &&
-		    ptrDeliveryReport->Value.b)
-			mapiTransport->requestDSN(true, "");
+		bool dsn = HrGetOneProp(lpMessage, PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED, &~ptrDeliveryReport) == hrSuccess &&
+		           ptrDeliveryReport->Value.b;
 
 		// Generate the message, "stream" it and delegate the sending
 		// to the generic send() function.
@@ -326,22 +391,81 @@ HRESULT ECVMIMESender::sendMail(LPADRBOOK lpAdrBook, LPMESSAGE lpMessage,
 		 * This would be the place for spooler's
 		 * log_raw_message_stage2, but this so deep in inetmapi…
 		 */
-		const std::string &str(oss.str()); // copy?
-		vmime::utility::inputStreamStringAdapter isAdapter(str); // direct oss.str() ?
+		return sendData(expeditor, recipients, oss.str(), dsn);
+	} catch (const vmime::exception &e) {
+		// connection_greeting_error, ...?
+		ec_log_err("%s", e.what());
+		error = convert_to<std::wstring>(e.what());
+		return MAPI_E_NETWORK_ERROR;
+	} catch (const std::exception &e) {
+		ec_log_err("%s", e.what());
+		error = convert_to<std::wstring>(e.what());
+		return MAPI_E_NETWORK_ERROR;
+	}
+	return hr;
+}
+
+/**
+ * Sends @str from @expeditor to @recipients over a pooled connection to
+ * the SMTP server, or a new one. The part of sendMail after the message
+ * is generated; the failed recipients and the error are set as for it.
+ */
+HRESULT ECVMIMESender::sendData(const vmime::mailbox &expeditor,
+    const vmime::mailboxList &recipients, const std::string &str, bool dsn)
+{
+	smtpresult = 0;
+	error.clear();
+	mPermanentFailedRecipients.clear();
+	mTemporaryFailedRecipients.clear();
+
+	try {
+		vmime::utility::inputStreamStringAdapter isAdapter(str);
+
+		/* Reuse a pooled connection if the server still accepts RSET on it. */
+		auto pool_key = smtphost + ":" + stringify(smtpport);
+		auto conn = smtp_pool_get(pool_key);
+		if (conn.transport != nullptr) {
+			try {
+				conn.transport->reset();
+				ec_log_debug("SMTP: reusing connection (%u messages sent)", conn.messages);
+			} catch (const vmime::exception &e) {
+				ec_log_debug("SMTP: pooled connection unusable: %s", e.what());
+				conn = smtp_conn();
+			}
+		}
+		vmime::shared_ptr<vmime::net::transport> vmTransport = conn.transport;
+		if (vmTransport == nullptr) {
+			// Session initialization (global properties)
+			conn.session = vmime::net::session::create();
+			conn.created = time(nullptr);
+			// set the server address and port, plus type of service by use of url
+			// and get our special mapismtp mailer
+			vmime::utility::url url("mapismtp", smtphost, smtpport);
+			vmTransport = conn.session->getTransport(url);
+			vmTransport->setTimeoutHandlerFactory(vmime::make_shared<mapiTimeoutHandlerFactory>());
+		}
+
+		/* cast to access interface extras */
+		auto mapiTransport = vmime::dynamicCast<MAPISMTPTransport>(vmTransport);
+		if (mapiTransport != nullptr)
+			mapiTransport->requestDSN(dsn, "");
 
 		// send the email already!
 		bool ok = false;
-		try {
-			vmTransport->connect();
-		} catch (const vmime::exception &e) {
-			// special error, smtp server not respoding, so try later again
-			ec_log_err("Connect to SMTP: %s. E-Mail will be tried again later.", e.what());
-			return MAPI_W_NO_SERVICE;
+		if (!vmTransport->isConnected()) {
+			try {
+				vmTransport->connect();
+			} catch (const vmime::exception &e) {
+				// special error, smtp server not respoding, so try later again
+				ec_log_err("Connect to SMTP: %s. E-Mail will be tried again later.", e.what());
+				return MAPI_W_NO_SERVICE;
+			}
 		}
 
 		try {
 			vmTransport->send(expeditor, recipients, isAdapter, str.length(), NULL);
-			vmTransport->disconnect();
+			if (mapiTransport == nullptr)
+				vmTransport->disconnect();
 			ok = true;
 		} catch (const vmime::exceptions::command_error &e) {
 			if (mapiTransport != NULL) {
@@ -374,6 +498,12 @@ HRESULT ECVMIMESender::sendMail(LPADRBOOK lpAdrBook, LPMESSAGE lpMessage,
 			 */
 			mPermanentFailedRecipients = mapiTransport->getPermanentFailedRecipients();
 			mTemporaryFailedRecipients = mapiTransport->getTemporaryFailedRecipients();
+			if (ok) {
+				/* Hand the connection back only once done with it. */
+				conn.transport = std::move(mapiTransport);
+				++conn.messages;
+				smtp_pool_put(pool_key, std::move(conn));
+			}
 
 			if (mPermanentFailedRecipients.size() == static_cast<size_t>(recipients.getMailboxCount())) {
 				ec_log_err("SMTP: e-mail will be not be tried again: all recipients failed.");
@@ -400,7 +530,7 @@ HRESULT ECVMIMESender::sendMail(LPADRBOOK lpAdrBook, LPMESSAGE lpMessage,
 		error = convert_to<std::wstring>(e.what());
 		return MAPI_E_NETWORK_ERROR;
 	}
-	return hr;
+	return hrSuccess;
 }
 
 vmime::parsingContext imopt_default_parsectx()
@@ -21,6 +21,8 @@ private:
 public:
 	KC_HIDDEN ECVMIMESender(const std::string &host, int port);
 	KC_HIDDEN HRESULT sendMail(IAddrBook *, IMessage *, vmime::shared_ptr<vmime::message>, bool allow_everyone, bool always_expand_distlist);
+	/* Exported for tests/smtppool */
+	HRESULT sendData(const vmime::mailbox &expeditor, const vmime::mailboxList &recips, const std::string &data, bool dsn);
 };
 
 extern vmime::parsingContext imopt_default_parsectx();
@@ -435,6 +435,19 @@ void MAPISMTPTransport::noop()
 		throw exceptions::command_error("NOOP", resp->getText());
 }
 
+/* Abort any mail transaction, so that the connection can carry another message. */
+void MAPISMTPTransport::reset()
+{
+	if (!isConnected())
+		throw exceptions::not_connected();
+	sendRequest("RSET");
+	auto resp = readResponse();
+	if (resp->getCode() / 10 != 25) {
+		internalDisconnect();
+		throw exceptions::command_error("RSET", resp->getText());
+	}
+}
+
 //
 // Only this function is altered, to return per recipient failure.
 //
@@ -464,7 +477,28 @@ void MAPISMTPTransport::send(const mailbox &expeditor,
 			strSend += " ENVID=" + m_strDSNTrackid;
 	}
 
-	sendRequest(strSend);
+	auto rcpt_cmd = [&](const mailbox &mbox) {
+		auto cmd = "RCPT TO: <" + mbox.getEmail().toString() + ">";
+		if (bDSN)
+			cmd += " NOTIFY=SUCCESS,DELAY";
+		return cmd;
+	};
+
+	/*
+	 * With PIPELINING [RFC 2920], the whole envelope up to and including
+	 * DATA goes out in one write, and the replies are read afterwards in
+	 * order, instead of waiting a round trip for every recipient.
+	 */
+	bool pipeline = m_extensions.find("PIPELINING") != m_extensions.end();
+	if (pipeline) {
+		strSend += "\r\n";
+		for (size_t i = 0; i < recipients.getMailboxCount(); ++i)
+			strSend += rcpt_cmd(*recipients.getMailboxAt(i)) + "\r\n";
+		strSend += "DATA\r\n";
+		sendRequest(strSend, false);
+	} else {
+		sendRequest(strSend);
+	}
 	auto resp = readResponse();
 	if (resp->getCode() / 10 != 25) {
 		internalDisconnect();
@@ -478,11 +512,8 @@ void MAPISMTPTransport::send(const mailbox &expeditor,
 		const mailbox& mbox = *recipients.getMailboxAt(i);
 		unsigned int code;
 
-		strSend = "RCPT TO: <" + mbox.getEmail().toString() + ">";
-		if (bDSN)
-			 strSend += " NOTIFY=SUCCESS,DELAY";
-
-		sendRequest(strSend);
+		if (!pipeline)
+			sendRequest(rcpt_cmd(mbox));
 		resp = readResponse();
 		code = resp->getCode();
 
@@ -499,6 +530,11 @@ void MAPISMTPTransport::send(const mailbox &expeditor,
 			/* 421 4.7.0 localhorse.lh Error: too many errors */
 			ec_log_err("RCPT line gave SMTP error: %d %s. (and now?)",
 				resp->getCode(), resp->getText().c_str());
+			if (pipeline) {
+				/* The remaining replies, if any, are moot. */
+				internalDisconnect();
+				throw exceptions::connection_error(resp->getText());
+			}
 			break;
 		} else if (code / 100 == 5) {
 			/*
@@ -525,7 +561,8 @@ void MAPISMTPTransport::send(const mailbox &expeditor,
 	}
 
 	// Send the message data
-	sendRequest("DATA");
+	if (!pipeline)
+		sendRequest("DATA");
 
 	// we also stop here if all recipients failed before
 	resp = readResponse();
@@ -52,6 +52,7 @@ public:
 	bool isConnected() const;
 	void disconnect();
 	void noop();
+	void reset();
 	void send(const vmime::mailbox &expeditor, const vmime::mailboxList &recipients, vmime::utility::inputStream &, size_t, vmime::utility::progressListener * = nullptr, const vmime::mailbox &sender = {});
 	bool isSecuredConnection(void) const { return m_secured; }
 	vmime::shared_ptr<vmime::net::connectionInfos> getConnectionInfos() const { return m_cntInfos; }
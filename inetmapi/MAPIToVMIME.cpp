@@ -32,6 +32,7 @@
 #include "inputStreamMAPIAdapter.h"
 #include "mapiAttachment.h"
 #include "mapiTextPart.h"
+#include "mimeCodec.h"
 #include "rtfutil.h"
 #include <kopano/CommonUtil.h>
 #include <kopano/stringutil.h>
@@ -394,11 +395,11 @@ HRESULT MAPIToVMIME::handleSingleAttachment(IMessage* lpMessage, LPSRow lpRow, v
 				// had szFilename .. but how, on inline?
 				// @todo find out how Content-Disposition receives highchar filename... always UTF-8?
 				if (inputDataStream != nullptr)
-					textPart.addObject(vmime::make_shared<vmime::streamContentHandler>(inputDataStream, 0), vmime::encoding("base64"), vmMIMEType, strContentId, string(), strContentLocation);
+					textPart.addObject(vmime::make_shared<im_stream_content>(inputDataStream, 0), vmime::encoding("base64"), vmMIMEType, strContentId, string(), strContentLocation);
 				else
 					textPart.addObject(vmime::make_shared<vmime::stringContentHandler>(absent_note), vmime::encoding("base64"), note_type, strContentId, std::string(), strContentLocation);
 			} else if (inputDataStream != nullptr) {
-				vmMapiAttach = vmime::make_shared<mapiAttachment>(vmime::make_shared<vmime::streamContentHandler>(inputDataStream, 0),
+				vmMapiAttach = vmime::make_shared<mapiAttachment>(vmime::make_shared<im_stream_content>(inputDataStream, 0),
 				               bSendBinary ? vmime::encoding("base64") : vmime::encoding("quoted-printable"),
 				               vmMIMEType, strContentId,
 				               vmime::word(m_converter.convert_to<string>(m_strCharset.c_str(), szFilename, rawsize(szFilename), CHARSET_WCHAR), m_vmCharset));
@@ -1368,12 +1369,12 @@ HRESULT MAPIToVMIME::handleExtraHeaders(IMessage *lpMessage,
 		vmime::string inString;
 		inString.assign((const char*)lpConversationIndex->Value.bin.lpb, lpConversationIndex->Value.bin.cb);
 
-		vmime::shared_ptr<vmime::utility::encoder::encoder> enc = vmime::utility::encoder::encoderFactory::getInstance()->create("base64");
+		b64_codec enc;
 		vmime::utility::inputStreamStringAdapter in(inString);
 		vmime::string outString;
 		vmime::utility::outputStreamStringAdapter out(outString);
 
-		enc->encode(in, out);
+		enc.encode(in, out);
 		vmHeader->appendField(hff->create("Thread-Index", outString));
 	}
 
@@ -1912,7 +1913,7 @@ tnef_anyway:
 				auto inputDataStream = vmime::make_shared<inputStreamMAPIAdapter>(lpStream);
 				// Now, add the stream as an attachment to the message, filename winmail.dat
 				// and MIME type 'application/ms-tnef', no content-id
-				auto vmTNEFAtt = vmime::make_shared<mapiAttachment>(vmime::make_shared<vmime::streamContentHandler>(inputDataStream, 0),
+				auto vmTNEFAtt = vmime::make_shared<mapiAttachment>(vmime::make_shared<im_stream_content>(inputDataStream, 0),
 				                 vmime::encoding("base64"), vmime::mediaType("application/ms-tnef"), string(),
 				                 vmime::word("winmail.dat"));
 
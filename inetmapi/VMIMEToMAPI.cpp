@@ -53,6 +53,7 @@
 #include "ECVMIMEUtils.h"
 #include "HtmlToTextParser.h"
 #include "inputStreamMAPIAdapter.h"
+#include "mimeCodec.h"
 #include "ICalToMAPI.h"
 #define x2s(s) reinterpret_cast<const char *>(s)
 
@@ -79,7 +80,7 @@ enum {
 static vmime::charset vtm_upgrade_charset(vmime::charset cset, const char *ascii_upgrade = nullptr);
 static int getCharsetFromHTML(const string &, vmime::charset *);
 static HRESULT postWriteFixups(IMessage *);
-static size_t countBodyLines(const std::string &, size_t, size_t);
+static size_t countBodyLines(const im_input &, size_t, size_t);
 static std::string parameterizedFieldToStructure(vmime::shared_ptr<vmime::parameterizedHeaderField>);
 static void vtm_hide_attachment(IMessage *);
 
@@ -196,18 +197,30 @@ HRESULT VMIMEToMAPI::createIMAPProperties(const std::string &input, std::string
 	return hrSuccess;
 }
 
-static size_t extract_headers_raw(IMessage *msg, const std::string &input)
+/**
+ * Wrap the input buffer for vmime. Parsing from a seekable stream makes vmime
+ * reference body regions in place; attachment data is only decoded when it
+ * is written out to its MAPI stream.
+ */
+vmime::shared_ptr<vmime::utility::seekableInputStream> im_input::stream() const
+{
+	return vmime::make_shared<vmime::utility::inputStreamByteBufferAdapter>(
+	       reinterpret_cast<const vmime::byte_t *>(data), size);
+}
+
+static size_t extract_headers_raw(IMessage *msg, const im_input &input)
 {
-	auto end = input.find("\r\n\r\n");
+	auto p = static_cast<const char *>(memmem(input.data, input.size, "\r\n\r\n", 4));
 	bool lfonly = false;
-	if (end == std::string::npos) {
+	if (p == nullptr) {
 		/* Input was not RFC compliant, try Unix enters */
-		end = input.find("\n\n");
+		p = static_cast<const char *>(memmem(input.data, input.size, "\n\n", 2));
 		lfonly = true;
 	}
-	if (end == std::string::npos)
-		return end;
-	auto headers = input.substr(0, end);
+	if (p == nullptr)
+		return std::string::npos;
+	size_t end = p - input.data;
+	std::string headers(input.data, end);
 	KPropbuffer<1> prop;
 	if (lfonly)
 		StringLFtoCRLF(headers);
@@ -225,12 +238,12 @@ static size_t extract_headers_raw(IMessage *msg, const std::string &input)
  * fillMAPIMail. Afterwards it may handle signed messages, and set an
  * extra flag when all attachments were marked hidden.
  *
- * @param[in]	input	std::string containing the RFC 2822 mail.
+ * @param[in]	input	buffer containing the RFC 2822 mail; not copied.
  * @param[out]	lpMessage	Pointer to a message which was already created on a IMAPIFolder.
  * @return		MAPI error code.
  * @retval		MAPI_E_CALL_FAILED	Caught an exception, which breaks the conversion.
  */
-HRESULT VMIMEToMAPI::convertVMIMEToMAPI(const string &input, IMessage *lpMessage) {
+HRESULT VMIMEToMAPI::convertVMIMEToMAPI(const im_input &input, IMessage *lpMessage) {
 
 	try {
 		if (m_mailState.ulMsgInMsg == 0)
@@ -247,12 +260,12 @@ HRESULT VMIMEToMAPI::convertVMIMEToMAPI(const string &input, IMessage *lpMessage
 		*/
 		SPropValue sMessageSize;
 		sMessageSize.ulPropTag = PR_MESSAGE_SIZE;
-		sMessageSize.Value.ul = input.length();
+		sMessageSize.Value.ul = input.size;
 		lpMessage->SetProps(1, &sMessageSize, nullptr);
 
 		// turn buffer into a message
 		auto vmMessage = vmime::make_shared<vmime::message>();
-		vmMessage->parse(m_parsectx, input);
+		vmMessage->parse(m_parsectx, input.stream(), 0, input.size);
 		if (m_dopt.header_strict_rfc) {
 			auto vmHeader = vmMessage->getHeader();
 			if (!vmHeader->hasField(vmime::fields::FROM) && !vmHeader->hasField(vmime::fields::DATE))
@@ -287,7 +300,7 @@ HRESULT VMIMEToMAPI::convertVMIMEToMAPI(const string &input, IMessage *lpMessage
 	return hrSuccess;
 }
 
-HRESULT VMIMEToMAPI::save_raw_smime(const std::string &input, size_t posHeaderEnd,
+HRESULT VMIMEToMAPI::save_raw_smime(const im_input &input, size_t posHeaderEnd,
     const vmime::shared_ptr<vmime::header> &vmHeader, IMessage *lpMessage)
 {
 	static constexpr const SizedSPropTagArray(2, sptaAttach) =
@@ -329,7 +342,7 @@ HRESULT VMIMEToMAPI::save_raw_smime(const std::string &input, size_t posHeaderEn
 	// find the original received body
 	// vmime re-generates different headers and spacings, so we can't use this.
 	if (posHeaderEnd != string::npos)
-		os.write(input.c_str() + posHeaderEnd, input.size() - posHeaderEnd);
+		os.write(input.data + posHeaderEnd, input.size - posHeaderEnd);
 	hr = lpStream->Commit(0);
 	if (hr != hrSuccess)
 		return hr;
@@ -799,10 +812,10 @@ HRESULT VMIMEToMAPI::handleHeaders(vmime::shared_ptr<vmime::header> vmHeader,
 			vmime::string outString;
 			SPropValue sThreadIndex;
 			auto threadIndex = generate_wrap(vmHeader->findField("Thread-Index")->getValue());
-			auto enc = vmime::utility::encoder::encoderFactory::getInstance()->create("base64");
+			b64_codec enc;
 			vmime::utility::inputStreamStringAdapter in(threadIndex);
 			vmime::utility::outputStreamStringAdapter out(outString);
-			enc->decode(in, out);
+			enc.decode(in, out);
 
 			sThreadIndex.ulPropTag = PR_CONVERSATION_INDEX;
 			sThreadIndex.Value.bin.cb = outString.size();
@@ -1615,7 +1628,7 @@ HRESULT VMIMEToMAPI::dissect_ical(vmime::shared_ptr<vmime::header> vmHeader,
 	if (strCharset == "us-ascii")
 		// We can safely upgrade from US-ASCII to UTF-8 since that is compatible
 		strCharset = "utf-8";
-	vmBody->getContents()->extract(os);
+	im_extract(*vmBody->getContents(), os);
 	if (m_mailState.bodyLevel > BODY_NONE)
 		/* Force attachment if we already have some text. */
 		bIsAttachment = true;
@@ -1797,7 +1810,7 @@ HRESULT VMIMEToMAPI::dissect_body(vmime::shared_ptr<vmime::header> vmHeader,
 				return hr;
 
 			outputStreamMAPIAdapter str(lpStream);
-			vmBody->getContents()->extract(str);
+			im_extract(*vmBody->getContents(), str);
 			hr = lpStream->Seek(large_int_zero, STREAM_SEEK_SET, nullptr);
 			if(hr != hrSuccess)
 				return hr;
@@ -1907,7 +1920,7 @@ static std::string content_transfer_decode(vmime::shared_ptr<vmime::body> im_bod
 	auto im_cont = im_body->getContents();
 
 	try {
-		im_cont->extract(str_adap);
+		im_extract(*im_cont, str_adap);
 	} catch (const vmime::exceptions::no_encoder_available &e) {
 		ec_log_warn("VMIME could not process the Content-Transfer-Encoding \"%s\" (%s). Reading part raw.",
 			im_cont->getEncoding().generate().c_str(), e.what());
@@ -2446,7 +2459,7 @@ HRESULT VMIMEToMAPI::handleAttachment(vmime::shared_ptr<vmime::header> vmHeader,
 		auto mt = vmime::dynamicCast<vmime::mediaType>(ctf->getValue());
 
 		try {
-			vmBody->getContents()->generate(osMAPI, vmime::encoding(vmime::encodingTypes::BINARY));
+			im_extract(*vmBody->getContents(), osMAPI);
 		} catch (const vmime::exceptions::no_encoder_available &) {
 			/* RFC 2045 §6.4 page 17 */
 			vmBody->getContents()->extractRaw(osMAPI);
@@ -3232,7 +3245,7 @@ std::string VMIMEToMAPI::createIMAPEnvelope(vmime::shared_ptr<vmime::message> vm
  *
  * @return MAPI error code
  */
-HRESULT VMIMEToMAPI::createIMAPBody(const string &input,
+HRESULT VMIMEToMAPI::createIMAPBody(const im_input &input,
     vmime::shared_ptr<vmime::message> vmMessage, IMessage *lpMessage)
 {
 	KPropbuffer<4> sProps;
@@ -3241,10 +3254,10 @@ HRESULT VMIMEToMAPI::createIMAPBody(const string &input,
 	messagePartToStructure(input, vmMessage, &strBody, &strBodyStructure);
 
 	sProps[0].ulPropTag = PR_EC_IMAP_EMAIL_SIZE;
-	sProps[0].Value.ul = input.length();
+	sProps[0].Value.ul = input.size;
 	sProps[1].ulPropTag = PR_EC_IMAP_EMAIL;
-	sProps[1].Value.bin.lpb = (BYTE*)input.c_str();
-	sProps[1].Value.bin.cb = input.length();
+	sProps[1].Value.bin.lpb = (BYTE *)input.data;
+	sProps[1].Value.bin.cb = input.size;
 	sProps.set(2, PR_EC_IMAP_BODY, std::move(strBody));
 	sProps.set(3, PR_EC_IMAP_BODYSTRUCTURE, std::move(strBodyStructure));
 	return lpMessage->SetProps(4, sProps.get(), nullptr);
@@ -3260,7 +3273,7 @@ HRESULT VMIMEToMAPI::createIMAPBody(const string &input,
  *
  * @return always success
  */
-HRESULT VMIMEToMAPI::messagePartToStructure(const string &input,
+HRESULT VMIMEToMAPI::messagePartToStructure(const im_input &input,
     vmime::shared_ptr<vmime::bodyPart> vmBodyPart, std::string *lpSimple,
     std::string *lpExtended)
 {
@@ -3338,7 +3351,7 @@ HRESULT VMIMEToMAPI::messagePartToStructure(const string &input,
  *
  * @return always success
  */
-HRESULT VMIMEToMAPI::bodyPartToStructure(const string &input,
+HRESULT VMIMEToMAPI::bodyPartToStructure(const im_input &input,
     vmime::shared_ptr<vmime::bodyPart> vmBodyPart, std::string *lpSimple,
     std::string *lpExtended)
 {
@@ -3514,18 +3527,19 @@ static std::string parameterizedFieldToStructure(vmime::shared_ptr<vmime::parame
  *
  * @return number of lines
  */
-static size_t countBodyLines(const std::string &input, size_t start, size_t length)
+static size_t countBodyLines(const im_input &input, size_t start, size_t length)
 {
-	string::size_type lines = 0, pos = start;
-
-	while (true) {
-		pos = input.find_first_of('\n', pos);
-		if (pos == string::npos || pos > start+length)
+	size_t lines = 0;
+	if (start >= input.size)
+		return 0;
+	/* a newline right at start+length still counts */
+	auto end = input.data + std::min(start + length + 1, input.size);
+	for (auto p = input.data + start; p < end; ++p) {
+		p = static_cast<const char *>(memchr(p, '\n', end - p));
+		if (p == nullptr)
 			break;
-		++pos;
 		++lines;
 	}
-
 	return lines;
 }
 
@@ -36,13 +36,27 @@ struct sMailState {
 
 void ignoreError(void *ctx, const char *msg, ...);
 
+/*
+ * Non-owning reference to the raw RFC 5322 input. The buffer (a string or a
+ * mapped file) must stay alive for as long as the parsed vmime objects are
+ * used, since their bodies point into it rather than holding copies.
+ */
+struct im_input {
+	im_input(const std::string &s) : data(s.c_str()), size(s.size()) {}
+	im_input(const char *d, size_t z) : data(d), size(z) {}
+	vmime::shared_ptr<vmime::utility::seekableInputStream> stream() const;
+
+	const char *data;
+	size_t size;
+};
+
 class VMIMEToMAPI final {
 public:
 	VMIMEToMAPI();
 	VMIMEToMAPI(IAddrBook *, delivery_options &&);
-	HRESULT convertVMIMEToMAPI(const std::string &input, IMessage *lpMessage);
+	HRESULT convertVMIMEToMAPI(const im_input &input, IMessage *lpMessage);
 	HRESULT createIMAPProperties(const std::string &input, std::string *envelope, std::string *body, std::string *bodystruct);
-	HRESULT createIMAPBody(const std::string &input, vmime::shared_ptr<vmime::message>, IMessage *);
+	HRESULT createIMAPBody(const im_input &input, vmime::shared_ptr<vmime::message>, IMessage *);
 	HRESULT createIMAPEnvelope(vmime::shared_ptr<vmime::message>, IMessage *);
 
 	public:
@@ -74,10 +88,10 @@ public:
 	HRESULT handleMessageToMeProps(IMessage *lpMessage, LPADRLIST lpRecipients);
 	std::wstring getWideFromVmimeText(const vmime::text &vmText);
 	std::string createIMAPEnvelope(vmime::shared_ptr<vmime::message>);
-	HRESULT messagePartToStructure(const std::string &input, vmime::shared_ptr<vmime::bodyPart>, std::string *simple, std::string *extended);
-	HRESULT bodyPartToStructure(const std::string &input, vmime::shared_ptr<vmime::bodyPart>, std::string *simple, std::string *extended);
+	HRESULT messagePartToStructure(const im_input &input, vmime::shared_ptr<vmime::bodyPart>, std::string *simple, std::string *extended);
+	HRESULT bodyPartToStructure(const im_input &input, vmime::shared_ptr<vmime::bodyPart>, std::string *simple, std::string *extended);
 	std::string getStructureExtendedFields(vmime::shared_ptr<vmime::header> part);
-	HRESULT save_raw_smime(const std::string &input, size_t hdr_end, const vmime::shared_ptr<vmime::header> &in, IMessage *out);
+	HRESULT save_raw_smime(const im_input &input, size_t hdr_end, const vmime::shared_ptr<vmime::header> &in, IMessage *out);
 };
 
 } /* namespace */
@@ -42,8 +42,17 @@ public:
 /* c wrapper to create object */
 extern KC_EXPORT ECSender *CreateSender(const std::string &smtphost, int port);
 
+/*
+ * Keep up to @size authenticated connections per SMTP server open between
+ * messages sent through ECSender objects in this process (0 disables and
+ * closes them). Each connection carries at most @max_msgs messages and
+ * lives at most @max_age seconds (0: unlimited).
+ */
+extern KC_EXPORT void smtp_pool_configure(unsigned int size, unsigned int max_msgs, unsigned int max_age);
+
 // Read char Buffer and set properties on open lpMessage object
 extern KC_EXPORT HRESULT IMToMAPI(IMAPISession *, IMsgStore *, IAddrBook *, IMessage *, const std::string &input, delivery_options dopt);
+extern KC_EXPORT HRESULT IMToMAPI(IMAPISession *, IMsgStore *, IAddrBook *, IMessage *, const char *input, size_t input_size, delivery_options dopt);
 
 // Read properties from lpMessage object and fill a buffer with internet rfc822 format message
 // Use this one for retrieving messages not in outgoing que, they already have PR_SENDER_EMAIL/NAME
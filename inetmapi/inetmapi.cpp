@@ -141,6 +141,18 @@ static bool vtm_ascii_compatible(const char *s)
 HRESULT IMToMAPI(IMAPISession *lpSession, IMsgStore *lpMsgStore,
     IAddrBook *lpAddrBook, IMessage *lpMessage, const string &input,
     delivery_options dopt)
+{
+	return IMToMAPI(lpSession, lpMsgStore, lpAddrBook, lpMessage,
+	       input.c_str(), input.size(), std::move(dopt));
+}
+
+/*
+ * Same, but over a caller-owned buffer (e.g. a mapped file), which is parsed
+ * in place instead of being copied into a string first.
+ */
+HRESULT IMToMAPI(IMAPISession *lpSession, IMsgStore *lpMsgStore,
+    IAddrBook *lpAddrBook, IMessage *lpMessage, const char *input,
+    size_t input_size, delivery_options dopt)
 {
 	// Sanitize options
 	if (dopt.ascii_upgrade == nullptr || *dopt.ascii_upgrade == '\0') {
@@ -168,7 +180,7 @@ HRESULT IMToMAPI(IMAPISession *lpSession, IMsgStore *lpMsgStore,
 	}
 
 	// fill mapi object from buffer
-	return VMIMEToMAPI(lpAddrBook, std::move(dopt)).convertVMIMEToMAPI(input, lpMessage);
+	return VMIMEToMAPI(lpAddrBook, std::move(dopt)).convertVMIMEToMAPI(im_input(input, input_size), lpMessage);
 }
 
 // Read properties from lpMessage object and fill a buffer with internet rfc822 format message
@@ -30,6 +30,7 @@
 //
 #include <memory>
 #include "mapiTextPart.h"
+#include "mimeCodec.h"
 #include <vmime/exception.hpp>
 #include <vmime/contentTypeField.hpp>
 #include <vmime/contentDisposition.hpp>
@@ -202,7 +203,7 @@ void mapiTextPart::parse(const vmime::shared_ptr<const vmime::bodyPart> &message
 	// Extract HTML text
 	std::ostringstream oss;
 	utility::outputStreamAdapter adapter(oss);
-	text_part->getBody()->getContents()->extract(adapter);
+	im_extract(*text_part->getBody()->getContents(), adapter);
 	const string data = oss.str();
 	m_text = text_part->getBody()->getContents()->clone();
 	if (text_part->getHeader()->hasField(fields::CONTENT_TYPE)) {
@@ -0,0 +1,356 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <strings.h>
+#include <vmime/encoding.hpp>
+#include <vmime/utility/progressListener.hpp>
+#include "mimeCodec.h"
+#include "simdcodec.h"
+
+namespace KC {
+
+using vmime::utility::inputStream;
+using vmime::utility::outputStream;
+using vmime::utility::progressListener;
+
+/*
+ * The decoders are push-style state machines, so that they can sit behind
+ * an outputStream (see decode_filter) as well as read an inputStream. Their
+ * handling of whitespace, junk, padding and truncated input mirrors the
+ * vmime b64Encoder/qpEncoder decode loops.
+ */
+class b64_decoder final {
+	public:
+	bool feed(const char *, size_t, outputStream &);
+	void finish(outputStream &);
+
+	size_t total = 0;
+
+	private:
+	void group(outputStream &);
+
+	unsigned char m_grp[4];
+	unsigned int m_cnt = 0;
+	bool m_done = false;
+};
+
+class qp_decoder final {
+	public:
+	qp_decoder(bool rfc2047) : m_rfc2047(rfc2047) {}
+	bool feed(const char *, size_t, outputStream &);
+	void finish(outputStream &);
+
+	size_t total = 0;
+
+	private:
+	enum { QP_TEXT, QP_EQ, QP_EQ_CR, QP_EQ_HEX } m_state = QP_TEXT;
+	bool m_rfc2047;
+	char m_hi = 0;
+	std::string m_buf;
+};
+
+template<typename D> class decode_filter final : public outputStream {
+	public:
+	decode_filter(D &dec, outputStream &out) : m_dec(dec), m_out(out) {}
+	void writeImpl(const vmime::byte_t *data, size_t count) override
+	{
+		m_dec.feed(reinterpret_cast<const char *>(data), count, m_out);
+	}
+	void flush() override { m_out.flush(); }
+
+	private:
+	D &m_dec;
+	outputStream &m_out;
+};
+
+static inline bool b64_space(unsigned char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* vmime treats anything outside the alphabet as 0 */
+static inline unsigned int b64_val(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	return c == '+' ? 62 : c == '/' ? 63 : 0;
+}
+
+static inline unsigned int hex_val(unsigned char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return 0;
+}
+
+void b64_decoder::group(outputStream &out)
+{
+	auto a = m_grp[0], b = m_grp[1], c = m_grp[2], d = m_grp[3];
+	vmime::byte_t o[3];
+	m_cnt = 0;
+	if (a == '=' || b == '=') {
+		m_done = true;
+		return;
+	}
+	o[0] = (b64_val(a) << 2) | ((b64_val(b) & 0x30) >> 4);
+	if (c == '=') {
+		out.write(o, 1);
+		++total;
+		m_done = true;
+		return;
+	}
+	o[1] = ((b64_val(b) & 0xf) << 4) | ((b64_val(c) & 0x3c) >> 2);
+	if (d == '=') {
+		out.write(o, 2);
+		total += 2;
+		m_done = true;
+		return;
+	}
+	o[2] = ((b64_val(c) & 0x03) << 6) | b64_val(d);
+	out.write(o, 3);
+	total += 3;
+}
+
+/* Returns false once padding has ended the data. */
+bool b64_decoder::feed(const char *in, size_t len, outputStream &out)
+{
+	vmime::byte_t buf[49152];
+	size_t pos = 0;
+
+	while (!m_done && pos < len) {
+		if (m_cnt == 0) {
+			auto used = b64_decode_groups(in + pos, std::min(len - pos, sizeof(buf) / 3 * 4), buf);
+			if (used > 0) {
+				out.write(buf, used / 4 * 3);
+				total += used / 4 * 3;
+				pos += used;
+				continue;
+			}
+		}
+		unsigned char c = in[pos++];
+		if (b64_space(c))
+			continue;
+		m_grp[m_cnt++] = c;
+		if (m_cnt == 4)
+			group(out);
+	}
+	return !m_done;
+}
+
+void b64_decoder::finish(outputStream &out)
+{
+	if (m_done || m_cnt == 0)
+		return;
+	while (m_cnt < 4)
+		m_grp[m_cnt++] = '=';
+	group(out);
+}
+
+bool qp_decoder::feed(const char *in, size_t len, outputStream &out)
+{
+	size_t pos = 0;
+
+	while (pos < len) {
+		switch (m_state) {
+		case QP_TEXT: {
+			auto n = qp_literal_run(in + pos, len - pos, m_rfc2047);
+			m_buf.append(in + pos, n);
+			pos += n;
+			if (pos == len)
+				break;
+			if (in[pos++] == '=')
+				m_state = QP_EQ;
+			else /* '_' in RFC 2047 mode */
+				m_buf += ' ';
+			break;
+		}
+		case QP_EQ:
+			/* "=\r" swallows one more character, whatever it is */
+			m_hi = in[pos++];
+			m_state = m_hi == '\r' ? QP_EQ_CR : m_hi == '\n' ? QP_TEXT : QP_EQ_HEX;
+			break;
+		case QP_EQ_CR:
+			++pos;
+			m_state = QP_TEXT;
+			break;
+		case QP_EQ_HEX:
+			m_buf += static_cast<char>(hex_val(m_hi) * 16 + hex_val(in[pos++]));
+			m_state = QP_TEXT;
+			break;
+		}
+	}
+	if (m_buf.size() >= 16384) {
+		out.write(m_buf.c_str(), m_buf.size());
+		total += m_buf.size();
+		m_buf.clear();
+	}
+	return true;
+}
+
+void qp_decoder::finish(outputStream &out)
+{
+	/* An incomplete escape at the end is dropped. */
+	out.write(m_buf.c_str(), m_buf.size());
+	total += m_buf.size();
+	m_buf.clear();
+}
+
+template<typename D> static size_t decode_stream(D &&dec, inputStream &in,
+    outputStream &out, progressListener *progress)
+{
+	char buf[65536];
+	size_t in_total = 0;
+
+	in.reset();
+	if (progress != nullptr)
+		progress->start(0);
+	while (!in.eof()) {
+		auto n = in.read(reinterpret_cast<vmime::byte_t *>(buf), sizeof(buf));
+		if (n == 0)
+			break;
+		in_total += n;
+		if (progress != nullptr)
+			progress->progress(in_total, in_total);
+		if (!dec.feed(buf, n, out))
+			break;
+	}
+	dec.finish(out);
+	if (progress != nullptr)
+		progress->stop(in_total);
+	return dec.total;
+}
+
+size_t b64_codec::decode(inputStream &in, outputStream &out,
+    progressListener *progress)
+{
+	return decode_stream(b64_decoder(), in, out, progress);
+}
+
+size_t qp_codec::decode(inputStream &in, outputStream &out,
+    progressListener *progress)
+{
+	return decode_stream(qp_decoder(getProperties().getProperty<bool>("rfc2047", false)),
+	       in, out, progress);
+}
+
+/*
+ * vmime wraps after every 4-character quantum that leaves less than room
+ * for another one plus CRLF on a line of maxlinelength (capped at 76).
+ */
+size_t b64_codec::encode(inputStream &in, outputStream &out,
+    progressListener *progress)
+{
+	auto maxlen = getProperties().getProperty<size_t>("maxlinelength", static_cast<size_t>(-1));
+	bool wrap = maxlen != static_cast<size_t>(-1);
+	maxlen = std::min(maxlen, static_cast<size_t>(76));
+	size_t per_line = !wrap ? SIZE_MAX : maxlen > 6 ? (maxlen - 6 + 3) / 4 : 1;
+	vmime::byte_t ibuf[49152];
+	std::string obuf;
+	size_t have = 0, col = 0, total = 0, in_total = 0;
+
+	in.reset();
+	if (progress != nullptr)
+		progress->start(0);
+	auto emit = [&](const vmime::byte_t *p, size_t groups) {
+		while (groups > 0) {
+			auto n = std::min(groups, per_line - col);
+			auto o = obuf.size();
+			obuf.resize(o + n * 4);
+			b64_encode_groups(p, n * 3, &obuf[o]);
+			p += n * 3;
+			groups -= n;
+			col += n;
+			total += n * 4;
+			if (col == per_line) {
+				obuf += "\r\n";
+				col = 0;
+			}
+		}
+	};
+	while (!in.eof()) {
+		auto n = in.read(ibuf + have, sizeof(ibuf) - have);
+		if (n == 0)
+			break;
+		have += n;
+		in_total += n;
+		emit(ibuf, have / 3);
+		memmove(ibuf, ibuf + have / 3 * 3, have % 3);
+		have %= 3;
+		out.write(obuf.c_str(), obuf.size());
+		obuf.clear();
+		if (progress != nullptr)
+			progress->progress(in_total, in_total);
+	}
+	if (have > 0) {
+		/* final quantum with padding */
+		vmime::byte_t last[3] = {ibuf[0], have > 1 ? ibuf[1] : vmime::byte_t(0), 0};
+		char q[4];
+		b64_encode_groups(last, sizeof(last), q);
+		q[3] = '=';
+		if (have == 1)
+			q[2] = '=';
+		obuf.append(q, sizeof(q));
+		total += sizeof(q);
+		if (++col == per_line)
+			obuf += "\r\n";
+		out.write(obuf.c_str(), obuf.size());
+	}
+	if (progress != nullptr)
+		progress->stop(in_total);
+	return total;
+}
+
+im_stream_content::im_stream_content(const vmime::shared_ptr<inputStream> &is,
+    size_t length) :
+	streamContentHandler(is, length), m_stream(is)
+{}
+
+vmime::shared_ptr<vmime::contentHandler> im_stream_content::clone() const
+{
+	return vmime::make_shared<im_stream_content>(*this);
+}
+
+void im_stream_content::generate(outputStream &os, const vmime::encoding &enc,
+    size_t maxlen) const
+{
+	if (isEncoded() || strcasecmp(enc.getName().c_str(), vmime::encodingTypes::BASE64) != 0)
+		return streamContentHandler::generate(os, enc, maxlen);
+	b64_codec codec;
+	codec.getProperties()["maxlinelength"] = maxlen;
+	codec.encode(*m_stream, os);
+}
+
+void im_extract(const vmime::contentHandler &ch, outputStream &out)
+{
+	if (!ch.isEncoded())
+		return ch.extract(out);
+	auto &name = ch.getEncoding().getName();
+	if (strcasecmp(name.c_str(), vmime::encodingTypes::BASE64) == 0) {
+		b64_decoder dec;
+		decode_filter<b64_decoder> filter(dec, out);
+		ch.extractRaw(filter);
+		dec.finish(out);
+	} else if (strcasecmp(name.c_str(), vmime::encodingTypes::QUOTED_PRINTABLE) == 0) {
+		qp_decoder dec(false);
+		decode_filter<qp_decoder> filter(dec, out);
+		ch.extractRaw(filter);
+		dec.finish(out);
+	} else {
+		ch.extract(out);
+	}
+}
+
+} /* namespace */
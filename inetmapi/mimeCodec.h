@@ -0,0 +1,48 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <kopano/zcdefs.h>
+#include <vmime/streamContentHandler.hpp>
+#include <vmime/utility/encoder/b64Encoder.hpp>
+#include <vmime/utility/encoder/qpEncoder.hpp>
+#include <vmime/utility/outputStream.hpp>
+
+namespace KC {
+
+/*
+ * vmime's base64 and quoted-printable encoders, running on the vectorized
+ * kernels from simdcodec.cpp. Output is byte-identical to vmime's own.
+ * Quoted-printable encoding is inherited unchanged.
+ */
+class KC_EXPORT b64_codec final : public vmime::utility::encoder::b64Encoder {
+	public:
+	size_t encode(vmime::utility::inputStream &, vmime::utility::outputStream &, vmime::utility::progressListener * = nullptr) override;
+	size_t decode(vmime::utility::inputStream &, vmime::utility::outputStream &, vmime::utility::progressListener * = nullptr) override;
+};
+
+class KC_EXPORT qp_codec final : public vmime::utility::encoder::qpEncoder {
+	public:
+	size_t decode(vmime::utility::inputStream &, vmime::utility::outputStream &, vmime::utility::progressListener * = nullptr) override;
+};
+
+/*
+ * Attachment contents that are base64-encoded with b64_codec when the
+ * message is generated. (vmime's encoderFactory always hands out the
+ * first encoder registered for a name, so it cannot be overridden there.)
+ */
+class im_stream_content final : public vmime::streamContentHandler {
+	public:
+	im_stream_content(const vmime::shared_ptr<vmime::utility::inputStream> &, size_t length);
+	vmime::shared_ptr<vmime::contentHandler> clone() const override;
+	void generate(vmime::utility::outputStream &, const vmime::encoding &, size_t maxlen = vmime::lineLengthLimits::infinite) const override;
+
+	private:
+	vmime::shared_ptr<vmime::utility::inputStream> m_stream;
+};
+
+/* Like contentHandler::extract, but decodes base64 and QP with the codecs above. */
+extern KC_EXPORT void im_extract(const vmime::contentHandler &, vmime::utility::outputStream &);
+
+} /* namespace */
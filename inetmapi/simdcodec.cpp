@@ -0,0 +1,310 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#include <kopano/platform.h>
+#include <cstdint>
+#include <cstring>
+#include "simdcodec.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	define KC_SIMD_X86 1
+#	include <immintrin.h>
+#endif
+
+namespace KC {
+
+static const char b64_alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* 0xff marks characters outside the alphabet */
+static const unsigned char b64_value[256] = {
+#define X 0xff
+	X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+	X,X,X,X,X,X,X,X,X,X,X,62,X,X,X,63, 52,53,54,55,56,57,58,59,60,61,X,X,X,X,X,X,
+	X,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14, 15,16,17,18,19,20,21,22,23,24,25,X,X,X,X,X,
+	X,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, 41,42,43,44,45,46,47,48,49,50,51,X,X,X,X,X,
+	X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+	X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+	X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+	X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X, X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+#undef X
+};
+
+static size_t b64_encode_scalar(const unsigned char *in, size_t len, char *out)
+{
+	size_t i = 0;
+	for (; i + 3 <= len; i += 3) {
+		uint32_t v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+		*out++ = b64_alphabet[(v >> 18) & 0x3f];
+		*out++ = b64_alphabet[(v >> 12) & 0x3f];
+		*out++ = b64_alphabet[(v >> 6) & 0x3f];
+		*out++ = b64_alphabet[v & 0x3f];
+	}
+	return i;
+}
+
+static size_t b64_decode_scalar(const char *in, size_t len, unsigned char *out)
+{
+	auto s = reinterpret_cast<const unsigned char *>(in);
+	size_t i = 0;
+	for (; i + 4 <= len; i += 4) {
+		unsigned int a = b64_value[s[i]], b = b64_value[s[i+1]],
+		             c = b64_value[s[i+2]], d = b64_value[s[i+3]];
+		if ((a | b | c | d) == 0xff)
+			break;
+		uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+		*out++ = v >> 16;
+		*out++ = v >> 8;
+		*out++ = v;
+	}
+	return i;
+}
+
+static size_t qp_literal_scalar(const char *in, size_t len, bool rfc2047)
+{
+	for (size_t i = 0; i < len; ++i)
+		if (in[i] == '=' || (rfc2047 && in[i] == '_'))
+			return i;
+	return len;
+}
+
+#ifdef KC_SIMD_X86
+/*
+ * The SIMD variants follow W. Muła and D. Lemire, "Faster Base64 Encoding
+ * and Decoding Using AVX2 Instructions" (2018): bytes are regrouped into
+ * 6-bit indices with pshufb and multiplies, and characters are mapped
+ * by range offsets instead of table lookups.
+ */
+#define T_SSSE3 __attribute__((target("ssse3")))
+#define T_AVX2 __attribute__((target("avx2")))
+
+static inline T_SSSE3 __m128i enc_reshuffle_128(__m128i in)
+{
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	auto t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	auto t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	auto t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	auto t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
+
+static inline T_SSSE3 __m128i enc_translate_128(__m128i idx)
+{
+	auto r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	auto less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+	r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+	auto lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+	           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	return _mm_add_epi8(_mm_shuffle_epi8(lut, r), idx);
+}
+
+static T_SSSE3 size_t b64_encode_ssse3(const unsigned char *in, size_t len, char *out)
+{
+	size_t i = 0;
+	/* 16 bytes are loaded, 12 are used */
+	for (; i + 16 <= len; i += 12, out += 16) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), enc_translate_128(enc_reshuffle_128(v)));
+	}
+	return i + b64_encode_scalar(in + i, len - i, out);
+}
+
+/* Map alphabet characters to their 6-bit values; @valid is all-ones where they were in range. */
+static inline T_SSSE3 __m128i dec_translate_128(__m128i c, __m128i &valid)
+{
+	auto upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+	auto lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+	auto digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	auto plus  = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+	auto slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+	valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+	auto shift = _mm_or_si128(_mm_or_si128(
+	             _mm_and_si128(upper, _mm_set1_epi8(-65)),
+	             _mm_and_si128(lower, _mm_set1_epi8(-71))), _mm_or_si128(
+	             _mm_and_si128(digit, _mm_set1_epi8(4)), _mm_or_si128(
+	             _mm_and_si128(plus, _mm_set1_epi8(19)),
+	             _mm_and_si128(slash, _mm_set1_epi8(16)))));
+	return _mm_add_epi8(c, shift);
+}
+
+/* Pack 16 six-bit values into 12 bytes (in the low part of the result). */
+static inline T_SSSE3 __m128i dec_pack_128(__m128i v)
+{
+	auto ab_cd = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+	auto abcd = _mm_madd_epi16(ab_cd, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+static T_SSSE3 size_t b64_decode_ssse3(const char *in, size_t len, unsigned char *out)
+{
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16, out += 12) {
+		__m128i valid;
+		auto v = dec_translate_128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), valid);
+		if (_mm_movemask_epi8(valid) != 0xffff)
+			break;
+		alignas(16) unsigned char tmp[16];
+		_mm_store_si128(reinterpret_cast<__m128i *>(tmp), dec_pack_128(v));
+		memcpy(out, tmp, 12);
+	}
+	return i + b64_decode_scalar(in + i, len - i, out);
+}
+
+static T_SSSE3 size_t qp_literal_ssse3(const char *in, size_t len, bool rfc2047)
+{
+	auto eq = _mm_set1_epi8('='), us = _mm_set1_epi8(rfc2047 ? '_' : '=');
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(c, eq), _mm_cmpeq_epi8(c, us)));
+		if (m != 0)
+			return i + __builtin_ctz(m);
+	}
+	return i + qp_literal_scalar(in + i, len - i, rfc2047);
+}
+
+static inline T_AVX2 __m256i enc_translate_256(__m256i idx)
+{
+	auto r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+	auto less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+	r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+	auto lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+	           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+	           'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+	           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	return _mm256_add_epi8(_mm256_shuffle_epi8(lut, r), idx);
+}
+
+static T_AVX2 size_t b64_encode_avx2(const unsigned char *in, size_t len, char *out)
+{
+	size_t i = 0;
+	/* each lane takes 12 of the 16 bytes loaded at in+i and in+i+12 */
+	for (; i + 28 <= len; i += 24, out += 32) {
+		auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 12));
+		auto v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+		    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+		    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+		auto t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+		auto t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		auto t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+		auto t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), enc_translate_256(_mm256_or_si256(t1, t3)));
+	}
+	return i + b64_encode_ssse3(in + i, len - i, out);
+}
+
+static inline T_AVX2 __m256i in_range_256(__m256i c, char lo, char hi)
+{
+	return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(lo - 1)),
+	       _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), c));
+}
+
+static T_AVX2 size_t b64_decode_avx2(const char *in, size_t len, unsigned char *out)
+{
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32, out += 24) {
+		auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+		auto upper = in_range_256(c, 'A', 'Z');
+		auto lower = in_range_256(c, 'a', 'z');
+		auto digit = in_range_256(c, '0', '9');
+		auto plus  = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+		auto slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+		auto valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+		if (static_cast<unsigned int>(_mm256_movemask_epi8(valid)) != 0xffffffffU)
+			break;
+		auto shift = _mm256_or_si256(_mm256_or_si256(
+		             _mm256_and_si256(upper, _mm256_set1_epi8(-65)),
+		             _mm256_and_si256(lower, _mm256_set1_epi8(-71))), _mm256_or_si256(
+		             _mm256_and_si256(digit, _mm256_set1_epi8(4)), _mm256_or_si256(
+		             _mm256_and_si256(plus, _mm256_set1_epi8(19)),
+		             _mm256_and_si256(slash, _mm256_set1_epi8(16)))));
+		auto v = _mm256_add_epi8(c, shift);
+		auto ab_cd = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		auto abcd = _mm256_madd_epi16(ab_cd, _mm256_set1_epi32(0x00011000));
+		auto packed = _mm256_shuffle_epi8(abcd, _mm256_setr_epi8(
+		              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		alignas(32) unsigned char tmp[32];
+		_mm256_store_si256(reinterpret_cast<__m256i *>(tmp), packed);
+		memcpy(out, tmp, 12);
+		memcpy(out + 12, tmp + 16, 12);
+	}
+	return i + b64_decode_ssse3(in + i, len - i, out);
+}
+
+static T_AVX2 size_t qp_literal_avx2(const char *in, size_t len, bool rfc2047)
+{
+	auto eq = _mm256_set1_epi8('='), us = _mm256_set1_epi8(rfc2047 ? '_' : '=');
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+		unsigned int m = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(c, eq), _mm256_cmpeq_epi8(c, us)));
+		if (m != 0)
+			return i + __builtin_ctz(m);
+	}
+	return i + qp_literal_ssse3(in + i, len - i, rfc2047);
+}
+#endif /* KC_SIMD_X86 */
+
+struct simd_kernels {
+	enum simd_level level;
+	size_t (*encode)(const unsigned char *, size_t, char *);
+	size_t (*decode)(const char *, size_t, unsigned char *);
+	size_t (*qp_literal)(const char *, size_t, bool);
+};
+
+static const struct simd_kernels simd_table[] = {
+	{SIMD_SCALAR, b64_encode_scalar, b64_decode_scalar, qp_literal_scalar},
+#ifdef KC_SIMD_X86
+	{SIMD_SSSE3, b64_encode_ssse3, b64_decode_ssse3, qp_literal_ssse3},
+	{SIMD_AVX2, b64_encode_avx2, b64_decode_avx2, qp_literal_avx2},
+#endif
+};
+
+static enum simd_level simd_cpu_level()
+{
+#ifdef KC_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("ssse3"))
+		return SIMD_SSSE3;
+#endif
+	return SIMD_SCALAR;
+}
+
+static const struct simd_kernels *simd_active = &simd_table[simd_cpu_level()];
+
+enum simd_level simd_codec_select(enum simd_level want)
+{
+	auto have = simd_cpu_level();
+	simd_active = &simd_table[want < have ? want : have];
+	return simd_active->level;
+}
+
+enum simd_level simd_codec_level()
+{
+	return simd_active->level;
+}
+
+size_t b64_encode_groups(const void *in, size_t len, char *out)
+{
+	return simd_active->encode(static_cast<const unsigned char *>(in), len, out);
+}
+
+size_t b64_decode_groups(const char *in, size_t len, void *out)
+{
+	return simd_active->decode(in, len, static_cast<unsigned char *>(out));
+}
+
+size_t qp_literal_run(const char *in, size_t len, bool rfc2047)
+{
+	return simd_active->qp_literal(in, len, rfc2047);
+}
+
+} /* namespace */
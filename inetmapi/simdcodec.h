@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <cstddef>
+#include <kopano/zcdefs.h>
+
+namespace KC {
+
+/*
+ * Block kernels for the MIME transfer encodings. The best implementation
+ * for the running CPU (AVX2, SSSE3 or plain C++) is picked on first use.
+ */
+enum simd_level {
+	SIMD_SCALAR = 0,
+	SIMD_SSSE3,
+	SIMD_AVX2,
+};
+
+/*
+ * Encode all complete 3-byte groups of @in into @out, without padding or
+ * line breaks. Returns the number of input bytes consumed (a multiple of
+ * 3); 4/3 of that many characters are written.
+ */
+extern KC_EXPORT size_t b64_encode_groups(const void *in, size_t len, char *out);
+
+/*
+ * Decode leading 4-character groups that consist of base64 alphabet only.
+ * Stops before the first group containing anything else (padding,
+ * whitespace, junk). Returns the number of characters consumed (a multiple
+ * of 4); 3/4 of that many bytes are written to @out.
+ */
+extern KC_EXPORT size_t b64_decode_groups(const char *in, size_t len, void *out);
+
+/*
+ * Length of the leading run of @in that quoted-printable decoding copies
+ * through unchanged, i.e. up to the first '=' (or '_' in RFC 2047 mode).
+ */
+extern KC_EXPORT size_t qp_literal_run(const char *in, size_t len, bool rfc2047);
+
+/* Select a kernel level for testing; clamped to what the CPU supports. */
+extern KC_EXPORT enum simd_level simd_codec_select(enum simd_level);
+extern KC_EXPORT enum simd_level simd_codec_level();
+
+} /* namespace */
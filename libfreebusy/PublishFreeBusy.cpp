@@ -10,6 +10,9 @@
 #include <kopano/mapiguidext.h>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <algorithm>
 #include <kopano/memory.hpp>
@@ -51,6 +54,70 @@ class PublishFreeBusy final {
 	PROPMAP_DEF_NAMED_ID(APPT_TIMEZONESTRUCT)
 };
 
+/*
+ * Expanding a recurrence walks every day (or week, month) from the start of
+ * the series to the end of the publish window, which adds up for series
+ * that have been running for years, and is redone on every calendar save.
+ * The blocks of each recurrence are therefore kept, keyed by what they are
+ * computed from: the recurrence blob, the timezone and the busy status.
+ * A changed appointment has a different key, so only changed appointments
+ * get expanded again; entries unused for a while are dropped.
+ *
+ * The blocks are expanded over whole days, so that the window, and with it
+ * the entry, stays the same for all publishes during a day.
+ */
+class fb_occr_cache final {
+	public:
+	bool get(const std::string &key, time_t start, time_t end, std::vector<FBBlock_1> &);
+	void put(std::string &&key, time_t start, time_t end, std::vector<FBBlock_1> &&);
+
+	private:
+	struct entry {
+		time_t start = 0, end = 0, last_used = 0;
+		std::vector<FBBlock_1> blocks;
+	};
+
+	static constexpr size_t MAX_ENTRIES = 4096;
+	static constexpr time_t MAX_IDLE = 86400;
+	std::mutex m_lock;
+	std::unordered_map<std::string, entry> m_entries;
+};
+
+static fb_occr_cache occr_cache;
+
+bool fb_occr_cache::get(const std::string &key, time_t start, time_t end,
+    std::vector<FBBlock_1> &blocks)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto i = m_entries.find(key);
+	if (i == m_entries.cend() || i->second.start != start || i->second.end != end)
+		return false;
+	i->second.last_used = time(nullptr);
+	blocks = i->second.blocks;
+	return true;
+}
+
+void fb_occr_cache::put(std::string &&key, time_t start, time_t end,
+    std::vector<FBBlock_1> &&blocks)
+{
+	auto now = time(nullptr);
+	std::lock_guard<std::mutex> lk(m_lock);
+	if (m_entries.size() >= MAX_ENTRIES) {
+		for (auto i = m_entries.begin(); i != m_entries.end(); )
+			if (i->second.last_used + MAX_IDLE < now || i->second.start != start)
+				i = m_entries.erase(i);
+			else
+				++i;
+		if (m_entries.size() >= MAX_ENTRIES)
+			m_entries.clear();
+	}
+	auto &e = m_entries[std::move(key)];
+	e.start = start;
+	e.end = end;
+	e.last_used = now;
+	e.blocks = std::move(blocks);
+}
+
 struct TSARRAY {
 	ULONG ulType, ulStatus;
 	time_t tsTime;
@@ -227,9 +294,7 @@ HRESULT PublishFreeBusy::HrGetResctItems(IMAPITable **lppTable)
  */
 HRESULT PublishFreeBusy::HrProcessTable(IMAPITable *lpTable, FBBlock_1 **lppfbBlocks, ULONG *lpcValues)
 {
-	memory_ptr<OccrInfo> lpOccrInfo;
-	FBBlock_1 *lpfbBlocks = NULL;
-	recurrence lpRecurrence;
+	std::vector<FBBlock_1> blocks;
 	SizedSPropTagArray(7, proptags) =
 		{7, {PROP_APPT_STARTWHOLE, PROP_APPT_ENDWHOLE,
 		PROP_APPT_FBSTATUS, PROP_APPT_ISRECURRING,
@@ -239,6 +304,10 @@ HRESULT PublishFreeBusy::HrProcessTable(IMAPITable *lpTable, FBBlock_1 **lppfbBl
 	if(hr != hrSuccess)
 		return hr;
 
+	/* The window recurrences are expanded over, see fb_occr_cache */
+	auto tsExpStart = m_tsStart - m_tsStart % 86400;
+	auto tsExpEnd = tsExpStart + (m_tsEnd - m_tsStart) + 86400;
+
 	while (true)
 	{
 		rowset_ptr lpRowSet;
@@ -255,51 +324,66 @@ HRESULT PublishFreeBusy::HrProcessTable(IMAPITable *lpTable, FBBlock_1 **lppfbBl
 			if (lpRowSet[i].lpProps[3].ulPropTag != PROP_APPT_ISRECURRING ||
 			    !lpRowSet[i].lpProps[3].Value.b)
 			{
-				OccrInfo sOccrBlock;
+				FBBlock_1 fbBlock{};
 
 				if (lpRowSet[i].lpProps[0].ulPropTag == PROP_APPT_STARTWHOLE)
-					sOccrBlock.fbBlock.m_tmStart = FileTimeToRTime(lpRowSet[i].lpProps[0].Value.ft);
-				if (lpRowSet[i].lpProps[1].ulPropTag == PROP_APPT_ENDWHOLE) {
-					sOccrBlock.fbBlock.m_tmEnd = FileTimeToRTime(lpRowSet[i].lpProps[1].Value.ft);
-					sOccrBlock.tBaseDate = FileTimeToUnixTime(lpRowSet[i].lpProps[1].Value.ft);
-				}
+					fbBlock.m_tmStart = FileTimeToRTime(lpRowSet[i].lpProps[0].Value.ft);
+				if (lpRowSet[i].lpProps[1].ulPropTag == PROP_APPT_ENDWHOLE)
+					fbBlock.m_tmEnd = FileTimeToRTime(lpRowSet[i].lpProps[1].Value.ft);
 				if (lpRowSet[i].lpProps[2].ulPropTag == PROP_APPT_FBSTATUS)
-					sOccrBlock.fbBlock.m_fbstatus = (FBStatus)lpRowSet[i].lpProps[2].Value.ul;
-				hr = HrAddFBBlock(sOccrBlock, &+lpOccrInfo, lpcValues);
-				if (hr != hrSuccess) {
-					ec_log_debug("Error adding occurrence block to list: %s (%x)", GetMAPIErrorMessage(hr), hr);
-					return hr;
-				}
+					fbBlock.m_fbstatus = (FBStatus)lpRowSet[i].lpProps[2].Value.ul;
+				blocks.emplace_back(std::move(fbBlock));
 				continue;
 			}
 			if (lpRowSet[i].lpProps[4].ulPropTag != PROP_APPT_RECURRINGSTATE)
 				continue;
-			hr = lpRecurrence.HrLoadRecurrenceState(reinterpret_cast<const char *>(lpRowSet[i].lpProps[4].Value.bin.lpb), lpRowSet[i].lpProps[4].Value.bin.cb, 0);
-			if (FAILED(hr)) {
-				kc_perror("Error loading recurrence state", hr);
-				continue;
-			}
+			const auto &rstate = lpRowSet[i].lpProps[4].Value.bin;
 			if (lpRowSet[i].lpProps[6].ulPropTag == PROP_APPT_TIMEZONESTRUCT) {
 				memcpy(&ttzInfo, lpRowSet[i].lpProps[6].Value.bin.lpb, sizeof(ttzInfo));
 				ttzInfo.le_to_cpu();
 			}
 			if (lpRowSet[i].lpProps[2].ulPropTag == PROP_APPT_FBSTATUS)
 				ulFbStatus = lpRowSet[i].lpProps[2].Value.ul;
-			hr = lpRecurrence.HrGetItems(m_tsStart, m_tsEnd, ttzInfo, ulFbStatus, &+lpOccrInfo, lpcValues);
-			if (hr != hrSuccess || !lpOccrInfo) {
-				kc_perror("Error expanding items for recurring item", hr);
-				continue;
+
+			std::string key(reinterpret_cast<const char *>(rstate.lpb), rstate.cb);
+			key.append(reinterpret_cast<const char *>(&ttzInfo), sizeof(ttzInfo));
+			key.append(reinterpret_cast<const char *>(&ulFbStatus), sizeof(ulFbStatus));
+			std::vector<FBBlock_1> rblocks;
+			if (!occr_cache.get(key, tsExpStart, tsExpEnd, rblocks)) {
+				recurrence lpRecurrence;
+				std::vector<OccrInfo> occrs;
+				hr = lpRecurrence.HrLoadRecurrenceState(reinterpret_cast<const char *>(rstate.lpb), rstate.cb, 0);
+				if (FAILED(hr)) {
+					kc_perror("Error loading recurrence state", hr);
+					continue;
+				}
+				hr = lpRecurrence.HrGetItems(tsExpStart, tsExpEnd, ttzInfo, ulFbStatus, occrs);
+				if (hr != hrSuccess) {
+					kc_perror("Error expanding items for recurring item", hr);
+					continue;
+				}
+				rblocks.reserve(occrs.size());
+				for (const auto &o : occrs)
+					rblocks.emplace_back(o.fbBlock);
+				occr_cache.put(std::move(key), tsExpStart, tsExpEnd, std::vector<FBBlock_1>(rblocks));
+			}
+			/* Occurrences that start in the publish window, as HrGetItems takes them */
+			for (const auto &b : rblocks) {
+				auto occ_start = RTimeToUnixTime(b.m_tmStart);
+				if (occ_start >= m_tsStart && occ_start <= m_tsEnd)
+					blocks.emplace_back(b);
 			}
 		}
 	}
-	
-	if (lpcValues == 0 || lpOccrInfo == nullptr)
+
+	*lpcValues = blocks.size();
+	if (blocks.empty())
 		return hrSuccess;
-	hr = MAPIAllocateBuffer(sizeof(FBBlock_1) * *lpcValues, reinterpret_cast<void **>(&lpfbBlocks));
+	FBBlock_1 *lpfbBlocks = nullptr;
+	hr = MAPIAllocateBuffer(sizeof(FBBlock_1) * blocks.size(), reinterpret_cast<void **>(&lpfbBlocks));
 	if (hr != hrSuccess)
 		return hr;
-	for (ULONG i = 0 ; i < *lpcValues; ++i)
-		lpfbBlocks[i]  = lpOccrInfo[i].fbBlock;
+	std::copy(blocks.cbegin(), blocks.cend(), lpfbBlocks);
 	*lppfbBlocks = lpfbBlocks;
 	return hrSuccess;
 }
@@ -9,6 +9,7 @@
 #include <cmath>
 #include <kopano/ECGetText.h>
 #include <kopano/ECLogger.h>
+#include <kopano/memory.hpp>
 #include <mapicode.h>
 #include <kopano/stringutil.h>
 #include <kopano/charset/convert.h>
@@ -945,7 +946,7 @@ ULONG recurrence::WeekDayFromTime(time_t t)
 
 bool recurrence::CheckAddValidOccr(time_t tsNow, time_t tsStart, time_t tsEnd,
     const TIMEZONE_STRUCT &ttZinfo, ULONG ulBusyStatus,
-    OccrInfo **lppOccrInfoAll, ULONG *lpcValues)
+    std::vector<OccrInfo> &occrs)
 {
 	ec_log_debug("Testing match: %lu ==> %s", tsNow, ctime(&tsNow));
 	if (!isOccurrenceValid(UTCToLocal(tsStart, ttZinfo), UTCToLocal(tsEnd, ttZinfo), tsNow + getStartTimeOffset())) {
@@ -955,7 +956,7 @@ bool recurrence::CheckAddValidOccr(time_t tsNow, time_t tsStart, time_t tsEnd,
 	auto tsOccStart = LocalToUTC(tsNow + getStartTimeOffset(), ttZinfo);
 	auto tsOccEnd = LocalToUTC(tsNow + getEndTimeOffset(), ttZinfo);
 	ec_log_debug("Adding match: %lu ==> %s", tsOccStart, ctime(&tsOccStart));
-	AddValidOccr(tsOccStart, tsOccEnd, ulBusyStatus, lppOccrInfoAll, lpcValues);
+	AddValidOccr(tsOccStart, tsOccEnd, ulBusyStatus, occrs);
 	return true;
 }
 
@@ -966,16 +967,43 @@ bool recurrence::CheckAddValidOccr(time_t tsNow, time_t tsStart, time_t tsEnd,
  * @param[in]	ttZinfo			timezone struct of the recurrence
  * @param[in]	ulBusyStatus	freebusy status of the recurrence
  * @param[in]	last	        only return last occurrence (fast)
- * @param[out]	lppOccrInfo		array of occurrences
- * @param[out]	lpcValues		number of occurrences in lppOccrInfo
+ * @param[in,out]	lppOccrInfo		array of occurrences, appended to
+ * @param[in,out]	lpcValues		number of occurrences in lppOccrInfo
  * @return		HRESULT
  */
 HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
     const TIMEZONE_STRUCT &ttZinfo, ULONG ulBusyStatus, OccrInfo **lppOccrInfo,
     ULONG *lpcValues, bool last)
 {
-	HRESULT hr = 0;
-	OccrInfo *lpOccrInfoAll = *lppOccrInfo;
+	std::vector<OccrInfo> occrs;
+	auto hr = HrGetItems(tsStart, tsEnd, ttZinfo, ulBusyStatus, occrs, last);
+	if (hr != hrSuccess || occrs.empty())
+		return hr;
+
+	/* One allocation for all of them, rather than one per occurrence */
+	unsigned int oldval = lpcValues != nullptr ? *lpcValues : 0;
+	memory_ptr<OccrInfo> lpOccrInfoAll;
+	hr = MAPIAllocateBuffer(sizeof(OccrInfo) * (oldval + occrs.size()), &~lpOccrInfoAll);
+	if (hr != hrSuccess)
+		return hr;
+	if (*lppOccrInfo != nullptr)
+		std::copy(*lppOccrInfo, *lppOccrInfo + oldval, lpOccrInfoAll.get());
+	std::copy(occrs.cbegin(), occrs.cend(), lpOccrInfoAll.get() + oldval);
+	MAPIFreeBuffer(*lppOccrInfo);
+	*lppOccrInfo = lpOccrInfoAll.release();
+	if (lpcValues != nullptr)
+		*lpcValues = oldval + occrs.size();
+	return hrSuccess;
+}
+
+/**
+ * Calculates occurrences of a recurrence between a specified period, like
+ * the above, and appends them to @occrs.
+ */
+HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
+    const TIMEZONE_STRUCT &ttZinfo, ULONG ulBusyStatus,
+    std::vector<OccrInfo> &occrs, bool last)
+{
 	std::vector<RecurrenceState::Exception> lstExceptions;
 	RecurrenceState::Exception lpException;
 	auto tsDayStart = getStartDate();
@@ -997,11 +1025,11 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
                         if (last) {
 				time_t remainder = (tsDayEnd - tsDayStart) % (m_sRecState.ulPeriod * 60);
 				for (time_t tsNow = tsDayEnd - remainder; tsNow >= tsDayStart; tsNow -= m_sRecState.ulPeriod * 60)
-					if (CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, &lpOccrInfoAll, lpcValues))
+					if (CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, occrs))
 						break;
                         } else {
 				for (time_t tsNow = tsDayStart; tsNow <= tsDayEnd; tsNow += m_sRecState.ulPeriod * 60)
-					CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, &lpOccrInfoAll, lpcValues);
+					CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, occrs);
                         }
                         break;
 		}
@@ -1012,7 +1040,7 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
 				tm sTm;
 				gmtime_safe(tsNow, &sTm);
 				if (sTm.tm_wday > 0 && sTm.tm_wday < 6 &&
-				    CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, &lpOccrInfoAll, lpcValues))
+				    CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, occrs))
 					break;
 			}
 			break;
@@ -1021,7 +1049,7 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
 			tm sTm;
 			gmtime_safe(tsNow, &sTm);
 			if (sTm.tm_wday > 0 && sTm.tm_wday < 6)
-				CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, &lpOccrInfoAll, lpcValues);
+				CheckAddValidOccr(tsNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, occrs);
 		}
 		break;// CASE : DAILY
 
@@ -1038,7 +1066,7 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
 					auto tsDayNow = tsNow + i * 1440 * 60; // 60 * 60 * 24 = 1440
 					ec_log_debug("Checking for weekly tsDayNow: %s", ctime(&tsDayNow));
 					if (m_sRecState.ulWeekDays & (1 << WeekDayFromTime(tsDayNow)) &&
-					    CheckAddValidOccr(tsDayNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, &lpOccrInfoAll, lpcValues)) {
+					    CheckAddValidOccr(tsDayNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, occrs)) {
 						found = true;
 						break;
 					}
@@ -1054,7 +1082,7 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
 				auto tsDayNow = tsNow + i * 1440 * 60; // 60 * 60 * 24 = 1440
 				ec_log_debug("Checking for weekly tsDayNow: %s", ctime(&tsDayNow));
 				if (m_sRecState.ulWeekDays & (1 << WeekDayFromTime(tsDayNow)))
-					CheckAddValidOccr(tsDayNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, &lpOccrInfoAll, lpcValues);
+					CheckAddValidOccr(tsDayNow, tsStart, tsEnd, ttZinfo, ulBusyStatus, occrs);
 			}
 		}
 		break;// CASE : WEEKLY
@@ -1096,7 +1124,7 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
 			if(isOccurrenceValid(tsStart, tsEnd, tsDayNow + getStartTimeOffset())){
 				auto tsOccStart =  LocalToUTC(tsDayNow + getStartTimeOffset(), ttZinfo);
 				auto tsOccEnd = LocalToUTC(tsDayNow + getEndTimeOffset(), ttZinfo);
-				AddValidOccr(tsOccStart, tsOccEnd, ulBusyStatus, &lpOccrInfoAll, lpcValues);
+				AddValidOccr(tsOccStart, tsOccEnd, ulBusyStatus, occrs);
 			}
 
 			tsNow += DaysTillMonth(tsNow, m_sRecState.ulPeriod) * 60 * 60 * 24;
@@ -1138,7 +1166,7 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
 			if(isOccurrenceValid(tsStart, tsEnd, tsDayNow + getStartTimeOffset())){
 				auto tsOccStart = LocalToUTC(tsDayNow + getStartTimeOffset(), ttZinfo);
 				auto tsOccEnd = LocalToUTC(tsDayNow + getEndTimeOffset(), ttZinfo);
-				AddValidOccr(tsOccStart, tsOccEnd, ulBusyStatus, &lpOccrInfoAll, lpcValues);
+				AddValidOccr(tsOccStart, tsOccEnd, ulBusyStatus, occrs);
 			}
 
 			tsNow += DaysTillMonth(tsNow, m_sRecState.ulPeriod) * 60 * 60 * 24;
@@ -1175,14 +1203,13 @@ HRESULT recurrence::HrGetItems(time_t tsStart, time_t tsEnd,
 		// Freebusy status
 		sOccrInfo.tBaseDate = RTimeToUnixTime(lpException.ulOriginalStartDate);
 		ec_log_debug("Adding exception match: %lu ==> %s", sOccrInfo.tBaseDate, ctime(&sOccrInfo.tBaseDate));
-		hr = HrAddFBBlock(sOccrInfo, &lpOccrInfoAll, lpcValues);
+		occrs.emplace_back(std::move(sOccrInfo));
 	}
-
-	*lppOccrInfo = lpOccrInfoAll;
-	return hr;
+	return hrSuccess;
 }
 
-HRESULT recurrence::AddValidOccr(time_t tsOccrStart, time_t tsOccrEnd, ULONG ulBusyStatus, OccrInfo **lpFBBlocksAll, ULONG *lpcValues)
+void recurrence::AddValidOccr(time_t tsOccrStart, time_t tsOccrEnd,
+    ULONG ulBusyStatus, std::vector<OccrInfo> &occrs)
 {
 	OccrInfo sOccrInfo;
 
@@ -1193,7 +1220,7 @@ HRESULT recurrence::AddValidOccr(time_t tsOccrStart, time_t tsOccrEnd, ULONG ulB
 	// APPT_ENDWHOLE
 	sOccrInfo.fbBlock.m_tmEnd = UnixTimeToRTime(tsOccrEnd);
 	sOccrInfo.fbBlock.m_fbstatus = (FBStatus)ulBusyStatus;
-	return HrAddFBBlock(sOccrInfo, lpFBBlocksAll, lpcValues);
+	occrs.emplace_back(std::move(sOccrInfo));
 }
 
 bool recurrence::isOccurrenceValid(time_t tsPeriodStart, time_t tsPeriodEnd,
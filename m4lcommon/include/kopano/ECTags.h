@@ -79,6 +79,8 @@
 #define PR_EC_STATSTABLE_USERS			PROP_TAG(PT_OBJECT, 0x6732)
 #define PR_EC_STATSTABLE_COMPANY		PROP_TAG(PT_OBJECT, 0x6733)
 #define PR_EC_STATSTABLE_SERVERS		PROP_TAG(PT_OBJECT, 0x6734)
+#define PR_EC_STATSTABLE_SOAP			PROP_TAG(PT_OBJECT, 0x6735)
+#define PR_EC_STATSTABLE_SLOW			PROP_TAG(PT_OBJECT, 0x6736)
 
 /* system stats */
 #define PR_EC_STATS_SYSTEM_DESCRIPTION		PROP_TAG(PT_STRING8, 0x6740)
@@ -112,6 +114,28 @@
 #define PR_EC_STATS_SESSION_CLIENT_APPLICATION_VERSION	PROP_TAG(PT_STRING8, 0x6754)
 #define PR_EC_STATS_SESSION_CLIENT_APPLICATION_MISC	PROP_TAG(PT_STRING8, 0x6755)
 
+/* SOAP method stats; times in seconds */
+#define PR_EC_STATS_SOAP_CALLS			PROP_TAG(PT_LONGLONG, 0x6756)
+#define PR_EC_STATS_SOAP_ERRORS			PROP_TAG(PT_LONGLONG, 0x6757)
+#define PR_EC_STATS_SOAP_WALL			PROP_TAG(PT_DOUBLE, 0x6758)
+#define PR_EC_STATS_SOAP_CPU			PROP_TAG(PT_DOUBLE, 0x6759)
+#define PR_EC_STATS_SOAP_WALL_P50		PROP_TAG(PT_DOUBLE, 0x675A)
+#define PR_EC_STATS_SOAP_WALL_P99		PROP_TAG(PT_DOUBLE, 0x675B)
+#define PR_EC_STATS_SOAP_CPU_P99		PROP_TAG(PT_DOUBLE, 0x675C)
+#define PR_EC_STATS_SOAP_SQL_QUERIES		PROP_TAG(PT_LONGLONG, 0x675D)
+#define PR_EC_STATS_SOAP_SQL_ROWS		PROP_TAG(PT_LONGLONG, 0x675E)
+#define PR_EC_STATS_SOAP_BYTES			PROP_TAG(PT_LONGLONG, 0x675F)
+/* slow request traces; times in seconds */
+#define PR_EC_STATS_SLOW_TIME			PROP_TAG(PT_SYSTIME, 0x6765)
+#define PR_EC_STATS_SLOW_WALL			PROP_TAG(PT_DOUBLE, 0x6766)
+#define PR_EC_STATS_SLOW_SQL_TIME		PROP_TAG(PT_DOUBLE, 0x6767)
+#define PR_EC_STATS_SLOW_LOCK_WAIT		PROP_TAG(PT_DOUBLE, 0x6768)
+#define PR_EC_STATS_SLOW_OBJECT			PROP_TAG(PT_LONG, 0x6769)
+#define PR_EC_STATS_SLOW_TABLE			PROP_TAG(PT_LONG, 0x676A)
+#define PR_EC_STATS_SLOW_CACHE_LOOKUPS		PROP_TAG(PT_LONGLONG, 0x676B)
+#define PR_EC_STATS_SLOW_CACHE_HITS		PROP_TAG(PT_LONGLONG, 0x676C)
+#define PR_EC_STATS_SLOW_QUERIES		PROP_TAG(PT_MV_STRING8, 0x676D)
+
 #define PR_EC_OUTOFOFFICE			PROP_TAG(PT_BOOLEAN, 0x6760)
 #define PR_EC_OUTOFOFFICE_MSG			PROP_TAG(PT_TSTRING, 0x6761)
 #define PR_EC_OUTOFOFFICE_MSG_A			PROP_TAG(PT_STRING8, 0x6761)
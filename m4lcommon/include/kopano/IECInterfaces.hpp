@@ -206,6 +206,9 @@ class IECSpooler : public virtual IUnknown {
 
 	// Removes a message from the master outgoing table
 	virtual HRESULT DeleteFromMasterOutgoingTable(ULONG cbEntryID, const ENTRYID *lpEntryID, ULONG ulFlags) = 0;
+
+	// Copies a delivered message into another folder on the same server, leaving out lpExclude
+	virtual HRESULT CopyMessageForDelivery(ULONG cbEntryID, const ENTRYID *lpEntryID, ULONG cbFolderID, const ENTRYID *lpFolderID, const SPropTagArray *lpExclude, ULONG *lpcbNewEntryID, ENTRYID **lppNewEntryID) = 0;
 };
 
 class IECTestProtocol : public virtual IUnknown {
@@ -2,7 +2,11 @@
  * SPDX-License-Identifier: AGPL-3.0-only
  * Copyright 2005 - 2016 Zarafa and its licensors
  */
+#include <algorithm>
+#include <chrono>
 #include <new>
+#include <system_error>
+#include <utility>
 #include <kopano/platform.h>
 #include <kopano/MAPIErrors.h>
 #include <kopano/memory.hpp>
@@ -29,6 +33,34 @@
 
 using namespace KC;
 
+/* Bounds for the adaptive stream export batch size */
+static constexpr unsigned int EXPORT_BATCH_MIN = 16, EXPORT_BATCH_MAX = 2048;
+/* Memory that may be spent on reading the next batch ahead */
+static constexpr size_t EXPORT_PREFETCH_BUDGET = 32 << 20;
+
+static constexpr const SizedSPropTagArray(11, sptImportProps) = { 11, {
+	PR_SOURCE_KEY,
+	PR_LAST_MODIFICATION_TIME,
+	PR_CHANGE_KEY,
+	PR_PARENT_SOURCE_KEY,
+	PR_PREDECESSOR_CHANGE_LIST,
+	PR_ENTRYID,
+	PR_ASSOCIATED,
+	PR_MESSAGE_FLAGS, /* needed for backward compat since PR_ASSOCIATED is not supported on earlier systems */
+	PR_STORE_RECORD_KEY,
+	PR_EC_HIERARCHYID,
+	PR_EC_PARENT_HIERARCHYID
+} };
+static constexpr const SizedSPropTagArray(7, sptImportPropsServerWide) = { 7, {
+	PR_SOURCE_KEY,
+	PR_PARENT_SOURCE_KEY,
+	PR_STORE_RECORD_KEY,
+	PR_STORE_ENTRYID,
+	PR_EC_HIERARCHYID,
+	PR_EC_PARENT_HIERARCHYID,
+	PR_ENTRYID
+} };
+
 class PropTagCompare final {
 	public:
 	bool operator()(unsigned int lhs, unsigned int rhs) const
@@ -113,9 +145,22 @@ ECExchangeExportChanges::ECExchangeExportChanges(ECMsgStore *lpStore,
 	m_ulSyncType(ulSyncType), m_sourcekey(sk),
 	m_strDisplay(szDisplay != nullptr ? szDisplay : L"<Unknown>"),
 	/* In server-side sync, only use a batch size of 1. */
-	m_ulBatchSize(sk.empty() ? 1 : 256), m_lpStore(lpStore)
+	m_ulBatchSize(sk.empty() ? 1 : 256),
+	m_batchSizer(m_ulBatchSize, EXPORT_BATCH_MIN, EXPORT_BATCH_MAX, EXPORT_PREFETCH_BUDGET),
+	m_lpStore(lpStore)
 {
 	memset(&m_tmsStart, 0, sizeof(m_tmsStart));
+	/* Test hook: fail every nth prefetched batch halfway. */
+	auto s = getenv("KOPANO_ICS_PREFETCH_FAIL");
+	if (s != nullptr)
+		m_ulPrefetchFail = atoui(s);
+}
+
+ECExchangeExportChanges::~ECExchangeExportChanges()
+{
+	/* The prefetch thread uses m_lpStore and m_lstChange. */
+	if (m_futPrefetch.valid())
+		m_futPrefetch.wait();
 }
 
 HRESULT ECExchangeExportChanges::Create(ECMsgStore *lpStore, REFIID iid, const std::string& sourcekey, const wchar_t *szDisplay, unsigned int ulSyncType, LPEXCHANGEEXPORTCHANGES* lppExchangeExportChanges){
@@ -509,6 +554,9 @@ progress:
 					else
 						snprintf(szDuration, sizeof(szDuration), "%u.%03u s.", (unsigned)dblDuration % 60, (unsigned)(dblDuration * 1000 + .5) % 1000);
 					ec_log_ics("folder changes synchronized in %s", szDuration);
+					if (m_ulBatches > 0 && dblDuration > 0)
+						ec_log_ics("ExportFast: %u batches, %u prefetched, %zu bytes read ahead, %.1f messages/s",
+							m_ulBatches, m_ulPrefetchHits, m_cbExported, m_lstChange.size() / dblDuration);
 				} else
 					ec_log(EC_LOGLEVEL_INFO | EC_LOGLEVEL_SYNC, "folder changes synchronized");
 			}
@@ -791,6 +839,159 @@ exit:
 	return hr;
 }
 
+/**
+ * Request the stream export of changes [@start, @start+@count) on a
+ * transport of its own, and read the message streams of up to @budget bytes
+ * into memory. Runs on the prefetch thread, so it must not touch the
+ * exporter object.
+ */
+ECExchangeExportChanges::export_batch
+ECExchangeExportChanges::FetchExportBatch(ECMsgStore *lpStore, ULONG ulFlags,
+    ULONG ulPropTag, const std::vector<ICSCHANGE> &lstChange, ULONG ulStart,
+    ULONG ulCount, const SPropTagArray *lpImportProps, size_t budget)
+{
+	export_batch batch;
+	batch.ulStart = ulStart;
+	batch.ulCount = std::min(static_cast<size_t>(ulCount), lstChange.size() - ulStart);
+
+	auto start = std::chrono::steady_clock::now();
+	batch.hr = lpStore->ExportMessageChangesAsStream(ulFlags, ulPropTag,
+	           lstChange, ulStart, ulCount, lpImportProps, &~batch.ptrExporter);
+	batch.dblRtt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (batch.hr != hrSuccess)
+		return batch;
+
+	for (ULONG i = ulStart; i < ulStart + batch.ulCount && batch.cbData < budget; ++i) {
+		prefetched_message pm;
+		pm.hr = batch.ptrExporter->GetSerializedMessage(i, &~pm.ptrMessage);
+		if (pm.hr == hrSuccess)
+			pm.hr = CreateStreamOnHGlobal(nullptr, true, &~pm.ptrData);
+		if (pm.hr == hrSuccess)
+			pm.hr = pm.ptrMessage->CopyData(pm.ptrData);
+		STATSTG st{};
+		if (pm.hr == hrSuccess && pm.ptrData->Stat(&st, STATFLAG_NONAME) == hrSuccess)
+			batch.cbData += st.cbSize.QuadPart;
+		auto hr = pm.hr;
+		batch.lstPrefetched.emplace_back(std::move(pm));
+		/* Anything but a deleted message is reported when it is consumed. */
+		if (hr != hrSuccess && hr != SYNC_E_OBJECT_DELETED)
+			break;
+	}
+	return batch;
+}
+
+/* Start fetching the batch that follows the current one. */
+void ECExchangeExportChanges::PrefetchExportBatch()
+{
+	ULONG ulStart = m_batch.ulStart + m_batch.ulCount;
+	if (ulStart >= m_lstChange.size())
+		return;
+	bool fail = m_ulPrefetchFail > 0 && ++m_ulPrefetches % m_ulPrefetchFail == 0;
+	auto store = m_lpStore.get();
+	auto flags = m_ulFlags & (SYNC_BEST_BODY | SYNC_LIMITED_IMESSAGE);
+	ULONG proptag = m_ulEntryPropTag, count = m_batchSizer.size();
+	size_t budget = m_batchSizer.budget();
+	const auto &changes = m_lstChange;
+	try {
+		m_futPrefetch = std::async(std::launch::async, [=, &changes]() {
+			auto batch = FetchExportBatch(store, flags, proptag, changes,
+			             ulStart, count, static_cast<const SPropTagArray *>(sptImportProps), budget);
+			if (!fail || batch.hr != hrSuccess)
+				return batch;
+			if (batch.lstPrefetched.empty()) {
+				batch.hr = MAPI_E_NETWORK_ERROR;
+				return batch;
+			}
+			auto half = batch.lstPrefetched.size() / 2;
+			batch.lstPrefetched.resize(half + 1);
+			batch.lstPrefetched[half].hr = MAPI_E_NETWORK_ERROR;
+			return batch;
+		});
+	} catch (const std::system_error &e) {
+		/* No thread: the next batch is fetched when it is needed. */
+		ec_log_ics("ExportFast: cannot prefetch: %s", e.what());
+	}
+}
+
+/**
+ * Make the batch starting at m_ulStep the current one: take it from the
+ * prefetch thread or request it now, then start prefetching the one after.
+ */
+HRESULT ECExchangeExportChanges::NextExportBatch()
+{
+	bool bPipelined = !m_sourcekey.empty();
+	if (m_ptrStreamExporter != nullptr && bPipelined) {
+		auto work = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tpBatchStart).count();
+		m_batchSizer.add_sizes(m_batch.lstPrefetched.size(), m_batch.cbData);
+		m_batchSizer.update(m_batch.ulCount, m_batch.dblRtt, work);
+	}
+	m_ptrStreamExporter.reset();
+
+	export_batch batch;
+	bool bPrefetched = false;
+	if (m_futPrefetch.valid()) {
+		batch = m_futPrefetch.get();
+		/*
+		 * Of a batch that failed halfway, only the messages read before
+		 * the failure are used; the rest is requested anew, from the
+		 * failed message on. A batch that failed as a whole, or at its
+		 * first message, is requested anew right here.
+		 */
+		if (batch.ulStart == m_ulStep && batch.hr == hrSuccess &&
+		    !batch.lstPrefetched.empty() &&
+		    batch.lstPrefetched.back().hr != hrSuccess &&
+		    batch.lstPrefetched.back().hr != SYNC_E_OBJECT_DELETED) {
+			ec_log_ics("ExportFast: Prefetched batch failed at step %u: %s",
+				batch.ulStart + static_cast<ULONG>(batch.lstPrefetched.size()) - 1,
+				GetMAPIErrorMessage(batch.lstPrefetched.back().hr));
+			batch.lstPrefetched.pop_back();
+			batch.ulCount = batch.lstPrefetched.size();
+		} else if (batch.ulStart == m_ulStep && batch.hr != hrSuccess) {
+			ec_log_ics("ExportFast: Prefetched batch failed at step %u: %s",
+				batch.ulStart, GetMAPIErrorMessage(batch.hr));
+		}
+		bPrefetched = batch.ulStart == m_ulStep && batch.hr == hrSuccess && batch.ulCount > 0;
+	}
+	if (!bPrefetched) {
+		auto ulCount = bPipelined ? m_batchSizer.size() : m_ulBatchSize;
+		ec_log_ics("ExportFast: Requesting new batch, batch size = %u", ulCount);
+		batch = FetchExportBatch(m_lpStore, m_ulFlags & (SYNC_BEST_BODY | SYNC_LIMITED_IMESSAGE),
+		        m_ulEntryPropTag, m_lstChange, m_ulStep, ulCount,
+		        bPipelined ? static_cast<const SPropTagArray *>(sptImportProps) : sptImportPropsServerWide, 0);
+	} else {
+		ec_log_ics("ExportFast: Using prefetched batch, batch size = %u, %zu messages (%zu bytes) read ahead",
+			batch.ulCount, batch.lstPrefetched.size(), batch.cbData);
+		++m_ulPrefetchHits;
+	}
+	if (batch.hr != hrSuccess)
+		return batch.hr;
+
+	m_cbExported += batch.cbData;
+	m_batch = std::move(batch);
+	m_ptrStreamExporter = std::move(m_batch.ptrExporter);
+	m_tpBatchStart = std::chrono::steady_clock::now();
+	++m_ulBatches;
+	if (bPipelined)
+		PrefetchExportBatch();
+	return hrSuccess;
+}
+
+static HRESULT CopyPrefetched(IStream *lpSrc, IStream *lpDest)
+{
+	char buf[65536];
+	ULONG cbRead = 0;
+	auto hr = lpSrc->Seek(large_int_zero, STREAM_SEEK_SET, nullptr);
+	while (hr == hrSuccess) {
+		hr = lpSrc->Read(buf, sizeof(buf), &cbRead);
+		if (hr != hrSuccess || cbRead == 0)
+			break;
+		hr = lpDest->Write(buf, cbRead, nullptr);
+	}
+	if (hr != hrSuccess)
+		return hr;
+	return lpDest->Commit(0);
+}
+
 HRESULT ECExchangeExportChanges::ExportMessageChangesFast()
 {
 	HRESULT hr = hrSuccess;
@@ -799,29 +1000,7 @@ HRESULT ECExchangeExportChanges::ExportMessageChangesFast()
 	SPropValuePtr ptrProps;
 	const SPropValue *lpPropVal = NULL;
 	StreamPtr ptrDestStream;
-	static constexpr const SizedSPropTagArray(11, sptImportProps) = { 11, {
-		PR_SOURCE_KEY,
-		PR_LAST_MODIFICATION_TIME,
-		PR_CHANGE_KEY,
-		PR_PARENT_SOURCE_KEY,
-		PR_PREDECESSOR_CHANGE_LIST,
-		PR_ENTRYID,
-		PR_ASSOCIATED,
-		PR_MESSAGE_FLAGS, /* needed for backward compat since PR_ASSOCIATED is not supported on earlier systems */
-		PR_STORE_RECORD_KEY,
-		PR_EC_HIERARCHYID,
-		PR_EC_PARENT_HIERARCHYID
-	} };
-	static constexpr const SizedSPropTagArray(7, sptImportPropsServerWide) = { 7, {
-		PR_SOURCE_KEY,
-		PR_PARENT_SOURCE_KEY,
-		PR_STORE_RECORD_KEY,
-		PR_STORE_ENTRYID,
-		PR_EC_HIERARCHYID,
-		PR_EC_PARENT_HIERARCHYID,
-		PR_ENTRYID
-	} };
-	const auto lpImportProps = m_sourcekey.empty() ? sptImportPropsServerWide : sptImportProps;
+	object_ptr<IStream> ptrPrefetched;
 
 	// No more changes (add/modify).
 	ec_log_ics("ExportFast: At step %u, changeset contains %zu items)",
@@ -829,9 +1008,8 @@ HRESULT ECExchangeExportChanges::ExportMessageChangesFast()
 	if (m_ulStep >= m_lstChange.size())
 		goto exit;
 
-	if (!m_ptrStreamExporter || m_ptrStreamExporter->IsDone()) {
-		ec_log_ics("ExportFast: Requesting new batch, batch size = %u", m_ulBatchSize);
-		hr = m_lpStore->ExportMessageChangesAsStream(m_ulFlags & (SYNC_BEST_BODY | SYNC_LIMITED_IMESSAGE), m_ulEntryPropTag, m_lstChange, m_ulStep, m_ulBatchSize, lpImportProps, &~m_ptrStreamExporter);
+	if (!m_ptrStreamExporter || m_ulStep >= m_batch.ulStart + m_batch.ulCount) {
+		hr = NextExportBatch();
 		if (hr == MAPI_E_UNABLE_TO_COMPLETE) {
 			// There was nothing to export (see ExportMessageChangesAsStream documentation)
 			assert(m_ulStep >= m_lstChange.size());	// @todo: Is this a correct assumption?
@@ -844,8 +1022,15 @@ HRESULT ECExchangeExportChanges::ExportMessageChangesFast()
 		zlog("ExportFast: Got new batch");
 	}
 
-	ec_log_ics("ExportFast: Requesting serialized message, step = %u", m_ulStep);
-	hr = m_ptrStreamExporter->GetSerializedMessage(m_ulStep, &~ptrSerializedMessage);
+	if (m_ulStep - m_batch.ulStart < m_batch.lstPrefetched.size()) {
+		auto &pm = m_batch.lstPrefetched[m_ulStep - m_batch.ulStart];
+		hr = pm.hr;
+		ptrSerializedMessage = std::move(pm.ptrMessage);
+		ptrPrefetched = std::move(pm.ptrData);
+	} else {
+		ec_log_ics("ExportFast: Requesting serialized message, step = %u", m_ulStep);
+		hr = m_ptrStreamExporter->GetSerializedMessage(m_ulStep, &~ptrSerializedMessage);
+	}
 	if (hr == SYNC_E_OBJECT_DELETED) {
 		zlog("ExportFast: Source message is deleted");
 		hr = hrSuccess;
@@ -869,7 +1054,10 @@ HRESULT ECExchangeExportChanges::ExportMessageChangesFast()
 	hr = m_lpImportStreamedContents->ImportMessageChangeAsAStream(cbProps, ptrProps, ulFlags, &~ptrDestStream);
 	if (hr == hrSuccess) {
 		zlog("ExportFast: Copying data");
-		hr = ptrSerializedMessage->CopyData(ptrDestStream);
+		if (ptrPrefetched != nullptr)
+			hr = CopyPrefetched(ptrPrefetched, ptrDestStream);
+		else
+			hr = ptrSerializedMessage->CopyData(ptrDestStream);
 		if (hr != hrSuccess) {
 			zlog("ExportFast: Failed to copy data", hr);
 			LogMessageProps(EC_LOGLEVEL_DEBUG, cbProps, ptrProps);
@@ -878,7 +1066,7 @@ HRESULT ECExchangeExportChanges::ExportMessageChangesFast()
 		zlog("ExportFast: Copied data");
 	} else if (hr == SYNC_E_IGNORE || hr == SYNC_E_OBJECT_DELETED) {
 		zlog("ExportFast: Change ignored", hr);
-		hr = ptrSerializedMessage->DiscardData();
+		hr = ptrPrefetched != nullptr ? hrSuccess : ptrSerializedMessage->DiscardData();
 		if (hr != hrSuccess) {
 			zlog("ExportFast: Failed to discard data", hr);
 			LogMessageProps(EC_LOGLEVEL_DEBUG, cbProps, ptrProps);
@@ -3,11 +3,14 @@
  * Copyright 2005 - 2016 Zarafa and its licensors
  */
 #pragma once
+#include <future>
 #include <memory>
 #include <mapidefs.h>
 #include <vector>
 #include <set>
 #include <string>
+#include <kopano/batchsize.hpp>
+#include <kopano/timeutil.hpp>
 #include "ics_client.hpp"
 #include "ECMAPIProp.h"
 #include <kopano/ECLogger.h>
@@ -16,6 +19,7 @@
 #include <kopano/memory.hpp>
 #include <kopano/zcdefs.h>
 #include "WSMessageStreamExporter.h"
+#include "WSSerializedMessage.h"
 
 class ECExchangeExportChanges KC_FINAL_OPG :
     public KC::ECUnknown, public KC::IECExportChanges {
@@ -23,6 +27,7 @@ protected:
 	ECExchangeExportChanges(ECMsgStore *lpStore, const std::string& strSK, const wchar_t *szDisplay, unsigned int ulSyncType);
 public:
 	static	HRESULT Create(ECMsgStore *lpStore, REFIID iid, const std::string& strSK, const wchar_t *szDisplay, unsigned int ulSyncType, LPEXCHANGEEXPORTCHANGES* lppExchangeExportChanges);
+	~ECExchangeExportChanges();
 	virtual HRESULT QueryInterface(const IID &, void **) override;
 	virtual HRESULT GetLastError(HRESULT, unsigned int flags, MAPIERROR **) override;
 	virtual HRESULT Config(IStream *, unsigned int, IUnknown *collector, SRestriction *, SPropTagArray *inclprop, SPropTagArray *exclprop, unsigned int bufsize) override;
@@ -35,6 +40,8 @@ private:
 	HRESULT ExportMessageChanges();
 	HRESULT ExportMessageChangesSlow();
 	HRESULT ExportMessageChangesFast();
+	HRESULT NextExportBatch();
+	void PrefetchExportBatch();
 	HRESULT ExportMessageFlags();
 	HRESULT ExportMessageDeletes();
 	HRESULT ExportFolderChanges();
@@ -54,6 +61,34 @@ private:
 	WSMessageStreamExporterPtr			m_ptrStreamExporter;
 	std::vector<ICSCHANGE> m_lstChange;
 
+	/*
+	 * Fast export pipeline: while one batch is imported, the next one is
+	 * requested on a transport of its own and, up to the memory budget of
+	 * m_batchSizer, read into memory.
+	 */
+	struct prefetched_message {
+		HRESULT hr = hrSuccess;
+		KC::object_ptr<WSSerializedMessage> ptrMessage;
+		KC::object_ptr<IStream> ptrData;
+	};
+	struct export_batch {
+		ULONG ulStart = 0, ulCount = 0;
+		HRESULT hr = hrSuccess;
+		WSMessageStreamExporterPtr ptrExporter;
+		std::vector<prefetched_message> lstPrefetched; /* from ulStart on */
+		size_t cbData = 0;
+		double dblRtt = 0;
+	};
+	static export_batch FetchExportBatch(ECMsgStore *, ULONG flags, ULONG proptag, const std::vector<ICSCHANGE> &, ULONG start, ULONG count, const SPropTagArray *, size_t budget);
+
+	KC::batch_sizer m_batchSizer;
+	std::future<export_batch> m_futPrefetch;
+	export_batch m_batch; /* m_ptrStreamExporter's */
+	KC::time_point m_tpBatchStart;
+	ULONG m_ulBatches = 0, m_ulPrefetchHits = 0;
+	ULONG m_ulPrefetches = 0, m_ulPrefetchFail = 0;
+	size_t m_cbExported = 0;
+
 	typedef std::list<ICSCHANGE>	ChangeList;
 	typedef ChangeList::iterator	ChangeListIter;
 	ChangeList m_lstFlag, m_lstSoftDelete, m_lstHardDelete;
@@ -169,6 +169,8 @@ ECMsgStore::ECMsgStore(const char *lpszProfname, IMAPISupport *sup,
 	HrAddPropHandlers(PR_EC_STATSTABLE_USERS, GetPropHandler, DefaultSetPropComputed, this, false, true);
 	HrAddPropHandlers(PR_EC_STATSTABLE_COMPANY, GetPropHandler, DefaultSetPropComputed, this, false, true);
 	HrAddPropHandlers(PR_EC_STATSTABLE_SERVERS, GetPropHandler, DefaultSetPropComputed, this, false, true);
+	HrAddPropHandlers(PR_EC_STATSTABLE_SOAP, GetPropHandler, DefaultSetPropComputed, this, false, true);
+	HrAddPropHandlers(PR_EC_STATSTABLE_SLOW, GetPropHandler, DefaultSetPropComputed, this, false, true);
 	HrAddPropHandlers(PR_TEST_LINE_SPEED, GetPropHandler, DefaultSetPropComputed, this, false, true);
 	HrAddPropHandlers(PR_EMSMDB_SECTION_UID, GetPropHandler, DefaultSetPropComputed, this, false, true);
 	HrAddPropHandlers(PR_ACL_DATA, GetPropHandler, SetPropHandler, this, false, true);
@@ -336,6 +338,12 @@ HRESULT ECMsgStore::OpenProperty(ULONG ulPropTag, LPCIID lpiid, ULONG ulInterfac
 	} else if(ulPropTag == PR_EC_STATSTABLE_SERVERS) {
 		if (*lpiid == IID_IMAPITable)
 			hr = OpenStatsTable(TABLETYPE_STATS_SERVERS, reinterpret_cast<IMAPITable **>(lppUnk));
+	} else if(ulPropTag == PR_EC_STATSTABLE_SOAP) {
+		if (*lpiid == IID_IMAPITable)
+			hr = OpenStatsTable(TABLETYPE_STATS_SOAP, reinterpret_cast<IMAPITable **>(lppUnk));
+	} else if(ulPropTag == PR_EC_STATSTABLE_SLOW) {
+		if (*lpiid == IID_IMAPITable)
+			hr = OpenStatsTable(TABLETYPE_STATS_SLOW, reinterpret_cast<IMAPITable **>(lppUnk));
 	} else if(ulPropTag == PR_ACL_TABLE) {
 		if(*lpiid == IID_IExchangeModifyTable)
 			hr = ECExchangeModifyTable::CreateACLTable(this, ulInterfaceOptions, (LPEXCHANGEMODIFYTABLE*)lppUnk);
@@ -1035,6 +1043,8 @@ HRESULT ECMsgStore::GetPropHandler(unsigned int ulPropTag, void *lpProvider,
 	case PROP_ID(PR_EC_STATSTABLE_SESSIONS):
 	case PROP_ID(PR_EC_STATSTABLE_USERS):
 	case PROP_ID(PR_EC_STATSTABLE_COMPANY):
+	case PROP_ID(PR_EC_STATSTABLE_SOAP):
+	case PROP_ID(PR_EC_STATSTABLE_SLOW):
 		lpsPropValue->ulPropTag = ulPropTag;
 		lpsPropValue->Value.x = 1;
 		break;
@@ -2510,6 +2520,18 @@ HRESULT ECMsgStore::DeleteFromMasterOutgoingTable(ULONG cbEntryId,
 	return lpTransport->HrFinishedMessage(cbEntryId, lpEntryId, EC_SUBMIT_MASTER | ulFlags);
 }
 
+HRESULT ECMsgStore::CopyMessageForDelivery(ULONG cbEntryId,
+    const ENTRYID *lpEntryId, ULONG cbFolderId, const ENTRYID *lpFolderId,
+    const SPropTagArray *lpExclude, ULONG *lpcbNewEntryId,
+    ENTRYID **lppNewEntryId)
+{
+	if (lpEntryId == nullptr || lpFolderId == nullptr ||
+	    lpcbNewEntryId == nullptr || lppNewEntryId == nullptr)
+		return MAPI_E_INVALID_PARAMETER;
+	return lpTransport->HrCopyMessageForDelivery(cbEntryId, lpEntryId,
+	       cbFolderId, lpFolderId, lpExclude, lpcbNewEntryId, lppNewEntryId);
+}
+
 // ProxyStoreObject
 HRESULT ECMsgStore::UnwrapNoRef(LPVOID *ppvObject)
 {
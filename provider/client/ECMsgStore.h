@@ -74,6 +74,7 @@ public:
 	// IECSpooler
 	virtual HRESULT GetMasterOutgoingTable(ULONG flags, IMAPITable **) override;
 	virtual HRESULT DeleteFromMasterOutgoingTable(ULONG eid_size, const ENTRYID *eid, ULONG flags) override;
+	virtual HRESULT CopyMessageForDelivery(ULONG eid_size, const ENTRYID *eid, ULONG feid_size, const ENTRYID *folder_eid, const SPropTagArray *exclude, ULONG *neweid_size, ENTRYID **new_eid) override;
 
 	// IECServiceAdmin
 	virtual HRESULT CreateStore(ULONG store_type, ULONG user_size, const ENTRYID *user_eid, ULONG *newstore_size, ENTRYID **newstore_eid, ULONG *root_size, ENTRYID **root_eid) override;
@@ -3684,7 +3684,8 @@ HRESULT WSTransport::HrOpenMiscTable(ULONG ulTableType, ULONG ulFlags,
 {
 	if (ulTableType != TABLETYPE_STATS_SYSTEM && ulTableType != TABLETYPE_STATS_SESSIONS &&
 	    ulTableType != TABLETYPE_STATS_USERS && ulTableType != TABLETYPE_STATS_COMPANY &&
-	    ulTableType != TABLETYPE_USERSTORES && ulTableType != TABLETYPE_STATS_SERVERS)
+	    ulTableType != TABLETYPE_USERSTORES && ulTableType != TABLETYPE_STATS_SERVERS &&
+	    ulTableType != TABLETYPE_STATS_SOAP && ulTableType != TABLETYPE_STATS_SLOW)
 		return MAPI_E_INVALID_PARAMETER;
 
 	HRESULT hr = hrSuccess;
@@ -3954,3 +3955,43 @@ HRESULT WSTransport::HrResetFolderCount(ULONG cbEntryId,
  exitm:
 	return hr;
 }
+
+HRESULT WSTransport::HrCopyMessageForDelivery(ULONG cbEntryId,
+    const ENTRYID *lpEntryId, ULONG cbFolderId, const ENTRYID *lpFolderId,
+    const SPropTagArray *lpExclude, ULONG *lpcbNewEntryId,
+    ENTRYID **lppNewEntryId)
+{
+	HRESULT hr = hrSuccess;
+	ECRESULT er = erSuccess;
+	entryId eidMessage, eidFolder;
+	propTagArray sExclude{}, *lpsExclude = nullptr;
+	copyMessageResponse sResponse;
+
+	if ((m_ulServerCapabilities & KOPANO_CAP_DELIVERY_COPY) == 0)
+		return MAPI_E_NO_SUPPORT;
+	soap_lock_guard spg(*this);
+	hr = CopyMAPIEntryIdToSOAPEntryId(cbEntryId, lpEntryId, &eidMessage, true);
+	if (hr != hrSuccess)
+		goto exitm;
+	hr = CopyMAPIEntryIdToSOAPEntryId(cbFolderId, lpFolderId, &eidFolder, true);
+	if (hr != hrSuccess)
+		goto exitm;
+	if (lpExclude != nullptr) {
+		sExclude.__size = lpExclude->cValues;
+		sExclude.__ptr = (unsigned int *)lpExclude->aulPropTag;
+		lpsExclude = &sExclude;
+	}
+
+	START_SOAP_CALL
+	{
+		if (m_lpCmd->copyMessageForDelivery(m_ecSessionId, eidMessage, eidFolder, lpsExclude, 0, &sResponse) != SOAP_OK)
+			er = KCERR_NETWORK_ERROR;
+		else
+			er = sResponse.er;
+	}
+	END_SOAP_CALL
+
+	hr = CopySOAPEntryIdToMAPIEntryId(&sResponse.sEntryId, lpcbNewEntryId, lppNewEntryId);
+ exitm:
+	return hr;
+}
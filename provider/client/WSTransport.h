@@ -240,6 +240,7 @@ public:
 	HRESULT HrCancelIO();
 
 	HRESULT HrResetFolderCount(unsigned int eid_size, const ENTRYID *eid, unsigned int *nupdates);
+	HRESULT HrCopyMessageForDelivery(unsigned int eid_size, const ENTRYID *eid, unsigned int feid_size, const ENTRYID *folder_eid, const SPropTagArray *exclude, unsigned int *neweid_size, ENTRYID **new_eid);
 
 	std::string m_server_version;
 
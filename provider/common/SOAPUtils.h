@@ -116,6 +116,7 @@ struct SOAPINFO {
 	bool bProxy;
 	void (*fdone)(struct soap *soap, void *param);
 	void *fdoneparam;
+	int (*fsend)(struct soap *soap, const char *buf, size_t len);
 	ECSESSIONID ulLastSessionId; // Session ID of the last processed request
 	struct request_stat st;
 };
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <ctime>
+#include <cstdint>
 #include <kopano/timeutil.hpp>
 
 namespace KC {
@@ -28,6 +29,8 @@ struct request_stat {
 	std::string user, imp, agent;
 	const char *func = nullptr;
 	int er = 0;
+	/* SQL queries issued and rows selected during rh1; bytes of the response */
+	uint64_t sql_queries = 0, sql_rows = 0, bytes_sent = 0;
 };
 
 } /* namespace */
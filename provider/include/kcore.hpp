@@ -319,9 +319,11 @@ typedef EID * PEID;
  * returned from the getIDsForNames RPC.
  */
 #define KOPANO_CAP_GIFN32 0x8000
+// Server supports the copyMessageForDelivery call
+#define KOPANO_CAP_DELIVERY_COPY 0x10000
 
 // Do *not* use this from a client. This is just what the latest server supports.
-#define KOPANO_LATEST_CAPABILITIES (KOPANO_CAP_CRYPT | KOPANO_CAP_LICENSE_SERVER | KOPANO_CAP_LOADPROP_ENTRYID | KOPANO_CAP_EXPORT_PROPTAG | KOPANO_CAP_IMPERSONATION | KOPANO_CAP_GIFN32)
+#define KOPANO_LATEST_CAPABILITIES (KOPANO_CAP_CRYPT | KOPANO_CAP_LICENSE_SERVER | KOPANO_CAP_LOADPROP_ENTRYID | KOPANO_CAP_EXPORT_PROPTAG | KOPANO_CAP_IMPERSONATION | KOPANO_CAP_GIFN32 | KOPANO_CAP_DELIVERY_COPY)
 
 //
 // Logon flags, sent with ns__logon()
@@ -915,6 +915,11 @@ struct ns:resetFolderCountResponse {
 	unsigned int er;
 };
 
+struct ns:copyMessageResponse {
+	entryId sEntryId;
+	unsigned int er;
+};
+
 struct new_folder {
 	const char *name, *comment;
 	entryId *entryid;
@@ -945,6 +950,8 @@ struct ns:create_folders_response {
 #define TABLETYPE_USERSTORES		9	// UserStore tables
 #define TABLETYPE_MAILBOX			10	// Mailbox Table
 #define TABLETYPE_STATS_SERVERS		11	// Servers table
+#define TABLETYPE_STATS_SOAP		12	// Per-SOAP-method profile
+#define TABLETYPE_STATS_SLOW		13	// Slow request traces
 
 // Flags for struct tableMultiRequest
 #define TABLE_MULTI_CLEAR_RESTRICTION	0x1	// Clear table restriction
@@ -972,6 +979,7 @@ int ns__createFolder(ULONG64 ulSessionId, entryId sParentId, entryId *lpsNewEntr
 int ns__create_folders(ULONG64 session_id, entryId parent_eid, struct new_folder_set batch, struct ns:create_folders_response *response);
 int ns__deleteObjects(ULONG64 ulSessionId, unsigned int ulFlags, struct entryList *aMessages, unsigned int ulSyncId, unsigned int *result);
 int ns__copyObjects(ULONG64 ulSessionId, struct entryList *aMessages, entryId sDestFolderId, unsigned int ulFlags, unsigned int ulSyncId, unsigned int *result);
+int ns__copyMessageForDelivery(ULONG64 ulSessionId, entryId sEntryId, entryId sDestFolderId, struct propTagArray *lpsExclude, unsigned int ulSyncId, struct ns:copyMessageResponse *lpsResponse);
 int ns__emptyFolder(ULONG64 ulSessionId, entryId sEntryId,  unsigned int ulFlags, unsigned int ulSyncId, unsigned int *result);
 int ns__deleteFolder(ULONG64 ulSessionId, entryId sEntryId, unsigned int ulFlags, unsigned int ulSyncId, unsigned int *result);
 int ns__copyFolder(ULONG64 ulSessionId, entryId sEntryId, entryId sDestFolderId, const char *lpszNewFolderName, unsigned int ulFlags, unsigned int ulSyncId, unsigned int *result);
@@ -159,6 +159,8 @@ ECRESULT ECCacheManager::PurgeCache(unsigned int ulFlags)
 {
 	auto start = std::chrono::steady_clock::now();
 
+	if (ulFlags & (PURGE_CACHE_ACL | PURGE_CACHE_OBJECTS | PURGE_CACHE_USEROBJECT | PURGE_CACHE_USERDETAILS))
+		UpdatePermissions();
 	// cache mutex items
 	ulock_rec l_cache(m_hCacheMutex);
 	if (ulFlags & PURGE_CACHE_QUOTA)
@@ -178,6 +180,8 @@ ECRESULT ECCacheManager::PurgeCache(unsigned int ulFlags)
 	if (ulFlags & PURGE_CACHE_STORES)
 		m_StoresCache.ClearCache();
 	l_store.unlock();
+	if (ulFlags & PURGE_CACHE_STORES)
+		m_store_sizes.purge();
 
 	// Cell cache mutex
 	ulock_rec l_cells(m_hCacheCellsMutex);
@@ -232,12 +236,24 @@ ECRESULT ECCacheManager::Update(unsigned int ulType, unsigned int ulObjId)
 		I_DelACLs(ulObjId);
 		I_DelCell(ulObjId);
 		break;
-	case fnevObjectMoved:
+	case fnevObjectMoved: {
+		/*
+		 * Everything below a moved folder or store has new ancestors or
+		 * owners. A moved message does not need a new permission
+		 * generation, since remembered decisions are tied to the parent
+		 * and owner they were made with.
+		 */
+		unsigned int type = 0;
+		bool container = GetObject(ulObjId, nullptr, nullptr, nullptr, &type) != erSuccess ||
+		                 type == MAPI_FOLDER || type == MAPI_STORE;
 		LOG_CACHE_DEBUG("Remove cache cell, objects and store for object %d", ulObjId);
 		I_DelStore(ulObjId);
 		I_DelObject(ulObjId);
 		I_DelCell(ulObjId);
+		if (container)
+			UpdatePermissions();
 		break;
+	}
 	default:
 		//Do nothing
 		LOG_CACHE_DEBUG("Update cache, action type %d, objectid %d", ulType, ulObjId);
@@ -246,6 +262,47 @@ ECRESULT ECCacheManager::Update(unsigned int ulType, unsigned int ulObjId)
 	return erSuccess;
 }
 
+/**
+ * Start a new permission generation.
+ *
+ * @param[in] objid	object whose ACLs changed, or 0 if the change may
+ * 			affect any decision
+ */
+void ECCacheManager::UpdatePermissions(unsigned int objid)
+{
+	scoped_lock lock(m_hPermChangesMutex);
+	auto gen = ++m_ulPermGeneration;
+	if (objid == 0) {
+		m_ulPermResetGen = gen;
+		m_permChanges.clear();
+		return;
+	}
+	m_permChanges.emplace_back(gen, objid);
+	if (m_permChanges.size() > 256)
+		m_permChanges.pop_front();
+}
+
+/**
+ * List the objects whose ACLs changed after generation @since.
+ *
+ * @return false if something other than ACLs changed in the meantime, or
+ * the changes are no longer known; everything must be considered stale then
+ */
+bool ECCacheManager::GetPermissionChanges(uint64_t since,
+    std::vector<unsigned int> &objs)
+{
+	scoped_lock lock(m_hPermChangesMutex);
+	if (since >= m_ulPermGeneration)
+		return true;
+	if (m_ulPermResetGen > since || m_permChanges.empty() ||
+	    m_permChanges.front().first > since + 1)
+		return false;
+	for (const auto &c : m_permChanges)
+		if (c.first > since)
+			objs.emplace_back(c.second);
+	return true;
+}
+
 ECRESULT ECCacheManager::UpdateUser(unsigned int ulUserId)
 {
 	std::string strExternId;
@@ -259,6 +316,8 @@ ECRESULT ECCacheManager::UpdateUser(unsigned int ulUserId)
 	I_DelUserObjectDetails(ulUserId);
 	I_DelQuota(ulUserId, false);
 	I_DelQuota(ulUserId, true);
+	/* Group memberships or admin rights may have changed. */
+	UpdatePermissions();
 	return erSuccess;
 }
 
@@ -1244,6 +1303,11 @@ void ECCacheManager::update_extra_stats(ECStatsCollector &sc)
 	f(m_PropToObjectCache.get_stats());
 	f(m_ObjectToPropCache.get_stats());
 	l_prop.unlock();
+
+	auto st = m_store_sizes.get_stats();
+	sc.setg("cache_storesize_items", "Cache storesize items", st.items);
+	sc.set("cache_storesize_req", "Cache storesize requests", st.req);
+	sc.setg("cache_storesize_hit", "Cache storesize hits", st.hit);
 }
 
 ECRESULT ECCacheManager::GetObjectFlags(unsigned int ulObjId, unsigned int *ulFlags)
@@ -1432,6 +1496,100 @@ ECRESULT ECCacheManager::SetServerDetails(const std::string &strServerId, const
 	return m_ServerDetailsCache.AddCacheItem(strToLower(strServerId), std::move(sEntry));
 }
 
+ECRESULT ECCacheManager::GetStoreSize(ECDatabase *db, unsigned int store,
+    long long *size)
+{
+	auto now = time(nullptr);
+	if (m_store_sizes.get(store, now, size)) {
+		/*
+		 * The cache has committed sizes only. A transaction still
+		 * sees its own changes, as it does in the database.
+		 */
+		auto trans = db->get_trans_hook<store_size_trans>();
+		if (trans != nullptr)
+			*size = trans->view(store, *size);
+		return erSuccess;
+	}
+	/*
+	 * Within a transaction, the database shows the transaction's own
+	 * changes, and may show a snapshot from before what others have
+	 * committed since; such sizes are used, not kept.
+	 */
+	unsigned int gen = 0;
+	bool keep = !db->in_transaction() && m_store_sizes.loading(store, &gen);
+
+	DB_RESULT result;
+	auto er = db->DoSelect("SELECT val_longint FROM properties WHERE tag=" +
+	          stringify(PROP_ID(PR_MESSAGE_SIZE_EXTENDED)) + " AND type=" +
+	          stringify(PROP_TYPE(PR_MESSAGE_SIZE_EXTENDED)) +
+	          " AND hierarchyid=" + stringify(store), &result);
+	if (er != erSuccess)
+		return er;
+	if (result.get_num_rows() != 1) {
+		// This mostly happens when we're creating a new store, so return 0 sized store
+		*size = 0;
+		return erSuccess;
+	}
+	auto row = result.fetch_row();
+	if (row == nullptr || row[0] == nullptr) {
+		ec_log_err("ECCacheManager::GetStoreSize(): row is null");
+		return KCERR_DATABASE_ERROR;
+	}
+	*size = atoll(row[0]);
+	if (keep)
+		m_store_sizes.loaded(store, gen, *size, now);
+	return erSuccess;
+}
+
+void store_size_trans::begin(unsigned int store)
+{
+	if (m_changes.emplace(store, change()).second)
+		m_cache->StoreSizeBegin(store);
+}
+
+void store_size_trans::changed(unsigned int store, bool set, long long size)
+{
+	auto &c = m_changes[store];
+	if (set) {
+		c.set = true;
+		c.size = size;
+	} else {
+		c.size += size;
+	}
+}
+
+long long store_size_trans::view(unsigned int store, long long size) const
+{
+	auto i = m_changes.find(store);
+	if (i == m_changes.cend())
+		return size;
+	return i->second.set ? i->second.size : std::max(size + i->second.size, 0LL);
+}
+
+void store_size_trans::end(bool committed)
+{
+	for (const auto &s : m_changes) {
+		m_cache->StoreSizeEnd(s.first, s.second.set, s.second.size, committed);
+		if (!committed)
+			continue;
+		if (!s.second.set) {
+			auto er = m_cache->UpdateCell(s.first, PR_MESSAGE_SIZE_EXTENDED, s.second.size);
+			if (er != erSuccess)
+				ec_log_debug("Unable to update %d: %s (%x)", s.first, GetMAPIErrorMessage(kcerr_to_mapierr(er)), er);
+			continue;
+		}
+		sObjectTableKey key;
+		struct propVal pv;
+		key.ulObjId = s.first;
+		key.ulOrderId = 0;
+		pv.ulPropTag = PR_MESSAGE_SIZE_EXTENDED;
+		pv.Value.ul = s.second.size;
+		pv.__union = SOAP_UNION_propValData_ul;
+		m_cache->SetCell(&key, PR_MESSAGE_SIZE_EXTENDED, &pv);
+	}
+	m_changes.clear();
+}
+
 ECRESULT ECCacheManager::RemoveIndexData(unsigned int ulObjId)
 {
 	ECsIndexObject	sObjectKeyLower, sObjectKeyUpper;
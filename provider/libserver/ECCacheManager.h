@@ -4,6 +4,8 @@
  */
 #pragma once
 #include <kopano/zcdefs.h>
+#include <atomic>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -11,6 +13,8 @@
 #include "ECDatabaseFactory.h"
 #include "ECDatabaseUtils.h"
 #include "ECGenericObjectTable.h"	// ECListInt
+#include "ECRequestTrace.h"
+#include "ECStoreSize.h"
 #include <kopano/ECConfig.h>
 #include <kopano/ECLogger.h>
 #include "SOAPUtils.h"
@@ -22,6 +26,8 @@
 struct soap;
 
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace KC {
 
@@ -255,6 +261,16 @@ public:
 	ECRESULT GetObjectFlags(unsigned int ulObjId, unsigned int *ulFlags);
 	ECRESULT SetStore(unsigned int ulObjId, unsigned int ulStore, const GUID *, unsigned int ulType);
 	ECRESULT GetServerDetails(const std::string &strServerId, serverdetails_t *lpsDetails);
+	/*
+	 * Store sizes (PR_MESSAGE_SIZE_EXTENDED) for quota checks. Read-through;
+	 * writers go through store_size_trans, which announces a change with
+	 * StoreSizeBegin before the row changes and passes the outcome to
+	 * StoreSizeEnd once the transaction is over, so that no size read in
+	 * between is kept.
+	 */
+	ECRESULT GetStoreSize(ECDatabase *, unsigned int store, long long *size);
+	void StoreSizeBegin(unsigned int store) { m_store_sizes.begin(store); }
+	void StoreSizeEnd(unsigned int store, bool set, long long size, bool committed) { m_store_sizes.end(store, set, size, committed); }
 	ECRESULT SetServerDetails(const std::string &strServerId, const serverdetails_t &sDetails);
 
 	// Cache user table
@@ -274,6 +290,16 @@ public:
 
 	ECRESULT Update(unsigned int ulType, unsigned int ulObjId);
 	ECRESULT UpdateUser(unsigned int ulUserId);
+	/*
+	 * Permission decisions that sessions have remembered (see
+	 * ECSecurity::CheckPermission) are only valid while the generation
+	 * stays the same. It moves on with changes to ACLs, users, groups and
+	 * the folder hierarchy. For ACL changes, the object is recorded, so
+	 * that sessions can catch up by dropping only what depended on it.
+	 */
+	uint64_t GetPermissionGeneration() const { return m_ulPermGeneration; }
+	void UpdatePermissions(unsigned int objid = 0);
+	bool GetPermissionChanges(uint64_t since, std::vector<unsigned int> &objs);
 	ECRESULT GetEntryIdFromObject(unsigned int ulObjId, struct soap *soap, unsigned int ulFlags, entryId* lpEntrId);
 	ECRESULT GetEntryIdFromObject(unsigned int ulObjId, struct soap *soap, unsigned int ulFlags, entryId** lppEntryId);
 	ECRESULT GetObjectFromEntryId(const entryId *id, unsigned int *obj);
@@ -342,11 +368,17 @@ private:
 	ECRESULT I_AddIndexData(const ECsIndexObject &, const ECsIndexProp &);
 
 	ECDatabaseFactory*	m_lpDatabaseFactory;
-	std::recursive_mutex m_hCacheMutex; /* User, ACL, server cache */
-	std::recursive_mutex m_hCacheStoreMutex;
-	std::recursive_mutex m_hCacheObjectMutex;
-	std::recursive_mutex m_hCacheCellsMutex; /* Cell cache */
-	std::recursive_mutex m_hCacheIndPropMutex; /* Indexed properties cache */
+	/*
+	 * Waits for these count as lock wait in slow request traces. The
+	 * lock typedefs hide the KC:: ones in all of ECCacheManager.
+	 */
+	typedef std::lock_guard<traced_recursive_mutex> scoped_rlock;
+	typedef std::unique_lock<traced_recursive_mutex> ulock_rec;
+	traced_recursive_mutex m_hCacheMutex; /* User, ACL, server cache */
+	traced_recursive_mutex m_hCacheStoreMutex;
+	traced_recursive_mutex m_hCacheObjectMutex;
+	traced_recursive_mutex m_hCacheCellsMutex; /* Cell cache */
+	traced_recursive_mutex m_hCacheIndPropMutex; /* Indexed properties cache */
 	// Quota cache, to reduce the impact of the user plugin
 	// m_mapQuota contains user and company cache, except when it's the company user default quota
 	// m_mapQuotaUserDefault contains company user default quota
@@ -374,6 +406,36 @@ private:
 	// Properties from kopano-search
 	std::set<unsigned int> 		m_setExcludedIndexProperties;
 	std::mutex m_hExcludedIndexPropertiesMutex;
+	std::atomic<uint64_t> m_ulPermGeneration{0};
+	uint64_t m_ulPermResetGen = 0; /* last change not tied to one object */
+	std::deque<std::pair<uint64_t, unsigned int>> m_permChanges;
+	std::mutex m_hPermChangesMutex;
+	store_size_cache m_store_sizes;
+};
+
+/*
+ * The store size changes of one transaction. The cache hears of them when
+ * the transaction is over; until then, they are added to the committed
+ * sizes that the transaction reads from the cache.
+ */
+class store_size_trans final : public ECDatabase::trans_hook {
+	public:
+	store_size_trans(ECCacheManager *c) : m_cache(c) {}
+	/* Before the size of @store is changed */
+	void begin(unsigned int store);
+	/* After the size of @store was set to @size, or had it added */
+	void changed(unsigned int store, bool set, long long size);
+	/* The committed @size of @store as this transaction sees it */
+	long long view(unsigned int store, long long size) const;
+	virtual void end(bool committed) override;
+
+	private:
+	struct change {
+		bool set = false; /* @size replaces the store size, rather than adds to it */
+		long long size = 0;
+	};
+	ECCacheManager *m_cache;
+	std::map<unsigned int, change> m_changes;
 };
 
 } /* namespace */
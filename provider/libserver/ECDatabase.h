@@ -7,6 +7,9 @@
 #include <kopano/database.hpp>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
 
 namespace KC {
 
@@ -39,6 +42,34 @@ public:
 	ECRESULT UpdateDatabase(bool force_update, std::string &report);
 	const std::string &get_dbname() const { return m_dbname; }
 
+	bool in_transaction() const { return m_in_trans; }
+
+	/* Queries issued and rows selected by the current thread so far */
+	static thread_local uint64_t tls_queries, tls_rows;
+
+	/*
+	 * Work to do once the open transaction is over, such as updating
+	 * caches with what it changed. Hooks are called after COMMIT (with
+	 * whether it succeeded) or ROLLBACK, and then dropped.
+	 */
+	class trans_hook {
+		public:
+		virtual ~trans_hook() = default;
+		virtual void end(bool committed) = 0;
+	};
+	/* Only while in_transaction() */
+	void add_trans_hook(std::unique_ptr<trans_hook> &&h) { m_trans_hooks.emplace_back(std::move(h)); }
+	/* The hook of type @T of the open transaction, if one was added */
+	template<typename T> T *get_trans_hook() const
+	{
+		for (const auto &h : m_trans_hooks) {
+			auto t = dynamic_cast<T *>(h.get());
+			if (t != nullptr)
+				return t;
+		}
+		return nullptr;
+	}
+
 	private:
 	ECRESULT InitializeDBStateInner(void);
 	virtual const struct sSQLDatabase_t *GetDatabaseDefs() override;
@@ -46,11 +77,13 @@ public:
 	ECRESULT GetFirstUpdate(unsigned int *lpulDatabaseRevision);
 	ECRESULT UpdateDatabaseVersion(unsigned int ulDatabaseRevision);
 	virtual ECRESULT Query(const std::string &q) override;
+	void end_trans_hooks(bool committed);
 
 	std::string error, m_dbname;
-	bool m_bForceUpdate = false, m_bFirstResult = false;
+	bool m_bForceUpdate = false, m_bFirstResult = false, m_in_trans = false;
 	std::shared_ptr<ECConfig> m_lpConfig;
 	std::shared_ptr<ECStatsCollector> m_stats;
+	std::vector<std::unique_ptr<trans_hook>> m_trans_hooks;
 #ifdef KNOB144
 	unsigned int m_ulTransactionState = 0;
 #endif
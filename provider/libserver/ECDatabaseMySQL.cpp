@@ -4,6 +4,7 @@
  */
 #include <kopano/zcdefs.h>
 #include <kopano/platform.h>
+#include <chrono>
 #include <iostream>
 #include <list>
 #include <memory>
@@ -22,6 +23,7 @@
 #include <kopano/ecversion.h>
 #include <mapidefs.h>
 #include "ECDatabase.h"
+#include "ECRequestTrace.h"
 #include "SOAPUtils.h"
 #include "ECSearchFolders.h"
 #include "StatsClient.h"
@@ -54,6 +56,7 @@ class zcp_versiontuple final {
 };
 
 bool searchfolder_restart_required; //HACK for rebuild the searchfolders with an upgrade
+thread_local uint64_t ECDatabase::tls_queries, ECDatabase::tls_rows;
 
 static ECRESULT InsertServerGUID(ECDatabase *lpDatabase)
 {
@@ -457,7 +460,15 @@ exit:
 ECRESULT ECDatabase::Query(const std::string &strQuery)
 {
 	ECRESULT er = erSuccess;
+	/* Not something a reconnect would fix */
+	if (stream_busy(strQuery))
+		return KCERR_DATABASE_ERROR;
+	auto tstart = std::chrono::steady_clock::now();
 	int err = KDatabase::Query(strQuery);
+	++tls_queries;
+	auto dur = std::chrono::steady_clock::now() - tstart;
+	m_stats->sample(SCN_DATABASE_LATENCY, std::chrono::duration_cast<std::chrono::microseconds>(dur).count());
+	ECRequestTracer::add_query(strQuery, dur);
 
 	if(err && (mysql_errno(&m_lpMySQL) == CR_SERVER_LOST || mysql_errno(&m_lpMySQL) == CR_SERVER_GONE_ERROR)) {
 		ec_log_warn("SQL [%08lu] info: Try to reconnect", m_lpMySQL.thread_id);
@@ -483,6 +494,11 @@ ECRESULT ECDatabase::DoSelect(const std::string &strQuery,
 {
 	ECRESULT er = KDatabase::DoSelect(strQuery, lppResult, fStreamResult);
 	m_stats->inc(SCN_DATABASE_SELECTS);
+	/* Streamed results do not know their size yet and are not counted. */
+	if (er == erSuccess && lppResult != nullptr && !fStreamResult) {
+		tls_rows += lppResult->get_num_rows();
+		ECRequestTracer::set_rows(lppResult->get_num_rows());
+	}
 	if (er != erSuccess) {
 		m_stats->inc(SCN_DATABASE_FAILED_SELECTS);
 		m_stats->SetTime(SCN_DATABASE_LAST_FAILED, time(nullptr));
@@ -577,37 +593,52 @@ ECRESULT ECDatabase::FinalizeMulti(void)
 ECRESULT ECDatabase::DoUpdate(const std::string &strQuery,
     unsigned int *lpulAffectedRows)
 {
-	auto er = KDatabase::DoUpdate(strQuery, lpulAffectedRows);
+	unsigned int aff = 0;
+	auto er = KDatabase::DoUpdate(strQuery, &aff);
 	m_stats->inc(SCN_DATABASE_UPDATES);
 	if (er != erSuccess) {
 		m_stats->inc(SCN_DATABASE_FAILED_UPDATES);
 		m_stats->SetTime(SCN_DATABASE_LAST_FAILED, time(nullptr));
+		return er;
 	}
-	return er;
+	ECRequestTracer::set_rows(aff);
+	if (lpulAffectedRows != nullptr)
+		*lpulAffectedRows = aff;
+	return erSuccess;
 }
 
 ECRESULT ECDatabase::DoInsert(const std::string &strQuery,
     unsigned int *lpulInsertId, unsigned int *lpulAffectedRows)
 {
-	auto er = KDatabase::DoInsert(strQuery, lpulInsertId, lpulAffectedRows);
+	unsigned int aff = 0;
+	auto er = KDatabase::DoInsert(strQuery, lpulInsertId, &aff);
 	m_stats->inc(SCN_DATABASE_INSERTS);
 	if (er != erSuccess) {
 		m_stats->inc(SCN_DATABASE_FAILED_INSERTS);
 		m_stats->SetTime(SCN_DATABASE_LAST_FAILED, time(nullptr));
+		return er;
 	}
-	return er;
+	ECRequestTracer::set_rows(aff);
+	if (lpulAffectedRows != nullptr)
+		*lpulAffectedRows = aff;
+	return erSuccess;
 }
 
 ECRESULT ECDatabase::DoDelete(const std::string &strQuery,
     unsigned int *lpulAffectedRows)
 {
-	auto er = KDatabase::DoDelete(strQuery, lpulAffectedRows);
+	unsigned int aff = 0;
+	auto er = KDatabase::DoDelete(strQuery, &aff);
 	m_stats->inc(SCN_DATABASE_DELETES);
 	if (er != erSuccess) {
 		m_stats->inc(SCN_DATABASE_FAILED_DELETES);
 		m_stats->SetTime(SCN_DATABASE_LAST_FAILED, time(nullptr));
+		return er;
 	}
-	return er;
+	ECRequestTracer::set_rows(aff);
+	if (lpulAffectedRows != nullptr)
+		*lpulAffectedRows = aff;
+	return erSuccess;
 }
 
 /*
@@ -630,7 +661,10 @@ bool ECDatabase::SuppressLockErrorLogging(bool bSuppress)
 
 kd_trans ECDatabase::Begin(ECRESULT &res)
 {
-	auto dtx = KDatabase::Begin(res);
+	if (Query("BEGIN") != 0)
+		return kd_trans();
+	m_in_trans = true;
+	kd_trans dtx(*this, res);
 #if defined(KNOB144) && DEBUG_TRANSACTION
 	ec_log_debug("%08X: BEGIN", &m_lpMySQL);
 	if(m_ulTransactionState != 0) {
@@ -642,9 +676,20 @@ kd_trans ECDatabase::Begin(ECRESULT &res)
 	return dtx;
 }
 
+void ECDatabase::end_trans_hooks(bool committed)
+{
+	/* A hook may use this connection for a transaction of its own */
+	auto hooks = std::move(m_trans_hooks);
+	m_trans_hooks.clear();
+	for (const auto &h : hooks)
+		h->end(committed);
+}
+
 ECRESULT ECDatabase::Commit(void)
 {
 	auto er = KDatabase::Commit();
+	m_in_trans = false;
+	end_trans_hooks(er == erSuccess);
 #if defined(KNOB144) && DEBUG_TRANSACTION
 	ec_log_debug("%08X: COMMIT", &m_lpMySQL);
 	if(m_ulTransactionState != 1) {
@@ -659,6 +704,8 @@ ECRESULT ECDatabase::Commit(void)
 ECRESULT ECDatabase::Rollback(void)
 {
 	auto er = KDatabase::Rollback();
+	m_in_trans = false;
+	end_trans_hooks(false);
 #if defined(KNOB144) && DEBUG_TRANSACTION
 	ec_log_debug("%08X: ROLLBACK", &m_lpMySQL);
 	if(m_ulTransactionState != 1) {
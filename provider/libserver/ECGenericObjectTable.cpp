@@ -548,6 +548,7 @@ ECRESULT ECGenericObjectTable::SetSortOrder(const struct sortOrderArray *lpsSort
 
 	m_ulCategories = ulCategories;
 	m_ulExpanded = ulExpanded;
+	DetachSharedView();
 
 	// Save the sort order requested
 	soap_del_PointerTosortOrderArray(&lpsSortOrderArray);
@@ -694,6 +695,7 @@ ECRESULT ECGenericObjectTable::Restrict(struct restrictTable *rt)
 	// Copy the restriction so we can remember it
 	soap_del_PointerTorestrictTable(&lpsRestrict);
 	lpsRestrict = nullptr;
+	DetachSharedView();
 	if (rt != nullptr) {
 		er = CopyRestrictTable(nullptr, rt, &lpsRestrict);
 		if(er != erSuccess)
@@ -730,9 +732,9 @@ ECRESULT ECGenericObjectTable::Restrict(struct restrictTable *rt)
 ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int *lpulLoaded, unsigned int ulFlags, bool bLoad, bool bOverride, struct restrictTable *lpOverrideRestrict)
 {
 	ECRESULT		er = erSuccess;
-	gsoap_size_t ulFirstCol = 0, n = 0;
+	gsoap_size_t ulFirstCol = 0, n = 0, ulSortCols = 0;
 	unsigned int	ulLoaded = 0;
-	bool bExist, fMatch = true, fHidden = false;
+	bool bExist, fMatch = true, fHidden = false, bulk_sort = false;
 	ECObjectTableList sQueryRows;
 	struct propTagArray sPropTagArray{};
 	struct rowSet		*lpRowSet = NULL;
@@ -740,6 +742,11 @@ ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int
 	struct restrictTable *rt = nullptr;
 	sObjectTableKey					sRowItem;
 	ECCategory		*lpCategory = NULL;
+	std::shared_ptr<ECSharedView> view;
+	uint64_t view_gen = 0;
+	ECObjectTableList lstUnknown;
+	std::vector<std::pair<sObjectTableKey, ECSharedView::row>> known;
+	std::vector<std::pair<unsigned int, ECSharedView::row>> learnt;
 	ulock_rec biglock(m_hLock);
 
 	if (lpRows->empty()) {
@@ -749,6 +756,37 @@ ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int
 		goto exit;
 	}
 
+	/*
+	 * Rows that another session has already sorted and restricted the
+	 * same way are taken from the shared view. The others are looked at
+	 * below, and put in the view for the next session, unless the folder
+	 * changed meanwhile. The view is locked only to copy rows in or out.
+	 */
+	if (!bOverride && m_ulCategories == 0 && !IsMVSet())
+		view = GetSharedView();
+	if (view != nullptr) {
+		std::unique_lock<std::mutex> l_view(view->m_lock);
+		for (const auto &row : *lpRows) {
+			auto iter = row.ulOrderId == 0 ? view->m_rows.find(row.ulObjId) : view->m_rows.end();
+			if (iter == view->m_rows.end())
+				lstUnknown.emplace_back(row);
+			else
+				known.emplace_back(row, iter->second);
+		}
+		view_gen = view->m_gen;
+		l_view.unlock();
+		for (auto &row : known) {
+			if (!row.second.match) {
+				DeleteRow(row.first, ulFlags);
+				continue;
+			}
+			AddRow(row.first, std::move(row.second.sortkey), ulFlags);
+			++ulLoaded;
+		}
+		lpSession->GetSessionManager()->GetSharedViews()->m_rows_shared += known.size();
+		lpRows = &lstUnknown;
+	}
+
 	rt = bOverride ? lpOverrideRestrict : lpsRestrict;
 	// We want all columns of the sort data, plus all the columns needed for restriction, plus the ID of the row
 	if (lpsSortOrderArray != nullptr)
@@ -790,6 +828,11 @@ ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int
 	}
 
 	sPropTagArray.__size = n;
+	ulSortCols = lpsSortOrderArray != nullptr ? lpsSortOrderArray->__size : 0;
+	bulk_sort = rt == nullptr && m_ulCategories == 0 && ulSortCols > 0;
+	for (gsoap_size_t i = 0; bulk_sort && i < ulSortCols; ++i)
+		if (ISMINMAX(lpsSortOrderArray->__ptr[i].ulOrder))
+			bulk_sort = false;
 
 	for (auto iterRows = lpRows->cbegin(); iterRows != lpRows->cend(); ) {
 		sQueryRows.clear();
@@ -811,6 +854,27 @@ ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int
 				goto exit;
 		}
 
+		/*
+		 * Without restriction every row goes in, so make the string sort
+		 * keys of the whole batch in one go. Only when the columns are
+		 * not reordered for min/max categories, see GetSortKey.
+		 */
+		std::vector<std::string> presort;
+		if (bulk_sort) {
+			std::vector<const char *> strs(lpRowSet->__size * ulSortCols);
+			for (gsoap_size_t i = 0; i < lpRowSet->__size; ++i) {
+				if (lpRowSet->__ptr[i].__size < ulFirstCol + ulSortCols)
+					continue;
+				for (gsoap_size_t j = 0; j < ulSortCols; ++j) {
+					const auto &pv = lpRowSet->__ptr[i].__ptr[ulFirstCol+j];
+					auto type = PROP_TYPE(pv.ulPropTag);
+					if (type == PT_STRING8 || type == PT_UNICODE)
+						strs[i*ulSortCols+j] = pv.Value.lpszA;
+				}
+			}
+			presort = createSortKeysFromUTF8(strs, 255, m_locale);
+		}
+
 		// Send all this data to the internal key table
 		auto cache = lpSession->GetSessionManager()->GetCacheManager();
 		for (gsoap_size_t i = 0; i < lpRowSet->__size; ++i) {
@@ -826,6 +890,8 @@ ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int
 			if (rt != nullptr) {
 				MatchRowRestrict(cache, &lpRowSet->__ptr[i], rt, &sub_results, m_locale, &fMatch);
 				if (!fMatch) {
+					if (view != nullptr)
+						learnt.emplace_back(sRowItem.ulObjId, ECSharedView::row());
 					// this row isn't in the table, as it does not match the restrict criteria. Remove it as if it had
 					// been deleted if it was already in the table.
 					DeleteRow(sRowItem, ulFlags);
@@ -841,7 +907,23 @@ ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int
 			}
 
 			// Put the row into the key table and send notification if required
-			AddRow(sRowItem, lpRowSet->__ptr[i].__ptr+ulFirstCol, lpsSortOrderArray->__size, ulFlags, fHidden, lpCategory);
+			auto rowsort = presort.empty() ? nullptr : &presort[i*ulSortCols];
+			if (view != nullptr) {
+				std::vector<ECSortCol> sortkey;
+				if (GetSortKey(nullptr, &sRowItem, lpRowSet->__ptr[i].__ptr + ulFirstCol, lpsSortOrderArray->__size, sortkey, rowsort) == erSuccess) {
+					ECSharedView::row shrow;
+					shrow.match = true;
+					shrow.sortkey = sortkey;
+					learnt.emplace_back(sRowItem.ulObjId, std::move(shrow));
+					AddRow(sRowItem, std::move(sortkey), ulFlags);
+				}
+			} else if (rowsort != nullptr) {
+				std::vector<ECSortCol> sortkey;
+				if (GetSortKey(nullptr, &sRowItem, lpRowSet->__ptr[i].__ptr + ulFirstCol, lpsSortOrderArray->__size, sortkey, rowsort) == erSuccess)
+					AddRow(sRowItem, std::move(sortkey), ulFlags);
+			} else {
+				AddRow(sRowItem, lpRowSet->__ptr[i].__ptr+ulFirstCol, lpsSortOrderArray->__size, ulFlags, fHidden, lpCategory);
+			}
 			// Loaded one row
 			++ulLoaded;
 		}
@@ -850,6 +932,12 @@ ECRESULT ECGenericObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int
 		lpRowSet = NULL;
 	}
 
+	if (view != nullptr && !learnt.empty()) {
+		std::lock_guard<std::mutex> l_view(view->m_lock);
+		if (view->m_gen == view_gen)
+			for (auto &row : learnt)
+				view->m_rows[row.first] = std::move(row.second);
+	}
 	if(lpulLoaded)
 		*lpulLoaded = ulLoaded;
 exit:
@@ -874,6 +962,21 @@ ECRESULT ECGenericObjectTable::AddRow(sObjectTableKey sRowItem, struct propVal *
 	return er;
 }
 
+ECRESULT ECGenericObjectTable::AddRow(const sObjectTableKey &sRowItem,
+    std::vector<ECSortCol> &&sortkey, unsigned int ulFlags)
+{
+	auto ulAction = ECKeyTable::TABLE_ROW_ADD;
+	sObjectTableKey sPrevRow;
+
+	auto er = lpKeyTable->UpdateRow(ECKeyTable::TABLE_ROW_ADD, &sRowItem,
+	          std::move(sortkey), &sPrevRow, false, &ulAction);
+	if (er != erSuccess)
+		return er;
+	if (ulAction != 0 && (ulFlags & OBJECTTABLE_NOTIFY))
+		er = AddTableNotif(ulAction, sRowItem, &sPrevRow);
+	return er;
+}
+
 // Actually remove a row from the table
 ECRESULT ECGenericObjectTable::DeleteRow(sObjectTableKey sRow, unsigned int ulFlags)
 {
@@ -1912,6 +2015,12 @@ void ECGenericObjectTable::SetTableId(unsigned int ulTableId)
 	m_ulTableId = ulTableId;
 }
 
+void ECGenericObjectTable::DetachSharedView()
+{
+	m_lpSharedView.reset();
+	m_bSharedViewChecked = false;
+}
+
 ECRESULT ECGenericObjectTable::Clear()
 {
 	scoped_rlock biglock(m_hLock);
@@ -2236,6 +2345,19 @@ ECRESULT ECGenericObjectTable::UpdateCategoryMinMax(sObjectTableKey &sKey,
  * @return result
  */
 ECRESULT ECGenericObjectTable::UpdateKeyTableRow(ECCategory *lpCategory, sObjectTableKey *lpsRowKey, struct propVal *lpProps, unsigned int cValues, bool fHidden, sObjectTableKey *lpsPrevRow, ECKeyTable::UpdateType *lpulAction)
+{
+	std::vector<ECSortCol> zort;
+	auto er = GetSortKey(lpCategory, lpsRowKey, lpProps, cValues, zort);
+	if (er != erSuccess)
+		return er;
+	// Update row
+	return lpKeyTable->UpdateRow(ECKeyTable::TABLE_ROW_ADD, lpsRowKey,
+	       std::move(zort), lpsPrevRow, fHidden, lpulAction);
+}
+
+ECRESULT ECGenericObjectTable::GetSortKey(ECCategory *lpCategory,
+    const sObjectTableKey *lpsRowKey, struct propVal *lpProps,
+    unsigned int cValues, std::vector<ECSortCol> &zort, std::string *presort)
 {
 	ECRESULT er = erSuccess;
     struct propVal sProp;
@@ -2265,7 +2387,7 @@ ECRESULT ECGenericObjectTable::UpdateKeyTableRow(ECCategory *lpCategory, sObject
     }
 
 	auto lpOrderedProps = std::make_unique<propVal[]>(cValues);
-	std::vector<ECSortCol> zort(cValues);
+	zort.assign(cValues, ECSortCol());
 
 	for (unsigned int i = 0; i < cValues; ++i) {
 		if (ISMINMAX(soa->__ptr[i].ulOrder)) {
@@ -2291,17 +2413,17 @@ ECRESULT ECGenericObjectTable::UpdateKeyTableRow(ECCategory *lpCategory, sObject
 
     // Build binary sort keys from updated data
     for (int i = 0; i < n; ++i) {
-		if (GetBinarySortKey(&lpOrderedProps[i], zort[i]) != erSuccess)
+		auto type = PROP_TYPE(lpOrderedProps[i].ulPropTag);
+		if (presort != nullptr && lpOrderedProps[i].Value.lpszA != nullptr &&
+		    (type == PT_STRING8 || type == PT_UNICODE))
+			zort[i].key = std::move(presort[i]);
+		else if (GetBinarySortKey(&lpOrderedProps[i], zort[i]) != erSuccess)
 			zort[i].isnull = true;
 		if (GetSortFlags(lpOrderedProps[i].ulPropTag, &zort[i].flags) != erSuccess)
 			zort[i].flags = 0;
 		if (soa->__ptr[i].ulOrder == EC_TABLE_SORT_DESCEND)
 			zort[i].flags |= TABLEROW_FLAG_DESC;
     }
-
-    // Update row
-	er = lpKeyTable->UpdateRow(ECKeyTable::TABLE_ROW_ADD, lpsRowKey,
-	     std::move(zort), lpsPrevRow, fHidden, lpulAction);
 exit:
 	if (lpOrderedProps != nullptr)
 		for (unsigned int i = 0; i < cValues; ++i)
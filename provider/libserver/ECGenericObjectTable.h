@@ -9,6 +9,8 @@
 #include "soapH.h"
 #include <list>
 #include <map>
+#include <memory>
+#include <vector>
 #include "ECSubRestriction.h"
 #include <kopano/ECKeyTable.h>
 #include "ECDatabase.h"
@@ -33,6 +35,7 @@ typedef std::list<unsigned int>::const_iterator ECListIntIterator;
 
 class ECSession;
 class ECCacheManager;
+class ECSharedView;
 
 typedef std::map<ECTableRow, sObjectTableKey> ECSortedCategoryMap;
 
@@ -149,12 +152,16 @@ public:
 protected:
 	// Add an actual row to the table, and send a notification if required. If you add an existing row, the row is modified and the notification is sent as a modification.
 	ECRESULT AddRow(sObjectTableKey sRowItem, struct propVal *lpProps, unsigned int cProps, unsigned int ulFlags, bool fHidden, ECCategory *lpCategory);
+	// Same, for a row of which the sort key is already known
+	ECRESULT AddRow(const sObjectTableKey &, std::vector<ECSortCol> &&sortkey, unsigned int ulFlags);
 	// Remove an actual row from the table, and send a notification if required. You may try to delete non-existing rows, in which case nothing happens
 	ECRESULT 	DeleteRow(sObjectTableKey sRow, unsigned int ulFlags);
 	// Send a notification by getting row data and adding the notification
 	ECRESULT 	AddTableNotif(ECKeyTable::UpdateType, sObjectTableKey sRowItem, sObjectTableKey *lpsPrevRow);
 	// Add data to key table
 	ECRESULT 	UpdateKeyTableRow(ECCategory *lpCategory, sObjectTableKey *lpsRowKey, struct propVal *lpProps, unsigned int cValues, bool fHidden, sObjectTableKey *sPrevRow, ECKeyTable::UpdateType *lpulAction);
+	// Build the key table sort key of a row; @presort: string keys per column, see AddRowKey
+	ECRESULT GetSortKey(ECCategory *, const sObjectTableKey *, struct propVal *props, unsigned int cValues, std::vector<ECSortCol> &, std::string *presort = nullptr);
 	// Update min/max field for category
 	ECRESULT 	UpdateCategoryMinMax(sObjectTableKey& lpKey, ECCategory *lpCategory, size_t i, struct propVal *lpProps, size_t cProps, bool *lpfModified);
 
@@ -165,6 +172,9 @@ protected:
 	virtual ECRESULT ReloadTable(enumReloadType eType);
 	virtual ECRESULT	Load();
 	virtual ECRESULT CheckPermissions(unsigned int objid) { return hrSuccess; } /* normally overridden by subclass */
+	/* The view shared with other sessions this table takes its rows from, if any */
+	virtual std::shared_ptr<ECSharedView> GetSharedView() { return nullptr; }
+	void DetachSharedView();
 	const ECLocale &GetLocale() const { return m_locale; }
 
 	// Constants
@@ -196,6 +206,9 @@ protected:
 	unsigned int m_ulCategory = 1, m_ulCategories = 0, m_ulExpanded = 0;
 	bool m_bPopulated = false;
 	ECLocale					m_locale;
+	/* Set by GetSharedView; reset when the sort order or restriction changes */
+	std::shared_ptr<ECSharedView> m_lpSharedView;
+	bool m_bSharedViewChecked = false;
 };
 
 } /* namespace */
@@ -964,7 +964,7 @@ ECRESULT ECGetContentChangesHelper::GetSyncedMessages(unsigned int ulSyncId, uns
 				"ON m.sourcekey=c.sourcekey AND m.parentsourcekey=c.parentsourcekey AND c.id > " + stringify(ulChangeId) + " AND c.sourcesync != " + stringify(ulSyncId) + " "
 		"WHERE sync_id=" + stringify(ulSyncId) + " AND change_id=" + stringify(ulChangeId);
 	assert(m_lpDatabase != NULL);
-	auto er = m_lpDatabase->DoSelect(strQuery, &lpDBResult);
+	auto er = m_lpDatabase->DoSelect(strQuery, &lpDBResult, true);
 	if (er != erSuccess)
 		return er;
 
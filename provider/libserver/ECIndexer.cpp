@@ -361,6 +361,7 @@ ECRESULT GetIndexerResults(ECDatabase *lpDatabase, ECConfig *lpConfig,
 	llelapsedtime = std::chrono::duration_cast<std::chrono::microseconds>(decltype(tstart)::clock::now() - tstart).count();
 	g_lpSessionManager->m_stats->Max(SCN_INDEXER_SEARCH_MAX, llelapsedtime);
 	g_lpSessionManager->m_stats->avg(SCN_INDEXER_SEARCH_AVG, llelapsedtime);
+	g_lpSessionManager->m_stats->sample(SCN_INDEXER_LATENCY, llelapsedtime);
 
 	if (er != erSuccess) {
 		g_lpSessionManager->m_stats->inc(SCN_INDEXER_SEARCH_ERRORS);
@@ -5,8 +5,9 @@
 #pragma once
 #include <kopano/zcdefs.h>
 #include <kopano/kcodes.h>
-#include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <pthread.h>
 
 namespace KC {
@@ -36,16 +37,31 @@ private:
 class ECLockManager final : public std::enable_shared_from_this<ECLockManager> {
 public:
 	static ECLockManagerPtr Create();
+	/*
+	 * Does not wait: if another session holds the lock, this returns
+	 * KCERR_NO_ACCESS right away (lockObject passes it on to the client as
+	 * KCERR_SUBMITTED), and it is up to the caller to try again.
+	 */
 	ECRESULT LockObject(unsigned int ulObjId, ECSESSIONID sessionId, ECObjectLock *lpOjbectLock);
 	ECRESULT UnlockObject(unsigned int ulObjId, ECSESSIONID sessionId);
 	bool IsLocked(unsigned int ulObjId, ECSESSIONID *lpSessionId);
 
 private:
 	ECLockManager(void) = default;
-	// Map object ids to session IDs.
-	typedef std::map<unsigned int, ECSESSIONID>	LockMap;
-	KC::shared_mutex m_hRwLock;
-	LockMap				m_mapLocks;
+
+	/*
+	 * The locks are spread over shards by object id, so that sessions
+	 * (un)locking or checking different objects do not contend.
+	 */
+	struct shard {
+		std::mutex lock;
+		// Map object ids to session IDs.
+		std::unordered_map<unsigned int, ECSESSIONID> locks;
+	};
+
+	static constexpr unsigned int LOCK_SHARDS = 16;
+	shard &get_shard(unsigned int id) { return m_shards[id % LOCK_SHARDS]; }
+	shard m_shards[LOCK_SHARDS];
 };
 
 } /* namespace */
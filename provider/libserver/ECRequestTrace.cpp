@@ -0,0 +1,150 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#include <kopano/platform.h>
+#include <memory>
+#include <utility>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <kopano/ECConfig.h>
+#include <kopano/ECLogger.h>
+#include <kopano/fileutil.hpp>
+#include <kopano/rqstat.hpp>
+#include <kopano/stringutil.h>
+#include <ECCache.h>
+#include "ECRequestTrace.h"
+
+using namespace std::chrono;
+
+namespace KC {
+
+/* Limits on what a single trace keeps of its queries */
+static constexpr size_t TRACE_MAX_QUERIES = 256, TRACE_MAX_QUERY_LEN = 1024;
+
+thread_local request_trace *ECRequestTracer::tls_trace;
+static thread_local request_trace t_trace;
+static thread_local steady_clock::time_point t_start;
+static thread_local ECCacheBase::size_type t_lookups, t_hits;
+static thread_local bool t_last_kept;
+
+void ECRequestTracer::configure(ECConfig *cfg)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	m_ring_size = atoui(cfg->GetSetting("slow_request_traces"));
+	while (m_ring.size() > m_ring_size)
+		m_ring.pop_front();
+	m_logfile = cfg->GetSetting("slow_request_log");
+	m_threshold = atoui(cfg->GetSetting("slow_request_threshold"));
+}
+
+void ECRequestTracer::begin(const char *func, ECSESSIONID session)
+{
+	if (m_threshold.load(std::memory_order_relaxed) == 0) {
+		tls_trace = nullptr;
+		return;
+	}
+	/* clear() rather than a new object, to keep the vector's buffer */
+	t_trace.queries.clear();
+	t_trace.start = time(nullptr);
+	t_trace.func = func;
+	t_trace.user.clear();
+	t_trace.session = session;
+	t_trace.obj_id = t_trace.table_id = t_trace.queries_dropped = 0;
+	t_trace.wall = t_trace.sql_time = t_trace.lock_wait = 0;
+	t_start = steady_clock::now();
+	t_lookups = ECCacheBase::tls_lookups;
+	t_hits = ECCacheBase::tls_hits;
+	t_last_kept = false;
+	tls_trace = &t_trace;
+}
+
+void ECRequestTracer::end(const request_stat &st)
+{
+	auto tr = tls_trace;
+	if (tr == nullptr)
+		return;
+	tls_trace = nullptr;
+	tr->wall = duration_cast<microseconds>(steady_clock::now() - t_start).count();
+	auto threshold = m_threshold.load(std::memory_order_relaxed);
+	if (threshold == 0 || tr->wall < threshold * 1000ULL)
+		return;
+	tr->user = st.user;
+	tr->cache_lookups = ECCacheBase::tls_lookups - t_lookups;
+	tr->cache_hits = ECCacheBase::tls_hits - t_hits;
+
+	std::lock_guard<std::mutex> lk(m_lock);
+	if (!m_logfile.empty())
+		write_log(*tr);
+	if (m_ring_size == 0)
+		return;
+	if (m_ring.size() >= m_ring_size)
+		m_ring.pop_front();
+	m_ring.emplace_back(std::move(*tr));
+}
+
+std::vector<request_trace> ECRequestTracer::traces() const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	return {m_ring.cbegin(), m_ring.cend()};
+}
+
+void ECRequestTracer::add_query(const std::string &query,
+    steady_clock::duration dur)
+{
+	auto tr = tls_trace;
+	if (tr == nullptr)
+		return;
+	auto usec = duration_cast<microseconds>(dur).count();
+	tr->sql_time += usec;
+	t_last_kept = tr->queries.size() < TRACE_MAX_QUERIES;
+	if (!t_last_kept) {
+		++tr->queries_dropped;
+		return;
+	}
+	trace_query q;
+	q.query = query.substr(0, TRACE_MAX_QUERY_LEN);
+	q.usec = usec;
+	tr->queries.emplace_back(std::move(q));
+}
+
+void ECRequestTracer::set_rows(uint64_t rows)
+{
+	if (tls_trace != nullptr && t_last_kept)
+		tls_trace->queries.back().rows = rows;
+}
+
+void ECRequestTracer::add_lock_wait(steady_clock::duration dur)
+{
+	if (tls_trace != nullptr)
+		tls_trace->lock_wait += duration_cast<microseconds>(dur).count();
+}
+
+/* Appends @tr to the slow request log. Called with m_lock held. */
+void ECRequestTracer::write_log(const request_trace &tr)
+{
+	std::unique_ptr<FILE, file_deleter> fp(fopen(m_logfile.c_str(), "a"));
+	if (fp == nullptr) {
+		ec_log_err("Unable to open slow request log \"%s\": %s", m_logfile.c_str(), strerror(errno));
+		return;
+	}
+	char tbuf[64];
+	struct tm tm;
+	localtime_r(&tr.start, &tm);
+	strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &tm);
+	fprintf(fp.get(), "%s %s user=%s session=%llu wall=%.6f sql=%.6f lockwait=%.6f object=%u table=%u cache=%llu/%llu queries=%zu\n",
+		tbuf, tr.func.c_str(), tr.user.empty() ? "-" : tr.user.c_str(),
+		static_cast<unsigned long long>(tr.session), tr.wall / 1e6,
+		tr.sql_time / 1e6, tr.lock_wait / 1e6, tr.obj_id, tr.table_id,
+		static_cast<unsigned long long>(tr.cache_hits),
+		static_cast<unsigned long long>(tr.cache_lookups),
+		tr.queries.size() + tr.queries_dropped);
+	for (const auto &q : tr.queries)
+		fprintf(fp.get(), "\t%.6f %llu %s\n", q.usec / 1e6,
+			static_cast<unsigned long long>(q.rows), q.query.c_str());
+	if (tr.queries_dropped > 0)
+		fprintf(fp.get(), "\t(%u more queries)\n", tr.queries_dropped);
+}
+
+} /* namespace */
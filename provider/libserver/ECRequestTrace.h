@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <kopano/zcdefs.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ctime>
+#include <kopano/kcodes.h>
+
+namespace KC {
+
+class ECConfig;
+struct request_stat;
+
+struct trace_query {
+	std::string query;
+	unsigned int usec = 0;
+	uint64_t rows = 0;
+};
+
+/* What a request that took longer than slow_request_threshold has done */
+struct request_trace {
+	time_t start = 0;
+	std::string func, user;
+	ECSESSIONID session = 0;
+	/* The first object checked for permissions, the first table used */
+	unsigned int obj_id = 0, table_id = 0;
+	/* times in µs */
+	uint64_t wall = 0, sql_time = 0, lock_wait = 0;
+	uint64_t cache_lookups = 0, cache_hits = 0;
+	std::vector<trace_query> queries;
+	/* Queries that were run, but not kept in @queries */
+	unsigned int queries_dropped = 0;
+};
+
+/*
+ * Records what each request does while slow_request_threshold is set, and
+ * keeps the traces of the requests that turn out slower than that in a
+ * ring of slow_request_traces entries, for the slow requests stats table.
+ * Requests under the threshold are only ever seen by their own thread, so
+ * recording takes no locks.
+ */
+class ECRequestTracer final {
+	public:
+	/* The trace the calling thread is recording, or nullptr */
+	static thread_local request_trace *tls_trace;
+
+	void configure(ECConfig *);
+	/* Starts recording the request of the calling thread, if enabled. */
+	void begin(const char *func, ECSESSIONID);
+	/* Keeps the recording if the request was slow. */
+	void end(const request_stat &);
+	std::vector<request_trace> traces() const;
+
+	static void add_query(const std::string &, std::chrono::steady_clock::duration);
+	/* Sets the row count of the query last passed to add_query. */
+	static void set_rows(uint64_t);
+	static void add_lock_wait(std::chrono::steady_clock::duration);
+	static void set_object(unsigned int id)
+	{
+		if (tls_trace != nullptr && tls_trace->obj_id == 0)
+			tls_trace->obj_id = id;
+	}
+	static void set_table(unsigned int id)
+	{
+		if (tls_trace != nullptr && tls_trace->table_id == 0)
+			tls_trace->table_id = id;
+	}
+
+	private:
+	void write_log(const request_trace &);
+
+	std::atomic<unsigned int> m_threshold{0}; /* ms, 0 = off */
+	mutable std::mutex m_lock;
+	std::deque<request_trace> m_ring;
+	size_t m_ring_size = 0;
+	std::string m_logfile;
+};
+
+/*
+ * A recursive mutex that accounts the time spent waiting for it to the
+ * trace of the calling thread. Usable wherever std::recursive_mutex is
+ * locked through lock_guard/unique_lock.
+ */
+class traced_recursive_mutex final : public std::recursive_mutex {
+	public:
+	void lock()
+	{
+		if (ECRequestTracer::tls_trace == nullptr)
+			return std::recursive_mutex::lock();
+		if (try_lock())
+			return;
+		auto start = std::chrono::steady_clock::now();
+		std::recursive_mutex::lock();
+		ECRequestTracer::add_lock_wait(std::chrono::steady_clock::now() - start);
+	}
+};
+
+} /* namespace */
@@ -5,13 +5,16 @@
 #include <kopano/platform.h>
 #include <list>
 #include <memory>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 #include "ECDatabaseUtils.h"
 #include "ECDatabase.h"
 #include "ECSessionManager.h"
 #include "ECSession.h"
 #include <kopano/ECDefs.h>
 #include "ECSecurity.h"
+#include <kopano/scope.hpp>
 #include <kopano/stringutil.h>
 #include "kcore.hpp"
 #include <mapidefs.h>
@@ -28,6 +31,7 @@
 #include <edkmdb.h>
 #include "ECDBDef.h"
 #include "cmdutil.hpp"
+#include "StatsClient.h"
 
 namespace KC {
 
@@ -60,7 +64,10 @@ ECSecurity::ECSecurity(ECSession *lpSession, std::shared_ptr<ECConfig> c,
 	m_lpSession(lpSession), m_lpAudit(std::move(lpAudit)), m_lpConfig(std::move(c)),
 	m_bRestrictedAdmin(parseBool(m_lpConfig->GetSetting("restrict_admin_permissions"))),
 	m_bOwnerAutoFullAccess(parseBool(m_lpConfig->GetSetting("owner_auto_full_access")))
-{}
+{
+	m_ulPermMemoMax = atoll(m_lpConfig->GetSetting("cache_permission_size")) /
+	                  MEMORY_USAGE_HASHMAP(1, decltype(m_permMemo));
+}
 
 /**
  * Called once for each login after the object was constructed. Since
@@ -185,8 +192,10 @@ ECRESULT ECSecurity::GetGroupsForUser(unsigned int ulUserId,
 ECRESULT ECSecurity::GetObjectPermission(unsigned int ulObjId, unsigned int* lpulRights)
 {
 	struct rightsArray *lpRights = NULL;
-	unsigned int ulCurObj = ulObjId, ulDepth = 0;
+	unsigned int ulCurObj = ulObjId, ulDepth = 0, ulSource = 0;
 	bool 			bFoundACL = false;
+	std::unordered_set<unsigned int> principals;
+	std::vector<unsigned int> vFolders; /* folders passed on the way up */
 
 	*lpulRights = 0;
 
@@ -194,47 +203,64 @@ ECRESULT ECSecurity::GetObjectPermission(unsigned int ulObjId, unsigned int* lpu
 	// WARNING we totally ignore DENY ACLs here. This means that the deepest GRANT counts. In practice
 	// this doesn't matter because GRANTmask = ~DENYmask.
 	auto cache = m_lpSession->GetSessionManager()->GetCacheManager();
+	auto ulGen = cache->GetPermissionGeneration();
+	/*
+	 * All folders between the object and the level whose ACLs decided
+	 * have the same effective rights, so each walk fills in the index for
+	 * its whole path, and the next walk through here stops at once.
+	 */
+	auto remember = make_scope_success([&]() {
+		if (m_ulPermMemoMax > 0 && !vFolders.empty())
+			RememberRights(vFolders, ulGen, *lpulRights, ulSource);
+	});
 	while(true)
 	{
+		unsigned int ulParent = 0, ulType = 0;
+		auto er = cache->GetObject(ulCurObj, &ulParent, nullptr, nullptr, &ulType);
+		bool bFolder = er == erSuccess && (ulType == MAPI_FOLDER || ulType == MAPI_STORE);
+		if (bFolder && m_ulPermMemoMax > 0 &&
+		    LookupRights(ulCurObj, ulGen, lpulRights, &ulSource))
+			return erSuccess;
+		if (bFolder)
+			vFolders.emplace_back(ulCurObj);
 		if (cache->GetACLs(ulCurObj, &lpRights) == erSuccess) {
-			/* This object has ACLs, check if any of them are for this user. */
-			for (gsoap_size_t i = 0; i < lpRights->__size; ++i)
-				if(lpRights->__ptr[i].ulType == ACCESS_TYPE_GRANT && lpRights->__ptr[i].ulUserid == m_ulUserID) {
-					*lpulRights |= lpRights->__ptr[i].ulRights;
-					bFoundACL = true;
-				}
-			// Check for the company we are in and add the permissions
+			/*
+			 * This object has ACLs, check if any of them are for this
+			 * user, the company we are in, or groups that we are in.
+			 */
+			if (principals.empty()) {
+				principals.emplace(m_ulUserID);
+				principals.emplace(m_ulCompanyID);
+				if (m_lpGroups != nullptr || GetGroupsForUser(m_ulUserID, m_lpGroups) == erSuccess)
+					for (const auto &grp : *m_lpGroups)
+						principals.emplace(grp.ulId);
+			}
 			for (gsoap_size_t i = 0; i < lpRights->__size; ++i)
-				if (lpRights->__ptr[i].ulType == ACCESS_TYPE_GRANT && lpRights->__ptr[i].ulUserid == m_ulCompanyID) {
+				if (lpRights->__ptr[i].ulType == ACCESS_TYPE_GRANT &&
+				    principals.count(lpRights->__ptr[i].ulUserid) > 0) {
 					*lpulRights |= lpRights->__ptr[i].ulRights;
 					bFoundACL = true;
 				}
-			// Also check for groups that we are in, and add those permissions
-			if (m_lpGroups != nullptr || GetGroupsForUser(m_ulUserID, m_lpGroups) == erSuccess)
-				for (const auto &grp : *m_lpGroups)
-					for (gsoap_size_t i = 0; i < lpRights->__size; ++i)
-						if (lpRights->__ptr[i].ulType == ACCESS_TYPE_GRANT &&
-						    lpRights->__ptr[i].ulUserid == grp.ulId) {
-							*lpulRights |= lpRights->__ptr[i].ulRights;
-							bFoundACL = true;
-						}
 		}
 
 		soap_del_PointerTorightsArray(&lpRights);
 		lpRights = nullptr;
-		if (bFoundACL)
+		if (bFoundACL) {
 			// If any of the ACLs at this level were for us, then use these ACLs.
+			ulSource = ulCurObj;
 			break;
+		}
 		// There were no ACLs or no ACLs for us, go to the parent and try there
-		auto er = cache->GetParent(ulCurObj, &ulCurObj);
-		if (er != erSuccess)
+		if (er != erSuccess || ulParent == CACHE_NO_PARENT)
 			// No more parents, break (with ulRights = 0)
 			return erSuccess;
+		ulCurObj = ulParent;
 		// This can really only happen if you have a broken tree in the database, eg a record which has
 		// parent == id. To break out of the loop we limit the depth to 64 which is very deep in practice. This means
 		// that you never have any rights for folders that are more than 64 levels of folders away from their ACL ..
 		if (++ulDepth > MAX_PARENT_LIMIT) {
 			ec_log_err("Maximum depth reached for object %d, deepest object: %d", ulObjId, ulCurObj);
+			vFolders.clear();
 			return erSuccess;
 		}
 	}
@@ -336,17 +362,27 @@ ECRESULT ECSecurity::CheckDeletedParent(unsigned int ulId) const
 ECRESULT ECSecurity::CheckPermission(unsigned int ulObjId, unsigned int ulecRights)
 {
 	ECRESULT		er = KCERR_NO_ACCESS;
-	bool			bOwnerFound = false;
+	bool			bOwnerFound = false, bRemembered = false;
 	unsigned int ulStoreOwnerId = 0, ulStoreType = 0, ulObjectOwnerId = 0;
 	unsigned int ulACL = 0, ulObjType, ulParentId, ulParentType;
 	int				nCheckType = 0;
-	auto cache = m_lpSession->GetSessionManager()->GetCacheManager();
+	auto sesmgr = m_lpSession->GetSessionManager();
+	auto cache = sesmgr->GetCacheManager();
+	/* read before deciding, so that a concurrent ACL change is not memoized over */
+	auto ulGen = cache->GetPermissionGeneration();
 
+	ECRequestTracer::set_object(ulObjId);
 	if(m_ulUserID == KOPANO_UID_SYSTEM) {
 		// SYSTEM is always allowed everything
 		er = erSuccess;
 		goto exit;
 	}
+	if (m_ulPermMemoMax > 0) {
+		bRemembered = LookupPermission(ulObjId, ulecRights, ulGen, &er, &ulStoreOwnerId);
+		sesmgr->m_stats->inc(bRemembered ? SCN_SECURITY_CACHE_HITS : SCN_SECURITY_CACHE_MISSES);
+		if (bRemembered)
+			goto exit;
+	}
 
 	// special case: stores and root containers are always allowed to be opened
 	if (ulecRights == ecSecurityFolderVisible || ulecRights == ecSecurityRead) {
@@ -463,6 +499,9 @@ ECRESULT ECSecurity::CheckPermission(unsigned int ulObjId, unsigned int ulecRigh
 	}
 
 exit:
+	if (!bRemembered && m_ulPermMemoMax > 0 && m_ulUserID != KOPANO_UID_SYSTEM &&
+	    (er == erSuccess || er == KCERR_NO_ACCESS))
+		RememberPermission(ulObjId, ulecRights, ulGen, er, ulStoreOwnerId);
 	if (er == erSuccess && (ulecRights == ecSecurityCreate || ulecRights == ecSecurityEdit || ulecRights == ecSecurityCreateFolder))
 		// writing in a deleted parent is not allowed
 		er = CheckDeletedParent(ulObjId);
@@ -497,6 +536,110 @@ exit:
 	return er;
 }
 
+/**
+ * Bring the memo and the rights index up to permission generation @gen.
+ * Only the index entries that were derived through an object whose ACLs
+ * changed are dropped; any other kind of change empties both.
+ * m_hPermMemoMutex must be held.
+ */
+void ECSecurity::SyncPermissionMemo(uint64_t gen)
+{
+	if (gen <= m_ulPermMemoGen)
+		return;
+	std::vector<unsigned int> changed;
+	m_permMemo.clear();
+	if (!m_lpSession->GetSessionManager()->GetCacheManager()->GetPermissionChanges(m_ulPermMemoGen, changed))
+		m_rightsIndex.clear();
+	for (auto objid : changed) {
+		/*
+		 * Every folder that a walk passed is in the index with the
+		 * same source as the folders below it. If objid is not in
+		 * the index, no entry depends on it.
+		 */
+		auto i = m_rightsIndex.find(objid);
+		if (i == m_rightsIndex.cend())
+			continue;
+		auto source = i->second.source;
+		for (auto j = m_rightsIndex.begin(); j != m_rightsIndex.end(); )
+			if (j->second.source == source)
+				j = m_rightsIndex.erase(j);
+			else
+				++j;
+	}
+	m_ulPermMemoGen = gen;
+}
+
+/**
+ * Look up an earlier decision of CheckPermission for this session.
+ *
+ * @param[in] gen	permission generation of the cache manager
+ * @param[out] er	the remembered decision
+ * @param[out] store_owner	store owner, as needed for auditing
+ *
+ * @return true if a decision that still holds was found
+ */
+bool ECSecurity::LookupPermission(unsigned int objid, unsigned int rights,
+    uint64_t gen, ECRESULT *er, unsigned int *store_owner)
+{
+	unsigned int parent = 0, owner = 0;
+	/* Moves and ownership changes of single items do not bump the generation. */
+	if (m_lpSession->GetSessionManager()->GetCacheManager()->GetObject(objid,
+	    &parent, &owner, nullptr, nullptr) != erSuccess)
+		return false;
+	scoped_lock lock(m_hPermMemoMutex);
+	SyncPermissionMemo(gen);
+	auto i = m_permMemo.find(static_cast<uint64_t>(objid) << 8 | rights);
+	if (i == m_permMemo.cend() || i->second.parent != parent ||
+	    i->second.owner != owner)
+		return false;
+	*er = i->second.er;
+	*store_owner = i->second.store_owner;
+	return true;
+}
+
+void ECSecurity::RememberPermission(unsigned int objid, unsigned int rights,
+    uint64_t gen, ECRESULT er, unsigned int store_owner)
+{
+	perm_memo m{er, 0, 0, store_owner};
+	if (m_lpSession->GetSessionManager()->GetCacheManager()->GetObject(objid,
+	    &m.parent, &m.owner, nullptr, nullptr) != erSuccess)
+		return;
+	scoped_lock lock(m_hPermMemoMutex);
+	/* The decision may predate a change. */
+	if (gen < m_ulPermMemoGen)
+		return;
+	SyncPermissionMemo(gen);
+	if (m_permMemo.size() >= m_ulPermMemoMax)
+		m_permMemo.clear();
+	m_permMemo[static_cast<uint64_t>(objid) << 8 | rights] = m;
+}
+
+bool ECSecurity::LookupRights(unsigned int folder, uint64_t gen,
+    unsigned int *rights, unsigned int *source)
+{
+	scoped_lock lock(m_hPermMemoMutex);
+	SyncPermissionMemo(gen);
+	auto i = m_rightsIndex.find(folder);
+	if (i == m_rightsIndex.cend())
+		return false;
+	*rights = i->second.rights;
+	*source = i->second.source;
+	return true;
+}
+
+void ECSecurity::RememberRights(const std::vector<unsigned int> &folders,
+    uint64_t gen, unsigned int rights, unsigned int source)
+{
+	scoped_lock lock(m_hPermMemoMutex);
+	if (gen < m_ulPermMemoGen)
+		return;
+	SyncPermissionMemo(gen);
+	if (m_rightsIndex.size() + folders.size() > m_ulPermMemoMax)
+		m_rightsIndex.clear();
+	for (auto f : folders)
+		m_rightsIndex[f] = {rights, source};
+}
+
 /**
  * Get the ACLs on a given object in a protocol struct to send to the client
  *
@@ -591,7 +734,10 @@ ECRESULT ECSecurity::SetRights(unsigned int objid, struct rightsArray *lpsRights
 		return KCERR_INVALID_PARAMETER;
 
 	// Invalidate cache for this object
-	m_lpSession->GetSessionManager()->GetCacheManager()->Update(fnevObjectModified, objid);
+	auto cache = m_lpSession->GetSessionManager()->GetCacheManager();
+	cache->Update(fnevObjectModified, objid);
+	/* ACLs are inherited, so decisions below objid are stale as well */
+	auto bump = make_scope_success([&]() { cache->UpdatePermissions(objid); });
 	auto usrmgt = m_lpSession->GetUserManagement();
 
 	for (gsoap_size_t i = 0; i < lpsRightsArray->__size; ++i) {
@@ -1063,32 +1209,16 @@ ECRESULT ECSecurity::GetStoreSize(unsigned int ulObjId,
     long long *lpllStoreSize) const
 {
 	ECDatabase		*lpDatabase = NULL;
-	DB_RESULT lpDBResult;
 	unsigned int	ulStore;
 
 	auto er = m_lpSession->GetDatabase(&lpDatabase);
 	if (er != erSuccess)
 		return er;
-	er = m_lpSession->GetSessionManager()->GetCacheManager()->GetStore(ulObjId, &ulStore, NULL);
-	if(er != erSuccess)
-		return er;
-	auto strQuery = "SELECT val_longint FROM properties WHERE tag=" + stringify(PROP_ID(PR_MESSAGE_SIZE_EXTENDED)) + " AND type=" + stringify(PROP_TYPE(PR_MESSAGE_SIZE_EXTENDED)) + " AND hierarchyid=" + stringify(ulStore);
-	er = lpDatabase->DoSelect(strQuery, &lpDBResult);
+	auto cache = m_lpSession->GetSessionManager()->GetCacheManager();
+	er = cache->GetStore(ulObjId, &ulStore, NULL);
 	if(er != erSuccess)
 		return er;
-
-	if (lpDBResult.get_num_rows() != 1) {
-		// This mostly happens when we're creating a new store, so return 0 sized store
-		*lpllStoreSize = 0;
-		return erSuccess;
-	}
-	auto lpDBRow = lpDBResult.fetch_row();
-	if(lpDBRow == NULL || lpDBRow[0] == NULL) {
-		ec_log_err("ECSecurity::GetStoreSize(): row is null");
-		return KCERR_DATABASE_ERROR;
-	}
-	*lpllStoreSize = atoll(lpDBRow[0]);
-	return erSuccess;
+	return cache->GetStoreSize(lpDatabase, ulStore, lpllStoreSize);
 }
 
 /**
@@ -1336,6 +1466,9 @@ size_t ECSecurity::GetObjectSize(void) const
 		ulSize += MEMORY_USAGE_LIST(m_lpAdminCompanies->size(), std::list<localobjectdetails_t>);
 	}
 
+	scoped_lock lock(m_hPermMemoMutex);
+	ulSize += MEMORY_USAGE_HASHMAP(m_permMemo.size(), decltype(m_permMemo));
+	ulSize += MEMORY_USAGE_HASHMAP(m_rightsIndex.size(), decltype(m_rightsIndex));
 	return ulSize;
 }
 
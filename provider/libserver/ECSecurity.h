@@ -4,6 +4,10 @@
  */
 #pragma once
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
 #include <kopano/memory.hpp>
 #include "ECUserManagement.h"
 #include "plugin.h"
@@ -69,6 +73,11 @@ private:
 	ECRESULT GetViewableCompanies(unsigned int flags, std::unique_ptr<std::list<localobjectdetails_t>> &objs) const;
 	ECRESULT GetAdminCompanies(unsigned int flags, std::unique_ptr<std::list<localobjectdetails_t>> &objs);
 	ECRESULT HaveObjectPermission(unsigned int ulObjId, unsigned int ulACLMask);
+	void SyncPermissionMemo(uint64_t gen);
+	bool LookupPermission(unsigned int objid, unsigned int rights, uint64_t gen, ECRESULT *, unsigned int *store_owner);
+	void RememberPermission(unsigned int objid, unsigned int rights, uint64_t gen, ECRESULT, unsigned int store_owner);
+	bool LookupRights(unsigned int folder, uint64_t gen, unsigned int *rights, unsigned int *source);
+	void RememberRights(const std::vector<unsigned int> &folders, uint64_t gen, unsigned int rights, unsigned int source);
 
 protected:
 	ECSession			*m_lpSession;
@@ -84,6 +93,29 @@ protected:
 	std::unique_ptr<std::list<localobjectdetails_t>> m_lpGroups; // current user groups
 	std::unique_ptr<std::list<localobjectdetails_t>> m_lpViewCompanies; // current visible companies
 	std::unique_ptr<std::list<localobjectdetails_t>> m_lpAdminCompanies; // Companies where the user has admin rights on
+
+	/*
+	 * Outcome of earlier CheckPermission calls, keyed by (objid << 8 |
+	 * rights). An entry only holds while the object keeps its parent and
+	 * owner, and the whole memo is dropped when the cache manager's
+	 * permission generation moves on.
+	 */
+	struct perm_memo {
+		ECRESULT er;
+		unsigned int parent, owner, store_owner;
+	};
+	std::unordered_map<uint64_t, perm_memo> m_permMemo;
+	/*
+	 * Effective ACL rights of this user per folder (GetObjectPermission),
+	 * with the folder whose ACLs they came from (0: none up to the root).
+	 */
+	struct eff_rights {
+		unsigned int rights, source;
+	};
+	std::unordered_map<unsigned int, eff_rights> m_rightsIndex;
+	uint64_t m_ulPermMemoGen = 0;
+	size_t m_ulPermMemoMax = 0;
+	mutable std::mutex m_hPermMemoMutex;
 };
 
 } /* namespace */
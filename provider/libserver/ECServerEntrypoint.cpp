@@ -106,6 +106,14 @@ static int kopano_fparsehdr(struct soap *soap, const char *key,
 	return soap_info(soap)->fparsehdr(soap, key, val);
 }
 
+/* Counts the bytes of responses, for the per-method SOAP profile. */
+static int kopano_fsend(struct soap *soap, const char *buf, size_t len)
+{
+	auto info = soap_info(soap);
+	info->st.bytes_sent += len;
+	return info->fsend(soap, buf, len);
+}
+
 // Called just after a new soap connection is established
 void kopano_new_soap_connection(CONNECTION_TYPE ulType, struct soap *soap)
 {
@@ -114,6 +122,8 @@ void kopano_new_soap_connection(CONNECTION_TYPE ulType, struct soap *soap)
 	lpInfo->ulConnectionType = ulType;
 	lpInfo->bProxy = false;
 	soap->user = lpInfo;
+	lpInfo->fsend = soap->fsend; /* daisy-chain, like fparsehdr */
+	soap->fsend = kopano_fsend;
 	if (szProxy[0] == '\0')
 		return;
 	if (strcmp(szProxy, "*") == 0) {
@@ -482,9 +482,13 @@ ECRESULT ECSession::LockObject(unsigned int ulObjId)
 {
 	scoped_lock lock(m_hLocksLock);
 	auto res = m_mapLocks.emplace(ulObjId, ECObjectLock());
-	if (res.second)
-		return m_lpSessionManager->GetLockManager()->LockObject(ulObjId, m_sessionID, &res.first->second);
-	return erSuccess;
+	if (!res.second)
+		return erSuccess;
+	auto er = m_lpSessionManager->GetLockManager()->LockObject(ulObjId, m_sessionID, &res.first->second);
+	/* Not held, so a retry must ask the lock manager again */
+	if (er != erSuccess)
+		m_mapLocks.erase(res.first);
+	return er;
 }
 
 ECRESULT ECSession::UnlockObject(unsigned int ulObjId)
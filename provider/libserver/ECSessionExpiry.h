@@ -0,0 +1,70 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <kopano/zcdefs.h>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <ctime>
+#include <kopano/kcodes.h>
+
+namespace KC {
+
+/*
+ * The sessions of one bucket of ECSessionManager, ordered by when they
+ * expire, as known when they were put in. Requests do not touch it: the
+ * cleaner only looks at the entries that are due, and puts back those of
+ * sessions that have seen requests since.
+ */
+class session_expiry final {
+	public:
+	/* Sessions that cannot be removed yet are looked at again after this long */
+	static constexpr time_t RECHECK = 30;
+
+	void add(ECSESSIONID id, time_t expires) { m_heap.emplace(expires, id); }
+	void clear() { m_heap = decltype(m_heap)(); }
+	size_t size() const { return m_heap.size(); }
+
+	/*
+	 * Goes through the entries that are due by @now. @expires(id, &t)
+	 * returns false for a session that is gone, whose entry is dropped;
+	 * otherwise it sets when the session expires by its last request, and
+	 * if that is still ahead, the entry is put back for then. Due sessions
+	 * for which @persistent(id) holds are looked at again RECHECK later,
+	 * the others are appended to @expired.
+	 *
+	 * Returns true if it stopped because @deadline passed while more
+	 * entries were due. At least one entry is handled per call.
+	 */
+	template<typename E, typename P> bool
+	expire(time_t now, std::chrono::steady_clock::time_point deadline,
+	    E &&expires, P &&persistent, std::vector<ECSESSIONID> &expired)
+	{
+		while (!m_heap.empty() && m_heap.top().first < now) {
+			auto id = m_heap.top().second;
+			m_heap.pop();
+			time_t t = 0;
+			if (!expires(id, &t))
+				continue;
+			if (t >= now)
+				m_heap.emplace(t, id);
+			else if (persistent(id))
+				m_heap.emplace(now + RECHECK, id);
+			else
+				expired.emplace_back(id);
+			if (std::chrono::steady_clock::now() >= deadline)
+				return !m_heap.empty() && m_heap.top().first < now;
+		}
+		return false;
+	}
+
+	private:
+	typedef std::pair<time_t, ECSESSIONID> entry;
+	std::priority_queue<entry, std::vector<entry>, std::greater<entry>> m_heap;
+};
+
+} /* namespace */
@@ -11,6 +11,7 @@
 #include <set>
 #include <shared_mutex>
 #include <utility>
+#include <vector>
 #include <pthread.h>
 #include <libHX/string.h>
 #include <mapidefs.h>
@@ -89,10 +90,12 @@ ECSessionManager::~ECSessionManager()
 	m_lpDatabase.reset();
 	m_lpDatabaseFactory.reset();
 	/* Clean up all sessions */
-	std::lock_guard<KC::shared_mutex> l_cache(m_hCacheRWLock);
-	for (auto s = m_mapSessions.begin(); s != m_mapSessions.end();
-	     s = m_mapSessions.erase(s))
-		delete s->second;
+	for (auto &b : m_sessions) {
+		std::lock_guard<KC::shared_mutex> l_ses(b.lock);
+		for (auto s = b.sessions.begin(); s != b.sessions.end();
+		     s = b.sessions.erase(s))
+			delete s->second;
+	}
 	// Clearing the cache takes too long while shutting down
 }
 
@@ -218,9 +221,11 @@ ECRESULT ECSessionManager::DeleteIfOrphaned(ECSessionGroup *lpGroup)
 
 BTSession* ECSessionManager::GetSession(ECSESSIONID sessionID, bool fLockSession) {
 	BTSession *lpSession = NULL;
+	auto &b = get_bucket(sessionID);
+	std::shared_lock<KC::shared_mutex> l_ses(b.lock);
 
-	auto iIterator = m_mapSessions.find(sessionID);
-	if (iIterator != m_mapSessions.cend()) {
+	auto iIterator = b.sessions.find(sessionID);
+	if (iIterator != b.sessions.cend()) {
 		lpSession = iIterator->second;
 		lpSession->UpdateSessionTime();
 		if(fLockSession)
@@ -231,18 +236,27 @@ BTSession* ECSessionManager::GetSession(ECSESSIONID sessionID, bool fLockSession
 	return lpSession;
 }
 
+void ECSessionManager::AddSession(ECSESSIONID id, BTSession *ses)
+{
+	auto &b = get_bucket(id);
+	std::lock_guard<KC::shared_mutex> l_ses(b.lock);
+	b.sessions.emplace(id, ses);
+	b.expiry.add(id, ses->GetSessionTime());
+}
+
 // Clean up all current sessions
 ECRESULT ECSessionManager::RemoveAllSessions()
 {
 	std::list<BTSession *> lstSessions;
 
-	// Lock the session map since we're going to remove all the sessions.
-	std::unique_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
 	ec_log_info("Shutdown all current sessions");
-	for (auto s = m_mapSessions.cbegin(); s != m_mapSessions.cend();
-	     s = m_mapSessions.erase(s))
-		lstSessions.emplace_back(s->second);
-	l_cache.unlock();
+	for (auto &b : m_sessions) {
+		std::lock_guard<KC::shared_mutex> l_ses(b.lock);
+		for (auto s = b.sessions.cbegin(); s != b.sessions.cend();
+		     s = b.sessions.erase(s))
+			lstSessions.emplace_back(s->second);
+		b.expiry.clear();
+	}
 	// Do the actual session deletes, while the session map is not locked (!)
 	for (auto sesp : lstSessions)
 		delete sesp;
@@ -254,24 +268,22 @@ ECRESULT ECSessionManager::CancelAllSessions(ECSESSIONID sessionIDException)
 	BTSession		*lpSession = NULL;
 	std::list<BTSession *> lstSessions;
 
-	// Lock the session map since we're going to remove all the sessions.
-	std::unique_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
 	ec_log_info("Shutdown all current sessions");
-
-	for (auto iIterSession = m_mapSessions.begin();
-	     iIterSession != m_mapSessions.cend(); ) {
-		if (iIterSession->first == sessionIDException) {
-			++iIterSession;
-			continue;
+	for (auto &b : m_sessions) {
+		std::lock_guard<KC::shared_mutex> l_ses(b.lock);
+		for (auto iIterSession = b.sessions.begin();
+		     iIterSession != b.sessions.cend(); ) {
+			if (iIterSession->first == sessionIDException) {
+				++iIterSession;
+				continue;
+			}
+			lpSession = iIterSession->second;
+			// Tell the notification manager to wake up anyone waiting for this session
+			m_lpNotificationManager->NotifyChange(iIterSession->first);
+			iIterSession = b.sessions.erase(iIterSession);
+			lstSessions.emplace_back(lpSession);
 		}
-		lpSession = iIterSession->second;
-		// Tell the notification manager to wake up anyone waiting for this session
-		m_lpNotificationManager->NotifyChange(iIterSession->first);
-		iIterSession = m_mapSessions.erase(iIterSession);
-		lstSessions.emplace_back(lpSession);
 	}
-
-	l_cache.unlock();
 	// Do the actual session deletes, while the session map is not locked (!)
 	for (auto sesp : lstSessions)
 		delete sesp;
@@ -282,23 +294,25 @@ ECRESULT ECSessionManager::CancelAllSessions(ECSESSIONID sessionIDException)
 // used by ECStatsTable
 ECRESULT ECSessionManager::ForEachSession(void(*callback)(ECSession*, void*), void *obj)
 {
-	std::shared_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
-	for (const auto &p : m_mapSessions)
-		callback(dynamic_cast<ECSession *>(p.second), obj);
+	for (auto &b : m_sessions) {
+		std::shared_lock<KC::shared_mutex> l_ses(b.lock);
+		for (const auto &p : b.sessions)
+			callback(dynamic_cast<ECSession *>(p.second), obj);
+	}
 	return erSuccess;
 }
 
 // Locking of sessions works as follows:
 //
 // - A session is requested by the caller thread through ValidateSession. ValidateSession
-//   Locks the complete session table, then acquires a lock on the session, and then
-//   frees the lock on the session table. This makes sure that when a session is returned,
+//   Locks the bucket of the session table that holds the session, then acquires a lock
+//   on the session, and then frees the lock on the bucket. This makes sure that when a session is returned,
 //   it is guaranteed not to be deleted by another thread (due to a shutdown or logoff).
 //   The caller of 'ValidateSession' is therefore responsible for unlocking the session
 //   when it is finished.
 //
-// - When a session is terminated, a lock is opened on the session table, making sure no
-//   new session can be opened, or session can be deleted. Then, the session is searched
+// - When a session is terminated, a lock is opened on its bucket of the session table,
+//   making sure no session in there can be opened or deleted. Then, the session is searched
 //   in the table, and directly deleted from the table, making sure that no new threads can
 //   open the session in question after this point. Then, the session is deleted, but the
 //   session itself waits in the destructor until all threads holding a lock on the session
@@ -344,11 +358,7 @@ ECRESULT ECSessionManager::ValidateSession(struct soap *soap,
 ECRESULT ECSessionManager::ValidateBTSession(struct soap *soap,
     ECSESSIONID sessionID, BTSession **lppSession)
 {
-	// Read lock
-	std::shared_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
 	auto lpSession = GetSession(sessionID, true);
-	l_cache.unlock();
-
 	if (lpSession == NULL)
 		return KCERR_END_OF_SESSION;
 	lpSession->RecordRequest(soap);
@@ -389,9 +399,7 @@ ECRESULT ECSessionManager::CreateAuthSession(struct soap *soap, unsigned int ulC
 	if (bLockSession)
 	        lpAuthSession->lock();
 	if (bRegisterSession) {
-		std::unique_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
-		m_mapSessions.emplace(newSessionID, lpAuthSession);
-		l_cache.unlock();
+		AddSession(newSessionID, lpAuthSession);
 		g_lpSessionManager->m_stats->inc(SCN_SESSIONS_CREATED);
 	}
 
@@ -483,9 +491,7 @@ ECRESULT ECSessionManager::RegisterSession(ECAuthSession *lpAuthSession,
 
 	if (fLockSession)
 		lpSession->lock();
-	std::unique_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
-	m_mapSessions.emplace(newSID, lpSession);
-	l_cache.unlock();
+	AddSession(newSID, lpSession);
 	*lpSessionID = std::move(newSID);
 	*lppSession = lpSession;
 	g_lpSessionManager->m_stats->inc(SCN_SESSIONS_CREATED);
@@ -522,17 +528,21 @@ void ECSessionManager::RemoveSessionInternal(ECSession *lpSession)
 ECRESULT ECSessionManager::RemoveSession(ECSESSIONID sessionID){
 	m_stats->inc(SCN_SESSIONS_DELETED);
 
-	// Make sure no other thread can read or write the sessions list
-	std::unique_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
-	// Get a session, don't lock it ourselves
-	auto lpSession = GetSession(sessionID, false);
+	// Make sure no other thread can read or write this part of the sessions list
+	auto &b = get_bucket(sessionID);
+	std::unique_lock<KC::shared_mutex> l_ses(b.lock);
+	BTSession *lpSession = nullptr;
+	auto iSession = b.sessions.find(sessionID);
 	// Remove the session from the list. No other threads can start new
 	// requests on the session after this point
-	m_mapSessions.erase(sessionID);
-	l_cache.unlock();
+	if (iSession != b.sessions.cend()) {
+		lpSession = iSession->second;
+		b.sessions.erase(iSession);
+	}
+	l_ses.unlock();
 
 	// We know for sure that no other thread is attempting to remove the session
-	// at this time because it would not have been in the m_mapSessions map
+	// at this time because it would not have been in the sessions map
 	// Delete the session. This will block until all requesters on the session
 	// have released their lock on the session
 	if(lpSession != NULL) {
@@ -617,6 +627,48 @@ ECRESULT ECSessionManager::AddNotification(notification *notifyItem, unsigned in
 	return hrSuccess;
 }
 
+/*
+ * How long the cleaner holds a bucket lock at most, so that requests looking
+ * up sessions in the bucket never wait for long.
+ */
+static constexpr std::chrono::microseconds SESSION_CLEAN_SLICE{500};
+
+/**
+ * Takes the sessions of @b that have expired by @now out of the bucket, and
+ * appends them to @expired.
+ */
+void ECSessionManager::CleanBucket(session_bucket &b, time_t now,
+    std::list<BTSession *> &expired)
+{
+	auto expires = [&](ECSESSIONID id, time_t *t) {
+		auto i = b.sessions.find(id);
+		if (i == b.sessions.cend())
+			/* Removed in the meantime */
+			return false;
+		*t = i->second->GetSessionTime();
+		return true;
+	};
+	auto persistent = [this](ECSESSIONID id) { return IsSessionPersistent(id); };
+	std::vector<ECSESSIONID> ids;
+
+	for (bool more = true; more; ) {
+		std::lock_guard<KC::shared_mutex> l_ses(b.lock);
+		more = b.expiry.expire(now, std::chrono::steady_clock::now() + SESSION_CLEAN_SLICE,
+		       expires, persistent, ids);
+		for (auto id : ids) {
+			auto i = b.sessions.find(id);
+			if (i == b.sessions.cend())
+				continue;
+			// Remember all the session to be deleted
+			expired.emplace_back(i->second);
+			// Remove the session from the list, no new threads can start on this session after this point.
+			m_stats->inc(SCN_SESSIONS_TIMEOUT);
+			b.sessions.erase(i);
+		}
+		ids.clear();
+	}
+}
+
 void* ECSessionManager::SessionCleaner(void *lpTmpSessionManager)
 {
 	kcsrv_blocksigs();
@@ -631,27 +683,11 @@ void* ECSessionManager::SessionCleaner(void *lpTmpSessionManager)
 		ec_log_err("GTLD failed in SessionCleaner");
 
 	while(true){
-		std::unique_lock<KC::shared_mutex> l_cache(lpSessionManager->m_hCacheRWLock);
 		auto lCurTime = GetProcessTime();
 
-		// Find a session that has timed out
-		for (auto iIterator = lpSessionManager->m_mapSessions.begin();
-		     iIterator != lpSessionManager->m_mapSessions.cend(); ) {
-			bool del = iIterator->second->GetSessionTime() < lCurTime &&
-			           !lpSessionManager->IsSessionPersistent(iIterator->first);
-			if (!del) {
-				++iIterator;
-				continue;
-			}
-			// Remember all the session to be deleted
-			lstSessions.emplace_back(iIterator->second);
-			// Remove the session from the list, no new threads can start on this session after this point.
-			g_lpSessionManager->m_stats->inc(SCN_SESSIONS_TIMEOUT);
-			iIterator = lpSessionManager->m_mapSessions.erase(iIterator);
-		}
-
-		// Release ownership of the rwlock object. This makes sure all threads are free to run (and exit).
-		l_cache.unlock();
+		// Find the sessions that have timed out
+		for (auto &b : lpSessionManager->m_sessions)
+			lpSessionManager->CleanBucket(b, lCurTime, lstSessions);
 
 		// Now, remove all the session. It will wait until all running threads for that session have exited.
 		for (const auto ses : lstSessions) {
@@ -718,6 +754,11 @@ ECRESULT ECSessionManager::UpdateSubscribedTables(ECKeyTable::UpdateType ulType,
 {
 	std::set<ECSESSIONID> setSessions;
 
+	// Update the rows shared by the tables once, before each table takes the change
+	if (sSubscription.ulType == TABLE_ENTRY::TABLE_TYPE_GENERIC)
+		m_shared_views.update(ulType, sSubscription.ulRootObjectId,
+			sSubscription.ulObjectType, sSubscription.ulObjectFlags, lstChildId);
+
     // Find out which sessions our interested in this event by looking at our subscriptions
 	ulock_normal l_sub(m_mutexTableSubscriptions);
 	for (auto sub = m_mapTableSubscriptions.find(sSubscription);
@@ -731,9 +772,7 @@ ECRESULT ECSessionManager::UpdateSubscribedTables(ECKeyTable::UpdateType ulType,
     // For each of the sessions that are interested, send the table change
 	for (const auto &ses : setSessions) {
 		// Get session
-		std::shared_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
 		auto lpBTSession = GetSession(ses, true);
-		l_cache.unlock();
 
 	    // Send the change notification
 		if (lpBTSession == nullptr)
@@ -938,6 +977,8 @@ void ECSessionManager::update_extra_stats()
 	s.setg("tables_subscr_size", "Memory usage of subscribed tables", sSessionStats.ulTableSubscriptionSize);
 	s.setg("object_subscr", "Objects subscribed", sSessionStats.ulObjectSubscriptions);
 	s.setg("object_subscr_size", "Memory usage of subscribed objects", sSessionStats.ulObjectSubscriptionSize);
+	s.setg("tables_shared", "Contents table views shared between sessions", sSessionStats.ulSharedViews);
+	s.setg("tables_shared_rows", "Table rows taken from shared views", m_shared_views.m_rows_shared.load());
 
 	auto sSearchStats = m_lpSearchFolders->get_stats();
 	s.setg("searchfld_stores", "Number of stores in use by search folders", sSearchStats.ulStores);
@@ -948,6 +989,14 @@ void ECSessionManager::update_extra_stats()
 	auto cm = GetCacheManager();
 	if (cm != nullptr)
 		cm->update_extra_stats(s);
+	if (m_lpTPropsPurge != nullptr) {
+		auto dst = m_lpTPropsPurge->get_stats();
+		s.setg("deferred_backlog", "Deferred tproperties updates not yet purged", dst.records);
+		s.setg("deferred_backlog_folders", "Folders with deferred tproperties updates", dst.folders);
+		s.setg("deferred_backlog_max", "Deferred tproperties updates of the folder with the most", dst.max_records);
+		s.setg("deferred_backlog_max_folder", "Folder with the most deferred tproperties updates", dst.max_folder);
+		s.setg("deferred_backlog_age", "Age of the oldest deferred tproperties update (s)", static_cast<int64_t>(dst.max_age));
+	}
 
 	/* It's not the same as the AUTO_INCREMENT value, but good enough. */
 	ECDatabase *db = nullptr;
@@ -971,10 +1020,12 @@ sSessionManagerStats ECSessionManager::get_stats()
 	sSessionManagerStats sStats;
 
 	// Get session data
-	std::shared_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
-	sStats.session.ulItems = m_mapSessions.size();
+	sStats.session.ulItems = 0;
+	for (auto &b : m_sessions) {
+		std::shared_lock<KC::shared_mutex> l_ses(b.lock);
+		sStats.session.ulItems += b.sessions.size();
+	}
 	sStats.session.ullSize = MEMORY_USAGE_MAP(sStats.session.ulItems, SESSIONMAP);
-	l_cache.unlock();
 	sStats.session.ulLocked = 0;
 	sStats.session.ulOpenTables = 0;
 
@@ -1007,6 +1058,7 @@ sSessionManagerStats ECSessionManager::get_stats()
 	sStats.ulObjectSubscriptionSize = MEMORY_USAGE_MULTIMAP(sStats.ulObjectSubscriptions, OBJECTSUBSCRIPTIONSMULTIMAP);
 	l_objsub.unlock();
 
+	sStats.ulSharedViews = m_shared_views.size();
 	return sStats;
 }
 
@@ -1256,9 +1308,7 @@ ECRESULT ECSessionManager::RemoveBusyState(ECSESSIONID ecSessionId, pthread_t th
 {
 	ECRESULT er = erSuccess;
 	ECSession *lpECSession = NULL;
-	std::shared_lock<KC::shared_mutex> l_cache(m_hCacheRWLock);
 	auto lpSession = GetSession(ecSessionId, true);
-	l_cache.unlock();
 	if(!lpSession)
 		goto exit;
 
@@ -1282,36 +1332,38 @@ ECLockManagerPtr ECLockManager::Create()
 ECRESULT ECLockManager::LockObject(unsigned int objid, ECSESSIONID sid,
     ECObjectLock *objlock)
 {
-	ECRESULT er = erSuccess;
-	std::lock_guard<KC::shared_mutex> lock(m_hRwLock);
-	auto res = m_mapLocks.emplace(objid, sid);
+	auto &sh = get_shard(objid);
+	std::unique_lock<std::mutex> lk(sh.lock);
+	auto res = sh.locks.emplace(objid, sid);
 	if (!res.second && res.first->second != sid)
-		er = KCERR_NO_ACCESS;
+		return KCERR_NO_ACCESS;
+	lk.unlock();
 	if (objlock != nullptr)
 		*objlock = ECObjectLock(shared_from_this(), objid, sid);
-	return er;
+	return erSuccess;
 }
 
 ECRESULT ECLockManager::UnlockObject(unsigned int objid, ECSESSIONID sid)
 {
-	std::lock_guard<KC::shared_mutex> lock(m_hRwLock);
-	auto i = m_mapLocks.find(objid);
-	if (i == m_mapLocks.cend())
+	auto &sh = get_shard(objid);
+	std::lock_guard<std::mutex> lk(sh.lock);
+	auto i = sh.locks.find(objid);
+	if (i == sh.locks.cend())
 		return KCERR_NOT_FOUND;
 	else if (i->second != sid)
 		return KCERR_NO_ACCESS;
-	else
-		m_mapLocks.erase(i);
+	sh.locks.erase(i);
 	return erSuccess;
 }
 
 bool ECLockManager::IsLocked(unsigned int objid, ECSESSIONID *sid)
 {
-	std::shared_lock<KC::shared_mutex> lock(m_hRwLock);
-	auto i = m_mapLocks.find(objid);
-	if (i != m_mapLocks.cend() && sid != nullptr)
+	auto &sh = get_shard(objid);
+	std::lock_guard<std::mutex> lk(sh.lock);
+	auto i = sh.locks.find(objid);
+	if (i != sh.locks.cend() && sid != nullptr)
 		*sid = i->second;
-	return i != m_mapLocks.end();
+	return i != sh.locks.cend();
 }
 
 ECRESULT ECSessionManager::get_user_count(usercount_t *uc)
@@ -5,12 +5,15 @@
 #pragma once
 #include <kopano/zcdefs.h>
 #include "ECSession.h"
+#include <atomic>
 #include <condition_variable>
 #include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <string>
+#include <vector>
 #include <pthread.h>
 #include <kopano/platform.h>
 #include <kopano/timeutil.hpp>
@@ -21,9 +24,12 @@
 #include "ECCacheManager.h"
 #include "ECPluginFactory.h"
 #include "ECServerEntrypoint.h"
+#include "ECSessionExpiry.h"
 #include "ECSessionGroup.h"
 #include "ECNotificationManager.h"
 #include "ECLockManager.h"
+#include "ECRequestTrace.h"
+#include "ECSharedView.h"
 #include "StatsClient.h"
 
 struct soap;
@@ -64,6 +70,7 @@ struct sSessionManagerStats {
 	ULONG ulPersistentBySession, ulPersistentBySessionSize;
 	ULONG ulTableSubscriptions, ulTableSubscriptionSize;
 	ULONG ulObjectSubscriptions, ulObjectSubscriptionSize;
+	ULONG ulSharedViews;
 };
 
 class usercount_t final {
@@ -120,14 +127,43 @@ class usercount_t final {
 	unsigned int m_counts[ucMAX]{};
 };
 
+/* Totals of one SOAP method, as shown in the SOAP stats table */
+struct soap_method_usage {
+	std::string name;
+	uint64_t calls = 0, errors = 0, queries = 0, rows = 0, bytes = 0;
+	/* times in µs */
+	uint64_t wall = 0, cpu = 0, wall_p50 = 0, wall_p99 = 0, cpu_p99 = 0;
+};
+
 class KC_EXPORT server_stats final : public ECStatsCollector {
 	public:
 	KC_HIDDEN server_stats(std::shared_ptr<ECConfig>);
 	virtual void stop() override;
 	virtual void fill_odm() override;
+	/*
+	 * Accounts a finished request to its SOAP method. Does nothing unless
+	 * soap_profiling is enabled.
+	 */
+	void soap_call(const request_stat &);
+	void set_soap_profiling(bool on) { m_soap_profiling = on; }
+	std::vector<soap_method_usage> soap_profile() const;
+
+	/* Traces of slow requests, see slow_request_threshold */
+	ECRequestTracer m_tracer;
 
 	private:
+	struct soap_method {
+		std::atomic<uint64_t> calls{0}, errors{0}, wall{0}, cpu{0};
+		std::atomic<uint64_t> queries{0}, rows{0}, bytes{0};
+		std::atomic<uint64_t> wall_hist[ECHistogram::BUCKETS]{}, cpu_hist[ECHistogram::BUCKETS]{};
+	};
+
 	KC_HIDDEN void update_tcmalloc_stats();
+
+	std::atomic<bool> m_soap_profiling{false};
+	/* Methods are only ever added, so counting needs the lock only shared. */
+	std::map<std::string, std::unique_ptr<soap_method>, std::less<>> m_soap_methods;
+	mutable KC::shared_mutex m_soap_lock;
 };
 
 class SOURCEKEY;
@@ -195,7 +231,9 @@ public:
 	KC_HIDDEN unsigned int GetSortLCID(unsigned int store_id);
 	KC_HIDDEN ECLocale GetSortLocale(unsigned int store_id);
 	KC_HIDDEN ECCacheManager *GetCacheManager() const { return m_lpECCacheManager.get(); }
+	KC_HIDDEN ECTPropsPurge *GetTPropsPurge() const { return m_lpTPropsPurge.get(); }
 	KC_HIDDEN ECSearchFolders *GetSearchFolders() const { return m_lpSearchFolders.get(); }
+	KC_HIDDEN ECSharedViewManager *GetSharedViews() { return &m_shared_views; }
 	KC_HIDDEN std::shared_ptr<ECConfig> GetConfig() const { return m_lpConfig; }
 	KC_HIDDEN std::shared_ptr<ECLogger> GetAudit() const { return m_lpAudit; }
 	KC_HIDDEN ECPluginFactory *GetPluginFactory() const { return m_lpPluginFactory.get(); }
@@ -214,9 +252,23 @@ protected:
 	KC_HIDDEN ECRESULT UpdateSubscribedTables(ECKeyTable::UpdateType, const TABLESUBSCRIPTION &, std::list<unsigned int> &child_id);
 	KC_HIDDEN ECRESULT SaveSourceKeyAutoIncrement(unsigned long long new_src_key_autoincr);
 
+	/*
+	 * The sessions are spread over buckets by id, each with its own lock,
+	 * so that looking up the session of a request only contends with
+	 * requests that happen to use the same bucket.
+	 */
+	struct session_bucket {
+		KC::shared_mutex lock;
+		SESSIONMAP sessions;
+		session_expiry expiry;
+	};
+	static constexpr unsigned int SESSION_BUCKETS = 64;
+	session_bucket &get_bucket(ECSESSIONID id) { return m_sessions[id % SESSION_BUCKETS]; }
+	KC_HIDDEN void AddSession(ECSESSIONID, BTSession *);
+	KC_HIDDEN void CleanBucket(session_bucket &, time_t now, std::list<BTSession *> &expired);
+
 	EC_SESSIONGROUPMAP m_mapSessionGroups; ///< map of all the session groups
-	SESSIONMAP			m_mapSessions;			///< map of all the sessions
-	KC::shared_mutex m_hCacheRWLock; ///< locking of the sessionMap
+	session_bucket m_sessions[SESSION_BUCKETS];
 	KC::shared_mutex m_hGroupLock; ///< locking of session group map and lonely list
 	std::mutex m_hExitMutex; /* Mutex needed for the release signal */
 	std::condition_variable m_hExitSignal; /* Signal that should be sent to the sessionncleaner when to exit */
@@ -235,6 +287,7 @@ protected:
 	TABLESUBSCRIPTIONMULTIMAP m_mapTableSubscriptions;	///< Maps a table subscription to the subscriber
 	std::mutex m_mutexObjectSubscriptions;
 	OBJECTSUBSCRIPTIONSMULTIMAP	m_mapObjectSubscriptions;	///< Maps an object notification subscription (store id) to the subscriber
+	ECSharedViewManager m_shared_views; ///< Contents table rows shared between sessions
 
 	// Sequences
 	std::mutex m_hSeqMutex;
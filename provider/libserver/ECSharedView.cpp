@@ -0,0 +1,177 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#include <kopano/platform.h>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <mapidefs.h>
+#include <mapitags.h>
+#include <edkmdb.h>
+#include <kopano/stringutil.h>
+#include "soapH.h"
+#include "ECGenericObjectTable.h"
+#include "ECSharedView.h"
+
+namespace KC {
+
+std::shared_ptr<ECSharedView> ECSharedViewManager::get(shared_view_key &&key)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto i = m_views.find(key);
+	if (i != m_views.cend()) {
+		auto view = i->second.lock();
+		if (view != nullptr)
+			return view;
+	}
+	/* New views are rare enough to sweep the ones nobody uses anymore. */
+	for (auto j = m_views.begin(); j != m_views.end(); )
+		if (j->second.expired())
+			j = m_views.erase(j);
+		else
+			++j;
+	auto view = std::make_shared<ECSharedView>();
+	m_views[std::move(key)] = view;
+	return view;
+}
+
+void ECSharedViewManager::update(ECKeyTable::UpdateType type,
+    unsigned int folder, unsigned int objtype, unsigned int flags,
+    const std::list<unsigned int> &ids)
+{
+	std::vector<std::shared_ptr<ECSharedView>> views;
+	std::unique_lock<std::mutex> lk(m_lock);
+	for (auto i = m_views.lower_bound({folder, objtype, flags, {}, {}});
+	     i != m_views.cend() && i->first.folder == folder &&
+	     i->first.objtype == objtype && i->first.flags == flags; ++i) {
+		auto view = i->second.lock();
+		if (view != nullptr)
+			views.emplace_back(std::move(view));
+	}
+	lk.unlock();
+
+	for (const auto &view : views) {
+		std::lock_guard<std::mutex> vl(view->m_lock);
+		++view->m_gen;
+		switch (type) {
+		case ECKeyTable::TABLE_CHANGE:
+			view->m_ids.clear();
+			view->m_ids_valid = false;
+			view->m_rows.clear();
+			break;
+		case ECKeyTable::TABLE_ROW_ADD:
+		case ECKeyTable::TABLE_ROW_MODIFY:
+			/* Tables take modified rows in if they did not have them. */
+			for (auto id : ids) {
+				if (view->m_ids_valid)
+					view->m_ids.emplace(id);
+				view->m_rows.erase(id);
+			}
+			break;
+		case ECKeyTable::TABLE_ROW_DELETE:
+			for (auto id : ids) {
+				view->m_ids.erase(id);
+				view->m_rows.erase(id);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+size_t ECSharedViewManager::size() const
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	size_t n = 0;
+	for (const auto &v : m_views)
+		if (!v.second.expired())
+			++n;
+	return n;
+}
+
+/* Properties whose value depends on the session that asks for them */
+static bool sv_tag_shareable(unsigned int tag)
+{
+	switch (PROP_ID(tag)) {
+	case PROP_ID(PR_ACCESS):
+	case PROP_ID(PR_ACCESS_LEVEL):
+	case PROP_ID(PR_RIGHTS):
+		return false;
+	default:
+		return true;
+	}
+}
+
+static bool sv_restrict_shareable(const struct restrictTable *rt, unsigned int level)
+{
+	if (rt == nullptr || level > RESTRICT_MAX_DEPTH)
+		return false;
+	switch (rt->ulType) {
+	case RES_AND:
+		for (gsoap_size_t i = 0; i < rt->lpAnd->__size; ++i)
+			if (!sv_restrict_shareable(rt->lpAnd->__ptr[i], level + 1))
+				return false;
+		return true;
+	case RES_OR:
+		for (gsoap_size_t i = 0; i < rt->lpOr->__size; ++i)
+			if (!sv_restrict_shareable(rt->lpOr->__ptr[i], level + 1))
+				return false;
+		return true;
+	case RES_NOT:
+		return sv_restrict_shareable(rt->lpNot->lpNot, level + 1);
+	case RES_COMMENT:
+		return sv_restrict_shareable(rt->lpComment->lpResTable, level + 1);
+	case RES_SUBRESTRICTION:
+		/* Applied to the recipients or attachments of each row */
+		return sv_restrict_shareable(rt->lpSub->lpSubObject, level + 1);
+	case RES_CONTENT:
+		/* May be answered by the indexer, see ECStoreObjectTable::AddRowKey */
+		return false;
+	case RES_PROPERTY:
+		return sv_tag_shareable(rt->lpProp->ulPropTag);
+	case RES_COMPAREPROPS:
+		return sv_tag_shareable(rt->lpCompare->ulPropTag1) &&
+		       sv_tag_shareable(rt->lpCompare->ulPropTag2);
+	case RES_BITMASK:
+		return sv_tag_shareable(rt->lpBitmask->ulPropTag);
+	case RES_SIZE:
+		return sv_tag_shareable(rt->lpSize->ulPropTag);
+	case RES_EXIST:
+		return sv_tag_shareable(rt->lpExist->ulPropTag);
+	default:
+		return false;
+	}
+}
+
+bool ECSharedViewManager::signature(const struct sortOrderArray *so,
+    const struct restrictTable *rt, std::string &sig)
+{
+	sig.clear();
+	for (gsoap_size_t i = 0; so != nullptr && i < so->__size; ++i) {
+		if (!sv_tag_shareable(so->__ptr[i].ulPropTag))
+			return false;
+		sig += stringify_hex(so->__ptr[i].ulPropTag) + ":" +
+		       stringify(so->__ptr[i].ulOrder) + ",";
+	}
+	if (rt == nullptr)
+		return true;
+	if (!sv_restrict_shareable(rt, 0))
+		return false;
+
+	/* Same serialization as ECSearchFolders uses for search criteria */
+	struct soap xmlsoap;
+	std::ostringstream xml;
+	soap_set_mode(&xmlsoap, SOAP_XML_TREE | SOAP_C_UTFSTRING);
+	xmlsoap.os = &xml;
+	soap_serialize_restrictTable(&xmlsoap, rt);
+	if (soap_begin_send(&xmlsoap) != 0 ||
+	    soap_put_restrictTable(&xmlsoap, rt, "Restriction", nullptr) != 0 ||
+	    soap_end_send(&xmlsoap) != 0)
+		return false;
+	sig += "|" + xml.str();
+	return true;
+}
+
+} /* namespace */
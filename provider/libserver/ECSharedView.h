@@ -0,0 +1,99 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <kopano/zcdefs.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <kopano/ECKeyTable.h>
+
+struct restrictTable;
+struct sortOrderArray;
+
+namespace KC {
+
+struct shared_view_key {
+	unsigned int folder, objtype, flags;
+	/*
+	 * The locale of the table, which sort keys and string comparisons
+	 * in restrictions depend on
+	 */
+	std::string locale;
+	/* sort order and restriction, see ECSharedViewManager::signature */
+	std::string sig;
+
+	bool operator<(const shared_view_key &o) const
+	{
+		return std::tie(folder, objtype, flags, locale, sig) <
+		       std::tie(o.folder, o.objtype, o.flags, o.locale, o.sig);
+	}
+};
+
+/*
+ * The part of a contents table that is the same for every session that has
+ * the folder open with the same sort order and restriction: which objects
+ * are in the folder, which of them match the restriction, and their sort
+ * keys. The tables of all those sessions take their rows from here, so
+ * that the folder is read, and each changed row is looked at, only once
+ * (or once per session that does so at the same time); each table still
+ * keeps its own ECKeyTable as the cursor of its session.
+ *
+ * Lock order: a table's m_hLock before m_lock.
+ */
+class ECSharedView final {
+	public:
+	struct row {
+		bool match = false;
+		std::vector<ECSortCol> sortkey;
+	};
+
+	std::mutex m_lock;
+	/* The objects in the folder, as ECStoreObjectTable::Load finds them */
+	std::set<unsigned int> m_ids;
+	bool m_ids_valid = false;
+	/*
+	 * Restriction result and sort key per object. Objects that are not in
+	 * here (yet, or again after a change) are looked at by the next table
+	 * that needs them.
+	 */
+	std::unordered_map<unsigned int, row> m_rows;
+	/*
+	 * Counts the changes of the folder. m_lock is held only to read or
+	 * fill in the above; whoever reads the database meanwhile stores what
+	 * it found only if no change came in since it looked.
+	 */
+	uint64_t m_gen = 0;
+};
+
+class ECSharedViewManager final {
+	public:
+	std::shared_ptr<ECSharedView> get(shared_view_key &&);
+	/* Applies a table change of the folder to all its views. */
+	void update(ECKeyTable::UpdateType, unsigned int folder, unsigned int objtype, unsigned int flags, const std::list<unsigned int> &ids);
+	size_t size() const;
+	/*
+	 * Builds the part of the key that comes from the table. Returns false
+	 * if rows sorted or restricted this way depend on the session, or on
+	 * the indexer, and cannot be shared.
+	 */
+	static bool signature(const struct sortOrderArray *, const struct restrictTable *, std::string &);
+
+	/* Rows that a table took from a view instead of reading them */
+	std::atomic<uint64_t> m_rows_shared{0};
+
+	private:
+	mutable std::mutex m_lock;
+	std::map<shared_view_key, std::weak_ptr<ECSharedView>> m_views;
+};
+
+} /* namespace */
@@ -3,8 +3,12 @@
  * Copyright 2005 - 2016 Zarafa and its licensors
  */
 #include <kopano/platform.h>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <new>
+#include <shared_mutex>
+#include <cstdint>
 #include <ctime>
 #include <libHX/misc.h>
 #include <kopano/tie.hpp>
@@ -127,6 +131,77 @@ void server_stats::fill_odm()
 	g_lpSessionManager->update_extra_stats();
 }
 
+void server_stats::soap_call(const request_stat &st)
+{
+	if (!m_soap_profiling || st.func == nullptr)
+		return;
+	soap_method *m = nullptr;
+	{
+		std::shared_lock<KC::shared_mutex> lk(m_soap_lock);
+		auto i = m_soap_methods.find(st.func);
+		if (i != m_soap_methods.cend())
+			m = i->second.get();
+	}
+	if (m == nullptr) {
+		std::unique_lock<KC::shared_mutex> lk(m_soap_lock);
+		auto &p = m_soap_methods[st.func];
+		if (p == nullptr)
+			p.reset(new soap_method);
+		m = p.get();
+	}
+	uint64_t wall = std::chrono::duration_cast<std::chrono::microseconds>(st.rh1_wall_dur).count();
+	uint64_t cpu = st.rh1_cpu[2].tv_sec * 1000000ULL + st.rh1_cpu[2].tv_nsec / 1000;
+	auto r = std::memory_order_relaxed;
+	m->calls.fetch_add(1, r);
+	if (st.er != erSuccess)
+		m->errors.fetch_add(1, r);
+	m->wall.fetch_add(wall, r);
+	m->cpu.fetch_add(cpu, r);
+	m->queries.fetch_add(st.sql_queries, r);
+	m->rows.fetch_add(st.sql_rows, r);
+	m->bytes.fetch_add(st.bytes_sent, r);
+	m->wall_hist[ECHistogram::index(wall)].fetch_add(1, r);
+	m->cpu_hist[ECHistogram::index(cpu)].fetch_add(1, r);
+}
+
+static ECHistogram soap_hist(const std::atomic<uint64_t> *b)
+{
+	ECHistogram h;
+	h.n.resize(ECHistogram::BUCKETS);
+	for (unsigned int i = 0; i < ECHistogram::BUCKETS; ++i) {
+		h.n[i] = b[i].load(std::memory_order_relaxed);
+		h.count += h.n[i];
+		if (h.n[i] > 0)
+			/* only the bucket is known */
+			h.max = i + 1 < ECHistogram::BUCKETS ? ECHistogram::lower(i + 1) - 1 : UINT64_MAX;
+	}
+	return h;
+}
+
+std::vector<soap_method_usage> server_stats::soap_profile() const
+{
+	std::vector<soap_method_usage> v;
+	std::shared_lock<KC::shared_mutex> lk(m_soap_lock);
+	for (const auto &p : m_soap_methods) {
+		const auto &m = *p.second;
+		soap_method_usage u;
+		u.name     = p.first;
+		u.calls    = m.calls.load();
+		u.errors   = m.errors.load();
+		u.wall     = m.wall.load();
+		u.cpu      = m.cpu.load();
+		u.queries  = m.queries.load();
+		u.rows     = m.rows.load();
+		u.bytes    = m.bytes.load();
+		auto wh = soap_hist(m.wall_hist), ch = soap_hist(m.cpu_hist);
+		u.wall_p50 = wh.quantile(0.5);
+		u.wall_p99 = wh.quantile(0.99);
+		u.cpu_p99  = ch.quantile(0.99);
+		v.push_back(std::move(u));
+	}
+	return v;
+}
+
 ECRESULT ECSystemStatsTable::Load()
 {
 	id = 0;
@@ -1036,4 +1111,289 @@ ECRESULT ECServerStatsTable::QueryRowData(ECGenericObjectTable *lpThis,
 	return erSuccess;
 }
 
+ECSoapStatsTable::ECSoapStatsTable(ECSession *ses, unsigned int ulFlags,
+    const ECLocale &locale) :
+	ECGenericObjectTable(ses, MAPI_STATUS, ulFlags, locale)
+{
+	m_lpfnQueryRowData = QueryRowData;
+}
+
+ECRESULT ECSoapStatsTable::Create(ECSession *lpSession, unsigned int ulFlags,
+    const ECLocale &locale, ECGenericObjectTable **lppTable)
+{
+	return alloc_wrap<ECSoapStatsTable>(lpSession, ulFlags, locale).put(lppTable);
+}
+
+ECRESULT ECSoapStatsTable::Load()
+{
+	/* Take the counters once, so that the rows agree with each other. */
+	m_methods = g_lpSessionManager->m_stats->soap_profile();
+	for (unsigned int i = 0; i < m_methods.size(); ++i)
+		UpdateRow(ECKeyTable::TABLE_ROW_ADD, i, 0);
+	return erSuccess;
+}
+
+ECRESULT ECSoapStatsTable::QueryRowData(ECGenericObjectTable *lpThis,
+    struct soap *soap, ECSession *lpSession, const ECObjectTableList *lpRowList,
+    const struct propTagArray *lpsPropTagArray, const void *lpObjectData,
+    struct rowSet **lppRowSet, bool bCacheTableData, bool bTableLimit)
+{
+	const auto &methods = static_cast<ECSoapStatsTable *>(lpThis)->m_methods;
+	auto lpsRowSet = soap_new_rowSet(soap);
+	lpsRowSet->__size = 0;
+	lpsRowSet->__ptr = NULL;
+
+	if (lpRowList->empty()) {
+		*lppRowSet = lpsRowSet;
+		return erSuccess;
+	}
+
+	// We return a square array with all the values
+	lpsRowSet->__size = lpRowList->size();
+	lpsRowSet->__ptr  = soap_new_propValArray(soap, lpsRowSet->__size);
+
+	// Allocate memory for all rows
+	for (gsoap_size_t i = 0; i < lpsRowSet->__size; ++i) {
+		lpsRowSet->__ptr[i].__size = lpsPropTagArray->__size;
+		lpsRowSet->__ptr[i].__ptr  = soap_new_propVal(soap, lpsPropTagArray->__size);
+	}
+
+	gsoap_size_t i = 0;
+	for (const auto &row : *lpRowList) {
+		for (gsoap_size_t k = 0; k < lpsPropTagArray->__size; ++k) {
+			// default is error prop
+			auto &m = lpsRowSet->__ptr[i].__ptr[k];
+			m.ulPropTag = CHANGE_PROP_TYPE(lpsPropTagArray->__ptr[k], PT_ERROR);
+			m.Value.ul = KCERR_NOT_FOUND;
+			m.__union = SOAP_UNION_propValData_ul;
+			if (row.ulObjId >= methods.size())
+				continue;		// broken .. should never happen
+			const auto &u = methods[row.ulObjId];
+
+			switch (PROP_ID(lpsPropTagArray->__ptr[k])) {
+			case PROP_ID(PR_INSTANCE_KEY):
+				// generate key
+				m.__union = SOAP_UNION_propValData_bin;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.bin = soap_new_xsd__base64Binary(soap);
+				m.Value.bin->__size = sizeof(sObjectTableKey);
+				m.Value.bin->__ptr  = soap_new_unsignedByte(soap, sizeof(sObjectTableKey));
+				memcpy(m.Value.bin->__ptr, &row, sizeof(sObjectTableKey));
+				break;
+			case PROP_ID(PR_DISPLAY_NAME):
+				m.__union = SOAP_UNION_propValData_lpszA;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.lpszA = soap_strdup(soap, u.name.c_str());
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_CALLS):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = u.calls;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_ERRORS):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = u.errors;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_WALL):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = u.wall / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_CPU):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = u.cpu / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_WALL_P50):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = u.wall_p50 / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_WALL_P99):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = u.wall_p99 / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_CPU_P99):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = u.cpu_p99 / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_SQL_QUERIES):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = u.queries;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_SQL_ROWS):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = u.rows;
+				break;
+			case PROP_ID(PR_EC_STATS_SOAP_BYTES):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = u.bytes;
+				break;
+			}
+		}
+		++i;
+	}
+
+	*lppRowSet = lpsRowSet;
+	return erSuccess;
+}
+
+ECSlowStatsTable::ECSlowStatsTable(ECSession *ses, unsigned int ulFlags,
+    const ECLocale &locale) :
+	ECGenericObjectTable(ses, MAPI_STATUS, ulFlags, locale)
+{
+	m_lpfnQueryRowData = QueryRowData;
+}
+
+ECRESULT ECSlowStatsTable::Create(ECSession *lpSession, unsigned int ulFlags,
+    const ECLocale &locale, ECGenericObjectTable **lppTable)
+{
+	return alloc_wrap<ECSlowStatsTable>(lpSession, ulFlags, locale).put(lppTable);
+}
+
+ECRESULT ECSlowStatsTable::Load()
+{
+	m_traces = g_lpSessionManager->m_stats->m_tracer.traces();
+	for (unsigned int i = 0; i < m_traces.size(); ++i)
+		UpdateRow(ECKeyTable::TABLE_ROW_ADD, i, 0);
+	return erSuccess;
+}
+
+ECRESULT ECSlowStatsTable::QueryRowData(ECGenericObjectTable *lpThis,
+    struct soap *soap, ECSession *lpSession, const ECObjectTableList *lpRowList,
+    const struct propTagArray *lpsPropTagArray, const void *lpObjectData,
+    struct rowSet **lppRowSet, bool bCacheTableData, bool bTableLimit)
+{
+	const auto &traces = static_cast<ECSlowStatsTable *>(lpThis)->m_traces;
+	auto lpsRowSet = soap_new_rowSet(soap);
+	lpsRowSet->__size = 0;
+	lpsRowSet->__ptr = NULL;
+
+	if (lpRowList->empty()) {
+		*lppRowSet = lpsRowSet;
+		return erSuccess;
+	}
+
+	// We return a square array with all the values
+	lpsRowSet->__size = lpRowList->size();
+	lpsRowSet->__ptr  = soap_new_propValArray(soap, lpsRowSet->__size);
+
+	// Allocate memory for all rows
+	for (gsoap_size_t i = 0; i < lpsRowSet->__size; ++i) {
+		lpsRowSet->__ptr[i].__size = lpsPropTagArray->__size;
+		lpsRowSet->__ptr[i].__ptr  = soap_new_propVal(soap, lpsPropTagArray->__size);
+	}
+
+	gsoap_size_t i = 0;
+	for (const auto &row : *lpRowList) {
+		for (gsoap_size_t k = 0; k < lpsPropTagArray->__size; ++k) {
+			// default is error prop
+			auto &m = lpsRowSet->__ptr[i].__ptr[k];
+			m.ulPropTag = CHANGE_PROP_TYPE(lpsPropTagArray->__ptr[k], PT_ERROR);
+			m.Value.ul = KCERR_NOT_FOUND;
+			m.__union = SOAP_UNION_propValData_ul;
+			if (row.ulObjId >= traces.size())
+				continue;		// broken .. should never happen
+			const auto &t = traces[row.ulObjId];
+
+			switch (PROP_ID(lpsPropTagArray->__ptr[k])) {
+			case PROP_ID(PR_INSTANCE_KEY):
+				// generate key
+				m.__union = SOAP_UNION_propValData_bin;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.bin = soap_new_xsd__base64Binary(soap);
+				m.Value.bin->__size = sizeof(sObjectTableKey);
+				m.Value.bin->__ptr  = soap_new_unsignedByte(soap, sizeof(sObjectTableKey));
+				memcpy(m.Value.bin->__ptr, &row, sizeof(sObjectTableKey));
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_TIME): {
+				auto ft = UnixTimeToFileTime(t.start);
+				m.__union = SOAP_UNION_propValData_hilo;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.hilo = soap_new_hiloLong(soap);
+				m.Value.hilo->hi = ft.dwHighDateTime;
+				m.Value.hilo->lo = ft.dwLowDateTime;
+				break;
+			}
+			case PROP_ID(PR_DISPLAY_NAME):
+				m.__union = SOAP_UNION_propValData_lpszA;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.lpszA = soap_strdup(soap, t.func.c_str());
+				break;
+			case PROP_ID(PR_EC_USERNAME):
+				m.__union = SOAP_UNION_propValData_lpszA;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.lpszA = soap_strdup(soap, t.user.c_str());
+				break;
+			case PROP_ID(PR_EC_STATS_SESSION_ID):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = t.session;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_WALL):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = t.wall / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_SQL_TIME):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = t.sql_time / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_LOCK_WAIT):
+				m.__union = SOAP_UNION_propValData_dbl;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.dbl = t.lock_wait / 1000000.0;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_OBJECT):
+				m.__union = SOAP_UNION_propValData_ul;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.ul = t.obj_id;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_TABLE):
+				m.__union = SOAP_UNION_propValData_ul;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.ul = t.table_id;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_CACHE_LOOKUPS):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = t.cache_lookups;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_CACHE_HITS):
+				m.__union = SOAP_UNION_propValData_li;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.li = t.cache_hits;
+				break;
+			case PROP_ID(PR_EC_STATS_SLOW_QUERIES): {
+				/* "seconds rows query", in the order they were run */
+				auto n = t.queries.size() + (t.queries_dropped > 0);
+				m.__union = SOAP_UNION_propValData_mvszA;
+				m.ulPropTag = lpsPropTagArray->__ptr[k];
+				m.Value.mvszA.__size = n;
+				m.Value.mvszA.__ptr  = soap_new_string(soap, n);
+				size_t j = 0;
+				for (const auto &q : t.queries)
+					m.Value.mvszA.__ptr[j++] = soap_strdup(soap, format("%.6f %llu %s",
+						q.usec / 1000000.0, static_cast<unsigned long long>(q.rows),
+						q.query.c_str()).c_str());
+				if (t.queries_dropped > 0)
+					m.Value.mvszA.__ptr[j++] = soap_strdup(soap, format("(%u more queries)", t.queries_dropped).c_str());
+				break;
+			}
+			}
+		}
+		++i;
+	}
+
+	*lppRowSet = lpsRowSet;
+	return erSuccess;
+}
+
 } /* namespace */
@@ -8,9 +8,11 @@
 #include <kopano/Util.h>
 #include "ECGenericObjectTable.h"
 #include "ECSession.h"
+#include "ECSessionManager.h"
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 
 namespace KC {
 
@@ -102,4 +104,34 @@ private:
 	ALLOC_WRAP_FRIEND;
 };
 
+/* Per-SOAP-method profile, see server_stats::soap_call */
+class ECSoapStatsTable final : public ECGenericObjectTable {
+protected:
+	ECSoapStatsTable(ECSession *lpSession, unsigned int ulFlags, const ECLocale &locale);
+
+public:
+	static ECRESULT Create(ECSession *, unsigned int flags, const ECLocale &, ECGenericObjectTable **);
+	virtual ECRESULT Load();
+	static ECRESULT QueryRowData(ECGenericObjectTable *, struct soap *, ECSession *, const ECObjectTableList *, const struct propTagArray *, const void *priv, struct rowSet **, bool cache_table_data, bool table_limit);
+
+private:
+	std::vector<soap_method_usage> m_methods;
+	ALLOC_WRAP_FRIEND;
+};
+
+/* Ring of slow request traces, see ECRequestTracer */
+class ECSlowStatsTable final : public ECGenericObjectTable {
+protected:
+	ECSlowStatsTable(ECSession *lpSession, unsigned int ulFlags, const ECLocale &locale);
+
+public:
+	static ECRESULT Create(ECSession *, unsigned int flags, const ECLocale &, ECGenericObjectTable **);
+	virtual ECRESULT Load();
+	static ECRESULT QueryRowData(ECGenericObjectTable *, struct soap *, ECSession *, const ECObjectTableList *, const struct propTagArray *, const void *priv, struct rowSet **, bool cache_table_data, bool table_limit);
+
+private:
+	std::vector<request_trace> m_traces;
+	ALLOC_WRAP_FRIEND;
+};
+
 } /* namespace */
@@ -970,6 +970,24 @@ ECRESULT ECStoreObjectTable::Load()
         // Clear old entries
         Clear();
 
+	/*
+	 * If another session has the folder open the same way, its listing
+	 * is used. Otherwise, we list the folder and leave the result for the
+	 * next one, unless the folder changed meanwhile.
+	 */
+	auto view = GetSharedView();
+	uint64_t view_gen = 0;
+	if (view != nullptr) {
+		std::unique_lock<std::mutex> l_view(view->m_lock);
+		if (view->m_ids_valid) {
+			lstObjIds.assign(view->m_ids.cbegin(), view->m_ids.cend());
+			l_view.unlock();
+			LoadRows(&lstObjIds, 0);
+			return erSuccess;
+		}
+		view_gen = view->m_gen;
+	}
+
         // Load the table with all the objects of type ulObjType and flags ulFlags in container ulParent
 	std::string strQuery = "SELECT hierarchy.id, hierarchy.parent, hierarchy.owner, hierarchy.flags, hierarchy.type FROM hierarchy WHERE hierarchy.parent=" + stringify(ulFolderId);
 
@@ -991,7 +1009,8 @@ ECRESULT ECStoreObjectTable::Load()
 			 strQuery += " AND hierarchy.type = " +  stringify(ulObjType);
 		}
 
-        er = lpDatabase->DoSelect(strQuery, &lpDBResult);
+	/* Streamed, so that a big folder is not held in memory twice */
+	er = lpDatabase->DoSelect(strQuery, &lpDBResult, true);
         if(er != erSuccess)
 		return er;
 
@@ -1013,11 +1032,39 @@ ECRESULT ECStoreObjectTable::Load()
 			lstObjIds.emplace_back(atoi(lpDBRow[0]));
 			++i;
         }
-
+	lpDBResult = DB_RESULT();
+
+	if (view != nullptr) {
+		std::lock_guard<std::mutex> l_view(view->m_lock);
+		if (view->m_gen == view_gen) {
+			view->m_ids.clear();
+			view->m_ids.insert(lstObjIds.cbegin(), lstObjIds.cend());
+			view->m_ids_valid = true;
+		}
+	}
         LoadRows(&lstObjIds, 0);
 	return erSuccess;
 }
 
+std::shared_ptr<ECSharedView> ECStoreObjectTable::GetSharedView()
+{
+	if (m_bSharedViewChecked)
+		return m_lpSharedView;
+	m_bSharedViewChecked = true;
+	auto lpData = static_cast<const ECODStore *>(m_lpObjectData);
+	auto sesmgr = lpSession->GetSessionManager();
+	std::string sig;
+	if (m_ulObjType != MAPI_MESSAGE || lpData->ulFolderId == 0 ||
+	    !parseBool(sesmgr->GetConfig()->GetSetting("shared_table_views")) ||
+	    !ECSharedViewManager::signature(lpsSortOrderArray, lpsRestrict, sig))
+		return nullptr;
+	/* Same flags as the table subscription, see ECTableManager::OpenGenericTable */
+	m_lpSharedView = sesmgr->GetSharedViews()->get({lpData->ulFolderId,
+		m_ulObjType, lpData->ulFlags & (MAPI_ASSOCIATED | MSGFLAG_DELETED),
+		m_locale.getName(), std::move(sig)});
+	return m_lpSharedView;
+}
+
 ECRESULT ECStoreObjectTable::CheckPermissions(unsigned int ulObjId)
 {
     unsigned int ulParent = 0;
@@ -1055,8 +1102,10 @@ ECRESULT ECStoreObjectTable::AddRowKey(ECObjectTableList* lpRows, unsigned int *
     //  - not an initial load (but a table update)
     //  - no restriction
 	//  - not a restriction on a folder (e.g. searchfolder)
+	//  - rows shared with other sessions (their restrictions have nothing for the indexer)
 	if (!bLoad || lpsRestrict == nullptr || lpODStore->ulFolderId == 0 ||
-	    lpODStore->ulStoreId == 0 || (lpODStore->ulFlags & MAPI_ASSOCIATED))
+	    lpODStore->ulStoreId == 0 || (lpODStore->ulFlags & MAPI_ASSOCIATED) ||
+	    GetSharedView() != nullptr)
 		return ECGenericObjectTable::AddRowKey(lpRows, lpulLoaded, ulFlags, bLoad, false, nullptr);
 
         // Attempt to use the indexer
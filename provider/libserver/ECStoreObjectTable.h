@@ -59,6 +59,7 @@ private:
 	virtual ECRESULT GetMVRowCount(std::list<unsigned int> &&obj_ids, std::map<unsigned int, unsigned int> &count) override;
 	virtual ECRESULT ReloadTableMVData(ECObjectTableList *rows, ECListInt *mvproptags) override;
 	virtual ECRESULT CheckPermissions(unsigned int obj_id) override;
+	virtual std::shared_ptr<ECSharedView> GetSharedView() override;
 
 	unsigned int ulPermission = 0;
 	bool fPermissionRead = false;
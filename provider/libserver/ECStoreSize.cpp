@@ -0,0 +1,99 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#include <kopano/platform.h>
+#include <mutex>
+#include "ECStoreSize.h"
+
+namespace KC {
+
+constexpr time_t store_size_cache::MAX_AGE;
+
+bool store_size_cache::get(unsigned int store, time_t now, long long *size)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	++m_req;
+	auto i = m_sizes.find(store);
+	if (i == m_sizes.cend() || !i->second.valid ||
+	    now - i->second.loaded >= MAX_AGE)
+		return false;
+	++m_hit;
+	*size = i->second.size;
+	return true;
+}
+
+bool store_size_cache::loading(unsigned int store, unsigned int *gen)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto &e = m_sizes[store];
+	if (e.busy != 0)
+		return false;
+	*gen = e.gen;
+	return true;
+}
+
+void store_size_cache::loaded(unsigned int store, unsigned int gen,
+    long long size, time_t now)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto i = m_sizes.find(store);
+	if (i == m_sizes.cend() || i->second.busy != 0 || i->second.gen != gen)
+		return;
+	i->second.size = size;
+	i->second.loaded = now;
+	i->second.valid = true;
+}
+
+void store_size_cache::begin(unsigned int store)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	++m_sizes[store].busy;
+}
+
+void store_size_cache::end(unsigned int store, bool set, long long size,
+    bool committed)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	auto i = m_sizes.find(store);
+	if (i == m_sizes.cend())
+		return;
+	auto &e = i->second;
+	if (e.busy > 0)
+		--e.busy;
+	++e.gen;
+	/*
+	 * Additions can be applied in any order, a new size cannot: another
+	 * transaction may have committed after this one and ended before it.
+	 * Subtractions the database refused to take below 0 are not known.
+	 */
+	if (!committed || set || !e.valid || (size < 0 && e.size < -size))
+		e.valid = false;
+	else
+		e.size += size;
+}
+
+void store_size_cache::purge()
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	/* Entries of running transactions are needed for end() */
+	for (auto i = m_sizes.begin(); i != m_sizes.end(); )
+		if (i->second.busy == 0) {
+			i = m_sizes.erase(i);
+		} else {
+			i->second.valid = false;
+			++i;
+		}
+}
+
+struct store_size_cache::stats store_size_cache::get_stats()
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	struct stats st;
+	st.items = m_sizes.size();
+	st.req = m_req;
+	st.hit = m_hit;
+	return st;
+}
+
+} /* namespace */
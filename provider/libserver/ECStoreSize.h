@@ -0,0 +1,71 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <kopano/zcdefs.h>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+
+namespace KC {
+
+/*
+ * Committed store sizes (PR_MESSAGE_SIZE_EXTENDED) for quota checks.
+ *
+ * Writers announce a change of a store with begin() before they change its
+ * row, and pass the outcome to end() once their transaction is over. A size
+ * that is read from the database while a change is busy, or that ended
+ * during the read, is not kept: the reader cannot tell which changes it
+ * includes.
+ */
+class KC_EXPORT store_size_cache final {
+	public:
+	/*
+	 * Sizes are read again this long after they were read from the
+	 * database, in case something other than this server changes them.
+	 * Changes made in between through end() do not restart the clock.
+	 */
+	static constexpr time_t MAX_AGE = 300;
+
+	struct stats {
+		size_t items = 0;
+		uint64_t req = 0, hit = 0;
+	};
+
+	/* Returns true with the size of @store if a recent one is known */
+	bool get(unsigned int store, time_t now, long long *size);
+	/*
+	 * Called before reading the size of @store from the database. Returns
+	 * false if what is read cannot be kept, else sets @gen for loaded().
+	 */
+	bool loading(unsigned int store, unsigned int *gen);
+	void loaded(unsigned int store, unsigned int gen, long long size, time_t now);
+	void begin(unsigned int store);
+	/*
+	 * @size replaces the size of @store if @set, else it is added. Only
+	 * additions are applied to a known size; the rest forget it.
+	 */
+	void end(unsigned int store, bool set, long long size, bool committed);
+	/* Forgets all sizes */
+	void purge();
+	struct stats get_stats();
+
+	private:
+	/*
+	 * @busy counts the changes between begin() and end(), @gen moves
+	 * with each of them ending.
+	 */
+	struct entry {
+		long long size = 0;
+		time_t loaded = 0;
+		unsigned int busy = 0, gen = 0;
+		bool valid = false;
+	};
+	std::mutex m_lock;
+	std::unordered_map<unsigned int, entry> m_sizes;
+	uint64_t m_req = 0, m_hit = 0;
+};
+
+} /* namespace */
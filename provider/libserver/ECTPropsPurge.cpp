@@ -2,11 +2,15 @@
  * SPDX-License-Identifier: AGPL-3.0-only
  * Copyright 2005 - 2016 Zarafa and its licensors
  */
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <utility>
+#include <vector>
 #include <kopano/platform.h>
 #include <kopano/stringutil.h>
 #include <kopano/ECLogger.h>
+#include <kopano/MAPIErrors.h>
 #include <kopano/ECConfig.h>
 #include "ECSession.h"
 #include "ECSessionManager.h"
@@ -19,6 +23,14 @@ using namespace std::chrono_literals;
 
 namespace KC {
 
+/* How often the backlog is counted again in the database */
+static constexpr time_t DEFERRED_RESYNC_INTERVAL = 600;
+/*
+ * How long to leave a folder alone after a purge found nothing, but
+ * counting found records, committed in between
+ */
+static constexpr time_t DEFERRED_RETRY_DELAY = 10;
+
 ECTPropsPurge::ECTPropsPurge(std::shared_ptr<ECConfig> c,
     ECDatabaseFactory *lpDatabaseFactory) :
 	m_lpConfig(std::move(c)), m_lpDatabaseFactory(lpDatabaseFactory)
@@ -31,6 +43,18 @@ ECTPropsPurge::ECTPropsPurge(std::shared_ptr<ECConfig> c,
 	}
 	m_thread_active = true;
     set_thread_name(m_hThread, "TPropsPurge");
+
+	auto nworkers = std::max(1U, atoui(m_lpConfig->GetSetting("deferred_purge_threads")));
+	for (unsigned int i = 0; i < nworkers; ++i) {
+		pthread_t tid;
+		ret = pthread_create(&tid, nullptr, Worker, this);
+		if (ret != 0) {
+			ec_log_err("Could not create TPropsPurge worker thread: %s", strerror(ret));
+			break;
+		}
+		set_thread_name(tid, "TPropsPurge/w");
+		m_workers.emplace_back(tid);
+	}
 }
 
 ECTPropsPurge::~ECTPropsPurge()
@@ -39,11 +63,14 @@ ECTPropsPurge::~ECTPropsPurge()
 	ulock_normal l_exit(m_hMutexExit);
 	m_bExit = true;
 	m_hCondExit.notify_all();
+	m_queue_cond.notify_all();
 	l_exit.unlock();
 
 	// Wait for the thread to exit
 	if (m_thread_active)
 		pthread_join(m_hThread, nullptr);
+	for (auto tid : m_workers)
+		pthread_join(tid, nullptr);
 }
 
 /**
@@ -59,13 +86,24 @@ void * ECTPropsPurge::Thread(void *param)
 	return NULL;
 }
 
+void *ECTPropsPurge::Worker(void *param)
+{
+	kcsrv_blocksigs();
+	static_cast<ECTPropsPurge *>(param)->WorkerThread();
+	return nullptr;
+}
+
 /**
  * Main TProps purger loop
  *
- * This is a constantly running loop that checks the number of deferred updates in the
- * deferredupdate table, and starts purging them if it goes over a certain limit. The purged
- * items are from the largest folder first; A folder with 20 deferredupdates will be purged
- * before a folder with only 10 deferred updates.
+ * This is a constantly running loop that decides which folders need their
+ * deferred updates purged, and hands them to the worker threads. A folder
+ * is purged when it has max_deferred_records_folder records or more, when
+ * its oldest record is older than max_deferred_age, or, while the total
+ * exceeds max_deferred_records, when it is among the largest folders.
+ *
+ * The backlog is tracked in memory (see deferred_backlog), and counted again in
+ * the deferredupdate table every DEFERRED_RESYNC_INTERVAL seconds.
  *
  * The loop (thread) will exit ASAP when m_bExit is set to TRUE.
  *
@@ -75,6 +113,7 @@ ECRESULT ECTPropsPurge::PurgeThread()
 {
     ECRESULT er = erSuccess;
     ECDatabase *lpDatabase = NULL;
+	time_t last_sync = 0;
 
     while(1) {
     	// Run in a loop constantly checking our deferred update table
@@ -82,23 +121,25 @@ ECRESULT ECTPropsPurge::PurgeThread()
 			er = m_lpDatabaseFactory->get_tls_db(&lpDatabase);
             if(er != erSuccess) {
                 ec_log_crit("Unable to get database connection for delayed purge!");
-                Sleep(60000);
+				ulock_normal l_exit(m_hMutexExit);
+				if (m_hCondExit.wait_for(l_exit, 60s, [&]() { return m_bExit; }))
+					break;
                 continue;
             }
         }
+		if (time(nullptr) - last_sync >= DEFERRED_RESYNC_INTERVAL &&
+		    LoadBacklog(lpDatabase) == erSuccess)
+			last_sync = time(nullptr);
 
-		// Wait a while before repolling the count, unless we are requested to exit
-        {
-			ulock_normal l_exit(m_hMutexExit);
-
-			if (m_bExit)
-				break;
-			m_hCondExit.wait_for(l_exit, 10s);
-			if (m_bExit)
-				break;
-        }
-
-        PurgeOverflowDeferred(lpDatabase); // Ignore error, just retry
+		// Wait a while before looking at the backlog, unless we are requested to exit
+		ulock_normal l_exit(m_hMutexExit);
+		if (m_bExit)
+			break;
+		m_hCondExit.wait_for(l_exit, 1s);
+		if (m_bExit)
+			break;
+		l_exit.unlock();
+		PurgeOverflowDeferred();
     }
 
 	m_lpDatabaseFactory->thread_end();
@@ -108,41 +149,236 @@ ECRESULT ECTPropsPurge::PurgeThread()
 /**
  * Purge deferred updates
  *
- * This purges deferred updates until the total number of deferred updates drops below
- * the limit in max_deferred_records.
+ * Queues the folders whose deferred updates need purging for the workers,
+ * see PurgeThread.
  *
- * @param lpDatabase Database to use
  * @return Result
  */
-ECRESULT ECTPropsPurge::PurgeOverflowDeferred(ECDatabase *lpDatabase)
+ECRESULT ECTPropsPurge::PurgeOverflowDeferred()
 {
-	unsigned int ulCount = 0, ulFolderId = 0;
-    unsigned int ulMaxDeferred = atoi(m_lpConfig->GetSetting("max_deferred_records"));
+	auto max_total = atoui(m_lpConfig->GetSetting("max_deferred_records"));
+	auto max_folder = atoui(m_lpConfig->GetSetting("max_deferred_records_folder"));
+	time_t max_age = atoui(m_lpConfig->GetSetting("max_deferred_age"));
 
-	if (ulMaxDeferred == 0)
-		return erSuccess;
-	while (!m_bExit) {
-		auto er = GetDeferredCount(lpDatabase, &ulCount);
-		if (er != erSuccess)
-			return er;
-		if (ulCount < ulMaxDeferred)
+	std::lock_guard<std::mutex> lk(m_hMutexExit);
+	if (m_backlog.schedule(time(nullptr), max_total, max_folder, max_age))
+		m_queue_cond.notify_all();
+	return erSuccess;
+}
+
+/**
+ * Worker loop
+ *
+ * Takes folders off the queue and purges their deferred updates, in
+ * transactions of DEFERRED_PURGE_BATCH records so that row locks are not
+ * held for long. Multiple workers run at the same time, but never on the
+ * same folder.
+ */
+void ECTPropsPurge::WorkerThread()
+{
+	ECDatabase *db = nullptr;
+
+	while (true) {
+		ulock_normal lk(m_hMutexExit);
+		m_queue_cond.wait(lk, [&]() { return m_bExit || m_backlog.queued(); });
+		if (m_bExit)
 			break;
-		auto dtx = lpDatabase->Begin(er);
-		if (er != erSuccess)
-			return er;
-		er = GetLargestFolderId(lpDatabase, &ulFolderId);
-		if (er != erSuccess)
-			return er;
-		er = PurgeDeferredTableUpdates(lpDatabase, ulFolderId);
-		if (er != erSuccess)
-			return er;
-		er = dtx.commit();
+		auto folder = m_backlog.next();
+		lk.unlock();
+
+		auto er = db != nullptr ? erSuccess : m_lpDatabaseFactory->get_tls_db(&db);
+		unsigned int purged = DEFERRED_PURGE_BATCH, total = 0;
+		while (er == erSuccess && purged == DEFERRED_PURGE_BATCH && !m_bExit) {
+			auto dtx = db->Begin(er);
+			if (er != erSuccess)
+				break;
+			er = PurgeBatch(db, folder, DEFERRED_PURGE_BATCH, &purged);
+			if (er != erSuccess)
+				break;
+			er = dtx.commit();
+			if (er != erSuccess)
+				break;
+			total += purged;
+			lk.lock();
+			m_backlog.purged(folder, purged, time(nullptr));
+			lk.unlock();
+		}
+		/* Nothing to do: the count was off, or the records are not committed yet */
+		unsigned int count = 0;
+		if (er == erSuccess && total == 0 && !m_bExit)
+			er = GetDeferredCount(db, folder, &count);
 		if (er != erSuccess)
-			return er;
+			ec_log_warn("Purging deferred updates of folder %u failed: %s (0x%x)",
+				folder, GetMAPIErrorMessage(kcerr_to_mapierr(er, ~0U)), er);
+		lk.lock();
+		if (er == erSuccess && total == 0 && !m_bExit)
+			m_backlog.counted(folder, count, time(nullptr));
+		m_backlog.done(folder);
 	}
+	m_lpDatabaseFactory->thread_end();
+}
+
+/**
+ * Count the deferred updates per folder in the database
+ *
+ * Replaces the in-memory backlog with what is in the deferredupdate table.
+ */
+ECRESULT ECTPropsPurge::LoadBacklog(ECDatabase *db)
+{
+	DB_RESULT result;
+	DB_ROW row;
+	std::unordered_map<unsigned int, unsigned int> counts;
+
+	auto er = db->DoSelect("SELECT folderid, COUNT(*) FROM deferredupdate GROUP BY folderid", &result, true);
+	if (er != erSuccess)
+		return er;
+	while ((row = result.fetch_row()) != nullptr)
+		if (row[0] != nullptr && row[1] != nullptr)
+			counts[atoui(row[0])] = atoui(row[1]);
+	std::lock_guard<std::mutex> lk(m_hMutexExit);
+	m_backlog.load(counts, time(nullptr));
 	return erSuccess;
 }
 
+deferred_stats ECTPropsPurge::get_stats()
+{
+	std::lock_guard<std::mutex> lk(m_hMutexExit);
+	return m_backlog.stats(time(nullptr));
+}
+
+void deferred_backlog::added(unsigned int folder, unsigned int n, time_t now)
+{
+	if (n == 0)
+		return;
+	auto &f = m_folders[folder];
+	if (f.records == 0)
+		f.oldest = now;
+	f.records += n;
+}
+
+void deferred_backlog::moved(unsigned int folder, unsigned int old_folder,
+    unsigned int n, unsigned int affected, time_t now)
+{
+	added(folder, n, now);
+	/* Records that were in @folder already count as 0 or 1; a few too many is harmless */
+	removed(old_folder, affected > n ? affected - n : 0);
+}
+
+void deferred_backlog::removed(unsigned int folder, unsigned int n)
+{
+	auto i = m_folders.find(folder);
+	if (n == 0 || i == m_folders.cend())
+		return;
+	if (n >= i->second.records)
+		m_folders.erase(i);
+	else
+		i->second.records -= n;
+}
+
+void deferred_backlog::purged(unsigned int folder, unsigned int n, time_t now)
+{
+	if (n == 0)
+		return;
+	removed(folder, n);
+	auto i = m_folders.find(folder);
+	/* What is left was added after the purge had started */
+	if (i != m_folders.cend())
+		i->second.oldest = now;
+}
+
+void deferred_backlog::counted(unsigned int folder, unsigned int n, time_t now)
+{
+	/*
+	 * Records of transactions that are still open are not seen; they
+	 * are counted again by the next LoadBacklog.
+	 */
+	if (n == 0) {
+		m_folders.erase(folder);
+		return;
+	}
+	auto &f = m_folders[folder];
+	if (f.records == 0)
+		f.oldest = now;
+	f.records = n;
+	f.retry = now + DEFERRED_RETRY_DELAY;
+}
+
+void deferred_backlog::load(const std::unordered_map<unsigned int, unsigned int> &counts, time_t now)
+{
+	decltype(m_folders) folders;
+	for (const auto &c : counts) {
+		auto &f = folders[c.first];
+		f.records = c.second;
+		/* The age of records is not in the table; keep what we knew */
+		auto i = m_folders.find(c.first);
+		f.oldest = i != m_folders.cend() ? i->second.oldest : now;
+	}
+	m_folders = std::move(folders);
+}
+
+bool deferred_backlog::schedule(time_t now, unsigned int max_total,
+    unsigned int max_folder, time_t max_age)
+{
+	std::vector<std::pair<unsigned int, unsigned int>> largest;
+	unsigned int total = 0;
+	bool queued = false;
+
+	for (const auto &f : m_folders) {
+		total += f.second.records;
+		if (busy(f.first) || now < f.second.retry)
+			continue;
+		if ((max_folder != 0 && f.second.records >= max_folder) ||
+		    (max_age != 0 && now - f.second.oldest >= max_age)) {
+			m_queue.emplace_back(f.first);
+			m_busy.emplace(f.first);
+			queued = true;
+			continue;
+		}
+		largest.emplace_back(f.second.records, f.first);
+	}
+	if (max_total != 0 && total >= max_total) {
+		/* Everything queued so far still counts; drop the largest of the rest until below the limit */
+		std::sort(largest.begin(), largest.end(), std::greater<std::pair<unsigned int, unsigned int>>());
+		for (const auto &f : largest) {
+			if (total < max_total)
+				break;
+			m_queue.emplace_back(f.second);
+			m_busy.emplace(f.second);
+			total -= std::min(total, f.first);
+			queued = true;
+		}
+	}
+	return queued;
+}
+
+unsigned int deferred_backlog::next()
+{
+	auto folder = m_queue.front();
+	m_queue.pop_front();
+	return folder;
+}
+
+unsigned int deferred_backlog::records(unsigned int folder) const
+{
+	auto i = m_folders.find(folder);
+	return i != m_folders.cend() ? i->second.records : 0;
+}
+
+deferred_stats deferred_backlog::stats(time_t now) const
+{
+	deferred_stats st;
+	for (const auto &f : m_folders) {
+		st.records += f.second.records;
+		++st.folders;
+		if (f.second.records > st.max_records) {
+			st.max_records = f.second.records;
+			st.max_folder = f.first;
+		}
+		st.max_age = std::max(st.max_age, now - f.second.oldest);
+	}
+	return st;
+}
+
 /**
  * Get the deferred record count
  *
@@ -193,56 +429,91 @@ ECRESULT ECTPropsPurge::GetLargestFolderId(ECDatabase *lpDatabase, unsigned int
 	return erSuccess;
 }
 
+static ECTPropsPurge *tpp_instance()
+{
+	return g_lpSessionManager != nullptr ? g_lpSessionManager->GetTPropsPurge() : nullptr;
+}
+
 /**
  * Purge deferred table updates stored for folder ulFolderId
  *
  * This purges deferred records for hierarchy and contents tables of ulFolderId, and removes
- * them from the deferredupdate table.
+ * them from the deferredupdate table. Runs in the transaction of the caller.
  *
  * @param[in] lpDatabase Database pointer
  * @param[in] Hierarchy ID of folder to purge
  * @return Result
  */
-// @todo, multiple threads call this function, which will cause problems
 ECRESULT ECTPropsPurge::PurgeDeferredTableUpdates(ECDatabase *lpDatabase, unsigned int ulFolderId)
 {
-	unsigned int ulAffected;
+	unsigned int purged = DEFERRED_PURGE_BATCH, total = 0;
+	while (purged == DEFERRED_PURGE_BATCH) {
+		auto er = PurgeBatch(lpDatabase, ulFolderId, DEFERRED_PURGE_BATCH, &purged);
+		if (er != erSuccess)
+			return er;
+		total += purged;
+	}
+	auto tpp = tpp_instance();
+	if (tpp != nullptr) {
+		std::lock_guard<std::mutex> lk(tpp->m_hMutexExit);
+		tpp->m_backlog.purged(ulFolderId, total, time(nullptr));
+	}
+	return erSuccess;
+}
+
+/**
+ * Purge up to @limit deferred table updates of a folder
+ *
+ * @purged: (out) number of records that were purged; less than @limit if
+ * there are no more
+ */
+ECRESULT ECTPropsPurge::PurgeBatch(ECDatabase *lpDatabase,
+    unsigned int ulFolderId, unsigned int limit, unsigned int *purged)
+{
+	unsigned int ulAffected = 0;
 	DB_RESULT lpDBResult;
 	DB_ROW lpDBRow = NULL;
 	std::string strIn;
 
+	*purged = 0;
 	// This makes sure that we lock the record in the hierarchy *first*. This helps in serializing access and avoiding deadlocks.
-	std::string strQuery = "SELECT hierarchyid FROM deferredupdate WHERE folderid=" + stringify(ulFolderId);
-	auto er = lpDatabase->DoSelect(strQuery, &lpDBResult);
+	std::string strQuery = "SELECT hierarchyid FROM deferredupdate WHERE folderid=" + stringify(ulFolderId) + " LIMIT " + stringify(limit);
+	auto er = lpDatabase->DoSelect(strQuery, &lpDBResult, true);
 	if(er != erSuccess)
 		return er;
-	if (lpDBResult.get_num_rows() == 0)
-		return erSuccess;
 	while ((lpDBRow = lpDBResult.fetch_row()) != nullptr) {
 		strIn += lpDBRow[0];
 		strIn += ",";
 	}
+	if (strIn.empty())
+		return erSuccess;
 	strIn.resize(strIn.size()-1);
 
 	strQuery = "SELECT id FROM hierarchy WHERE id IN(";
 	strQuery += strIn;
 	strQuery += ") FOR UPDATE";
-	er = lpDatabase->DoSelect(strQuery, &lpDBResult);
+	er = lpDatabase->DoSelect(strQuery, nullptr);
 	if(er != erSuccess)
 		return er;
 
+	/*
+	 * Only the records that were selected, and only while they still
+	 * point to this folder: a message moved on in the meantime keeps its
+	 * record for the next folder.
+	 */
 	strQuery = "REPLACE INTO tproperties (folderid, hierarchyid, tag, type, val_ulong, val_string, val_binary, val_double, val_longint, val_hi, val_lo) ";
-	strQuery += "SELECT " + stringify(ulFolderId) + ", p.hierarchyid, p.tag, p.type, val_ulong, LEFT(val_string, " + stringify(TABLE_CAP_STRING) + "), LEFT(val_binary, " + stringify(TABLE_CAP_BINARY) + "), val_double, val_longint, val_hi, val_lo FROM properties AS p JOIN deferredupdate ON deferredupdate.hierarchyid=p.hierarchyid WHERE tag NOT IN(4105, 4115) AND deferredupdate.folderid = " + stringify(ulFolderId);
+	strQuery += "SELECT " + stringify(ulFolderId) + ", p.hierarchyid, p.tag, p.type, val_ulong, LEFT(val_string, " + stringify(TABLE_CAP_STRING) + "), LEFT(val_binary, " + stringify(TABLE_CAP_BINARY) + "), val_double, val_longint, val_hi, val_lo FROM properties AS p JOIN deferredupdate ON deferredupdate.hierarchyid=p.hierarchyid WHERE tag NOT IN(4105, 4115) AND deferredupdate.folderid = " + stringify(ulFolderId) + " AND deferredupdate.hierarchyid IN(" + strIn + ")";
 	er = lpDatabase->DoInsert(strQuery);
 	if(er != erSuccess)
 		return er;
 
-	strQuery = "DELETE FROM deferredupdate WHERE hierarchyid IN(" + strIn + ")";
+	strQuery = "DELETE FROM deferredupdate WHERE folderid=" + stringify(ulFolderId) + " AND hierarchyid IN(" + strIn + ")";
 	er = lpDatabase->DoDelete(strQuery, &ulAffected);
 	if(er != erSuccess)
 		return er;
 	g_lpSessionManager->m_stats->inc(SCN_DATABASE_MERGES);
 	g_lpSessionManager->m_stats->inc(SCN_DATABASE_MERGED_RECORDS, static_cast<int>(ulAffected));
+	*purged = ulAffected;
 	return erSuccess;
 }
 
@@ -292,21 +563,72 @@ ECRESULT ECTPropsPurge::AddDeferredUpdate(ECSession *lpSession, ECDatabase *lpDa
  */
 ECRESULT ECTPropsPurge::AddDeferredUpdateNoPurge(ECDatabase *lpDatabase, unsigned int ulFolderId, unsigned int ulOldFolderId, unsigned int ulObjId)
 {
-	std::string strQuery;
+	return AddDeferredUpdates(lpDatabase, ulFolderId, ulOldFolderId, {ulObjId});
+}
+
+std::vector<std::string> deferred_update_queries(unsigned int ulFolderId,
+    unsigned int ulOldFolderId, const std::vector<unsigned int> &objs)
+{
+	std::vector<std::string> queries;
+	auto src = stringify(ulOldFolderId != 0 ? ulOldFolderId : ulFolderId);
+	auto dst = stringify(ulFolderId);
 
-	if (ulOldFolderId)
-		// Message has moved into a new folder. If the record is already there, then just update the existing record so that srcfolderid from a previous move remains untouched.
-		strQuery = "INSERT INTO deferredupdate(hierarchyid, srcfolderid, folderid) VALUES(" + stringify(ulObjId) + "," + stringify(ulOldFolderId) + "," + stringify(ulFolderId) + ") ON DUPLICATE KEY UPDATE folderid = " + stringify(ulFolderId);
-	else
-		// Message has modified. If there is already a record for this message, we don't need to do anything
-		strQuery = "INSERT IGNORE INTO deferredupdate(hierarchyid, srcfolderid, folderid) VALUES(" + stringify(ulObjId) + "," + stringify(ulFolderId) + "," + stringify(ulFolderId) + ")";
-	return lpDatabase->DoInsert(strQuery);
+	for (size_t i = 0; i < objs.size(); i += DEFERRED_PURGE_BATCH) {
+		std::string strQuery;
+		auto n = std::min(objs.size() - i, static_cast<size_t>(DEFERRED_PURGE_BATCH));
+
+		for (size_t j = i; j < i + n; ++j) {
+			if (!strQuery.empty())
+				strQuery += ",";
+			strQuery += "(" + stringify(objs[j]) + "," + src + "," + dst + ")";
+		}
+		if (ulOldFolderId)
+			// Message has moved into a new folder. If the record is already there, then just update the existing record so that srcfolderid from a previous move remains untouched.
+			strQuery = "INSERT INTO deferredupdate(hierarchyid, srcfolderid, folderid) VALUES" + strQuery + " ON DUPLICATE KEY UPDATE folderid = " + dst;
+		else
+			// Message has modified. If there is already a record for this message, we don't need to do anything
+			strQuery = "INSERT IGNORE INTO deferredupdate(hierarchyid, srcfolderid, folderid) VALUES" + strQuery;
+		queries.emplace_back(std::move(strQuery));
+	}
+	return queries;
+}
+
+/**
+ * Add deferred updates for a number of objects
+ *
+ * Like AddDeferredUpdateNoPurge, for all of @objs, with one statement per
+ * DEFERRED_PURGE_BATCH objects.
+ */
+ECRESULT ECTPropsPurge::AddDeferredUpdates(ECDatabase *lpDatabase,
+    unsigned int ulFolderId, unsigned int ulOldFolderId,
+    const std::vector<unsigned int> &objs)
+{
+	auto tpp = tpp_instance();
+	size_t i = 0;
+
+	for (const auto &q : deferred_update_queries(ulFolderId, ulOldFolderId, objs)) {
+		unsigned int affected = 0;
+		auto n = std::min(objs.size() - i, static_cast<size_t>(DEFERRED_PURGE_BATCH));
+		i += n;
+		auto er = lpDatabase->DoInsert(q, nullptr, &affected);
+		if (er != erSuccess)
+			return er;
+		if (tpp == nullptr)
+			continue;
+		std::lock_guard<std::mutex> lk(tpp->m_hMutexExit);
+		if (ulOldFolderId != 0)
+			tpp->m_backlog.moved(ulFolderId, ulOldFolderId, n, affected, time(nullptr));
+		else
+			tpp->m_backlog.added(ulFolderId, affected, time(nullptr));
+	}
+	return erSuccess;
 }
 
 /**
  * Purge the deferred updates table if the count for the folder exceeds max_deferred_records_folder
  *
- * Purges the deferred updates for the folder if necessary.
+ * With the purger running, this only wakes it up; the folder is purged in
+ * the background once the caller's transaction is committed.
  *
  * @param[in] lpSession Session that created the change
  * @param[in] lpDatabase Database handle
@@ -315,11 +637,19 @@ ECRESULT ECTPropsPurge::AddDeferredUpdateNoPurge(ECDatabase *lpDatabase, unsigne
  */
 ECRESULT ECTPropsPurge::NormalizeDeferredUpdates(ECSession *lpSession, ECDatabase *lpDatabase, unsigned int ulFolderId)
 {
-	unsigned int ulCount = 0;
 	auto ulMaxDeferred = atoui(lpSession->GetSessionManager()->GetConfig()->GetSetting("max_deferred_records_folder"));
+	auto tpp = lpSession->GetSessionManager()->GetTPropsPurge();
 
 	if (ulMaxDeferred == 0)
 		return erSuccess;
+	if (tpp != nullptr && !tpp->m_workers.empty()) {
+		std::lock_guard<std::mutex> lk(tpp->m_hMutexExit);
+		if (tpp->m_backlog.records(ulFolderId) >= ulMaxDeferred)
+			tpp->m_hCondExit.notify_all();
+		return erSuccess;
+	}
+	/* No workers; purge here as it used to be */
+	unsigned int ulCount = 0;
 	auto er = GetDeferredCount(lpDatabase, ulFolderId, &ulCount);
 	if (er != erSuccess)
 		return er;
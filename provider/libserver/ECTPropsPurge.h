@@ -4,9 +4,18 @@
  */
 #pragma once
 #include <kopano/zcdefs.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ctime>
 #include <pthread.h>
+#include <kopano/kcodes.h>
 
 namespace KC {
 
@@ -15,6 +24,70 @@ class ECConfig;
 class ECDatabaseFactory;
 class ECSession;
 
+struct deferred_stats {
+	unsigned int records = 0, folders = 0;
+	/* The folder with the most records, and how many */
+	unsigned int max_folder = 0, max_records = 0;
+	/* Age of the oldest record, in seconds */
+	time_t max_age = 0;
+};
+
+/* Records moved to tproperties per statement (and per transaction, for the workers) */
+static constexpr unsigned int DEFERRED_PURGE_BATCH = 5000;
+
+/*
+ * What the purger knows of the deferredupdate records of each folder, and
+ * which folders are handed to the workers. Counted as records are added,
+ * before their transaction commits, so the counts can be too high after a
+ * rollback; a worker whose purge finds nothing to do counts the folder
+ * again (see counted). Not locked by itself.
+ */
+class KC_EXPORT deferred_backlog final {
+	public:
+	void added(unsigned int folder, unsigned int n, time_t now);
+	/*
+	 * @n records for @folder went through INSERT ... ON DUPLICATE KEY
+	 * UPDATE with @affected rows: 1 per new record, 2 per record that
+	 * moved over from @old_folder.
+	 */
+	void moved(unsigned int folder, unsigned int old_folder, unsigned int n, unsigned int affected, time_t now);
+	void purged(unsigned int folder, unsigned int n, time_t now);
+	/* @n records of @folder are in the table, as far as committed */
+	void counted(unsigned int folder, unsigned int n, time_t now);
+	/* Replaces the counts with @counts from the table */
+	void load(const std::unordered_map<unsigned int, unsigned int> &counts, time_t now);
+	/*
+	 * Queues the folders that need purging, see ECTPropsPurge::PurgeThread.
+	 * Returns whether it queued any.
+	 */
+	bool schedule(time_t now, unsigned int max_total, unsigned int max_folder, time_t max_age);
+	bool queued() const { return !m_queue.empty(); }
+	/* Takes the next folder off the queue; it stays busy until done() */
+	unsigned int next();
+	void done(unsigned int folder) { m_busy.erase(folder); }
+	bool busy(unsigned int folder) const { return m_busy.find(folder) != m_busy.cend(); }
+	unsigned int records(unsigned int folder) const;
+	deferred_stats stats(time_t now) const;
+
+	private:
+	struct folder {
+		unsigned int records = 0;
+		time_t oldest = 0, retry = 0;
+	};
+
+	void removed(unsigned int folder, unsigned int n);
+
+	std::unordered_map<unsigned int, folder> m_folders;
+	std::deque<unsigned int> m_queue;
+	std::set<unsigned int> m_busy;
+};
+
+/*
+ * The statements that add deferred updates for @objs, one per
+ * DEFERRED_PURGE_BATCH objects. See ECTPropsPurge::AddDeferredUpdates.
+ */
+extern KC_EXPORT std::vector<std::string> deferred_update_queries(unsigned int folder, unsigned int old_folder, const std::vector<unsigned int> &objs);
+
 class ECTPropsPurge final {
 public:
 	ECTPropsPurge(std::shared_ptr<ECConfig>, ECDatabaseFactory *lpDatabaseFactory);
@@ -25,20 +98,34 @@ public:
     static ECRESULT GetLargestFolderId(ECDatabase *lpDatabase, unsigned int *lpulFolderId);
     static ECRESULT AddDeferredUpdate(ECSession *lpSession, ECDatabase *lpDatabase, unsigned int ulFolderId, unsigned int ulOldFolderId, unsigned int ulObjId);
     static ECRESULT AddDeferredUpdateNoPurge(ECDatabase *lpDatabase, unsigned int ulFolderId, unsigned int ulOldFolderId, unsigned int ulObjId);
+	static ECRESULT AddDeferredUpdates(ECDatabase *, unsigned int folder, unsigned int old_folder, const std::vector<unsigned int> &objs);
     static ECRESULT NormalizeDeferredUpdates(ECSession *lpSession, ECDatabase *lpDatabase, unsigned int ulFolderId);
 
+	deferred_stats get_stats();
+
 private:
     ECRESULT PurgeThread();
-    ECRESULT PurgeOverflowDeferred(ECDatabase *lpDatabase);
+	ECRESULT PurgeOverflowDeferred();
+	void WorkerThread();
+	ECRESULT LoadBacklog(ECDatabase *);
+	static ECRESULT PurgeBatch(ECDatabase *, unsigned int folder, unsigned int limit, unsigned int *purged);
     static ECRESULT GetDeferredCount(ECDatabase *lpDatabase, unsigned int ulFolderId, unsigned int *lpulCount);
     static void *Thread(void *param);
+	static void *Worker(void *);
 
 	std::mutex m_hMutexExit;
 	std::condition_variable m_hCondExit;
     pthread_t			m_hThread;
-	bool m_thread_active = false, m_bExit = false;
+	bool m_thread_active = false;
+	/* Also read by the workers between batches, without the lock */
+	std::atomic<bool> m_bExit{false};
 	std::shared_ptr<ECConfig> m_lpConfig;
     ECDatabaseFactory *m_lpDatabaseFactory;
+
+	/* Protected by m_hMutexExit */
+	deferred_backlog m_backlog;
+	std::condition_variable m_queue_cond;
+	std::vector<pthread_t> m_workers;
 };
 
 } /* namespace */
@@ -141,6 +141,21 @@ static const unsigned int sServerStatsProps[] = {
 	PR_EC_STATS_SERVER_PROXYURL, PR_EC_STATS_SERVER_HTTPURL,
 	PR_EC_STATS_SERVER_HTTPSURL, PR_EC_STATS_SERVER_FILEURL,
 };
+static const unsigned int sSoapStatsProps[] = {
+	PR_DISPLAY_NAME, PR_EC_STATS_SOAP_CALLS, PR_EC_STATS_SOAP_ERRORS,
+	PR_EC_STATS_SOAP_WALL, PR_EC_STATS_SOAP_WALL_P50,
+	PR_EC_STATS_SOAP_WALL_P99, PR_EC_STATS_SOAP_CPU,
+	PR_EC_STATS_SOAP_CPU_P99, PR_EC_STATS_SOAP_SQL_QUERIES,
+	PR_EC_STATS_SOAP_SQL_ROWS, PR_EC_STATS_SOAP_BYTES,
+};
+static const unsigned int sSlowStatsProps[] = {
+	PR_EC_STATS_SLOW_TIME, PR_DISPLAY_NAME, PR_EC_USERNAME_A,
+	PR_EC_STATS_SESSION_ID, PR_EC_STATS_SLOW_WALL,
+	PR_EC_STATS_SLOW_SQL_TIME, PR_EC_STATS_SLOW_LOCK_WAIT,
+	PR_EC_STATS_SLOW_OBJECT, PR_EC_STATS_SLOW_TABLE,
+	PR_EC_STATS_SLOW_CACHE_LOOKUPS, PR_EC_STATS_SLOW_CACHE_HITS,
+	PR_EC_STATS_SLOW_QUERIES,
+};
 
 static const struct propTagArray sPropTagArrayContents =
 	{const_cast<unsigned int *>(sContentsProps), ARRAY_SIZE(sContentsProps)};
@@ -163,6 +178,10 @@ static const struct propTagArray sPropTagArrayCompanyStats =
 	{const_cast<unsigned int *>(sCompanyStatsProps), ARRAY_SIZE(sCompanyStatsProps)};
 static const struct propTagArray sPropTagArrayServerStats =
 	{const_cast<unsigned int *>(sServerStatsProps), ARRAY_SIZE(sServerStatsProps)};
+static const struct propTagArray sPropTagArraySoapStats =
+	{const_cast<unsigned int *>(sSoapStatsProps), ARRAY_SIZE(sSoapStatsProps)};
+static const struct propTagArray sPropTagArraySlowStats =
+	{const_cast<unsigned int *>(sSlowStatsProps), ARRAY_SIZE(sSlowStatsProps)};
 
 ECTableManager::~ECTableManager()
 {
@@ -443,6 +462,28 @@ ECRESULT ECTableManager::OpenStatsTable(unsigned int ulTableType, unsigned int u
 		lpEntry->ulTableType = TABLE_ENTRY::TABLE_TYPE_SERVERSTATS;
 		er = lpTable->SetColumns(&sPropTagArrayServerStats, true);
 		break;
+	case TABLETYPE_STATS_SOAP:
+		if ((hosted && adminlevel < ADMIN_LEVEL_SYSADMIN) || (!hosted && adminlevel < ADMIN_LEVEL_ADMIN)) {
+			AuditStatsAccess(lpSession, "denied", "soap");
+			return KCERR_NO_ACCESS;
+		}
+		er = ECSoapStatsTable::Create(lpSession, ulFlags, createLocaleFromName(lpszLocaleId), &~lpTable);
+		if (er != erSuccess)
+			return er;
+		lpEntry->ulTableType = TABLE_ENTRY::TABLE_TYPE_SOAPSTATS;
+		er = lpTable->SetColumns(&sPropTagArraySoapStats, true);
+		break;
+	case TABLETYPE_STATS_SLOW:
+		if ((hosted && adminlevel < ADMIN_LEVEL_SYSADMIN) || (!hosted && adminlevel < ADMIN_LEVEL_ADMIN)) {
+			AuditStatsAccess(lpSession, "denied", "slow");
+			return KCERR_NO_ACCESS;
+		}
+		er = ECSlowStatsTable::Create(lpSession, ulFlags, createLocaleFromName(lpszLocaleId), &~lpTable);
+		if (er != erSuccess)
+			return er;
+		lpEntry->ulTableType = TABLE_ENTRY::TABLE_TYPE_SLOWSTATS;
+		er = lpTable->SetColumns(&sPropTagArraySlowStats, true);
+		break;
 	default:
 		er = KCERR_UNKNOWN;
 		break;
@@ -517,6 +558,7 @@ ECRESULT ECTableManager::OpenABTable(unsigned int ulParent, unsigned int ulParen
 
 ECRESULT ECTableManager::GetTable(unsigned int ulTableId, ECGenericObjectTable **lppTable)
 {
+	ECRequestTracer::set_table(ulTableId);
 	scoped_rlock lock(hListMutex);
 
 	auto iterTables = mapTable.find(ulTableId);
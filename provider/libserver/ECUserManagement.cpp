@@ -326,6 +326,15 @@ ECRESULT ECUserManagement::GetLocalObjectListFromSignatures(const signatures_t &
 	return erSuccess;
 }
 
+/*
+ * Marks are ordered the way LDAPUserPlugin::getChangedObjects orders them:
+ * the longer one, or else the one that sorts last, is the later.
+ */
+static bool sync_mark_before(const std::string &a, const std::string &b)
+{
+	return a.size() < b.size() || (a.size() == b.size() && a < b);
+}
+
 /**
  * Get object list
  *
@@ -412,10 +421,30 @@ ECRESULT ECUserManagement::GetCompanyObjectListAndSync(objectclass_t objclass,
 	alluser.clear();
 
 	if (bSync && !bIsSafeMode) {
+		/*
+		 * With sync_gab_incremental, only the objects changed since
+		 * the mark of the last sync are fetched, unless there is no
+		 * mark (yet, or any more) or a full sync is due.
+		 */
+		bool bTrack = rst == nullptr && parseBool(m_lpConfig->GetSetting("sync_gab_incremental"));
+		std::string strSince, strNext;
+		bool bMarkStuck = false;
+		if (bTrack && !(ulFlags & USERMANAGEMENT_FORCE_SYNC) &&
+		    GetSyncState(objclass, ulCompanyId, &strSince) != erSuccess)
+			strSince.clear();
 		// We now have a map, mapping external IDs to local user IDs (and their signatures)
 		try {
+			if (bTrack) {
+				try {
+					lpExternSignatures = lpPlugin->getChangedObjects(extcompany, objclass, strSince, &strNext);
+				} catch (const notimplemented &) {
+					bTrack = false;
+					strSince.clear();
+				}
+			}
 			// Get full user list
-			lpExternSignatures = lpPlugin->getAllObjects(extcompany, objclass, rst);
+			if (!bTrack)
+				lpExternSignatures = lpPlugin->getAllObjects(extcompany, objclass, rst);
 			// TODO: check requested 'objclass'
 		} catch (const notsupported &) {
 			return KCERR_NO_SUPPORT;
@@ -434,9 +463,14 @@ ECRESULT ECUserManagement::GetCompanyObjectListAndSync(objectclass_t objclass,
 			if (iterSignatureIdToLocal == mapSignatureIdToLocal.cend()) {
 				// User is in external user database, but not in local, so add
 				er = MoveOrCreateLocalObject(ext_sig, &ulObjectId, &bMoved);
-				if (er != erSuccess)
-					// Create failed, so skip this entry
+				if (er != erSuccess) {
+					// Create failed, so skip this entry, and have the next incremental sync fetch it again
+					if (bTrack && ext_sig.signature.empty())
+						bMarkStuck = true;
+					else if (bTrack && sync_mark_before(ext_sig.signature, strNext))
+						strNext = ext_sig.signature;
 					continue;
+				}
 
 				// Entry was moved rather then created, this means that in our localIdList we have
 				// an entry which matches this object.
@@ -461,6 +495,19 @@ ECRESULT ECUserManagement::GetCompanyObjectListAndSync(objectclass_t objclass,
 			// Add to conversion map so we can obtain the details
 			mapExternIdToLocal.emplace(ext_sig.id, ulObjectId);
 		}
+		if (!strSince.empty()) {
+			/*
+			 * Only the changes were fetched; all other objects are
+			 * as they were. Deletions are found by the next full sync.
+			 */
+			for (const auto &sil : mapSignatureIdToLocal) {
+				lpExternSignatures.emplace_back(sil.first, sil.second.second);
+				mapExternIdToLocal.emplace(sil.first, sil.second.first);
+			}
+			mapSignatureIdToLocal.clear();
+		}
+		if (bTrack)
+			SetSyncState(objclass, ulCompanyId, bMarkStuck ? strSince : strNext, strSince.empty());
 	} else if (bSync && strcmp(safe_mode, "verbose") == 0) {
 		try {
 			lpExternSignatures = lpPlugin->getAllObjects(extcompany, objclass, rst);
@@ -528,6 +575,75 @@ ECRESULT ECUserManagement::GetCompanyObjectListAndSync(objectclass_t objclass,
 	return erSuccess;
 }
 
+/*
+ * The state of the incremental synchronization of one object list is kept
+ * in the settings table as "<time of the last full sync> <mark>".
+ */
+static std::string sync_state_name(objectclass_t objclass, unsigned int ulCompanyId)
+{
+	return "gab_sync_" + stringify_hex(objclass) + "_" + stringify(ulCompanyId);
+}
+
+/**
+ * Get the mark from which the synchronization of an object list can
+ * continue incrementally.
+ *
+ * @return KCERR_NOT_FOUND if there is none, or if a full sync is due
+ */
+ECRESULT ECUserManagement::GetSyncState(objectclass_t objclass,
+    unsigned int ulCompanyId, std::string *lpstrMark) const
+{
+	ECDatabase *lpDatabase = nullptr;
+	DB_RESULT lpResult;
+
+	auto er = m_lpSession->GetDatabase(&lpDatabase);
+	if (er != erSuccess)
+		return er;
+	er = lpDatabase->DoSelect("SELECT `value` FROM `settings` WHERE `name`='" +
+	     sync_state_name(objclass, ulCompanyId) + "' LIMIT 1", &lpResult);
+	if (er != erSuccess)
+		return er;
+	auto lpRow = lpResult.fetch_row();
+	auto lpLen = lpResult.fetch_row_lengths();
+	if (lpRow == nullptr || lpRow[0] == nullptr || lpLen == nullptr)
+		return KCERR_NOT_FOUND;
+	std::string strState(lpRow[0], lpLen[0]);
+	auto pos = strState.find(' ');
+	if (pos == std::string::npos || pos + 1 == strState.size())
+		return KCERR_NOT_FOUND;
+	time_t full = strtoull(strState.c_str(), nullptr, 10);
+	time_t interval = atoui(m_lpConfig->GetSetting("sync_gab_full_interval"));
+	if (interval > 0 && time(nullptr) - full >= interval)
+		return KCERR_NOT_FOUND;
+	lpstrMark->assign(strState, pos + 1, std::string::npos);
+	return erSuccess;
+}
+
+/**
+ * Record the mark to continue the next synchronization of an object list
+ * from. @bFull says whether the list was synchronized completely.
+ */
+ECRESULT ECUserManagement::SetSyncState(objectclass_t objclass,
+    unsigned int ulCompanyId, const std::string &strMark, bool bFull)
+{
+	ECDatabase *lpDatabase = nullptr;
+
+	auto er = m_lpSession->GetDatabase(&lpDatabase);
+	if (er != erSuccess)
+		return er;
+	auto strName = sync_state_name(objclass, ulCompanyId);
+	if (bFull)
+		er = lpDatabase->DoInsert("REPLACE INTO `settings` VALUES ('" + strName + "', " +
+		     lpDatabase->EscapeBinary(stringify_int64(time(nullptr)) + " " + strMark) + ")");
+	else
+		er = lpDatabase->DoUpdate("UPDATE `settings` SET `value`=CONCAT(SUBSTRING_INDEX(`value`, ' ', 1), ' ', " +
+		     lpDatabase->EscapeBinary(strMark) + ") WHERE `name`='" + strName + "'");
+	if (er != erSuccess)
+		ec_log_warn("Unable to save the synchronization state of %s: %s",
+			strName.c_str(), GetMAPIErrorMessage(kcerr_to_mapierr(er)));
+	return er;
+}
+
 ECRESULT ECUserManagement::GetSubObjectsOfObjectAndSync(userobject_relation_t relation,
     unsigned int ulParentId, std::list<localobjectdetails_t> &objs, unsigned int ulFlags)
 {
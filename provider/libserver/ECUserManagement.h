@@ -153,6 +153,8 @@ private:
 	KC_HIDDEN ECRESULT GetUserAndCompanyFromLoginName(const std::string &login, std::string *user, std::string *company) const;
 
 	// Process the modification of a user-object
+	KC_HIDDEN ECRESULT GetSyncState(objectclass_t, unsigned int company_id, std::string *mark) const;
+	KC_HIDDEN ECRESULT SetSyncState(objectclass_t, unsigned int company_id, const std::string &mark, bool full);
 	KC_HIDDEN ECRESULT CheckObjectModified(unsigned int obj_id, const std::string &localsignature, const std::string &remotesignature);
 	KC_HIDDEN ECRESULT ProcessModification(unsigned int id, const std::string &newsignature);
 
@@ -126,17 +126,57 @@ ECRESULT CalculateObjectSize(ECDatabase* lpDatabase, unsigned int objid, unsigne
 	return erSuccess;
 }
 
+/*
+ * UpdateObjectSize for stores. The store size cache hears of the change
+ * before the row changes, and of its outcome once the transaction is over,
+ * or right away outside of one.
+ */
+static ECRESULT UpdateStoreSize(ECDatabase *db, unsigned int store,
+    eSizeUpdateAction action, long long size)
+{
+	auto cache = g_lpSessionManager->GetCacheManager();
+	store_size_trans local(cache), *trans = &local;
+	if (db->in_transaction()) {
+		trans = db->get_trans_hook<store_size_trans>();
+		if (trans == nullptr) {
+			auto h = make_unique_nt<store_size_trans>(cache);
+			if (h == nullptr)
+				return KCERR_NOT_ENOUGH_MEMORY;
+			trans = h.get();
+			db->add_trans_hook(std::move(h));
+		}
+	}
+	trans->begin(store);
+	ECRESULT er;
+	if (action == UPDATE_SET) {
+		er = db->DoInsert("REPLACE INTO properties(hierarchyid, tag, type, val_longint) VALUES(" + stringify(store) + "," + stringify(PROP_ID(PR_MESSAGE_SIZE_EXTENDED)) + "," + stringify(PROP_TYPE(PR_MESSAGE_SIZE_EXTENDED)) + "," + stringify_int64(size) + ")");
+		if (er == erSuccess)
+			trans->changed(store, true, size);
+	} else {
+		unsigned int affected = 0;
+		auto query = "UPDATE properties SET val_longint=val_longint" + std::string(action == UPDATE_ADD ? "+" : "-") + stringify_int64(size) + " WHERE tag=" + stringify(PROP_ID(PR_MESSAGE_SIZE_EXTENDED)) + " AND type=" + stringify(PROP_TYPE(PR_MESSAGE_SIZE_EXTENDED)) + " AND hierarchyid=" + stringify(store);
+		if (action == UPDATE_SUB)
+			query += " AND val_longint >=" + stringify_int64(size);
+		er = db->DoUpdate(query, &affected);
+		/* A subtraction that the database refused changes nothing */
+		if (er == erSuccess && affected > 0)
+			trans->changed(store, false, action == UPDATE_ADD ? size : -size);
+	}
+	if (trans == &local)
+		local.end(er == erSuccess);
+	return er;
+}
+
 ECRESULT UpdateObjectSize(ECDatabase* lpDatabase, unsigned int ulObjId, unsigned int ulObjType, eSizeUpdateAction updateAction, long long llSize)
 {
 	unsigned int ulPropTag = 0, ulAffRows = 0;
 	std::string strField;
 
+	if (ulObjType == MAPI_STORE)
+		return UpdateStoreSize(lpDatabase, ulObjId, updateAction, llSize);
 	if(ulObjType == MAPI_ATTACH) {
 		ulPropTag = PR_ATTACH_SIZE;
 		strField = "val_ulong";
-	}else if(ulObjType == MAPI_STORE) {
-		ulPropTag = PR_MESSAGE_SIZE_EXTENDED;
-		strField = "val_longint";
 	}else {
 		ulPropTag = PR_MESSAGE_SIZE;
 		strField = "val_ulong";
@@ -8,6 +8,10 @@
 #include "ECDatabaseUtils.h"
 #include "ECSession.h"
 #include "cmdutil.hpp"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 #include <SOAPUtils.h>
 #ifdef KNOB144
 #include <cstdio>
@@ -27,4 +31,35 @@ typedef const StreamCaps* LPCSTREAMCAPS;
 ECRESULT SerializeMessage(ECSession *lpecSession, ECDatabase *lpDatabase, ECAttachmentStorage *lpAttachmentStorage, LPCSTREAMCAPS lpStreamInfo, unsigned int ulObjId, unsigned int ulObjType, unsigned int ulStoreId, GUID *lpsGuid, ULONG ulFlags, ECSerializer *lpSink, bool bTop);
 ECRESULT DeserializeObject(ECSession *lpecSession, ECDatabase *lpDatabase, ECAttachmentStorage *lpAttachmentStorage, LPCSTREAMCAPS lpStreamInfo, unsigned int ulObjId, unsigned int ulStoreId, GUID *lpsGuid, bool bNewItem, unsigned long long ullIMAP, ECSerializer *lpSource, struct propValArray **lppPropValArray);
 
+/*
+ * What SerializeMessage needs from the database for a whole batch of
+ * messages (ICS stream export), fetched with a few set-based queries rather
+ * than several per message and subobject. Subobject properties of the
+ * batch share one soap arena. Once loaded, Serialize may run for different
+ * messages in parallel; it only goes to the database (@lpDatabase) for
+ * attachment data and embedded messages.
+ */
+class ECSerializeBatch final {
+	public:
+	ECSerializeBatch();
+	~ECSerializeBatch();
+	/* @objs: hierarchyid and store id of each message */
+	ECRESULT Load(ECSession *, ECDatabase *, const std::vector<std::pair<unsigned int, unsigned int>> &objs, ULONG flags);
+	ECRESULT Serialize(ECSession *, ECDatabase *, ECAttachmentStorage *, unsigned int obj_id, unsigned int store_id, GUID *, ULONG flags, ECSerializer *) const;
+
+	private:
+	struct message {
+		std::string props; /* serialized property block */
+		unsigned int count = 0;
+		ECRESULT er = erSuccess;
+	};
+
+	struct soap *m_soap;
+	std::map<unsigned int, message> m_messages;
+	/* parent id -> (id, type) of subobjects */
+	std::map<unsigned int, std::vector<std::pair<unsigned int, unsigned int>>> m_children;
+	ChildPropsMap m_child_props;
+	NamedPropDefMap m_named_props;
+};
+
 } /* namespace */
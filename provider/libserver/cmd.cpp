@@ -9,6 +9,7 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 #include <cstdint>
 #include <libHX/misc.h>
 #include <kopano/ECChannel.h>
@@ -320,14 +321,49 @@ ECRESULT ECFifoSerializer::SetBuffer(void *lpBuffer)
 	return erSuccess;
 }
 
+/*
+ * Write @nmemb integers in network byte order straight into the FIFO's
+ * free space. Only an integer that straddles the end of the ring is
+ * copied through Write().
+ */
+template<typename T, typename F> static ECRESULT
+WriteSwapped(ECFifoBuffer *lpBuffer, const void *ptr, size_t nmemb, F &&swap)
+{
+	auto lpSrc = static_cast<const unsigned char *>(ptr);
+
+	while (nmemb > 0) {
+		void *lpDest = nullptr;
+		ECFifoBuffer::size_type cbDest = 0;
+		auto er = lpBuffer->PeekWrite(&lpDest, &cbDest, STR_DEF_TIMEOUT);
+		if (er != erSuccess)
+			return er;
+		auto n = std::min(nmemb, cbDest / sizeof(T));
+		if (n == 0) {
+			T tmp;
+			memcpy(&tmp, lpSrc, sizeof(tmp));
+			tmp = swap(tmp);
+			er = lpBuffer->Write(&tmp, sizeof(tmp), STR_DEF_TIMEOUT, nullptr);
+			if (er != erSuccess)
+				return er;
+			n = 1;
+		} else {
+			for (size_t x = 0; x < n; ++x) {
+				T tmp;
+				memcpy(&tmp, lpSrc + x * sizeof(T), sizeof(tmp));
+				tmp = swap(tmp);
+				memcpy(static_cast<unsigned char *>(lpDest) + x * sizeof(T), &tmp, sizeof(tmp));
+			}
+			lpBuffer->CommitWrite(n * sizeof(T));
+		}
+		lpSrc += n * sizeof(T);
+		nmemb -= n;
+	}
+	return erSuccess;
+}
+
 ECRESULT ECFifoSerializer::Write(const void *ptr, size_t size, size_t nmemb)
 {
 	ECRESULT er = erSuccess;
-	union {
-		short s;
-		int i;
-		long long ll;
-	} tmp;
 
 	if (m_mode != serialize)
 		return KCERR_NO_SUPPORT;
@@ -339,22 +375,13 @@ ECRESULT ECFifoSerializer::Write(const void *ptr, size_t size, size_t nmemb)
 		er = m_lpBuffer->Write(ptr, nmemb, STR_DEF_TIMEOUT, NULL);
 		break;
 	case 2:
-		for (size_t x = 0; x < nmemb && er == erSuccess; ++x) {
-			tmp.s = htons(static_cast<const short *>(ptr)[x]);
-			er = m_lpBuffer->Write(&tmp, size, STR_DEF_TIMEOUT, nullptr);
-		}
+		er = WriteSwapped<uint16_t>(m_lpBuffer, ptr, nmemb, [](uint16_t v) { return htons(v); });
 		break;
 	case 4:
-		for (size_t x = 0; x < nmemb && er == erSuccess; ++x) {
-			tmp.i = htonl(static_cast<const int *>(ptr)[x]);
-			er = m_lpBuffer->Write(&tmp, size, STR_DEF_TIMEOUT, nullptr);
-		}
+		er = WriteSwapped<uint32_t>(m_lpBuffer, ptr, nmemb, [](uint32_t v) { return htonl(v); });
 		break;
 	case 8:
-		for (size_t x = 0; x < nmemb && er == erSuccess; ++x) {
-			tmp.ll = cpu_to_be64(static_cast<const uint64_t *>(ptr)[x]);
-			er = m_lpBuffer->Write(&tmp, size, STR_DEF_TIMEOUT, nullptr);
-		}
+		er = WriteSwapped<uint64_t>(m_lpBuffer, ptr, nmemb, [](uint64_t v) { return cpu_to_be64(v); });
 		break;
 	default:
 		er = KCERR_INVALID_PARAMETER;
@@ -414,27 +441,39 @@ ECRESULT ECFifoSerializer::Read(void *ptr, size_t size, size_t nmemb)
 
 ECRESULT ECFifoSerializer::Skip(size_t size, size_t nmemb)
 {
-	auto buf = make_unique_nt<char[]>(size * nmemb);
-	if (buf == nullptr)
-		return KCERR_NOT_ENOUGH_MEMORY;
-	return Read(buf.get(), size, nmemb);
+	size_t cbLeft = size * nmemb;
+
+	if (m_mode != deserialize)
+		return KCERR_NO_SUPPORT;
+	while (cbLeft > 0) {
+		const void *lpData = nullptr;
+		ECFifoBuffer::size_type cbData = 0;
+		auto er = m_lpBuffer->PeekRead(&lpData, &cbData, STR_DEF_TIMEOUT);
+		if (er != erSuccess)
+			return er;
+		if (cbData == 0)
+			return KCERR_CALL_FAILED;
+		cbData = std::min(cbData, cbLeft);
+		m_lpBuffer->CommitRead(cbData);
+		m_ulRead += cbData;
+		cbLeft -= cbData;
+	}
+	return erSuccess;
 }
 
 ECRESULT ECFifoSerializer::Flush()
 {
-	ECRESULT er;
-	size_t cbRead = 0;
-	char buf[16384];
-
 	while (true) {
-		er = m_lpBuffer->Read(buf, sizeof(buf), STR_DEF_TIMEOUT, &cbRead);
+		const void *lpData = nullptr;
+		ECFifoBuffer::size_type cbData = 0;
+		auto er = m_lpBuffer->PeekRead(&lpData, &cbData, STR_DEF_TIMEOUT);
 		if (er != erSuccess)
 			return er;
-		m_ulRead += cbRead;
-		if (cbRead < sizeof(buf))
-			break;
+		if (cbData == 0)
+			return erSuccess;
+		m_lpBuffer->CommitRead(cbData);
+		m_ulRead += cbData;
 	}
-	return er;
 }
 
 ECRESULT ECFifoSerializer::Stat(ULONG *lpcbRead, ULONG *lpcbWrite)
@@ -840,18 +879,23 @@ int KCmdService::fname(ULONG64 ulSessionId, ##__VA_ARGS__) \
 { \
 	soap_info(soap)->st.rh1_wall_start = time_point::clock::now(); \
 	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &soap_info(soap)->st.rh1_cpu[0]); \
+	auto xx_queries = ECDatabase::tls_queries, xx_rows = ECDatabase::tls_rows; \
 	auto xx_endtimer1 = make_scope_success([&]() { \
 		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &soap_info(soap)->st.rh1_cpu[1]); \
 		soap_info(soap)->st.rh1_wall_end = time_point::clock::now(); \
 		HX_timespec_sub(&soap_info(soap)->st.rh1_cpu[2], &soap_info(soap)->st.rh1_cpu[1], &soap_info(soap)->st.rh1_cpu[0]); \
 		soap_info(soap)->st.rh1_wall_dur = soap_info(soap)->st.rh1_wall_end - soap_info(soap)->st.rh1_wall_start; \
+		soap_info(soap)->st.sql_queries = ECDatabase::tls_queries - xx_queries; \
+		soap_info(soap)->st.sql_rows = ECDatabase::tls_rows - xx_rows; \
+		g_lpSessionManager->m_stats->m_tracer.end(soap_info(soap)->st); \
 	}); \
 	const char *szFname = #fname; \
 	soap_info(soap)->st.func = szFname; \
+	g_lpSessionManager->m_stats->m_tracer.begin(szFname, ulSessionId); \
 	ECSession *lpecSession = nullptr; \
 	auto er = g_lpSessionManager->ValidateSession(soap, ulSessionId, &lpecSession); \
 	if (er != erSuccess) { \
-		resultvar = er; \
+		resultvar = soap_info(soap)->st.er = er; \
 		return SOAP_OK; \
 	} \
 	soap_info(soap)->ulLastSessionId = ulSessionId; \
@@ -862,7 +906,7 @@ int KCmdService::fname(ULONG64 ulSessionId, ##__VA_ARGS__) \
 	}); \
 	soap_info(soap)->st.rh2_wall_start = time_point::clock::now(); \
 	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &soap_info(soap)->st.rh2_cpu[0]); \
-	resultvar = [&]() -> int {
+	resultvar = soap_info(soap)->st.er = [&]() -> int {
 
 #define SOAP_ENTRY_END() \
         return er; \
@@ -3243,6 +3287,8 @@ static ECRESULT OpenTable(ECSession *lpecSession, entryId sEntryId,
 	case TABLETYPE_STATS_USERS:
 	case TABLETYPE_STATS_COMPANY:
 	case TABLETYPE_STATS_SERVERS:
+	case TABLETYPE_STATS_SOAP:
+	case TABLETYPE_STATS_SLOW:
 		er = lpecSession->GetTableManager()->OpenStatsTable(ulTableType, ulFlags, &ulTableId);
 		if (er != erSuccess)
 			return er;
@@ -6203,6 +6249,8 @@ static ECRESULT MoveObjects(ECSession *lpSession, ECDatabase *lpDatabase,
 	}
 
 	auto cCopyItems = lstCopyItems.size();
+	/* Deferred tproperties updates, by source folder */
+	std::map<unsigned int, std::vector<unsigned int>> deferred;
 	// Move the messages to another folder
 	for (auto &cop : lstCopyItems) {
 		sObjectTableKey key(cop.ulId, 0);
@@ -6326,10 +6374,7 @@ static ECRESULT MoveObjects(ECSession *lpSession, ECDatabase *lpDatabase,
 			// Restore a softdeleted message
 			AddChange(lpSession, ulSyncId, cop.sNewSourceKey, sDestFolderSourceKey, ICS_MESSAGE_NEW);
 		}
-		er = ECTPropsPurge::AddDeferredUpdate(lpSession, lpDatabase,
-		     ulDestFolderId, cop.ulParent, cop.ulId);
-		if (er != erSuccess)
-			return er_ldebugf(er, "ECTPropsPurge::AddDeferredUpdate failed");
+		deferred[cop.ulParent].emplace_back(cop.ulId);
 
 		// Track folder count changes
 		if (cop.ulType == MAPI_MESSAGE) {
@@ -6360,6 +6405,17 @@ static ECRESULT MoveObjects(ECSession *lpSession, ECDatabase *lpDatabase,
 		cop.bMoved = true;
 	}
 
+	for (const auto &d : deferred) {
+		er = ECTPropsPurge::AddDeferredUpdates(lpDatabase, ulDestFolderId, d.first, d.second);
+		if (er != erSuccess)
+			return er_ldebugf(er, "ECTPropsPurge::AddDeferredUpdates failed");
+	}
+	if (!deferred.empty()) {
+		er = ECTPropsPurge::NormalizeDeferredUpdates(lpSession, lpDatabase, ulDestFolderId);
+		if (er != erSuccess)
+			return er_ldebugf(er, "ECTPropsPurge::NormalizeDeferredUpdates failed");
+	}
+
 	er = ApplyFolderCounts(lpDatabase, mapFolderCounts);
 	if (er != erSuccess)
 		return er_ldebugf(er, "ApplyFolderCounts failed");
@@ -6457,6 +6513,8 @@ static ECRESULT MoveObjects(ECSession *lpSession, ECDatabase *lpDatabase,
  * @param[in] bDoNotification true if you want to send object notifications.
  * @param[in] bDoTableNotification true if you want to send table notifications.
  * @param[in] ulSyncId Client sync identify.
+ * @param[in] lpsExclude Optional list of extra properties not to copy onto the root object.
+ * @param[out] lpulNewObjectId Optional, receives the id of the new object.
  *
  * @FIXME It is possible to send notifications before a commit, this can give issues with the cache!
  * 			This function should be refactored
@@ -6464,7 +6522,9 @@ static ECRESULT MoveObjects(ECSession *lpSession, ECDatabase *lpDatabase,
 static ECRESULT CopyObject(ECSession *lpecSession,
     ECAttachmentStorage *lpAttachmentStorage, unsigned int ulObjId,
     unsigned int ulDestFolderId, bool bIsRoot, bool bDoNotification,
-    bool bDoTableNotification, unsigned int ulSyncId)
+    bool bDoTableNotification, unsigned int ulSyncId,
+    const struct propTagArray *lpsExclude = nullptr,
+    unsigned int *lpulNewObjectId = nullptr)
 {
 	ECDatabase		*lpDatabase = NULL;
 	DB_RESULT lpDBResult;
@@ -6621,14 +6681,27 @@ static ECRESULT CopyObject(ECSession *lpecSession,
 	strExclude += " AND NOT (tag="+stringify(PROP_ID(PR_EC_IMAP_ID))+" AND type="+stringify(PROP_TYPE(PR_EC_IMAP_ID))+")";
 	// because of #7699, messages contain PR_LOCAL_COMMIT_TIME_MAX
 	strExclude += " AND NOT (tag="+stringify(PROP_ID(PR_LOCAL_COMMIT_TIME_MAX))+" AND type="+stringify(PROP_TYPE(PR_LOCAL_COMMIT_TIME_MAX))+")";
+	// Caller-specified exclusions; matched on id only, since string types may differ
+	std::string strExcludeExtra;
+	bool bExcludeIMAPEmail = false;
+	if (bIsRoot && lpsExclude != nullptr && lpsExclude->__size > 0) {
+		for (gsoap_size_t i = 0; i < lpsExclude->__size; ++i) {
+			if (i > 0)
+				strExcludeExtra += ",";
+			strExcludeExtra += stringify(PROP_ID(lpsExclude->__ptr[i]));
+			if (PROP_ID(lpsExclude->__ptr[i]) == PROP_ID(PR_EC_IMAP_EMAIL))
+				bExcludeIMAPEmail = true;
+		}
+		strExcludeExtra = " AND tag NOT IN (" + strExcludeExtra + ")";
+	}
 	// Copy properties...
-	strQuery = "INSERT INTO properties (hierarchyid, tag, type, val_ulong, val_string, val_binary,val_double,val_longint,val_hi,val_lo) SELECT "+stringify(ulNewObjectId)+", tag,type,val_ulong,val_string,val_binary,val_double,val_longint,val_hi,val_lo FROM properties WHERE hierarchyid ="+stringify(ulObjId)+strExclude;
+	strQuery = "INSERT INTO properties (hierarchyid, tag, type, val_ulong, val_string, val_binary,val_double,val_longint,val_hi,val_lo) SELECT "+stringify(ulNewObjectId)+", tag,type,val_ulong,val_string,val_binary,val_double,val_longint,val_hi,val_lo FROM properties WHERE hierarchyid ="+stringify(ulObjId)+strExclude+strExcludeExtra;
 	er = lpDatabase->DoInsert(strQuery);
 	if (er != erSuccess)
 		return er_lerrf(er, "Copy properties failed");
 
 	// Copy MVproperties...
-	strQuery = "INSERT INTO mvproperties (hierarchyid, orderid, tag, type, val_ulong, val_string, val_binary,val_double,val_longint,val_hi,val_lo) SELECT "+stringify(ulNewObjectId)+", orderid, tag,type,val_ulong,val_string,val_binary,val_double,val_longint,val_hi,val_lo FROM mvproperties WHERE hierarchyid ="+stringify(ulObjId);
+	strQuery = "INSERT INTO mvproperties (hierarchyid, orderid, tag, type, val_ulong, val_string, val_binary,val_double,val_longint,val_hi,val_lo) SELECT "+stringify(ulNewObjectId)+", orderid, tag,type,val_ulong,val_string,val_binary,val_double,val_longint,val_hi,val_lo FROM mvproperties WHERE hierarchyid ="+stringify(ulObjId)+strExcludeExtra;
 	er = lpDatabase->DoInsert(strQuery);
 	if (er != erSuccess)
 		return er_lerrf(er, "Copy MVproperties failed");
@@ -6637,6 +6710,11 @@ static ECRESULT CopyObject(ECSession *lpecSession,
 	if (er != erSuccess && er != KCERR_NOT_FOUND)
 		return er_lerrf(er, "CopyAttachment(%u -> %u) failed", ulObjId, ulNewObjectId);
 	er = erSuccess;
+	if (bExcludeIMAPEmail && lpAttachmentStorage->ExistAttachment(ulNewObjectId, PROP_ID(PR_EC_IMAP_EMAIL))) {
+		er = lpAttachmentStorage->DeleteAttachment(ulNewObjectId, PROP_ID(PR_EC_IMAP_EMAIL));
+		if (er != erSuccess)
+			return er_lerrf(er, "DeleteAttachment(%u, PR_EC_IMAP_EMAIL) failed", ulNewObjectId);
+	}
 
 	if (bIsRoot) {
 		// Create indexedproperties, Add new PR_SOURCE_KEY
@@ -6699,6 +6777,8 @@ static ECRESULT CopyObject(ECSession *lpecSession,
 	}
 
 	g_lpSessionManager->GetCacheManager()->Update(fnevObjectModified, ulDestFolderId);
+	if (lpulNewObjectId != nullptr)
+		*lpulNewObjectId = ulNewObjectId;
 	if (!bDoNotification)
 		return erSuccess;
 	// Update destination folder
@@ -6965,6 +7045,55 @@ SOAP_ENTRY_START(copyObjects, *result, struct entryList *aMessages,
 }
 SOAP_ENTRY_END()
 
+/**
+ * Create a copy of an already delivered message for another recipient
+ *
+ * The copy is made entirely on the server, so body and attachment data are
+ * shared through single instancing rather than being resent by the client.
+ * Properties in lpsExclude (recipient-specific data) are not carried over.
+ */
+SOAP_ENTRY_START(copyMessageForDelivery, lpsResponse->er,
+    const entryId &sEntryId, const entryId &sDestFolderId,
+    struct propTagArray *lpsExclude, unsigned int ulSyncId,
+    struct copyMessageResponse *lpsResponse)
+{
+	unsigned int ulObjId = 0, ulDestFolderId = 0, ulNewObjId = 0, ulGrandParent = 0;
+	std::set<EntryId> setEntryIds;
+	USE_DATABASE_NORESULT();
+
+	const EntryId srcEntryId(&sEntryId), dstEntryId(&sDestFolderId);
+	setEntryIds.emplace(sEntryId);
+	setEntryIds.emplace(sDestFolderId);
+	kd_trans dtx;
+	er = BeginLockFolders(lpDatabase, setEntryIds, LOCK_EXCLUSIVE, dtx, er);
+	if (er != erSuccess)
+		return er_lerrf(er, "Failed locking folders");
+	auto cleanup = make_scope_success([&]() { dtx.commit(); });
+	er = lpecSession->GetObjectFromEntryId(&sEntryId, &ulObjId);
+	if (er != erSuccess)
+		return er_lerrf(er, "Failed obtaining object by entry id (%s)", static_cast<std::string>(srcEntryId).c_str());
+	er = lpecSession->GetObjectFromEntryId(&sDestFolderId, &ulDestFolderId);
+	if (er != erSuccess)
+		return er_lerrf(er, "Failed obtaining object by entry id (%s)", static_cast<std::string>(dstEntryId).c_str());
+	er = lpecSession->GetSecurity()->CheckPermission(ulDestFolderId, ecSecurityCreate);
+	if (er != erSuccess)
+		return er_lerrf(er, "Failed checking permissions for folder id %u", ulDestFolderId);
+	er = CopyObject(lpecSession, nullptr, ulObjId, ulDestFolderId, true, true, true, ulSyncId, lpsExclude, &ulNewObjId);
+	if (er != erSuccess)
+		return er_lerrf(er, "Failed copying object %u", ulObjId);
+	er = WriteLocalCommitTimeMax(NULL, lpDatabase, ulDestFolderId, NULL);
+	if (er != erSuccess)
+		return er_lerrf(er, "WriteLocalCommitTimeMax failed");
+
+	auto gcache = g_lpSessionManager->GetCacheManager();
+	gcache->GetParent(ulDestFolderId, &ulGrandParent);
+	g_lpSessionManager->UpdateTables(ECKeyTable::TABLE_ROW_MODIFY, 0, ulGrandParent, ulDestFolderId, MAPI_FOLDER);
+	er = gcache->GetEntryIdFromObject(ulNewObjId, soap, 0, &lpsResponse->sEntryId);
+	if (er != erSuccess)
+		return er_lerrf(er, "GetEntryIdFromObject(%u) failed", ulNewObjId);
+}
+SOAP_ENTRY_END()
+
 SOAP_ENTRY_START(copyFolder, *result, const entryId &sEntryId,
     const entryId &sDestFolderId, const char *lpszNewFolderName,
     unsigned int ulFlags, unsigned int ulSyncId, unsigned int *result)
@@ -8398,6 +8527,18 @@ SOAP_ENTRY_END()
 typedef ECDeferredFunc<ECRESULT, ECRESULT(*)(void*), void*> task_type;
 struct MTOMStreamInfo;
 
+/*
+ * Number of threads that one export call serializes messages on, each
+ * with a database connection of its own
+ */
+#define MTOM_EXPORT_THREADS 4
+
+/* A database connection and attachment handle for one export thread */
+struct MTOMWorkerContext {
+	ECDatabase *lpDatabase;
+	std::shared_ptr<ECAttachmentStorage> lpAttachmentStorage;
+};
+
 struct MTOMSessionInfo {
 	MTOMSessionInfo(ECSession *s) : lpecSession(s), holder(*s) {}
 
@@ -8410,6 +8551,16 @@ struct MTOMSessionInfo {
 	std::lock_guard<ECSession> holder;
 	/* These are only tracked for cleanup at session exit */
 	MTOMStreamInfo *lpCurrentWriteStream = nullptr, *lpCurrentReadStream = nullptr;
+
+	/*
+	 * Batched export: all messages are loaded up front, and their
+	 * serialization tasks are queued before gSOAP opens the first stream.
+	 */
+	std::unique_ptr<ECSerializeBatch> lpBatch;
+	std::vector<MTOMStreamInfo *> vStreams;
+	std::vector<std::unique_ptr<ECDatabase>> vWorkerDatabases;
+	std::vector<MTOMWorkerContext> vIdleWorkers;
+	std::mutex mtxWorkers;
 };
 
 struct MTOMStreamInfo {
@@ -8426,10 +8577,45 @@ struct MTOMStreamInfo {
 
 typedef MTOMStreamInfo * LPMTOMStreamInfo;
 
+static ECRESULT SerializeBatchObject(MTOMStreamInfo *lpStreamInfo)
+{
+	auto lpInfo = lpStreamInfo->lpSessionInfo;
+	ulock_normal lk(lpInfo->mtxWorkers);
+	if (lpInfo->er != erSuccess) {
+		/* The export was aborted; do not bother the database any more. */
+		lk.unlock();
+		lpStreamInfo->lpFifoBuffer->Close(ECFifoBuffer::cfWrite);
+		return KCERR_CALL_FAILED;
+	}
+	assert(!lpInfo->vIdleWorkers.empty());
+	auto ctx = std::move(lpInfo->vIdleWorkers.back());
+	lpInfo->vIdleWorkers.pop_back();
+	lk.unlock();
+
+	ctx.lpDatabase->ThreadInit();
+	ECRESULT er;
+	{
+		ECFifoSerializer lpSink(lpStreamInfo->lpFifoBuffer, ECFifoSerializer::serialize);
+		er = lpInfo->lpBatch->Serialize(lpInfo->lpecSession, ctx.lpDatabase,
+		     ctx.lpAttachmentStorage.get(), lpStreamInfo->ulObjectId,
+		     lpStreamInfo->ulStoreId, &lpStreamInfo->sGuid,
+		     lpStreamInfo->ulFlags, &lpSink);
+	}
+	ctx.lpDatabase->ThreadEnd();
+
+	lk.lock();
+	lpInfo->vIdleWorkers.emplace_back(std::move(ctx));
+	if (er != erSuccess)
+		lpInfo->er = er;
+	return er;
+}
+
 static ECRESULT SerializeObject(void *arg)
 {
 	auto lpStreamInfo = static_cast<MTOMStreamInfo *>(arg);
 	assert(lpStreamInfo != NULL);
+	if (lpStreamInfo->lpSessionInfo->lpBatch != nullptr)
+		return SerializeBatchObject(lpStreamInfo);
 	lpStreamInfo->lpSessionInfo->lpSharedDatabase->ThreadInit();
 
 	ECFifoSerializer lpSink(lpStreamInfo->lpFifoBuffer, ECFifoSerializer::serialize);
@@ -8452,6 +8638,11 @@ static void *MTOMReadOpen(struct soap *soap, void *handle, const char *id,
 		soap->error = SOAP_FATAL_ERROR;
 		return NULL;
 	}
+	if (lpStreamInfo->lpTask != nullptr) {
+		/* Already queued by a batched export */
+		lpStreamInfo->lpSessionInfo->lpCurrentReadStream = lpStreamInfo;
+		return lpStreamInfo;
+	}
 
 	lpStreamInfo->lpFifoBuffer = new ECFifoBuffer();
 
@@ -8507,6 +8698,7 @@ static void MTOMReadClose(struct soap *soap, void *handle)
 	if (lpStreamInfo->lpTask) {
 		lpStreamInfo->lpTask->wait();	 // Todo: use result() to wait and get result
 		delete lpStreamInfo->lpTask;
+		lpStreamInfo->lpTask = nullptr;
 	}
 	delete lpStreamInfo->lpFifoBuffer;
 	lpStreamInfo->lpFifoBuffer = NULL;
@@ -8524,9 +8716,76 @@ static void MTOMSessionDone(struct soap *soap, void *param)
 	else if (lpInfo->lpCurrentReadStream != NULL)
         // Same but for MTOMReadClose()
 		MTOMReadClose(soap, lpInfo->lpCurrentReadStream);
+	if (!lpInfo->vStreams.empty()) {
+		/* Streams of a batched export which gSOAP never got to */
+		{
+			scoped_lock lk(lpInfo->mtxWorkers);
+			if (lpInfo->er == erSuccess)
+				lpInfo->er = KCERR_CALL_FAILED;
+		}
+		for (auto s : lpInfo->vStreams)
+			if (s->lpFifoBuffer != nullptr)
+				s->lpFifoBuffer->Close(ECFifoBuffer::cfRead);
+		for (auto s : lpInfo->vStreams)
+			if (s->lpFifoBuffer != nullptr)
+				MTOMReadClose(soap, s);
+	}
 	delete lpInfo;
 }
 
+/**
+ * Load the properties of all messages of an export batch with a few
+ * queries, and start serializing the messages on up to
+ * MTOM_EXPORT_THREADS threads, each with a database connection of its own.
+ * The tasks are queued in stream order, so the stream that gSOAP reads
+ * from is always being worked on.
+ */
+static ECRESULT StartBatchExport(ECSession *lpecSession, ECDatabase *lpDatabase,
+    MTOMSessionInfo *lpInfo, ULONG ulFlags)
+{
+	auto nthreads = std::min(lpInfo->vStreams.size(), static_cast<size_t>(MTOM_EXPORT_THREADS));
+	std::vector<std::pair<unsigned int, unsigned int>> objs;
+
+	objs.reserve(lpInfo->vStreams.size());
+	for (const auto s : lpInfo->vStreams)
+		objs.emplace_back(s->ulObjectId, s->ulStoreId);
+	lpInfo->lpBatch.reset(new(std::nothrow) ECSerializeBatch);
+	if (lpInfo->lpBatch == nullptr)
+		return KCERR_NOT_ENOUGH_MEMORY;
+	auto er = lpInfo->lpBatch->Load(lpecSession, lpDatabase, objs, ulFlags);
+	if (er != erSuccess)
+		return er;
+
+	lpInfo->vIdleWorkers.push_back({lpInfo->lpSharedDatabase.get(), lpInfo->lpAttachmentStorage});
+	while (lpInfo->vIdleWorkers.size() < nthreads) {
+		std::unique_ptr<ECDatabase> db;
+		er = lpecSession->GetAdditionalDatabase(&unique_tie(db));
+		if (er != erSuccess)
+			break;
+		std::shared_ptr<ECAttachmentStorage> atx(g_lpSessionManager->get_atxconfig()->new_handle(db.get()));
+		if (atx == nullptr)
+			break;
+		lpInfo->vIdleWorkers.push_back({db.get(), std::move(atx)});
+		lpInfo->vWorkerDatabases.emplace_back(std::move(db));
+	}
+	/* Fewer connections than hoped for only means less parallelism. */
+	nthreads = lpInfo->vIdleWorkers.size();
+	lpInfo->lpThreadPool.reset(new ksrv_tpool("mtomexport", nthreads));
+
+	for (auto s : lpInfo->vStreams) {
+		s->lpFifoBuffer = new ECFifoBuffer();
+		std::unique_ptr<task_type> ptrTask(new task_type(SerializeObject, s));
+		if (!ptrTask->queue_on(lpInfo->lpThreadPool.get())) {
+			ec_log_err("Failed to dispatch serialization task for object %u", s->ulObjectId);
+			delete s->lpFifoBuffer;
+			s->lpFifoBuffer = nullptr;
+			return KCERR_CALL_FAILED;
+		}
+		s->lpTask = ptrTask.release();
+	}
+	return erSuccess;
+}
+
 SOAP_ENTRY_START(exportMessageChangesAsStream, lpsResponse->er,
     unsigned int ulFlags, const struct propTagArray &sPropTags,
     const struct sourceKeyPairArray &sSourceKeyPairs, unsigned int ulPropTag,
@@ -8605,7 +8864,6 @@ SOAP_ENTRY_START(exportMessageChangesAsStream, lpsResponse->er,
 	lpMTOMSessionInfo->lpAttachmentStorage = lpAttachmentStorage;
 	lpMTOMSessionInfo->lpSharedDatabase = std::move(lpBatchDB);
 	lpMTOMSessionInfo->er = erSuccess;
-	lpMTOMSessionInfo->lpThreadPool.reset(new ksrv_tpool("mtomexport", 1));
 	soap_info(soap)->fdone = MTOMSessionDone;
 	soap_info(soap)->fdoneparam = lpMTOMSessionInfo;
 	lpsResponse->sMsgStreams.__ptr = soap_new_messageStream(soap, sSourceKeyPairs.__size);
@@ -8665,9 +8923,12 @@ SOAP_ENTRY_START(exportMessageChangesAsStream, lpsResponse->er,
 		lpStreamInfo->ulFlags = ulFlags;
 		lpStreamInfo->lpPropValArray = NULL;
 		lpStreamInfo->lpTask = NULL;
+		lpStreamInfo->lpFifoBuffer = nullptr;
 		lpStreamInfo->lpSessionInfo = lpMTOMSessionInfo;
 		if(bUseSQLMulti)
 			strQuery += "call StreamObj(" + stringify(ulObjectId) + "," + stringify(ulDepth) + ", " + stringify(ulMode) + ");";
+		else
+			lpMTOMSessionInfo->vStreams.emplace_back(lpStreamInfo);
 
 		// Setup the MTOM Attachments
 		lpsResponse->sMsgStreams.__ptr[ulObjCnt].sStreamData.xop__Include.__ptr = (unsigned char*)lpStreamInfo;
@@ -8685,6 +8946,13 @@ SOAP_ENTRY_START(exportMessageChangesAsStream, lpsResponse->er,
         if(er != erSuccess)
 			return er;
     }
+	if (bUseSQLMulti || ulObjCnt == 0) {
+		lpMTOMSessionInfo->lpThreadPool.reset(new ksrv_tpool("mtomexport", 1));
+	} else {
+		er = StartBatchExport(lpecSession, lpDatabase, lpMTOMSessionInfo, ulFlags);
+		if (er != erSuccess)
+			return er;
+	}
     memset(&ecODStore, 0, sizeof(ECODStore));
 	ecODStore.ulObjType = MAPI_MESSAGE;
 
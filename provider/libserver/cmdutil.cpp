@@ -10,6 +10,7 @@
 #include <list>
 #include <map>
 #include <utility>
+#include <vector>
 #include <mapidefs.h>
 #include <mapitags.h>
 #include <kopano/mapiext.h>
@@ -492,6 +493,7 @@ static ECRESULT DeleteObjectSoft(ECSession *lpSession, ECDatabase *lpDatabase,
 
 	// Add properties: PR_DELETED_ON
 	GetSystemTimeAsFileTime(&ft);
+	std::map<unsigned int, std::vector<unsigned int>> deferred;
 	for (const auto &di : lstDeleteItems) {
 		bool k = di.fRoot &&
 			((di.ulObjType == MAPI_MESSAGE &&
@@ -512,8 +514,10 @@ static ECRESULT DeleteObjectSoft(ECSession *lpSession, ECDatabase *lpDatabase,
 		er = lpDatabase->DoUpdate(strQuery);
 		if (er!= erSuccess)
 			return er;
-		er = ECTPropsPurge::AddDeferredUpdateNoPurge(lpDatabase,
-		     di.ulParent, 0, di.ulId);
+		deferred[di.ulParent].emplace_back(di.ulId);
+	}
+	for (const auto &d : deferred) {
+		er = ECTPropsPurge::AddDeferredUpdates(lpDatabase, d.first, 0, d.second);
 		if (er != erSuccess)
 			return er;
 	}
@@ -1818,41 +1822,23 @@ ECRESULT BeginLockFolders(ECDatabase *lpDatabase, const SOURCEKEY &sourcekey,
 	       ulFlags, dtx, dtxerr);
 }
 
-// Prepares child property data. This can be passed to ReadProps(). This allows the properties of child objects of object ulObjId to be
-// retrieved with far less SQL queries, since this function bulk-receives the data. You may pass EITHER ulObjId OR ulParentId to retrieve an object itself, or
-// children of an object.
-ECRESULT PrepareReadProps(struct soap *soap, ECDatabase *lpDatabase,
-    bool fDoQuery, unsigned int ulObjId, unsigned int ulParentId,
+/*
+ * Runs @prop_query and @mvprop_query (or, with an empty query, takes the
+ * next result of a multi-statement call) and sorts the rows into
+ * @lpChildProps by the hierarchyid in column FIELD_NR_MAX.
+ */
+static ECRESULT PrepareReadProps(struct soap *soap, ECDatabase *lpDatabase,
+    const std::string &prop_query, const std::string &mvprop_query,
     unsigned int ulMaxSize, ChildPropsMap *lpChildProps,
     NamedPropDefMap *lpNamedPropDefs)
 {
 	unsigned int ulSize;
 	struct propVal sPropVal;
-	std::string strQuery;
 	DB_RESULT lpDBResult;
 	DB_ROW lpDBRow = NULL;
 
-	if (ulObjId == 0 && ulParentId == 0)
-		return KCERR_INVALID_PARAMETER;
-
-    if(fDoQuery) {
-		// although we don't always use the names columns, we need to join anyway to check for existing nameids
-		// we may never stream propids > 0x8500 without the names data
-		if (ulObjId != 0)
-			strQuery = "SELECT " PROPCOLORDER ", hierarchyid, names.nameid, names.namestring, names.guid "
-				"FROM properties ";
-		else
-			strQuery = "SELECT " PROPCOLORDER ", hierarchy.id, names.nameid, names.namestring, names.guid "
-				"FROM properties JOIN hierarchy "
-			        "ON properties.hierarchyid=hierarchy.id ";
-
-		strQuery += "LEFT JOIN names ON properties.tag-34049=names.id ";
-		if (ulObjId)
-			strQuery += "WHERE hierarchyid=" + stringify(ulObjId);
-		else
-			strQuery += "WHERE hierarchy.parent=" + stringify(ulParentId);
-		strQuery += " AND (tag <= 34048 OR names.id IS NOT NULL)";
-		auto er = lpDatabase->DoSelect(strQuery, &lpDBResult);
+	if (!prop_query.empty()) {
+		auto er = lpDatabase->DoSelect(prop_query, &lpDBResult);
         if(er != erSuccess)
 			return er;
     } else {
@@ -1921,27 +1907,8 @@ ECRESULT PrepareReadProps(struct soap *soap, ECDatabase *lpDatabase,
         }
     }
 
-    if(fDoQuery) {
-		if (ulObjId != 0)
-			strQuery = "SELECT " MVPROPCOLORDER ", hierarchyid, names.nameid, names.namestring, names.guid "
-				"FROM mvproperties ";
-		else
-			strQuery = "SELECT " MVPROPCOLORDER ", hierarchy.id, names.nameid, names.namestring, names.guid "
-				"FROM mvproperties "
-				"JOIN hierarchy "
-				    "ON mvproperties.hierarchyid=hierarchy.id ";
-
-		strQuery += "LEFT JOIN names ON mvproperties.tag-34049=names.id ";
-        if (ulObjId != 0)
-            strQuery +=	"WHERE hierarchyid=" + stringify(ulObjId) +
-				" AND (tag <= 34048 OR names.id IS NOT NULL) "
-				" GROUP BY hierarchyid, tag";
-        else
-			strQuery +=	"WHERE hierarchy.parent=" + stringify(ulParentId) +
-				" AND (tag <= 34048 OR names.id IS NOT NULL) "
-				"GROUP BY tag, mvproperties.type";
-
-		auto er = lpDatabase->DoSelect(strQuery, &lpDBResult);
+	if (!mvprop_query.empty()) {
+		auto er = lpDatabase->DoSelect(mvprop_query, &lpDBResult);
         if(er != erSuccess)
 			return er;
     } else {
@@ -2004,6 +1971,81 @@ ECRESULT PrepareReadProps(struct soap *soap, ECDatabase *lpDatabase,
 	return erSuccess;
 }
 
+// Prepares child property data. This can be passed to ReadProps(). This allows the properties of child objects of object ulObjId to be
+// retrieved with far less SQL queries, since this function bulk-receives the data. You may pass EITHER ulObjId OR ulParentId to retrieve an object itself, or
+// children of an object.
+ECRESULT PrepareReadProps(struct soap *soap, ECDatabase *lpDatabase,
+    bool fDoQuery, unsigned int ulObjId, unsigned int ulParentId,
+    unsigned int ulMaxSize, ChildPropsMap *lpChildProps,
+    NamedPropDefMap *lpNamedPropDefs)
+{
+	std::string strQuery, strMVQuery;
+
+	if (ulObjId == 0 && ulParentId == 0)
+		return KCERR_INVALID_PARAMETER;
+
+    if(fDoQuery) {
+		// although we don't always use the names columns, we need to join anyway to check for existing nameids
+		// we may never stream propids > 0x8500 without the names data
+		if (ulObjId != 0)
+			strQuery = "SELECT " PROPCOLORDER ", hierarchyid, names.nameid, names.namestring, names.guid "
+				"FROM properties ";
+		else
+			strQuery = "SELECT " PROPCOLORDER ", hierarchy.id, names.nameid, names.namestring, names.guid "
+				"FROM properties JOIN hierarchy "
+			        "ON properties.hierarchyid=hierarchy.id ";
+
+		strQuery += "LEFT JOIN names ON properties.tag-34049=names.id ";
+		if (ulObjId)
+			strQuery += "WHERE hierarchyid=" + stringify(ulObjId);
+		else
+			strQuery += "WHERE hierarchy.parent=" + stringify(ulParentId);
+		strQuery += " AND (tag <= 34048 OR names.id IS NOT NULL)";
+
+		if (ulObjId != 0)
+			strMVQuery = "SELECT " MVPROPCOLORDER ", hierarchyid, names.nameid, names.namestring, names.guid "
+				"FROM mvproperties ";
+		else
+			strMVQuery = "SELECT " MVPROPCOLORDER ", hierarchy.id, names.nameid, names.namestring, names.guid "
+				"FROM mvproperties "
+				"JOIN hierarchy "
+				    "ON mvproperties.hierarchyid=hierarchy.id ";
+
+		strMVQuery += "LEFT JOIN names ON mvproperties.tag-34049=names.id ";
+        if (ulObjId != 0)
+            strMVQuery += "WHERE hierarchyid=" + stringify(ulObjId) +
+				" AND (tag <= 34048 OR names.id IS NOT NULL) "
+				" GROUP BY hierarchyid, tag";
+        else
+			strMVQuery += "WHERE hierarchy.parent=" + stringify(ulParentId) +
+				" AND (tag <= 34048 OR names.id IS NOT NULL) "
+				"GROUP BY tag, mvproperties.type";
+    }
+	return PrepareReadProps(soap, lpDatabase, strQuery, strMVQuery,
+	       ulMaxSize, lpChildProps, lpNamedPropDefs);
+}
+
+/* Same, for the children of all objects in @parents at once. */
+ECRESULT PrepareReadProps(struct soap *soap, ECDatabase *lpDatabase,
+    const std::vector<unsigned int> &parents, unsigned int ulMaxSize,
+    ChildPropsMap *lpChildProps, NamedPropDefMap *lpNamedPropDefs)
+{
+	if (parents.empty())
+		return erSuccess;
+	auto strParents = kc_join(parents, ",", stringify);
+	return PrepareReadProps(soap, lpDatabase,
+	       "SELECT " PROPCOLORDER ", hierarchy.id, names.nameid, names.namestring, names.guid "
+	       "FROM properties JOIN hierarchy ON properties.hierarchyid=hierarchy.id "
+	       "LEFT JOIN names ON properties.tag-34049=names.id "
+	       "WHERE hierarchy.parent IN (" + strParents + ") AND (tag <= 34048 OR names.id IS NOT NULL)",
+	       "SELECT " MVPROPCOLORDER ", hierarchy.id, names.nameid, names.namestring, names.guid "
+	       "FROM mvproperties JOIN hierarchy ON mvproperties.hierarchyid=hierarchy.id "
+	       "LEFT JOIN names ON mvproperties.tag-34049=names.id "
+	       "WHERE hierarchy.parent IN (" + strParents + ") AND (tag <= 34048 OR names.id IS NOT NULL) "
+	       "GROUP BY hierarchy.id, tag, mvproperties.type",
+	       ulMaxSize, lpChildProps, lpNamedPropDefs);
+}
+
 CHILDPROPS::CHILDPROPS(struct soap *soap, unsigned int hint) :
 	lpPropTags(new DynamicPropTagArray(soap)),
 	lpPropVals(new DynamicPropValArray(soap, hint))
@@ -12,6 +12,7 @@
 #include <set>
 #include <list>
 #include <string>
+#include <vector>
 
 namespace KC {
 
@@ -202,6 +203,7 @@ struct CHILDPROPS {
 typedef std::map<unsigned int, CHILDPROPS> ChildPropsMap;
 
 extern ECRESULT PrepareReadProps(struct soap *, ECDatabase *, bool do_query, unsigned int obj_id, unsigned int parent_id, unsigned int max_size, ChildPropsMap *, NamedPropDefMap *);
+extern ECRESULT PrepareReadProps(struct soap *, ECDatabase *, const std::vector<unsigned int> &parents, unsigned int max_size, ChildPropsMap *, NamedPropDefMap *);
 extern ECRESULT FixPropEncoding(struct propVal *);
 
 } /* namespace */
@@ -61,6 +61,12 @@ signatures_t DBPlugin::getAllObjects(const objectid_t &company,
 	return CreateSignatureList(strQuery);
 }
 
+signatures_t DBPlugin::getChangedObjects(const objectid_t &company,
+    objectclass_t objclass, const std::string &since, std::string *next)
+{
+	throw notimplemented("Change tracking not implemented by the db userplugin");
+}
+
 objectdetails_t DBPlugin::getObjectDetails(const objectid_t &objectid)
 {
 	auto objectdetails = DBPlugin::getObjectDetails(std::list<objectid_t>{objectid});
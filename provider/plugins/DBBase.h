@@ -91,6 +91,13 @@ public:
 	 */
 	virtual signatures_t getAllObjects(const objectid_t &company, objectclass_t, const restrictTable *) override;
 
+	/**
+	 * Not supported; the DB plugin has no sync to speed up.
+	 *
+	 * @throw notimplemented Always
+	 */
+	virtual signatures_t getChangedObjects(const objectid_t &company, objectclass_t, const std::string &since, std::string *next) override;
+
 	/**
 	 * Obtain the object details for the given object
 	 *
@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#include <kopano/platform.h>
+#include <kopano/ECLogger.h>
+#include "LDAPPool.h"
+
+using namespace KC;
+
+LDAPConnPool::~LDAPConnPool()
+{
+	for (auto ld : m_idle)
+		if (ldap_unbind_s(ld) == -1)
+			ec_log_err("LDAP unbind failed");
+}
+
+void LDAPConnPool::set_max(size_t n)
+{
+	scoped_lock lock(m_lock);
+	m_max = n > 0 ? n : 1;
+	m_cond.notify_all();
+}
+
+LDAP *LDAPConnPool::get(bool *create)
+{
+	ulock_normal lock(m_lock);
+	*create = false;
+	while (true) {
+		if (!m_idle.empty()) {
+			auto ld = m_idle.back();
+			m_idle.pop_back();
+			return ld;
+		}
+		if (m_total < m_max) {
+			++m_total;
+			*create = true;
+			return nullptr;
+		}
+		m_cond.wait(lock);
+	}
+}
+
+void LDAPConnPool::put(LDAP *ld)
+{
+	scoped_lock lock(m_lock);
+	if (m_total > m_max) {
+		/* The pool was shrunk */
+		--m_total;
+		if (ldap_unbind_s(ld) == -1)
+			ec_log_err("LDAP unbind failed");
+		return;
+	}
+	m_idle.emplace_back(ld);
+	m_cond.notify_one();
+}
+
+void LDAPConnPool::discard(LDAP *ld)
+{
+	if (ld != nullptr && ldap_unbind_s(ld) == -1)
+		ec_log_err("LDAP unbind failed");
+	scoped_lock lock(m_lock);
+	--m_total;
+	m_cond.notify_one();
+}
@@ -0,0 +1,45 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-only
+ * Copyright 2018, Kopano and its licensors
+ */
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <ldap.h>
+
+/**
+ * @defgroup userplugin_ldap_pool LDAP user plugin connection pool
+ * @ingroup userplugin_ldap
+ * @{
+ */
+
+/**
+ * Bound connections to the LDAP server(s), shared by all plugin instances
+ * (there is one instance per server thread). An instance only holds a
+ * connection for the length of a search, or a paged series of searches,
+ * so that a handful of binds serve all threads.
+ */
+class LDAPConnPool final {
+	public:
+	~LDAPConnPool();
+	void set_max(size_t);
+	/*
+	 * Hands out an idle connection. If there is none, but the pool may
+	 * still grow, *create is set and nullptr is returned; the caller
+	 * must then connect, or give back the slot with discard(nullptr).
+	 * Otherwise, waits for a connection to be returned.
+	 */
+	LDAP *get(bool *create);
+	void put(LDAP *);
+	/* For connections that failed: unbinds, and frees up the slot. */
+	void discard(LDAP *);
+
+	private:
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	std::vector<LDAP *> m_idle;
+	size_t m_total = 0, m_max = 8;
+};
+
+/** @} */
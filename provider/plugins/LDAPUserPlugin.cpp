@@ -13,6 +13,8 @@
 #include <string>
 #include <stdexcept>
 #include <algorithm>
+#include <deque>
+#include <functional>
 #include <map>
 #include <mutex>
 #include <set>
@@ -29,6 +31,7 @@
 #include "StatsClient.h"
 #include <kopano/stringutil.h>
 #include "LDAPCache.h"
+#include "LDAPPool.h"
 #include "LDAPUserPlugin.h"
 #include "ldappasswords.h"
 #include <kopano/ecversion.h>
@@ -84,6 +87,42 @@ typedef memory_ptr<LDAPControl, ldap_deleter> auto_free_ldap_control;
 typedef memory_ptr<LDAPControl *, ldap_deleter> auto_free_ldap_controls;
 typedef std::unique_ptr<struct berval *[], ldap_deleter> auto_free_ldap_berval;
 
+/*
+ * Holds a pooled connection in LDAPUserPlugin::m_conn for its lifetime.
+ * A lease taken while another one is active shares its connection. When
+ * that connection fails, the inner lease goes on with one of its own, and
+ * the outer lease, which may still have a paged search running on the
+ * failed one, throws it away when it ends.
+ */
+class ldap_lease final {
+	public:
+	ldap_lease(LDAPUserPlugin *p) : m_plugin(p), m_outer(p->m_conn)
+	{
+		if (m_outer != nullptr && m_outer != p->m_conn_failed)
+			return;
+		try {
+			p->AttachConnection();
+		} catch (...) {
+			p->m_conn = m_outer;
+			throw;
+		}
+	}
+	~ldap_lease() { m_plugin->ReturnConnection(m_outer); }
+	/* Give up the connection because of an API error, and get another. */
+	void renew() { m_plugin->RenewConnection(m_outer); }
+	/* Give up the connection because of an API error. */
+	void drop() { m_plugin->DropConnection(m_outer); }
+
+	private:
+	LDAPUserPlugin *m_plugin;
+	LDAP *m_outer;
+};
+
+/* Outstanding searches per connection in my_ldap_search_many */
+#define LDAP_PIPELINE_DEPTH 32
+/* Values per OR-filter when resolving many objects */
+#define LDAP_FILTER_BATCH 100
+
 #define LDAP_DATA_TYPE_DN			"dn"	// data in attribute like cn=piet,cn=user,dc=localhost,dc=com
 #define LDAP_DATA_TYPE_BINARY		"binary"
 
@@ -102,10 +141,9 @@ typedef std::unique_ptr<struct berval *[], ldap_deleter> auto_free_ldap_berval;
 	int rc; \
 	\
 	ldap_page_size = (ldap_page_size == 0) ? 1000 : ldap_page_size; \
+	/* the server ties the cookie to the connection: keep it for all pages */ \
+	ldap_lease lease(this); \
 	do { \
-		if (m_ldap == NULL) \
-			/* this either returns a connection or throws an exception */ \
-			m_ldap = ConnectLDAP(m_config->GetSetting("ldap_bind_user"), m_config->GetSetting("ldap_bind_passwd"), parseBool(m_config->GetSetting("ldap_starttls"))); \
 		/* set critical to 'F' to not force paging? @todo find an ldap server without support. */ \
 		rc = ldap_create_page_control(m_ldap, ldap_page_size, &sCookie, 0, &~pageControl); \
 		if (rc != LDAP_SUCCESS) \
@@ -228,6 +266,7 @@ static std::string StringEscapeSequence(const std::string &);
 static std::string StringEscapeSequence(const char *, size_t);
 
 std::unique_ptr<LDAPCache> LDAPUserPlugin::m_lpCache{std::make_unique<LDAPCache>()};
+std::unique_ptr<LDAPConnPool> LDAPUserPlugin::m_lpPool{std::make_unique<LDAPConnPool>()};
 
 template<typename T> static constexpr inline LONGLONG dur2us(const T &t)
 {
@@ -440,6 +479,7 @@ LDAPUserPlugin::LDAPUserPlugin(std::mutex &pluginlock,
 		{ "ldap_dynamicgroup_name_attribute","cn", CONFIGSETTING_RELOADABLE },
 		{ "ldap_addressbook_hide_attribute","kopanoHidden", CONFIGSETTING_RELOADABLE },
 		{ "ldap_network_timeout", "30", CONFIGSETTING_RELOADABLE },
+		{ "ldap_connection_pool_size", "8", CONFIGSETTING_RELOADABLE },
 		{ "ldap_object_search_filter", "", CONFIGSETTING_RELOADABLE },
 		{ "ldap_filter_cutoff_elements", "1000", CONFIGSETTING_RELOADABLE },
 		{ "ldap_page_size", "1000", CONFIGSETTING_RELOADABLE }, // MaxPageSize in ADS defaults to 1000
@@ -472,12 +512,14 @@ LDAPUserPlugin::LDAPUserPlugin(std::mutex &pluginlock,
 void LDAPUserPlugin::InitPlugin(std::shared_ptr<ECStatsCollector> sc)
 {
 	m_lpStatsCollector = std::move(sc);
-	const char *ldap_binddn = m_config->GetSetting("ldap_bind_user");
-	const char *ldap_bindpw = m_config->GetSetting("ldap_bind_passwd");
-	auto starttls = parseBool(m_config->GetSetting("ldap_starttls"));
-
-	/* FIXME encode the user and password, now it depends on which charset the config is saved in */
-	m_ldap = ConnectLDAP(ldap_binddn, ldap_bindpw, starttls);
+	ulock_normal biglock(m_plugin_lock);
+	auto rc = ldap_initialize(&m_ldap, ldap_servers.front().c_str());
+	biglock.unlock();
+	if (rc != LDAP_SUCCESS)
+		throw ldap_error(format("Failed to initialize LDAP for \"%s\": %s", ldap_servers.front().c_str(), ldap_err2string(rc)), rc);
+	m_lpPool->set_max(atoui(m_config->GetSetting("ldap_connection_pool_size")));
+	/* Make sure the server can be reached; this throws if it cannot. */
+	ldap_lease lease(this);
 	const char *ldap_server_charset = m_config->GetSetting("ldap_server_charset");
 	try {
 		m_iconv.reset(new decltype(m_iconv)::element_type("UTF-8", ldap_server_charset));
@@ -595,14 +637,61 @@ LDAP *LDAPUserPlugin::ConnectLDAP(const char *bind_dn,
 }
 
 LDAPUserPlugin::~LDAPUserPlugin() {
-	// Disconnect from the LDAP server
+	/* The pooled connections stay for the other instances. */
 	if (m_ldap == nullptr)
 		return;
-	LOG_PLUGIN_DEBUG("%s", "Disconnecting from LDAP since unloading plugin instance");
 	if (ldap_unbind_s(m_ldap) == -1)
 		ec_log_err("LDAP unbind failed");
 }
 
+void LDAPUserPlugin::AttachConnection()
+{
+	bool create = false;
+	m_conn = m_lpPool->get(&create);
+	if (!create)
+		return;
+	try {
+		/// @todo encode the user and password, now it's depended in which charset the config is saved
+		m_conn = ConnectLDAP(m_config->GetSetting("ldap_bind_user"),
+		         m_config->GetSetting("ldap_bind_passwd"),
+		         parseBool(m_config->GetSetting("ldap_starttls")));
+	} catch (...) {
+		m_lpPool->discard(nullptr);
+		throw;
+	}
+}
+
+void LDAPUserPlugin::ReturnConnection(LDAP *outer)
+{
+	if (m_conn != nullptr && m_conn != outer) {
+		if (m_conn == m_conn_failed) {
+			m_lpPool->discard(m_conn);
+			m_conn_failed = nullptr;
+		} else {
+			m_lpPool->put(m_conn);
+		}
+	}
+	m_conn = outer;
+}
+
+void LDAPUserPlugin::DropConnection(LDAP *outer)
+{
+	if (m_conn == nullptr)
+		return;
+	if (m_conn == outer)
+		/* The outer lease still uses it, and discards it when done. */
+		m_conn_failed = m_conn;
+	else
+		m_lpPool->discard(m_conn);
+	m_conn = nullptr;
+}
+
+void LDAPUserPlugin::RenewConnection(LDAP *outer)
+{
+	DropConnection(outer);
+	AttachConnection();
+}
+
 void LDAPUserPlugin::my_ldap_search_s(const char *base, int scope,
     const char *filter, const char *const *attrs, int attrsonly,
     LDAPMessage **lppres, LDAPControl **serverControls)
@@ -623,31 +712,20 @@ void LDAPUserPlugin::my_ldap_search_s(const char *base, int scope,
 		filter = NULL;
 	}
 	/*
-	 * When an m_ldap connection object already exists, use it to make
-	 * a query, and, if that fails for any reason, reconnect-and-retry
-	 * exactly once.
-	 * When no m_ldap connection object existed, this boils down to
-	 * one standard connect plus query.
+	 * Use the pooled connection to make a query, and, if that fails for
+	 * any reason, reconnect-and-retry exactly once.
 	 */
-	if (m_ldap != NULL)
-		result = ldap_search_ext_s(m_ldap, base, scope, filter, const_cast<char **>(attrs),
+	ldap_lease lease(this);
+	if (m_conn != nullptr)
+		result = ldap_search_ext_s(m_conn, base, scope, filter, const_cast<char **>(attrs),
 		         attrsonly, serverControls, nullptr, &m_timeout, 0, &~res);
 
-	if (m_ldap == NULL || LDAP_API_ERROR(result)) {
-		const char *ldap_binddn = m_config->GetSetting("ldap_bind_user");
-		const char *ldap_bindpw = m_config->GetSetting("ldap_bind_passwd");
-		auto starttls = parseBool(m_config->GetSetting("ldap_starttls"));
-
-		if (m_ldap != NULL) {
+	if (m_conn == nullptr || LDAP_API_ERROR(result)) {
+		if (m_conn != nullptr)
 			ec_log_err("LDAP search error: %s. Will unbind, reconnect and retry.", ldap_err2string(result));
-			if (ldap_unbind_s(m_ldap) == -1)
-				ec_log_err("LDAP unbind failed");
-			m_ldap = NULL;
-		}
-		/// @todo encode the user and password, now it's depended in which charset the config is saved
-		m_ldap = ConnectLDAP(ldap_binddn, ldap_bindpw, starttls);
+		lease.renew();
 		m_lpStatsCollector->inc(SCN_LDAP_RECONNECTS);
-		result = ldap_search_ext_s(m_ldap, base, scope, filter, const_cast<char **>(attrs),
+		result = ldap_search_ext_s(m_conn, base, scope, filter, const_cast<char **>(attrs),
 		          attrsonly, serverControls, nullptr, nullptr, 0, &~res);
 	}
 
@@ -657,11 +735,9 @@ void LDAPUserPlugin::my_ldap_search_s(const char *base, int scope,
 		if(LDAP_API_ERROR(result)) {
 		    // Some kind of API error occurred (error is not from the server). Unbind the connection so any next try will re-bind
 		    // which will possibly connect to a different (failed over) server.
-			if (m_ldap != NULL) {
+			if (m_conn != nullptr) {
 				ec_log_err("Unbinding from LDAP because of continued error (%s)", ldap_err2string(result));
-				if (ldap_unbind_s(m_ldap) == -1)
-					ec_log_err("LDAP unbind failed");
-				m_ldap = NULL;
+				lease.drop();
 			}
 		}
 		goto exit;
@@ -692,6 +768,141 @@ exit:
 	}
 }
 
+void LDAPUserPlugin::my_ldap_search_many(const std::list<ldap_query> &queries,
+    const char *const *attrs, const std::function<void(LDAPMessage *)> &cb)
+{
+	/* A search, and the cookie of its next page */
+	struct page {
+		const ldap_query *q;
+		std::string cookie;
+	};
+	std::deque<page> todo;
+	std::map<int, page> pending;
+	bool retried = false;
+	auto tstart = std::chrono::steady_clock::now();
+#ifdef HAVE_LDAP_CREATE_PAGE_CONTROL
+	int page_size = strtoul(m_config->GetSetting("ldap_page_size"), nullptr, 10);
+	if (page_size == 0)
+		page_size = 1000;
+#endif
+
+	for (const auto &q : queries)
+		todo.push_back({&q, std::string()});
+	ldap_lease lease(this);
+	/*
+	 * Like my_ldap_search_s: one reconnect, then the remaining searches
+	 * are sent again. The server ties page cookies to the connection, so
+	 * a search that is halfway through its pages cannot be resumed.
+	 */
+	auto fail = [&](const char *what, int rc) {
+		ec_log_err("LDAP %s failed: %s", what, ldap_err2string(rc));
+		bool resumable = std::none_of(todo.cbegin(), todo.cend(),
+		                 [](const page &p) { return !p.cookie.empty(); }) &&
+		                 std::none_of(pending.cbegin(), pending.cend(),
+		                 [](const std::pair<const int, page> &p) { return !p.second.cookie.empty(); });
+		if (retried || !resumable || !LDAP_API_ERROR(rc)) {
+			m_lpStatsCollector->inc(SCN_LDAP_SEARCH_FAILED);
+			if (LDAP_API_ERROR(rc))
+				lease.drop();
+			throw ldap_error(string(what) + ": " + ldap_err2string(rc), rc);
+		}
+		retried = true;
+		for (const auto &p : pending)
+			todo.emplace_front(p.second);
+		pending.clear();
+		lease.renew();
+		m_lpStatsCollector->inc(SCN_LDAP_RECONNECTS);
+	};
+
+	if (m_conn == nullptr)
+		lease.renew();
+	try {
+		while (!todo.empty() || !pending.empty()) {
+			while (!todo.empty() && pending.size() < LDAP_PIPELINE_DEPTH) {
+				auto &p = todo.front();
+				auto q = p.q;
+				LDAPControl *serverControls[2] = {nullptr, nullptr};
+				int msgid = 0, rc;
+#ifdef HAVE_LDAP_CREATE_PAGE_CONTROL
+				/* OR-filters may match more than the server's size limit */
+				auto_free_ldap_control pageControl;
+				if (q->scope != LDAP_SCOPE_BASE) {
+					struct berval cookie = {p.cookie.size(), const_cast<char *>(p.cookie.data())};
+					rc = ldap_create_page_control(m_ldap, page_size, &cookie, 0, &~pageControl);
+					if (rc != LDAP_SUCCESS)
+						throw ldap_error(string("ldap_create_page_control: ") + ldap_err2string(rc), rc);
+					serverControls[0] = pageControl;
+				}
+#endif
+				rc = ldap_search_ext(m_conn, q->base.c_str(), q->scope,
+				     q->filter.empty() ? nullptr : q->filter.c_str(),
+				     const_cast<char **>(attrs), FETCH_ATTR_VALS,
+				     serverControls, nullptr, &m_timeout, 0, &msgid);
+				if (rc != LDAP_SUCCESS) {
+					fail("ldap_search_ext", rc);
+					continue;
+				}
+				pending.emplace(msgid, std::move(p));
+				todo.pop_front();
+			}
+
+			auto_free_ldap_message res;
+			auto rc = ldap_result(m_conn, LDAP_RES_ANY, LDAP_MSG_ALL,
+			          m_timeout.tv_sec > 0 ? &m_timeout : nullptr, &~res);
+			if (rc <= 0) {
+				int err = LDAP_TIMEOUT;
+				if (rc < 0)
+					ldap_get_option(m_conn, LDAP_OPT_RESULT_CODE, &err);
+				fail("ldap_result", err);
+				continue;
+			}
+			auto p = pending.find(ldap_msgid(res));
+			if (p == pending.cend())
+				continue;
+			int err = LDAP_SUCCESS;
+			auto_free_ldap_controls returnedControls;
+			rc = ldap_parse_result(m_ldap, res, &err, nullptr, nullptr, nullptr, &~returnedControls, 0);
+			if (rc != LDAP_SUCCESS)
+				err = rc;
+			m_lpStatsCollector->inc(SCN_LDAP_SEARCH);
+			auto q = p->second.q;
+			if (err != LDAP_SUCCESS) {
+				m_lpStatsCollector->inc(SCN_LDAP_SEARCH_FAILED);
+				/* For one DN of a member list, this is not fatal. */
+				if (!LDAP_NAME_ERROR(err))
+					ec_log_warn("LDAP query in \"%s\" failed: %s (result=0x%02x, %s)",
+						q->base.c_str(), q->filter.c_str(), err, ldap_err2string(err));
+				pending.erase(p);
+				continue;
+			}
+			pending.erase(p);
+#ifdef HAVE_LDAP_CREATE_PAGE_CONTROL
+			if (q->scope != LDAP_SCOPE_BASE && !!returnedControls) {
+				struct berval cookie = {0, nullptr};
+				rc = ldap_parse_pageresponse_control(m_ldap, returnedControls[0], nullptr, &cookie);
+				if (rc != LDAP_SUCCESS)
+					throw ldap_error(string("ldap_parse_pageresponse_control: ") + ldap_err2string(rc), rc);
+				if (cookie.bv_len > 0)
+					todo.push_back({q, std::string(cookie.bv_val, cookie.bv_len)});
+				ber_memfree(cookie.bv_val);
+			}
+#endif
+			cb(res);
+		}
+	} catch (...) {
+		/* Do not leave replies behind on the shared connection. */
+		if (m_conn != nullptr)
+			for (const auto &p : pending)
+				ldap_abandon_ext(m_conn, p.first, nullptr, nullptr);
+		throw;
+	}
+
+	auto llelapsedtime = dur2us(decltype(tstart)::clock::now() - tstart);
+	LOG_PLUGIN_DEBUG("ldaptiming [%luµs] %zu searches", static_cast<unsigned long>(llelapsedtime), queries.size());
+	m_lpStatsCollector->inc(SCN_LDAP_SEARCH_TIME, llelapsedtime);
+	m_lpStatsCollector->Max(SCN_LDAP_SEARCH_TIME_MAX, llelapsedtime);
+}
+
 static std::vector<std::string> split_classes(const char *lpszClasses)
 {
 	auto lstClasses = tokenize(lpszClasses, ',');
@@ -856,6 +1067,12 @@ objectid_t LDAPUserPlugin::GetObjectIdForEntry(LDAPMessage *entry)
 signatures_t LDAPUserPlugin::getAllObjectsByFilter(const std::string &basedn,
     int scope, const std::string &search_filter,
     const std::string &strCompanyDN, bool bCache)
+{
+	return getAllObjectsByFilters({{basedn, search_filter, scope}}, strCompanyDN, bCache);
+}
+
+signatures_t LDAPUserPlugin::getAllObjectsByFilters(const std::list<ldap_query> &queries,
+    const std::string &strCompanyDN, bool bCache)
 {
 	signatures_t signatures;
 	objectid_t				objectid;
@@ -888,8 +1105,7 @@ signatures_t LDAPUserPlugin::getAllObjectsByFilter(const std::string &basedn,
 	/* Needed for cache */
 	CONFIG_TO_ATTR(request_attrs, modify_attr, "ldap_last_modification_attribute");
 
-	FOREACH_PAGING_SEARCH(basedn.c_str(), scope, search_filter.c_str(),
-	    request_attrs->get(), FETCH_ATTR_VALS, res) {
+	auto collect = [&](LDAPMessage *res) {
 		FOREACH_ENTRY(res) {
 			auto dn = GetLDAPEntryDN(entry);
 
@@ -923,8 +1139,19 @@ signatures_t LDAPUserPlugin::getAllObjectsByFilter(const std::string &basedn,
 			}
 		}
 		END_FOREACH_ENTRY
+	};
+
+	if (queries.size() == 1) {
+		/* A single search may return many objects: page through them. */
+		auto &q = queries.front();
+		FOREACH_PAGING_SEARCH(q.base.c_str(), q.scope, q.filter.c_str(),
+		    request_attrs->get(), FETCH_ATTR_VALS, res) {
+			collect(res);
+		}
+		END_FOREACH_LDAP_PAGING
+	} else if (!queries.empty()) {
+		my_ldap_search_many(queries, request_attrs->get(), collect);
 	}
-	END_FOREACH_LDAP_PAGING
 
 	/* Update cache */
 	for (auto &p : mapDNCache)
@@ -1256,6 +1483,18 @@ LDAPUserPlugin::objectDNtoObjectSignatures(objectclass_t objclass,
 {
 	signatures_t signatures;
 
+	if (dn.size() > 1) {
+		/*
+		 * A DN cannot portably be matched with a filter, so each one
+		 * is a base search of its own; these are pipelined on one
+		 * connection. Entries that do not exist are dropped.
+		 */
+		auto ldap_filter = getSearchFilter(objclass);
+		std::list<ldap_query> queries;
+		for (const auto &i : dn)
+			queries.push_back({i, ldap_filter, LDAP_SCOPE_BASE});
+		return getAllObjectsByFilters(queries, std::string(), false);
+	}
 	for (const auto &i : dn) {
 		try {
 			signatures.emplace_back(objectDNtoObjectSignature(objclass, i));
@@ -1289,12 +1528,24 @@ LDAPUserPlugin::resolveObjectsFromAttributes(objectclass_t objclass,
 	if (!company.id.empty())
 		companyDN = ldap_basedn; // in hosted, companyDN is the same as searchbase?
 
-	ldap_filter = "(&" + ldap_filter + "(|";
-	for (const auto &i : objects)
+	/*
+	 * Large OR-filters are slow to evaluate and may exceed server
+	 * limits; split them into batches that are searched concurrently.
+	 */
+	std::list<ldap_query> queries;
+	std::string terms;
+	unsigned int n = 0;
+	for (const auto &i : objects) {
 		for (unsigned int j = 0; lppAttr[j] != NULL; ++j)
-			ldap_filter += "(" + string(lppAttr[j]) + "=" + StringEscapeSequence(i) + ")";
-	ldap_filter += "))";
-	return getAllObjectsByFilter(ldap_basedn, LDAP_SCOPE_SUBTREE, ldap_filter, companyDN, false);
+			terms += "(" + string(lppAttr[j]) + "=" + StringEscapeSequence(i) + ")";
+		if (++n % LDAP_FILTER_BATCH != 0)
+			continue;
+		queries.push_back({ldap_basedn, "(&" + ldap_filter + "(|" + terms + "))", LDAP_SCOPE_SUBTREE});
+		terms.clear();
+	}
+	if (!terms.empty() || queries.empty())
+		queries.push_back({ldap_basedn, "(&" + ldap_filter + "(|" + terms + "))", LDAP_SCOPE_SUBTREE});
+	return getAllObjectsByFilters(queries, companyDN, false);
 }
 
 objectsignature_t LDAPUserPlugin::resolveObjectFromAttributeType(objectclass_t objclass, const string &object, const char* lpAttr, const char* lpAttrType, const objectid_t &company)
@@ -1566,6 +1817,37 @@ signatures_t LDAPUserPlugin::getAllObjects(const objectid_t &company,
 	       "(&" + getSearchFilter(objclass) + rst_to_filter(rst) + ")", companyDN, true);
 }
 
+signatures_t LDAPUserPlugin::getChangedObjects(const objectid_t &company,
+    objectclass_t objclass, const std::string &since, std::string *next)
+{
+	const char *modify_attr = m_config->GetSetting("ldap_last_modification_attribute");
+	if (modify_attr == nullptr || *modify_attr == '\0')
+		throw notimplemented("Change tracking needs ldap_last_modification_attribute");
+
+	string companyDN;
+	if (!company.id.empty())
+		companyDN = getSearchBase(company);
+	LOG_PLUGIN_DEBUG("%s Class %x, since \"%s\"", __FUNCTION__, objclass, since.c_str());
+	auto ldap_filter = "(&" + getSearchFilter(objclass);
+	if (!since.empty())
+		ldap_filter += "("s + modify_attr + ">=" + StringEscapeSequence(since) + ")";
+	ldap_filter += ")";
+	/* The DN cache merges, so the changes keep it current. */
+	auto signatures = getAllObjectsByFilter(getSearchBase(company),
+	                  LDAP_SCOPE_SUBTREE, ldap_filter, companyDN, true);
+
+	/*
+	 * Timestamps (and AD's uSNChanged) have a fixed format, so that
+	 * the longer value, or else the one that sorts last, is the later.
+	 */
+	*next = since;
+	for (const auto &sig : signatures)
+		if (sig.signature.size() > next->size() ||
+		    (sig.signature.size() == next->size() && sig.signature > *next))
+			*next = sig.signature;
+	return signatures;
+}
+
 std::string LDAPUserPlugin::getLDAPAttributeValue(const char *attribute, LDAPMessage *entry)
 {
 	list<string> l = getLDAPAttributeValues(attribute, entry);
@@ -4,6 +4,7 @@
  */
 // -*- Mode: c++ -*-
 #pragma once
+#include <functional>
 #include <list>
 #include <mutex>
 #include <string>
@@ -22,6 +23,16 @@ namespace KC { class ECStatsCollector; }
 using namespace KC;
 struct restrictTable;
 class LDAPCache;
+class LDAPConnPool;
+class ldap_lease;
+
+/**
+ * One search in a batch for LDAPUserPlugin::my_ldap_search_many.
+ */
+struct ldap_query {
+	std::string base, filter;
+	int scope;
+};
 
 /** 
  * LDAP user plugin
@@ -111,6 +122,26 @@ public:
 	 */
 	virtual signatures_t getAllObjects(const objectid_t &company, objectclass_t, const restrictTable * = nullptr) override;
 
+	/**
+	 * Request the objects that changed since an earlier call, by their
+	 * ldap_last_modification_attribute, whose highest value is the mark.
+	 * The search uses >=, so the objects changed at the mark itself are
+	 * returned again.
+	 *
+	 * @param[in]	company
+	 *					The company beneath which the objects should be listed.
+	 *					This objectid can be empty.
+	 * @param[in]	objclass
+	 *					The objectclass of the objects which should be returned.
+	 * @param[in]	since
+	 *					The mark from the previous call, or empty for all objects.
+	 * @param[out]	next
+	 *					The mark for the next call.
+	 * @return The list of object signatures of all objects which were changed
+	 * @throw notimplemented When ldap_last_modification_attribute is not set
+	 */
+	virtual signatures_t getChangedObjects(const objectid_t &company, objectclass_t, const std::string &since, std::string *next) override;
+
 	/**
 	 * Obtain the object details for the given object
 	 *
@@ -316,10 +347,18 @@ public:
 
 protected:
 	/**
-	 * Pointer to the LDAP state struct.
+	 * Handle that is never connected, used to take apart search results
+	 * (which may come from any pooled connection).
 	 */
 	LDAP *m_ldap;
 
+	/**
+	 * Connection leased from m_lpPool for the search(es) in progress, and
+	 * one that failed while an outer lease still used it.
+	 */
+	LDAP *m_conn = nullptr, *m_conn_failed = nullptr;
+	static std::unique_ptr<LDAPConnPool> m_lpPool;
+
 	/**
 	 * converter FROM ldap TO kopano-server and vice-versa
 	 */
@@ -627,6 +666,12 @@ private:
 	 */
 	signatures_t getAllObjectsByFilter(const std::string &basedn, int scope, const std::string &search_filter, const std::string &company_dn, bool cache);
 
+	/**
+	 * Like getAllObjectsByFilter(), for a batch of searches which are sent
+	 * to LDAP at once. Searches that fail are skipped.
+	 */
+	signatures_t getAllObjectsByFilters(const std::list<ldap_query> &, const std::string &company_dn, bool cache);
+
 	/**
 	 * Detecmine object id from LDAP result entry
 	 *
@@ -677,6 +722,34 @@ private:
 	 * @todo return value lppres
 	 */
 	void my_ldap_search_s(const char *base, int scope, const char *filter, const char *const *attrs, int attrsonly, LDAPMessage **lppres, LDAPControl **serverControls = nullptr);
+
+	/**
+	 * Issue many searches on one connection without waiting for each
+	 * answer (ldap_search_ext + ldap_result), with up to
+	 * LDAP_PIPELINE_DEPTH of them outstanding.
+	 *
+	 * @param[in]	queries	the searches
+	 * @param[in]	attrs	attributes to fetch, for all searches
+	 * @param[in]	cb	called for every search result, in the order
+	 *			in which they arrive; the result is freed afterwards
+	 * @throw ldap_error When the connection failed (after one reconnect)
+	 *
+	 * Searches for objects that do not exist, and other searches that
+	 * the server refuses, are logged and skipped.
+	 */
+	void my_ldap_search_many(const std::list<ldap_query> &queries, const char *const *attrs, const std::function<void(LDAPMessage *)> &cb);
+
+	/**
+	 * Manage m_conn for an ldap_lease; @outer is the connection of the
+	 * enclosing lease, if any, which is left alone. Use ldap_lease rather
+	 * than calling these directly.
+	 */
+	void AttachConnection();
+	void ReturnConnection(LDAP *outer);
+	/** Throw away m_conn because of an API error (and get another). */
+	void DropConnection(LDAP *outer);
+	void RenewConnection(LDAP *outer);
+	friend class ldap_lease;
 	std::string rst_to_filter(const restrictTable *);
 
 	long unsigned int ldapServerIndex; // index of the last ldap server to which we could connect
@@ -175,6 +175,29 @@ public:
 	 */
 	virtual signatures_t getAllObjects(const objectid_t &company, objectclass_t, const restrictTable * = nullptr) = 0;
 
+	/**
+	 * Request the objects for a particular company and specified
+	 * objectclass that have changed since an earlier call.
+	 *
+	 * Deleted objects are not reported; the caller has to find those
+	 * with getAllObjects.
+	 *
+	 * @param[in]	company
+	 *					The company beneath which the objects should be listed.
+	 *					This objectid can be empty.
+	 * @param[in]	objclass
+	 *					The objectclass of the objects which should be returned.
+	 * @param[in]	since
+	 *					The mark returned by an earlier call, or empty to
+	 *					list all objects (as getAllObjects does).
+	 * @param[out]	next
+	 *					The mark to pass next time.
+	 * @return The list of object signatures of all objects which were changed
+	 * @throw notimplemented When the plugin cannot track changes
+	 * @throw std::exception
+	 */
+	virtual signatures_t getChangedObjects(const objectid_t &company, objectclass_t, const std::string &since, std::string *next) = 0;
+
 	/**
 	 * Obtain the object details for the given object
 	 *
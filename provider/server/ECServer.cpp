@@ -110,6 +110,7 @@ server_stats::server_stats(std::shared_ptr<ECConfig> cfg) :
 	AddStat(SCN_SOAP_REQUESTS, SCT_INTEGER, "soap_request", "Number of soap requests handled by server");
 	AddStat(SCN_RESPONSE_TIME, SCT_REAL, "response_time", "Cumulated response time (includes queue time) of SOAP requests, in seconds.");
 	AddStat(SCN_PROCESSING_TIME, SCT_REAL, "processing_time", "Cumulated wallclock time taken to process SOAP requests, in seconds.");
+	AddStat(SCN_SOAP_LATENCY, SCT_HISTOGRAM, "soap_latency", "Distribution of SOAP request response times (includes queue time), in µs");
 
 	AddStat(SCN_DATABASE_CONNECTS, SCT_INTEGER, "sql_connect", "Number of connections made to SQL server");
 	AddStat(SCN_DATABASE_SELECTS, SCT_INTEGER, "sql_select", "Number of SQL Select commands executed");
@@ -129,6 +130,7 @@ server_stats::server_stats(std::shared_ptr<ECConfig> cfg) :
 	AddStat(SCN_DATABASE_MERGED_RECORDS, SCT_INTEGER, "deferred_records", "Number records merged in the deferred write table");
 	AddStat(SCN_DATABASE_ROW_READS, SCT_INTEGER, "row_reads", "Number of table rows read in row order");
 	AddStat(SCN_DATABASE_COUNTER_RESYNCS, SCT_INTEGER, "counter_resyncs", "Number of time a counter resync was required");
+	AddStat(SCN_DATABASE_LATENCY, SCT_HISTOGRAM, "sql_latency", "Distribution of SQL query execution times, in µs");
 	AddStat(SCN_DATABASE_MAX_OBJECTID, SCT_INTGAUGE, "max_objectid", "Highest object number used");
 
 	AddStat(SCN_LOGIN_PASSWORD, SCT_INTEGER, "login_password", "Number of logins through password authentication");
@@ -147,6 +149,9 @@ server_stats::server_stats(std::shared_ptr<ECConfig> cfg) :
 	AddStat(SCN_SESSIONGROUPS_CREATED, SCT_INTEGER, "sess_grp_created", "Number of created sessiongroups");
 	AddStat(SCN_SESSIONGROUPS_DELETED, SCT_INTEGER, "sess_grp_deleted", "Number of deleted sessiongroups");
 
+	AddStat(SCN_SECURITY_CACHE_HITS, SCT_INTEGER, "perm_cache_hit", "Number of permission checks answered from the session's decision cache");
+	AddStat(SCN_SECURITY_CACHE_MISSES, SCT_INTEGER, "perm_cache_miss", "Number of permission checks evaluated in full");
+
 	AddStat(SCN_LDAP_CONNECTS, SCT_INTEGER, "ldap_connect", "Number of connections made to LDAP server");
 	AddStat(SCN_LDAP_RECONNECTS, SCT_INTEGER, "ldap_reconnect", "Number of re-connections made to LDAP server");
 	AddStat(SCN_LDAP_CONNECT_FAILED, SCT_INTEGER, "ldap_connect_fail", "Number of failed connections made to LDAP server");
@@ -168,6 +173,7 @@ server_stats::server_stats(std::shared_ptr<ECConfig> cfg) :
 	AddStat(SCN_INDEXER_SEARCH_ERRORS, SCT_INTEGER, "index_search_errors", "Number of failed indexer queries");
 	AddStat(SCN_INDEXER_SEARCH_MAX, SCT_INTGAUGE, "index_search_max", "Maximum duration (in µs) of an indexed search query");
 	AddStat(SCN_INDEXER_SEARCH_AVG, SCT_INTGAUGE, "index_search_avg", "Average duration (in µs) of an indexed search query");
+	AddStat(SCN_INDEXER_LATENCY, SCT_HISTOGRAM, "index_latency", "Distribution of indexed search query durations, in µs");
 	AddStat(SCN_INDEXED_SEARCHES, SCT_INTEGER, "search_indexed", "Number of indexed searches performed");
 	AddStat(SCN_DATABASE_SEARCHES, SCT_INTEGER, "search_database", "Number of database searches performed");
 
@@ -175,6 +181,8 @@ server_stats::server_stats(std::shared_ptr<ECConfig> cfg) :
 	AddStat(SCN_SERVER_ATTACH_BACKEND, SCT_STRING, "attachment_storage", "Attachment backend type");
 	set(SCN_SERVER_USERDB_BACKEND, cfg->GetSetting("user_plugin"));
 	set(SCN_SERVER_ATTACH_BACKEND, cfg->GetSetting("attachment_storage"));
+	set_soap_profiling(parseBool(cfg->GetSetting("soap_profiling")));
+	m_tracer.configure(cfg.get());
 }
 
 void server_stats::stop()
@@ -241,6 +249,8 @@ void sv_sighup_sync()
 		g_lpAudit->Reset();
 	}
 	g_lpSessionManager->m_stats->SetTime(SCN_SERVER_LAST_CONFIGRELOAD, time(nullptr));
+	g_lpSessionManager->m_stats->set_soap_profiling(parseBool(g_lpConfig->GetSetting("soap_profiling")));
+	g_lpSessionManager->m_stats->m_tracer.configure(g_lpConfig.get());
 	g_lpSoapServerConn->DoHUP();
 }
 
@@ -938,6 +948,7 @@ static int running_server(char *szName, const char *szConfig, bool exp_config,
 		{ "cache_userdetails_size",		"0", CONFIGSETTING_SIZE },
 		{ "cache_userdetails_lifetime", "0" },							// 0 minutes - forever
 		{ "cache_acl_size",				"1M", CONFIGSETTING_SIZE },		// 1Mb, acl table cache
+		{ "cache_permission_size",		"32k", CONFIGSETTING_SIZE | CONFIGSETTING_RELOADABLE },	// per session, permission decisions
 		{ "cache_store_size",			"1M", CONFIGSETTING_SIZE },		// 1Mb, store table cache (storeid, storeguid), 40 bytes
 		{ "cache_server_size",			"1M", CONFIGSETTING_SIZE },		// 1Mb
 		{ "cache_server_lifetime",		"30" },							// 30 minutes
@@ -969,16 +980,25 @@ static int running_server(char *szName, const char *szConfig, bool exp_config,
 		{ "watchdog_frequency",		"1", CONFIGSETTING_RELOADABLE },
 
 		{ "folder_max_items",		"1000000", CONFIGSETTING_RELOADABLE },
+		{"shared_table_views", "yes", CONFIGSETTING_RELOADABLE},
 		{ "default_sort_locale_id",		"en_US", CONFIGSETTING_RELOADABLE },
 		{ "sync_gab_realtime",			"yes", CONFIGSETTING_RELOADABLE },
+		{ "sync_gab_incremental", "no", CONFIGSETTING_RELOADABLE },
+		{ "sync_gab_full_interval", "3600", CONFIGSETTING_RELOADABLE },
 		{ "max_deferred_records",		"0", CONFIGSETTING_RELOADABLE },
 		{ "max_deferred_records_folder", "20", CONFIGSETTING_RELOADABLE },
+		{"max_deferred_age", "60", CONFIGSETTING_RELOADABLE},
+		{"deferred_purge_threads", "2"},
 		{ "enable_test_protocol",		"no", CONFIGSETTING_RELOADABLE },
 		{ "disabled_features", "imap pop3", CONFIGSETTING_RELOADABLE },
 		{ "mysql_group_concat_max_len", "21844", CONFIGSETTING_RELOADABLE },
 		{ "restrict_admin_permissions", "no", 0 },
 		{"embedded_attachment_limit", "20", CONFIGSETTING_NONEMPTY | CONFIGSETTING_RELOADABLE},
 		{ "proxy_header", "", CONFIGSETTING_RELOADABLE },
+		{ "soap_profiling", "no", CONFIGSETTING_RELOADABLE },
+		{ "slow_request_threshold", "0", CONFIGSETTING_RELOADABLE },
+		{ "slow_request_traces", "100", CONFIGSETTING_RELOADABLE },
+		{ "slow_request_log", "", CONFIGSETTING_RELOADABLE },
 		{ "owner_auto_full_access", "true" },
 		{ "attachment_files_fsync", "yes", 0 },
 		{ "tmp_path", "/tmp" },
@@ -189,6 +189,8 @@ void WORKITEM::run()
 		// Pass information on start time of the request into soap->user, so that it can be applied to the correct
 		// session after XML parsing
 		info->st.func = nullptr;
+		info->st.er = 0;
+		info->st.sql_queries = info->st.sql_rows = info->st.bytes_sent = 0;
 		info->fdone = NULL;
 
 		// Do processing of work item
@@ -252,11 +254,13 @@ done:
 		g_lpSessionManager->RemoveBusyState(info->ulLastSessionId, thrself);
 		// Track cpu usage server-wide
 		g_lpSessionManager->m_stats->inc(SCN_SOAP_REQUESTS);
+		g_lpSessionManager->m_stats->soap_call(info->st);
 	}
 
 	using namespace std::chrono;
 	g_lpSessionManager->m_stats->inc(SCN_PROCESSING_TIME, duration_cast<duration<double>>(info->st.wi_wall_dur).count());
 	g_lpSessionManager->m_stats->inc(SCN_RESPONSE_TIME, duration_cast<duration<double>>(info->st.sk_wall_dur).count());
+	g_lpSessionManager->m_stats->sample(SCN_SOAP_LATENCY, duration_cast<microseconds>(info->st.sk_wall_dur).count());
 
 	if (g_request_logger != nullptr)
 		log_request(soap, err);
@@ -994,7 +994,7 @@ static HRESULT HrGetDeliveryStoreAndFolder(IMAPISession *lpSession,
  * @return MAPI Error code
  */
 static HRESULT FallbackDelivery(StatsClient *sc, IMessage *lpMessage,
-    const std::string &msg)
+    const mapped_file &msg)
 {
 	std::string newbody;
 	SPropValue pm[8], pa[4];
@@ -1028,7 +1028,7 @@ static HRESULT FallbackDelivery(StatsClient *sc, IMessage *lpMessage,
 	hr = lpAttach->OpenProperty(PR_ATTACH_DATA_BIN, &IID_IStream, STGM_WRITE | STGM_TRANSACTED, MAPI_CREATE | MAPI_MODIFY, &~lpStream);
 	if (hr != hrSuccess)
 		return kc_perrorf("lpAttach->OpenProperty failed", hr);
-	hr = lpStream->Write(msg.c_str(), msg.size(), NULL);
+	hr = lpStream->Write(msg.data(), msg.size(), NULL);
 	if (hr != hrSuccess)
 		return kc_perrorf("lpStream->Write failed", hr);
 	hr = lpStream->Commit(0);
@@ -1376,7 +1376,7 @@ static HRESULT HrCreateMessage(IMAPIFolder *lpFolder,
 /**
  * Convert the received rfc2822 email into a MAPI message
  *
- * @param[in] strMail the received email
+ * @param[in] mail the received email
  * @param[in] lpSession a MAPI Session
  * @param[in] lpMsgStore The store of the delivery
  * @param[in] lpAdrBook The Global Addressbook
@@ -1388,7 +1388,7 @@ static HRESULT HrCreateMessage(IMAPIFolder *lpFolder,
  *
  * @return MAPI Error code
  */
-static HRESULT HrStringToMAPIMessage(const string &strMail,
+static HRESULT HrStringToMAPIMessage(const mapped_file &mail,
     IMAPISession *lpSession, IMsgStore *lpMsgStore, LPADRBOOK lpAdrBook,
     IMAPIFolder *lpDeliveryFolder, IMessage *lpMessage, ECRecipient *lpRecip,
     DeliveryArgs *lpArgs, IMessage **lppMessage, bool *lpbFallbackDelivery)
@@ -1399,7 +1399,7 @@ static HRESULT HrStringToMAPIMessage(const string &strMail,
 	lpArgs->sDeliveryOpts.add_imap_data = lpRecip->bHasIMAP;
 
 	// Set the properties on the object
-	auto hr = IMToMAPI(lpSession, lpMsgStore, lpAdrBook, lpMessage, strMail, lpArgs->sDeliveryOpts);
+	auto hr = IMToMAPI(lpSession, lpMsgStore, lpAdrBook, lpMessage, mail.data(), mail.size(), lpArgs->sDeliveryOpts);
 	if (hr != hrSuccess) {
 		kc_pwarn("E-mail parsing failed; starting fallback delivery.", hr);
 
@@ -1409,7 +1409,7 @@ static HRESULT HrStringToMAPIMessage(const string &strMail,
 			kc_perror("Unable to create fallback message", hr);
 			goto exit;
 		}
-		hr = FallbackDelivery(lpArgs->sc.get(), lpFallbackMessage, strMail);
+		hr = FallbackDelivery(lpArgs->sc.get(), lpFallbackMessage, mail);
 		if (hr != hrSuccess) {
 			kc_perror("Unable to deliver fallback message", hr);
 			goto exit;
@@ -1715,9 +1715,125 @@ static HRESULT HrOverrideReceivedByProps(IMessage *lpMessage,
 	return hrSuccess;
 }
 
+/* Recipient-dependent properties which must not be copied to the next recipient */
+static constexpr const SizedSPropTagArray(11, sptaReceivedBy) = {
+	11, {
+		/* Overridden by HrOverrideRecipProps() */
+		PR_MESSAGE_RECIP_ME,
+		PR_MESSAGE_TO_ME,
+		PR_MESSAGE_CC_ME,
+		/* HrOverrideReceivedByProps() */
+		PR_RECEIVED_BY_ADDRTYPE,
+		PR_RECEIVED_BY_EMAIL_ADDRESS,
+		PR_RECEIVED_BY_ENTRYID,
+		PR_RECEIVED_BY_NAME,
+		PR_RECEIVED_BY_SEARCH_KEY,
+		/* Written by rules */
+		PR_LAST_VERB_EXECUTED,
+		PR_LAST_VERB_EXECUTION_TIME,
+		PR_ICON_INDEX,
+	}
+};
+static constexpr const SizedSPropTagArray(12, sptaFallback) = {
+	12, {
+		/* Overridden by HrOverrideFallbackProps() */
+		PR_SENDER_ADDRTYPE,
+		PR_SENDER_EMAIL_ADDRESS,
+		PR_SENDER_ENTRYID,
+		PR_SENDER_NAME,
+		PR_SENDER_SEARCH_KEY,
+		PR_SENT_REPRESENTING_ADDRTYPE,
+		PR_SENT_REPRESENTING_EMAIL_ADDRESS,
+		PR_SENT_REPRESENTING_ENTRYID,
+		PR_SENT_REPRESENTING_NAME,
+		PR_SENT_REPRESENTING_SEARCH_KEY,
+		PR_RCVD_REPRESENTING_ADDRTYPE,
+		PR_RCVD_REPRESENTING_EMAIL_ADDRESS,
+	}
+};
+static constexpr const SizedSPropTagArray(4, sptaIMAPData) =
+	{4, {PR_EC_IMAP_EMAIL_SIZE, PR_EC_IMAP_EMAIL, PR_EC_IMAP_BODY,
+	PR_EC_IMAP_BODYSTRUCTURE}};
+
+/**
+ * Copy a delivered message to another recipient on the storage server
+ *
+ * The copy is created by the server, sharing the body and attachment data
+ * of the original through single instancing, so nothing but the entryids
+ * travels over the wire. Only works when lpOrigMessage was saved on the
+ * same server as lpStore.
+ *
+ * @param[in] lpStore Store of lpDeliverFolder
+ * @param[in] lpOrigMessage The original (saved) delivered message
+ * @param[in] lpDeliverFolder The delivery folder of the new message
+ * @param[in] lpRecip recipient data to use
+ * @param[in] bFallbackDelivery lpOrigMessage is a fallback delivery message
+ * @param[out] lppMessage the newly copied message, opened for modification
+ *
+ * @return MAPI Error code
+ */
+static HRESULT HrServerCopyForDelivery(IMsgStore *lpStore,
+    IMessage *lpOrigMessage, IMAPIFolder *lpDeliverFolder,
+    ECRecipient *lpRecip, bool bFallbackDelivery, IMessage **lppMessage)
+{
+	object_ptr<IECSpooler> lpSpooler;
+	object_ptr<IMessage> lpMessage;
+	memory_ptr<SPropValue> lpMsgEntryId, lpFolderEntryId;
+	memory_ptr<SPropTagArray> lpExclude;
+	memory_ptr<ENTRYID> lpNewEntryId;
+	helpers::MAPIPropHelperPtr ptrArchiveHelper;
+	ULONG cbNewEntryId = 0, ulObjType = 0;
+
+	auto hr = lpStore->QueryInterface(IID_IECSpooler, &~lpSpooler);
+	if (hr != hrSuccess)
+		return hr;
+	hr = HrGetOneProp(lpOrigMessage, PR_ENTRYID, &~lpMsgEntryId);
+	if (hr != hrSuccess)
+		return hr;
+	hr = HrGetOneProp(lpDeliverFolder, PR_ENTRYID, &~lpFolderEntryId);
+	if (hr != hrSuccess)
+		return hr;
+
+	hr = MAPIAllocateBuffer(CbNewSPropTagArray(sptaReceivedBy.cValues + sptaFallback.cValues + sptaIMAPData.cValues), &~lpExclude);
+	if (hr != hrSuccess)
+		return hr;
+	lpExclude->cValues = 0;
+	for (unsigned int i = 0; i < sptaReceivedBy.cValues; ++i)
+		lpExclude->aulPropTag[lpExclude->cValues++] = sptaReceivedBy.aulPropTag[i];
+	if (bFallbackDelivery)
+		for (unsigned int i = 0; i < sptaFallback.cValues; ++i)
+			lpExclude->aulPropTag[lpExclude->cValues++] = sptaFallback.aulPropTag[i];
+	if (!lpRecip->bHasIMAP)
+		for (unsigned int i = 0; i < sptaIMAPData.cValues; ++i)
+			lpExclude->aulPropTag[lpExclude->cValues++] = sptaIMAPData.aulPropTag[i];
+
+	hr = lpSpooler->CopyMessageForDelivery(lpMsgEntryId->Value.bin.cb,
+	     reinterpret_cast<ENTRYID *>(lpMsgEntryId->Value.bin.lpb),
+	     lpFolderEntryId->Value.bin.cb,
+	     reinterpret_cast<ENTRYID *>(lpFolderEntryId->Value.bin.lpb),
+	     lpExclude, &cbNewEntryId, &~lpNewEntryId);
+	if (hr != hrSuccess)
+		return hr;
+	hr = lpStore->OpenEntry(cbNewEntryId, lpNewEntryId, &IID_IMessage,
+	     MAPI_MODIFY, &ulObjType, &~lpMessage);
+	if (hr != hrSuccess)
+		return kc_perrorf("OpenEntry failed", hr);
+
+	// Make sure the message is not attached to an archive
+	hr = helpers::MAPIPropHelper::Create(object_ptr<IMAPIProp>(lpMessage), &ptrArchiveHelper);
+	if (hr != hrSuccess)
+		return kc_perrorf("helpers::MAPIPropHelper::Create failed", hr);
+	hr = ptrArchiveHelper->DetachFromArchives();
+	if (hr != hrSuccess)
+		return kc_perrorf("DetachFromArchives failed", hr);
+	*lppMessage = lpMessage.release();
+	return hrSuccess;
+}
+
 /**
  * Copy a delivered message to another recipient
  *
+ * @param[in] lpStore Store of lpDeliverFolder
  * @param[in] lpOrigMessage The original delivered message
  * @param[in] lpDeliverFolder The delivery folder of the new message
  * @param[in] lpRecip recipient data to use
@@ -1725,52 +1841,36 @@ static HRESULT HrOverrideReceivedByProps(IMessage *lpMessage,
  * @param[in] bFallbackDelivery lpOrigMessage is a fallback delivery message
  * @param[out] lppFolder folder the new message was created in
  * @param[out] lppMessage the newly copied message
+ * @param[out] lpbStored the new message already exists on the server
  *
  * @return MAPI Error code
  */
-static HRESULT HrCopyMessageForDelivery(IMessage *lpOrigMessage,
-    IMAPIFolder *lpDeliverFolder, ECRecipient *lpRecip,
+static HRESULT HrCopyMessageForDelivery(IMsgStore *lpStore,
+    IMessage *lpOrigMessage, IMAPIFolder *lpDeliverFolder, ECRecipient *lpRecip,
     IMAPIFolder *lpFallbackFolder, bool bFallbackDelivery,
-    IMAPIFolder **lppFolder = NULL, IMessage **lppMessage = NULL)
+    IMAPIFolder **lppFolder = NULL, IMessage **lppMessage = NULL,
+    bool *lpbStored = nullptr)
 {
 	object_ptr<IMessage> lpMessage;
 	object_ptr<IMAPIFolder> lpFolder;
 	helpers::MAPIPropHelperPtr ptrArchiveHelper;
-	static constexpr const SizedSPropTagArray(13, sptaReceivedBy) = {
-		13, {
-			/* Overridden by HrOverrideRecipProps() */
-			PR_MESSAGE_RECIP_ME,
-			PR_MESSAGE_TO_ME,
-			PR_MESSAGE_CC_ME,
-			/* HrOverrideReceivedByProps() */
-			PR_RECEIVED_BY_ADDRTYPE,
-			PR_RECEIVED_BY_EMAIL_ADDRESS,
-			PR_RECEIVED_BY_ENTRYID,
-			PR_RECEIVED_BY_NAME,
-			PR_RECEIVED_BY_SEARCH_KEY,
-			/* Written by rules */
-			PR_LAST_VERB_EXECUTED,
-			PR_LAST_VERB_EXECUTION_TIME,
-			PR_ICON_INDEX,
-		}
-	};
-	static constexpr const SizedSPropTagArray(12, sptaFallback) = {
-		12, {
-			/* Overridden by HrOverrideFallbackProps() */
-			PR_SENDER_ADDRTYPE,
-			PR_SENDER_EMAIL_ADDRESS,
-			PR_SENDER_ENTRYID,
-			PR_SENDER_NAME,
-			PR_SENDER_SEARCH_KEY,
-			PR_SENT_REPRESENTING_ADDRTYPE,
-			PR_SENT_REPRESENTING_EMAIL_ADDRESS,
-			PR_SENT_REPRESENTING_ENTRYID,
-			PR_SENT_REPRESENTING_NAME,
-			PR_SENT_REPRESENTING_SEARCH_KEY,
-			PR_RCVD_REPRESENTING_ADDRTYPE,
-			PR_RCVD_REPRESENTING_EMAIL_ADDRESS,
+
+	if (lpbStored != nullptr)
+		*lpbStored = false;
+	if (parseBool(g_lpConfig->GetSetting("server_side_copy"))) {
+		auto hr = HrServerCopyForDelivery(lpStore, lpOrigMessage,
+		          lpDeliverFolder, lpRecip, bFallbackDelivery, &~lpMessage);
+		if (hr == hrSuccess) {
+			if (lppFolder)
+				lpDeliverFolder->QueryInterface(IID_IMAPIFolder, reinterpret_cast<void **>(lppFolder));
+			if (lppMessage)
+				lpMessage->QueryInterface(IID_IMessage, reinterpret_cast<void **>(lppMessage));
+			if (lpbStored != nullptr)
+				*lpbStored = true;
+			return hrSuccess;
 		}
-	};
+		hr_ldebug(hr, "Server-side copy not possible, copying message through dagent");
+	}
 
 	auto hr = HrCreateMessage(lpDeliverFolder, lpFallbackFolder, &~lpFolder, &~lpMessage);
 	if (hr != hrSuccess)
@@ -1935,12 +2035,12 @@ static HRESULT HrPostDeliveryProcessing(pym_plugin_intf *lppyMapiPlugin,
  * Find spam header if needed, and mark delivery as spam delivery if
  * header found.
  *
- * @param[in] strMail rfc2822 email being delivered
+ * @param[in] mail rfc2822 email being delivered
  * @param[in,out] lpArgs delivery options
  *
  * @return MAPI Error code
  */
-static HRESULT FindSpamMarker(const std::string &strMail,
+static HRESULT FindSpamMarker(const mapped_file &mail,
     DeliveryArgs *lpArgs)
 {
 	HRESULT hr = hrSuccess;
@@ -1952,14 +2052,14 @@ static HRESULT FindSpamMarker(const std::string &strMail,
 	if (!szHeader || !szValue)
 		return hr;
 	// find end of headers
-	auto end = strMail.find("\r\n\r\n");
-	if (end == string::npos)
+	auto hdr_end = static_cast<const char *>(memmem(mail.data(), mail.size(), "\r\n\r\n", 4));
+	if (hdr_end == nullptr)
 		return hr;
-	end += 2;
+	size_t end = hdr_end - mail.data() + 2;
 
 	// copy headers in upper case, need to resize destination first
 	strHeaders.resize(end);
-	transform(strMail.begin(), strMail.begin() +end, strHeaders.begin(), ::toupper);
+	transform(mail.data(), mail.data() + end, strHeaders.begin(), ::toupper);
 	auto match = strToUpper("\r\n"s + szHeader + ":");
 
 	// find header
@@ -1991,7 +2091,7 @@ static HRESULT FindSpamMarker(const std::string &strMail,
  * @param[in] lpAdrBook Global Addressbook
  * @param[in] lpOrigMessage a previously delivered message, if any
  * @param[in] bFallbackDelivery previously delivered message was a fallback message
- * @param[in] strMail original received rfc2822 email
+ * @param[in] mail original received rfc2822 email
  * @param[in] lpRecip recipient to deliver message to
  * @param[in] lpArgs delivery options
  * @param[out] lppMessage the newly delivered message
@@ -2002,7 +2102,7 @@ static HRESULT FindSpamMarker(const std::string &strMail,
 static HRESULT ProcessDeliveryToRecipient(pym_plugin_intf *lppyMapiPlugin,
     IMAPISession *lpSession, IMsgStore *lpStore, bool bIsAdmin,
     LPADRBOOK lpAdrBook, IMessage *lpOrigMessage, bool bFallbackDelivery,
-    const std::string &strMail, ECRecipient *lpRecip, DeliveryArgs *lpArgs,
+    const mapped_file &mail, ECRecipient *lpRecip, DeliveryArgs *lpArgs,
     IMessage **lppMessage, bool *lpbFallbackDelivery)
 {
 	object_ptr<IMsgStore> lpTargetStore;
@@ -2012,7 +2112,7 @@ static HRESULT ProcessDeliveryToRecipient(pym_plugin_intf *lppyMapiPlugin,
 	ULONG ulResult = 0;
 	object_ptr<IECServiceAdmin> lpServiceAdmin;
 	memory_ptr<ECQUOTASTATUS> lpsQuotaStatus;
-	bool over_quota = false;
+	bool over_quota = false, bStored = false;
 	auto dblStart = std::chrono::steady_clock::now();
 
 	// single user deliver did not lookup the user
@@ -2037,7 +2137,7 @@ static HRESULT ProcessDeliveryToRecipient(pym_plugin_intf *lppyMapiPlugin,
 		hr = HrCreateMessage(lpTargetFolder, lpInbox, &~lpFolder, &~lpMessageTmp);
 		if (hr != hrSuccess)
 			return kc_perrorf("HrCreateMessage failed", hr);
-		hr = HrStringToMAPIMessage(strMail, lpSession, lpTargetStore, lpAdrBook, lpFolder, lpMessageTmp, lpRecip, lpArgs, &~lpDeliveryMessage, &bFallbackDelivery);
+		hr = HrStringToMAPIMessage(mail, lpSession, lpTargetStore, lpAdrBook, lpFolder, lpMessageTmp, lpRecip, lpArgs, &~lpDeliveryMessage, &bFallbackDelivery);
 		if (hr != hrSuccess)
 			return kc_perrorf("HrStringToMAPIMessage failed", hr);
 
@@ -2057,7 +2157,7 @@ static HRESULT ProcessDeliveryToRecipient(pym_plugin_intf *lppyMapiPlugin,
 		// TODO do something with ulResult
 	} else {
 		/* Copy message to prepare for new delivery */
-		hr = HrCopyMessageForDelivery(lpOrigMessage, lpTargetFolder, lpRecip, lpInbox, bFallbackDelivery, &~lpFolder, &~lpDeliveryMessage);
+		hr = HrCopyMessageForDelivery(lpTargetStore, lpOrigMessage, lpTargetFolder, lpRecip, lpInbox, bFallbackDelivery, &~lpFolder, &~lpDeliveryMessage, &bStored);
 		if (hr != hrSuccess)
 			return kc_perrorf("HrCopyMessageForDelivery failed", hr);
 	}
@@ -2082,6 +2182,9 @@ static HRESULT ProcessDeliveryToRecipient(pym_plugin_intf *lppyMapiPlugin,
 
 	// TODO do something with ulResult
 	if (ulResult == MP_STOP_SUCCESS) {
+		/* A server-side copy already exists; drop it like an unsaved message would be */
+		if (bStored)
+			Util::HrDeleteMessage(lpSession, lpDeliveryMessage);
 		if (lppMessage)
 			lpDeliveryMessage->QueryInterface(IID_IMessage, reinterpret_cast<void **>(lppMessage));
 		if (lpbFallbackDelivery)
@@ -2113,6 +2216,8 @@ static HRESULT ProcessDeliveryToRecipient(pym_plugin_intf *lppyMapiPlugin,
 			hr = lpDeliveryMessage->SaveChanges(KEEP_OPEN_READWRITE);
 
 		if (hr != hrSuccess) {
+			if (bStored)
+				Util::HrDeleteMessage(lpSession, lpDeliveryMessage);
 			if (hr == MAPI_E_STORE_FULL)
 				// make sure the error is printed on stderr, so this will be bounced as error by the MTA.
 				// use cerr to avoid quiet mode.
@@ -2171,6 +2276,9 @@ static HRESULT ProcessDeliveryToRecipient(pym_plugin_intf *lppyMapiPlugin,
 				hr = hrSuccess;
 			}
 		}
+	} else if (bStored) {
+		/* Canceled by rules or the MR autoaccepter: remove the server-side copy */
+		Util::HrDeleteMessage(lpSession, lpDeliveryMessage);
 	}
 
 	if (lppMessage)
@@ -2209,7 +2317,7 @@ static void RespondMessageExpired(recipients_t::const_iterator iter,
  * @param[in] lpUserSession optional session of one user the message is being delivered to (cmdline dagent, NULL on LMTP mode)
  * @param[in] lpMessage an already delivered message
  * @param[in] bFallbackDelivery already delivered message is a fallback message
- * @param[in] strMail the rfc2822 received email
+ * @param[in] mail the rfc2822 received email
  * @param[in] strServer uri of the storage server to connect to
  * @param[in] listRecipients list of recipients present on the server connecting to
  * @param[in] lpAdrBook Global addressbook
@@ -2221,7 +2329,7 @@ static void RespondMessageExpired(recipients_t::const_iterator iter,
  */
 static HRESULT ProcessDeliveryToServer(pym_plugin_intf *lppyMapiPlugin,
     IMAPISession *lpUserSession, IMessage *lpMessage, bool bFallbackDelivery,
-    const std::string &strMail, const std::string &strServer,
+    const mapped_file &mail, const std::string &strServer,
     const recipients_t &listRecipients, LPADRBOOK lpAdrBook,
     DeliveryArgs *lpArgs, IMessage **lppMessage, bool *lpbFallbackDelivery)
 {
@@ -2264,7 +2372,7 @@ static HRESULT ProcessDeliveryToServer(pym_plugin_intf *lppyMapiPlugin,
 		 */
 		hr = ProcessDeliveryToRecipient(lppyMapiPlugin, lpSession,
 		     lpStore, lpUserSession == NULL, lpAdrBook, lpOrigMessage,
-		     bFallbackDelivery, strMail, recip, lpArgs, &~lpMessageTmp,
+		     bFallbackDelivery, mail, recip, lpArgs, &~lpMessageTmp,
 		     &bFallbackDeliveryTmp);
 		if (hr == hrSuccess || hr == MAPI_E_CANCEL) {
 			if (hr == hrSuccess) {
@@ -2277,7 +2385,7 @@ static HRESULT ProcessDeliveryToServer(pym_plugin_intf *lppyMapiPlugin,
 				ec_log_info("Delivered message to \"%ls\", Subject: \"%ls\", Message-Id: %ls, size %zu",
 					recip->wstrUsername.c_str(),
 					(lpSubject != NULL) ? lpSubject->Value.lpszW : L"<none>",
-					wMessageId.c_str(), strMail.size());
+					wMessageId.c_str(), mail.size());
 			}
 			// cancel already logged.
 			hr = hrSuccess;
@@ -2330,18 +2438,17 @@ static HRESULT ProcessDeliveryToSingleRecipient(pym_plugin_intf *lppyMapiPlugin,
     IMAPISession *lpSession, LPADRBOOK lpAdrBook, FILE *fp,
     recipients_t &lstSingleRecip, DeliveryArgs *lpArgs)
 {
-	std::string strMail;
+	mapped_file mail;
 	lpArgs->sc->inc(SCN_DAGENT_TO_SINGLE_RECIP);
 
 	/* Always start at the beginning of the file */
 	rewind(fp);
-	/* Read file into string */
-	HRESULT hr = HrMapFileToString(fp, &strMail);
+	HRESULT hr = mail.map(fp);
 	if (hr != hrSuccess)
 		return kc_perror("Unable to map input to memory", hr);
 
-	FindSpamMarker(strMail, lpArgs);
-	hr = ProcessDeliveryToServer(lppyMapiPlugin, lpSession, NULL, false, strMail, lpArgs->strPath, lstSingleRecip, lpAdrBook, lpArgs, NULL, NULL);
+	FindSpamMarker(mail, lpArgs);
+	hr = ProcessDeliveryToServer(lppyMapiPlugin, lpSession, NULL, false, mail, lpArgs->strPath, lstSingleRecip, lpAdrBook, lpArgs, NULL, NULL);
 	if (hr != hrSuccess)
 		return kc_perrorf("ProcessDeliveryToServer failed", hr);
 	return hrSuccess;
@@ -2365,7 +2472,7 @@ static HRESULT ProcessDeliveryToCompany(pym_plugin_intf *lppyMapiPlugin,
 {
 	HRESULT hr = hrSuccess;
 	object_ptr<IMessage> lpMasterMessage;
-	std::string strMail;
+	mapped_file mail;
 	serverrecipients_t listServerPathRecips;
 	bool bFallbackDelivery = false, bExpired = false;
 
@@ -2375,12 +2482,11 @@ static HRESULT ProcessDeliveryToCompany(pym_plugin_intf *lppyMapiPlugin,
 
 	/* Always start at the beginning of the file */
 	rewind(fp);
-	/* Read file into string */
-	hr = HrMapFileToString(fp, &strMail);
+	hr = mail.map(fp);
 	if (hr != hrSuccess)
 		return kc_perror("Unable to map input to memory", hr);
 
-	FindSpamMarker(strMail, lpArgs);
+	FindSpamMarker(mail, lpArgs);
 	hr = ResolveServerToPath(lpSession, lpServerNameRecips, lpArgs->strPath, &listServerPathRecips);
 	if (hr != hrSuccess)
 		return kc_perrorf("ResolveServerToPath failed", hr);
@@ -2395,7 +2501,7 @@ static HRESULT ProcessDeliveryToCompany(pym_plugin_intf *lppyMapiPlugin,
 			continue;
 		}
 		hr = ProcessDeliveryToServer(lppyMapiPlugin, NULL,
-		     lpMasterMessage, bFallbackDelivery, strMail,
+		     lpMasterMessage, bFallbackDelivery, mail,
 		     convert_to<std::string>(iter.first), iter.second,
 		     lpAdrBook, lpArgs, &~lpMessageTmp, &bFallbackDeliveryTmp);
 		if (hr == MAPI_W_CANCEL_MESSAGE)
@@ -3254,6 +3360,7 @@ int main(int argc, char **argv)
 		{ "log_raw_message", "error", CONFIGSETTING_RELOADABLE },
 		{"log_raw_message_path", "/var/lib/kopano", CONFIGSETTING_RELOADABLE},
 		{ "archive_on_delivery", "no", CONFIGSETTING_RELOADABLE },
+		{"server_side_copy", "no", CONFIGSETTING_RELOADABLE},
 		{ "mr_autoaccepter", "/usr/sbin/kopano-mr-accept", CONFIGSETTING_RELOADABLE },
 		{ "mr_autoprocessor", "/usr/sbin/kopano-mr-process", CONFIGSETTING_RELOADABLE },
 		{ "autoresponder", "/usr/sbin/kopano-autorespond", CONFIGSETTING_RELOADABLE },
@@ -186,6 +186,16 @@ static void sp_sighup_async(int)
 	hCondMessagesWaiting.notify_one();
 }
 
+/* Pooled SMTP connections only pay off when the sending threads share a process. */
+static void sp_smtp_pool_setup()
+{
+	if (g_process_model != GP_THREAD)
+		return;
+	smtp_pool_configure(atoui(g_lpConfig->GetSetting("smtp_pool_size")),
+		atoui(g_lpConfig->GetSetting("smtp_pool_max_messages")),
+		atoui(g_lpConfig->GetSetting("smtp_pool_max_age")));
+}
+
 static void sp_sighup_sync()
 {
 	bool expect_one = true;
@@ -194,6 +204,8 @@ static void sp_sighup_sync()
 	if (g_lpConfig != nullptr && !g_lpConfig->ReloadSettings() &&
 	    g_lpLogger != nullptr)
 		ec_log_warn("Unable to reload configuration file, continuing with current settings.");
+	if (g_lpConfig != nullptr)
+		sp_smtp_pool_setup();
 	if (g_lpLogger == nullptr)
 		return;
 	if (g_lpConfig) {
@@ -952,6 +964,9 @@ static int main2(int argc, char **argv)
 		{"log_raw_message_path", "/var/lib/kopano", CONFIGSETTING_RELOADABLE},
 		{"log_raw_message_stage1", "no", CONFIGSETTING_RELOADABLE},
 		{"process_model", "thread", CONFIGSETTING_NONEMPTY},
+		{"smtp_pool_size", "5", CONFIGSETTING_RELOADABLE},
+		{"smtp_pool_max_messages", "100", CONFIGSETTING_RELOADABLE},
+		{"smtp_pool_max_age", "60", CONFIGSETTING_RELOADABLE},
 		{ NULL, NULL },
 	};
     // SIGSEGV backtrace support
@@ -1157,7 +1172,9 @@ static int main2(int argc, char **argv)
 		     g_lpLogger, bDoSentMail);
 	} else {
 		sc->start();
+		sp_smtp_pool_setup();
 		hr = running_server(szSMTP, ulPort, szPath);
+		smtp_pool_configure(0, 0, 0);
 	}
 	if (!bForked)
 		ec_log_info("Spooler shutdown complete");
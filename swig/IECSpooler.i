@@ -7,6 +7,9 @@ public:
 	// Removes a message from the master outgoing table
 	virtual HRESULT DeleteFromMasterOutgoingTable(ULONG cbEntryID, LPENTRYID lpEntryID, ULONG ulFlags) = 0;
 
+	// Copies a delivered message into another folder on the same server, leaving out lpExclude
+	virtual HRESULT CopyMessageForDelivery(ULONG cbEntryID1, ENTRYID *lpEntryID1, ULONG cbEntryID2, ENTRYID *lpEntryID2, const SPropTagArray *lpExclude, ULONG *OUTPUT, LPENTRYID *OUTPUT) = 0;
+
 	%extend {
 		~IECSpooler() { self->Release(); }
 	}
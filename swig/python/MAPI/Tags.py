@@ -1435,6 +1435,8 @@ PR_EC_STATSTABLE_SESSIONS	= PROP_TAG(PT_OBJECT,		PR_EC_BASE+0x31)
 PR_EC_STATSTABLE_USERS		= PROP_TAG(PT_OBJECT,		PR_EC_BASE+0x32)
 PR_EC_STATSTABLE_COMPANY	= PROP_TAG(PT_OBJECT,		PR_EC_BASE+0x33)
 PR_EC_STATSTABLE_SERVERS	= PROP_TAG(PT_OBJECT,		PR_EC_BASE+0x34)
+PR_EC_STATSTABLE_SOAP		= PROP_TAG(PT_OBJECT,		PR_EC_BASE+0x35)
+PR_EC_STATSTABLE_SLOW		= PROP_TAG(PT_OBJECT,		PR_EC_BASE+0x36)
 
 # system stats
 PR_EC_STATS_SYSTEM_DESCRIPTION	= PROP_TAG(PT_TSTRING,		PR_EC_BASE+0x40)
@@ -1469,6 +1471,29 @@ PR_EC_COMPANY_ADMIN_W =         PROP_TAG(PT_UNICODE,    PR_EC_BASE+0x49)
 PR_EC_STATS_SESSION_CLIENT_APPLICATION_VERSION = PROP_TAG(PT_STRING8, PR_EC_BASE+0x54)
 PR_EC_STATS_SESSION_CLIENT_APPLICATION_MISC    = PROP_TAG(PT_STRING8, PR_EC_BASE+0x55)
 
+# SOAP method stats
+PR_EC_STATS_SOAP_CALLS =		PROP_TAG(PT_LONGLONG,	PR_EC_BASE+0x56)
+PR_EC_STATS_SOAP_ERRORS =		PROP_TAG(PT_LONGLONG,	PR_EC_BASE+0x57)
+PR_EC_STATS_SOAP_WALL =			PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x58)
+PR_EC_STATS_SOAP_CPU =			PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x59)
+PR_EC_STATS_SOAP_WALL_P50 =		PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x5a)
+PR_EC_STATS_SOAP_WALL_P99 =		PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x5b)
+PR_EC_STATS_SOAP_CPU_P99 =		PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x5c)
+PR_EC_STATS_SOAP_SQL_QUERIES =		PROP_TAG(PT_LONGLONG,	PR_EC_BASE+0x5d)
+PR_EC_STATS_SOAP_SQL_ROWS =		PROP_TAG(PT_LONGLONG,	PR_EC_BASE+0x5e)
+PR_EC_STATS_SOAP_BYTES =		PROP_TAG(PT_LONGLONG,	PR_EC_BASE+0x5f)
+
+# slow request traces
+PR_EC_STATS_SLOW_TIME =			PROP_TAG(PT_SYSTIME,	PR_EC_BASE+0x65)
+PR_EC_STATS_SLOW_WALL =			PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x66)
+PR_EC_STATS_SLOW_SQL_TIME =		PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x67)
+PR_EC_STATS_SLOW_LOCK_WAIT =		PROP_TAG(PT_DOUBLE,	PR_EC_BASE+0x68)
+PR_EC_STATS_SLOW_OBJECT =		PROP_TAG(PT_LONG,	PR_EC_BASE+0x69)
+PR_EC_STATS_SLOW_TABLE =		PROP_TAG(PT_LONG,	PR_EC_BASE+0x6a)
+PR_EC_STATS_SLOW_CACHE_LOOKUPS =	PROP_TAG(PT_LONGLONG,	PR_EC_BASE+0x6b)
+PR_EC_STATS_SLOW_CACHE_HITS =		PROP_TAG(PT_LONGLONG,	PR_EC_BASE+0x6c)
+PR_EC_STATS_SLOW_QUERIES =		PROP_TAG(PT_MV_STRING8,	PR_EC_BASE+0x6d)
+
 PR_EC_OUTOFOFFICE                   = PROP_TAG(PT_BOOLEAN,    PR_EC_BASE+0x60)
 PR_EC_OUTOFOFFICE_MSG               = PROP_TAG(PT_TSTRING,    PR_EC_BASE+0x61)
 PR_EC_OUTOFOFFICE_MSG_W             = PROP_TAG(PT_UNICODE,    PR_EC_BASE+0x61)
@@ -15,6 +15,8 @@ TABLES = {
     'company': (PR_EC_STATSTABLE_COMPANY, PR_EC_COMPANY_NAME),
     'session': (PR_EC_STATSTABLE_SESSIONS, (PR_EC_STATS_SESSION_IPADDRESS, -PR_EC_STATS_SESSION_IDLETIME)),
     'servers': (PR_EC_STATSTABLE_SERVERS, PR_EC_STATS_SERVER_NAME),
+    'slow': (PR_EC_STATSTABLE_SLOW, -PR_EC_STATS_SLOW_TIME),
+    'soap': (PR_EC_STATSTABLE_SOAP, -PR_EC_STATS_SOAP_WALL),
     'system': (PR_EC_STATSTABLE_SYSTEM, PR_NULL),
     'users': (PR_EC_STATSTABLE_USERS, (PR_EC_COMPANY_NAME, PR_EC_USERNAME_A)),
 }
@@ -135,6 +137,8 @@ def opt_args():
     parser.add_option('--company', dest='company', action='store_true', help='Gives information about companies, company sizes and quotas')
     parser.add_option('--servers', dest='servers', action='store_true', help='Gives information about cluster nodes')
     parser.add_option('--session', dest='session', action='store_true', help='Gives information about sessions and server time spent in SOAP calls')
+    parser.add_option('--soap', dest='soap', action='store_true', help='Gives information about server time and resources spent per SOAP method, busiest first')
+    parser.add_option('--slow', dest='slow', action='store_true', help='Gives traces of the latest requests slower than slow_request_threshold, with their SQL queries')
     parser.add_option('--top', dest='top', action='store_true', help='Shows top-like information about sessions')
     parser.add_option('-d','--dump', dest='dump', action='store_true', help='print output as csv')
     return parser.parse_args()
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Measures permission checks on a deep public folder tree.
+ *
+ * As SYSTEM, creates a folder "aclbench" in the public folders holding
+ * a number of chains of nested folders (by default 500 chains of 10, i.e.
+ * 5000 folders), and grants the grantee (a group, or else the user) read
+ * access on "aclbench" only, so that every check has to find the ACL at
+ * the top. The tree is kept, so that repeated runs only measure.
+ *
+ * Then, as the user, repeatedly lists the whole tree with PR_RIGHTS and
+ * PR_ACCESS (effective rights of each folder) and opens every folder
+ * (a permission check each). The first run starts with nothing known
+ * about the tree; compare with cache_permission_size = 0 on the server.
+ *
+ * Usage: aclbench user password [grantee group] [chains] [depth] [runs]
+ */
+#include <kopano/platform.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mapiutil.h>
+#include <edkmdb.h>
+#include <kopano/CommonUtil.h>
+#include <kopano/ECDefs.h>
+#include <kopano/ECGuid.h>
+#include <kopano/ECTags.h>
+#include <kopano/IECInterfaces.hpp>
+#include <kopano/MAPIErrors.h>
+#include <kopano/charset/convert.h>
+#include <kopano/memory.hpp>
+#include "tbi.hpp"
+
+using namespace KC;
+using clk = std::chrono::steady_clock;
+
+static void t_check(HRESULT ret)
+{
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+}
+
+/* Opens @eid in the public store, or the public folders root if it is nullptr. */
+static object_ptr<IMAPIFolder> t_open_public(IMAPISession *ses,
+    const SBinary *eid, unsigned int flags)
+{
+	object_ptr<IMsgStore> store;
+	object_ptr<IMAPIFolder> folder;
+	memory_ptr<SPropValue> root;
+	unsigned int type = 0;
+
+	t_check(HrOpenECPublicStore(ses, &~store));
+	if (eid == nullptr) {
+		t_check(HrGetOneProp(store, PR_IPM_PUBLIC_FOLDERS_ENTRYID, &~root));
+		eid = &root->Value.bin;
+	}
+	t_check(store->OpenEntry(eid->cb, reinterpret_cast<ENTRYID *>(eid->lpb),
+	        &iid_of(folder), flags, &type, &~folder));
+	return folder;
+}
+
+static void t_fill(IMAPIFolder *top, unsigned int chains, unsigned int depth)
+{
+	memory_ptr<SPropValue> have;
+	t_check(HrGetOneProp(top, PR_FOLDER_CHILD_COUNT, &~have));
+	if (have->Value.ul >= chains)
+		return;
+	printf("Creating %u chains of %u folders...\n", chains - have->Value.ul, depth);
+	for (unsigned int c = have->Value.ul; c < chains; ++c) {
+		object_ptr<IMAPIFolder> cur(top), sub;
+		for (unsigned int d = 0; d < depth; ++d) {
+			auto name = "chain " + std::to_string(c) + " level " + std::to_string(d);
+			t_check(cur->CreateFolder(FOLDER_GENERIC, (LPTSTR)name.c_str(),
+			        nullptr, nullptr, OPEN_IF_EXISTS, &~sub));
+			cur = std::move(sub);
+		}
+	}
+}
+
+static void t_grant(IMAPISession *ses, IMAPIFolder *top, const char *user,
+    const char *group)
+{
+	object_ptr<IMsgStore> store;
+	object_ptr<IECServiceAdmin> svcadm;
+	object_ptr<IExchangeModifyTable> acl;
+	memory_ptr<SPropValue> obj;
+	memory_ptr<ENTRYID> eid;
+	unsigned int eid_size = 0;
+
+	t_check(HrOpenDefaultStore(ses, &~store));
+	t_check(HrGetOneProp(store, PR_EC_OBJECT, &~obj));
+	t_check(reinterpret_cast<IUnknown *>(obj->Value.lpszA)->QueryInterface(IID_IECServiceAdmin, &~svcadm));
+	if (group != nullptr)
+		t_check(svcadm->ResolveGroupName(reinterpret_cast<const TCHAR *>(group), 0, &eid_size, &~eid));
+	else
+		t_check(svcadm->ResolveUserName(reinterpret_cast<const TCHAR *>(user), 0, &eid_size, &~eid));
+	t_check(top->OpenProperty(PR_ACL_TABLE, &iid_of(acl), 0, 0, &~acl));
+
+	SPropValue props[2];
+	props[0].ulPropTag = PR_MEMBER_ENTRYID;
+	props[0].Value.bin.cb = eid_size;
+	props[0].Value.bin.lpb = reinterpret_cast<BYTE *>(eid.get());
+	props[1].ulPropTag = PR_MEMBER_RIGHTS;
+	props[1].Value.l = ecRightsReadAny | ecRightsFolderVisible;
+	memory_ptr<ROWLIST> rows;
+	t_check(MAPIAllocateBuffer(CbNewROWLIST(1), &~rows));
+	rows->cEntries = 1;
+	rows->aEntries[0].ulRowFlags = ROW_MODIFY;
+	rows->aEntries[0].cValues = 2;
+	rows->aEntries[0].rgPropVals = props;
+	t_check(acl->ModifyTable(0, rows));
+}
+
+/* Returns the number of folders listed, and the time taken for each part. */
+static unsigned int t_run(IMAPIFolder *top, double *list_secs, double *open_secs)
+{
+	static constexpr const SizedSPropTagArray(3, cols) =
+		{3, {PR_ENTRYID, PR_RIGHTS, PR_ACCESS}};
+	object_ptr<IMAPITable> table;
+	rowset_ptr rows;
+
+	auto start = clk::now();
+	t_check(top->GetHierarchyTable(CONVENIENT_DEPTH, &~table));
+	t_check(table->SetColumns(cols, TBL_BATCH));
+	t_check(table->QueryRows(INT_MAX, 0, &~rows));
+	for (unsigned int i = 0; i < rows->cRows; ++i)
+		if (rows[i].lpProps[1].ulPropTag != PR_RIGHTS ||
+		    !(rows[i].lpProps[1].Value.ul & ecRightsReadAny))
+			throw KMAPIError(MAPI_E_NO_ACCESS);
+	*list_secs = std::chrono::duration<double>(clk::now() - start).count();
+
+	start = clk::now();
+	for (unsigned int i = 0; i < rows->cRows; ++i) {
+		object_ptr<IMAPIFolder> folder;
+		unsigned int type = 0;
+		auto &eid = rows[i].lpProps[0].Value.bin;
+		t_check(top->OpenEntry(eid.cb, reinterpret_cast<ENTRYID *>(eid.lpb),
+		        &iid_of(folder), 0, &type, &~folder));
+	}
+	*open_secs = std::chrono::duration<double>(clk::now() - start).count();
+	return rows->cRows;
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s user password [grantee group] [chains] [depth] [runs]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	const char *group = argc >= 4 && *argv[3] != '\0' ? argv[3] : nullptr;
+	unsigned int chains = argc >= 5 ? strtoul(argv[4], nullptr, 0) : 500;
+	unsigned int depth = argc >= 6 ? strtoul(argv[5], nullptr, 0) : 10;
+	unsigned int runs = argc >= 7 ? strtoul(argv[6], nullptr, 0) : 3;
+
+	try {
+		memory_ptr<SPropValue> eid;
+		{
+			KSession admin;
+			object_ptr<IMAPIFolder> top;
+			t_check(t_open_public(admin, nullptr, MAPI_MODIFY)->CreateFolder(FOLDER_GENERIC,
+			        (LPTSTR)"aclbench", nullptr, nullptr, OPEN_IF_EXISTS, &~top));
+			t_fill(top, chains, depth);
+			t_grant(admin, top, argv[1], group);
+			t_check(HrGetOneProp(top, PR_ENTRYID, &~eid));
+		}
+		auto user = convert_to<std::wstring>(argv[1]);
+		auto pass = convert_to<std::wstring>(argv[2]);
+		KSession ses(user.c_str(), pass.c_str());
+		auto top = t_open_public(ses, &eid->Value.bin, 0);
+		for (unsigned int r = 0; r < runs; ++r) {
+			double list_secs = 0, open_secs = 0;
+			auto n = t_run(top, &list_secs, &open_secs);
+			printf("run %u: %u folders: list %.3f s (%.0f/s), open %.3f s (%.0f/s)\n",
+			       r, n, list_secs, n / list_secs, open_secs, n / open_secs);
+		}
+	} catch (const KMAPIError &e) {
+		fprintf(stderr, "Aborted because of exception: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
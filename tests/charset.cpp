@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks that convert_to gives what iconv gives, for input that takes the
+ * pass-through paths (ASCII text, valid UTF-8) and for input that does not,
+ * to and from charsets that do and do not extend ASCII.
+ */
+#include <kopano/platform.h>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <kopano/charset/convert.h>
+
+using namespace KC;
+
+static int t_errors;
+
+static std::string t_hex(const std::string &s)
+{
+	std::string r;
+	char buf[4];
+	for (auto c : s) {
+		snprintf(buf, sizeof(buf), "%02x ", static_cast<unsigned char>(c));
+		r += buf;
+	}
+	return r;
+}
+
+static void t_conv(const char *to, const char *from, const std::string &in,
+    const std::string &want)
+{
+	/* Twice, the second time with a descriptor from the pool */
+	for (int i = 0; i < 2; ++i) {
+		auto have = convert_to<std::string>(to, in, in.size(), from);
+		if (have == want)
+			continue;
+		fprintf(stderr, "FAIL: %s -> %s: %s, expected %s\n", from, to,
+			t_hex(have).c_str(), t_hex(want).c_str());
+		++t_errors;
+		return;
+	}
+}
+
+int main()
+{
+	static const char *const ascii_sets[] = {
+		"utf-8", "us-ascii", "iso-8859-1", "ISO-8859-15", "windows-1250",
+		"windows-1252", "WINDOWS-1258", "cp1250", "CP1252", "cp1258",
+	};
+	const std::string hello = "Hello", ebcdic = "\xc8\x85\x93\x93\x96";
+
+	for (auto cs : ascii_sets) {
+		t_conv(cs, "utf-8", hello, hello);
+		t_conv("utf-8", cs, hello, hello);
+	}
+	/* EBCDIC, CP12712 looking much like the Windows code pages */
+	for (auto cs : {"CP12712", "cp12712", "IBM037"}) {
+		t_conv(cs, "utf-8", hello, ebcdic);
+		t_conv("utf-8", cs, ebcdic, hello);
+	}
+	/* Not ASCII */
+	t_conv("windows-1252", "utf-8", "h\xc3\xa9", "h\xe9");
+	t_conv("utf-8", "windows-1252", "h\xe9", "h\xc3\xa9");
+	t_conv("utf-8", "utf-8", "h\xc3\xa9", "h\xc3\xa9");
+	if (t_errors > 0)
+		return EXIT_FAILURE;
+	puts("ok");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Measures the cost of delivering one message to many recipients.
+ *
+ * Every mail from the given directory (normally tests/mails) is converted
+ * once with IMToMAPI and saved, then copied N times the way kopano-dagent
+ * does it for subsequent recipients: once through a client-side CopyTo, and
+ * once through the server-side IECSpooler::CopyMessageForDelivery.
+ *
+ * Usage: delivercopy <maildir> [copies]
+ */
+#include <kopano/platform.h>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <mapiutil.h>
+#include <edkmdb.h>
+#include <inetmapi/inetmapi.h>
+#include <inetmapi/options.h>
+#include <kopano/CommonUtil.h>
+#include <kopano/IECInterfaces.hpp>
+#include <kopano/MAPIErrors.h>
+#include <kopano/UnixUtil.h>
+#include <kopano/memory.hpp>
+#include "tbi.hpp"
+
+using namespace KC;
+using clk = std::chrono::steady_clock;
+
+struct bench_total {
+	double convert = 0, client = 0, server = 0;
+	unsigned int mails = 0;
+};
+
+static double msec_since(const clk::time_point &start)
+{
+	return std::chrono::duration<double, std::milli>(clk::now() - start).count();
+}
+
+static bool slurp_file(const std::string &file, std::string &msg)
+{
+	std::ifstream fp(file);
+	if (fp.fail()) {
+		fprintf(stderr, "Failed to open %s: %s\n", file.c_str(), strerror(errno));
+		return false;
+	}
+	msg.assign(std::istreambuf_iterator<char>(fp),
+	           std::istreambuf_iterator<char>());
+	return true;
+}
+
+static void t_client_copy(IMAPIFolder *folder, IMessage *orig)
+{
+	object_ptr<IMessage> msg;
+	auto ret = folder->CreateMessage(nullptr, 0, &~msg);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+	ret = orig->CopyTo(0, nullptr, nullptr, 0, nullptr, &IID_IMessage, msg, 0, nullptr);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+	ret = msg->SaveChanges(0);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+}
+
+static void t_server_copy(IMsgStore *store, IECSpooler *spooler,
+    const SBinary &msg_eid, const SBinary &folder_eid)
+{
+	memory_ptr<ENTRYID> neweid;
+	object_ptr<IMessage> msg;
+	ULONG neweid_size = 0, type = 0;
+	auto ret = spooler->CopyMessageForDelivery(msg_eid.cb,
+	           reinterpret_cast<const ENTRYID *>(msg_eid.lpb), folder_eid.cb,
+	           reinterpret_cast<const ENTRYID *>(folder_eid.lpb), nullptr,
+	           &neweid_size, &~neweid);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+	/* dagent reopens the copy to apply the per-recipient properties */
+	ret = store->OpenEntry(neweid_size, neweid, &IID_IMessage, MAPI_MODIFY, &type, &~msg);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+	ret = msg->SaveChanges(0);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+}
+
+static void t_bench_file(IMsgStore *store, IECSpooler *spooler,
+    IMAPIFolder *folder, const std::string &file, unsigned int copies,
+    bench_total &total)
+{
+	std::string rfcmsg;
+	if (!slurp_file(file, rfcmsg))
+		return;
+
+	delivery_options dopt;
+	imopt_default_delivery_options(&dopt);
+	object_ptr<IMessage> orig;
+	memory_ptr<SPropValue> msg_eid, folder_eid;
+	auto ret = folder->CreateMessage(nullptr, 0, &~orig);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+
+	auto start = clk::now();
+	ret = IMToMAPI(nullptr, nullptr, nullptr, orig, rfcmsg, dopt);
+	if (ret == hrSuccess)
+		ret = orig->SaveChanges(KEEP_OPEN_READWRITE);
+	if (ret != hrSuccess) {
+		fprintf(stderr, "%s: %s\n", file.c_str(), GetMAPIErrorMessage(ret));
+		return;
+	}
+	auto t_conv = msec_since(start);
+	ret = HrGetOneProp(orig, PR_ENTRYID, &~msg_eid);
+	if (ret == hrSuccess)
+		ret = HrGetOneProp(folder, PR_ENTRYID, &~folder_eid);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+
+	start = clk::now();
+	for (unsigned int i = 0; i < copies; ++i)
+		t_client_copy(folder, orig);
+	auto t_client = msec_since(start);
+	start = clk::now();
+	for (unsigned int i = 0; i < copies; ++i)
+		t_server_copy(store, spooler, msg_eid->Value.bin, folder_eid->Value.bin);
+	auto t_server = msec_since(start);
+
+	printf("%-40s %8zu %10.2f %10.2f %10.2f\n", file.substr(file.rfind('/') + 1).c_str(),
+	       rfcmsg.size(), t_conv, t_client, t_server);
+	total.convert += t_conv;
+	total.client += t_client;
+	total.server += t_server;
+	++total.mails;
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <maildir> [copies]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	unsigned int copies = argc >= 3 ? strtoul(argv[2], nullptr, 0) : 100;
+	std::unique_ptr<DIR, fs_deleter> dh(opendir(argv[1]));
+	if (dh == nullptr) {
+		fprintf(stderr, "Could not open %s: %s\n", argv[1], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	try {
+		auto store = KSession().open_default_store();
+		auto root = store.open_root(MAPI_MODIFY);
+		object_ptr<IECSpooler> spooler;
+		object_ptr<IMAPIFolder> folder;
+		auto ret = store->QueryInterface(IID_IECSpooler, &~spooler);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+		ret = root->CreateFolder(FOLDER_GENERIC, (LPTSTR)L"delivercopy",
+		      nullptr, nullptr, MAPI_UNICODE | OPEN_IF_EXISTS, &~folder);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+
+		bench_total total;
+		printf("%-40s %8s %10s %10s %10s\n", "# mail", "bytes",
+		       "convert", "client", "server");
+		struct dirent *de;
+		while ((de = readdir(dh.get())) != nullptr) {
+			auto len = strlen(de->d_name);
+			if (len < 4 || strcmp(de->d_name + len - 4, ".eml") != 0)
+				continue;
+			t_bench_file(store, spooler, folder,
+				std::string(argv[1]) + "/" + de->d_name, copies, total);
+		}
+		printf("%u mails, %u copies each: convert %.2f ms, client copy %.2f ms, server copy %.2f ms\n",
+		       total.mails, copies, total.convert, total.client, total.server);
+
+		memory_ptr<SPropValue> eid;
+		ret = HrGetOneProp(folder, PR_ENTRYID, &~eid);
+		if (ret == hrSuccess)
+			root->DeleteFolder(eid->Value.bin.cb, reinterpret_cast<ENTRYID *>(eid->Value.bin.lpb),
+				0, nullptr, DEL_FOLDERS | DEL_MESSAGES);
+	} catch (const KMAPIError &e) {
+		fprintf(stderr, "Aborted because of exception: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Measures the throughput of ECFifoBuffer between one writer thread and
+ * one reader thread, for write sizes from 1 KB to 64 KB, with the reader
+ * using Read() (as gSOAP's MTOM callbacks do) and PeekRead/CommitRead.
+ * The data is checked on the way.
+ *
+ * Usage: fifobench [MiB per run]
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "ECFifoBuffer.h"
+
+using namespace KC;
+using clk = std::chrono::steady_clock;
+/* (pos % 251) at every position, so that any slice can be compared */
+static unsigned char t_pattern[65536 + 251];
+
+static void t_writer(ECFifoBuffer *fifo, size_t total, size_t chunk)
+{
+	for (size_t pos = 0; pos < total; ) {
+		auto n = std::min(chunk, total - pos);
+		if (fifo->Write(&t_pattern[pos % 251], n, 0, nullptr) != erSuccess) {
+			fprintf(stderr, "Write failed\n");
+			break;
+		}
+		pos += n;
+	}
+	fifo->Close(ECFifoBuffer::cfWrite);
+}
+
+static bool t_check(const void *data, size_t n, size_t pos)
+{
+	return memcmp(data, &t_pattern[pos % 251], n) == 0;
+}
+
+static size_t t_read(ECFifoBuffer *fifo, bool peek)
+{
+	std::vector<unsigned char> buf(65536);
+	size_t pos = 0;
+	while (true) {
+		ECFifoBuffer::size_type n = 0;
+		const void *data = buf.data();
+		auto ret = peek ? fifo->PeekRead(&data, &n, 0) :
+		           fifo->Read(buf.data(), buf.size(), 0, &n);
+		if (ret != erSuccess || n == 0)
+			break;
+		n = std::min(n, buf.size());
+		if (!t_check(data, n, pos)) {
+			fprintf(stderr, "Data mismatch at %zu\n", pos);
+			exit(EXIT_FAILURE);
+		}
+		if (peek)
+			fifo->CommitRead(n);
+		pos += n;
+	}
+	fifo->Close(ECFifoBuffer::cfRead);
+	return pos;
+}
+
+int main(int argc, const char **argv)
+{
+	size_t total = (argc >= 2 ? strtoul(argv[1], nullptr, 0) : 256) << 20;
+	for (size_t i = 0; i < sizeof(t_pattern); ++i)
+		t_pattern[i] = i % 251;
+
+	printf("%-8s %12s %12s\n", "# write", "Read", "PeekRead");
+	for (size_t chunk = 1024; chunk <= 65536; chunk *= 4) {
+		printf("%6zuK ", chunk / 1024);
+		for (auto peek : {false, true}) {
+			ECFifoBuffer fifo;
+			auto start = clk::now();
+			std::thread writer(t_writer, &fifo, total, chunk);
+			auto got = t_read(&fifo, peek);
+			writer.join();
+			auto secs = std::chrono::duration<double>(clk::now() - start).count();
+			if (got != total) {
+				fprintf(stderr, "Read %zu of %zu bytes\n", got, total);
+				return EXIT_FAILURE;
+			}
+			printf(" %8.0f MB/s", total / secs / 1048576);
+		}
+		printf("\n");
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Measures the throughput of the streaming ICS content export
+ * (exportMessageChangesAsStream).
+ *
+ * Fills a folder with N messages (subject, body, one recipient, one
+ * attachment), then runs a full content synchronization of that folder
+ * into an importer that only collects the streams, and reports
+ * messages/sec. The folder is kept, so that repeated runs only measure.
+ * A per-message import delay stands in for a client that does real work
+ * with each message, which the exporter overlaps with fetching the next
+ * batch.
+ *
+ * Every run must deliver all messages of the folder. A last run has each
+ * prefetched batch fail halfway (KOPANO_ICS_PREFETCH_FAIL), which the
+ * exporter must make up for by requesting the rest anew.
+ *
+ * Usage: icsexport [messages] [runs] [import delay in usec]
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mapiutil.h>
+#include <edkguid.h>
+#include <edkmdb.h>
+#include <kopano/ECGuid.h>
+#include <kopano/ECUnknown.h>
+#include <kopano/IECInterfaces.hpp>
+#include <kopano/MAPIErrors.h>
+#include <kopano/memory.hpp>
+#include "tbi.hpp"
+
+using namespace KC;
+using clk = std::chrono::steady_clock;
+
+class t_importer final : public ECUnknown, public IECImportContentsChanges {
+	public:
+	HRESULT QueryInterface(const IID &refiid, void **lppInterface) override
+	{
+		REGISTER_INTERFACE2(IECImportContentsChanges, this);
+		REGISTER_INTERFACE2(IExchangeImportContentsChanges, this);
+		REGISTER_INTERFACE2(ECUnknown, this);
+		REGISTER_INTERFACE2(IUnknown, this);
+		return MAPI_E_INTERFACE_NOT_SUPPORTED;
+	}
+	HRESULT GetLastError(HRESULT, unsigned int, MAPIERROR **) override { return MAPI_E_NO_SUPPORT; }
+	HRESULT Config(IStream *, unsigned int) override { return hrSuccess; }
+	HRESULT UpdateState(IStream *) override { return hrSuccess; }
+	HRESULT ImportMessageChange(unsigned int, SPropValue *, unsigned int, IMessage **) override { return SYNC_E_IGNORE; }
+	HRESULT ImportMessageDeletion(unsigned int, ENTRYLIST *) override { return hrSuccess; }
+	HRESULT ImportPerUserReadStateChange(unsigned int, READSTATE *) override { return hrSuccess; }
+	HRESULT ImportMessageMove(unsigned int, BYTE *, unsigned int, BYTE *, unsigned int, BYTE *, unsigned int, BYTE *, unsigned int, BYTE *) override { return SYNC_E_IGNORE; }
+	HRESULT ImportMessageChangeAsAStream(unsigned int, SPropValue *, unsigned int, IStream **stream) override
+	{
+		collect();
+		if (delay.count() > 0)
+			std::this_thread::sleep_for(delay);
+		auto ret = CreateStreamOnHGlobal(nullptr, true, &~m_last);
+		if (ret != hrSuccess)
+			return ret;
+		++messages;
+		return m_last->QueryInterface(IID_IStream, reinterpret_cast<void **>(stream));
+	}
+	/* Account for the message that the exporter has last written. */
+	void collect()
+	{
+		STATSTG st{};
+		if (m_last != nullptr && m_last->Stat(&st, STATFLAG_NONAME) == hrSuccess)
+			bytes += st.cbSize.QuadPart;
+		m_last.reset();
+	}
+
+	unsigned int messages = 0;
+	unsigned long long bytes = 0;
+	std::chrono::microseconds delay{0};
+
+	private:
+	object_ptr<IStream> m_last;
+};
+
+static void t_fill(IMAPIFolder *folder, unsigned int count)
+{
+	static const std::string body(2000, 'x'), blob(20000, 'y');
+
+	for (unsigned int i = 0; i < count; ++i) {
+		KMessage msg;
+		auto ret = folder->CreateMessage(nullptr, 0, &~msg);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+		auto subject = "icsexport " + std::to_string(i);
+		SPropValue props[2];
+		props[0].ulPropTag = PR_SUBJECT_A;
+		props[0].Value.lpszA = const_cast<char *>(subject.c_str());
+		props[1].ulPropTag = PR_BODY_A;
+		props[1].Value.lpszA = const_cast<char *>(body.c_str());
+		ret = msg->SetProps(ARRAY_SIZE(props), props, nullptr);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+
+		adrlist_ptr rcpt;
+		ret = MAPIAllocateBuffer(CbNewADRLIST(1), &~rcpt);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+		rcpt->cEntries = 1;
+		rcpt->aEntries[0].cValues = 3;
+		ret = MAPIAllocateBuffer(sizeof(SPropValue) * 3, reinterpret_cast<void **>(&rcpt->aEntries[0].rgPropVals));
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+		auto rp = rcpt->aEntries[0].rgPropVals;
+		rp[0].ulPropTag = PR_RECIPIENT_TYPE;
+		rp[0].Value.ul = MAPI_TO;
+		rp[1].ulPropTag = PR_DISPLAY_NAME_A;
+		rp[1].Value.lpszA = const_cast<char *>("Recipient");
+		rp[2].ulPropTag = PR_EMAIL_ADDRESS_A;
+		rp[2].Value.lpszA = const_cast<char *>("recipient@example.com");
+		ret = msg->ModifyRecipients(MODRECIP_ADD, rcpt);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+
+		auto atx = msg.create_attach();
+		SPropValue method;
+		method.ulPropTag = PR_ATTACH_METHOD;
+		method.Value.ul = ATTACH_BY_VALUE;
+		ret = atx->SetProps(1, &method, nullptr);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+		auto stream = atx.open_property_stream(PR_ATTACH_DATA_BIN, STGM_WRITE, MAPI_CREATE | MAPI_MODIFY);
+		ret = stream.write(blob);
+		if (ret == hrSuccess)
+			ret = stream.commit();
+		if (ret == hrSuccess)
+			ret = atx.save_changes();
+		if (ret == hrSuccess)
+			ret = msg.save_changes();
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+	}
+}
+
+static double t_export(IMAPIFolder *folder, t_importer *imp)
+{
+	object_ptr<IExchangeExportChanges> exp;
+	object_ptr<IStream> state;
+	auto ret = folder->OpenProperty(PR_CONTENTS_SYNCHRONIZER, &IID_IExchangeExportChanges, 0, 0, &~exp);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+	/* sync id 0, change id 0: export everything */
+	static const char zero_state[8]{};
+	ret = CreateStreamOnHGlobal(nullptr, true, &~state);
+	if (ret == hrSuccess)
+		ret = state->Write(zero_state, sizeof(zero_state), nullptr);
+	if (ret == hrSuccess)
+		ret = state->Seek(large_int_zero, STREAM_SEEK_SET, nullptr);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+
+	auto start = clk::now();
+	ret = exp->Config(state, SYNC_NORMAL | SYNC_UNICODE, imp, nullptr, nullptr, nullptr, 0);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+	unsigned int steps = 0, progress = 0;
+	do {
+		ret = exp->Synchronize(&steps, &progress);
+	} while (ret == SYNC_W_PROGRESS);
+	if (ret != hrSuccess)
+		throw KMAPIError(ret);
+	imp->collect();
+	return std::chrono::duration<double>(clk::now() - start).count();
+}
+
+int main(int argc, const char **argv)
+{
+	unsigned int count = argc >= 2 ? strtoul(argv[1], nullptr, 0) : 1000;
+	unsigned int runs = argc >= 3 ? strtoul(argv[2], nullptr, 0) : 3;
+	std::chrono::microseconds delay{argc >= 4 ? strtoul(argv[3], nullptr, 0) : 0};
+
+	try {
+		auto store = KSession().open_default_store();
+		auto root = store.open_root(MAPI_MODIFY);
+		object_ptr<IMAPIFolder> folder;
+		auto ret = root->CreateFolder(FOLDER_GENERIC, (LPTSTR)L"icsexport",
+		           nullptr, nullptr, MAPI_UNICODE | OPEN_IF_EXISTS, &~folder);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+		memory_ptr<SPropValue> have;
+		ret = HrGetOneProp(folder, PR_CONTENT_COUNT, &~have);
+		if (ret != hrSuccess)
+			throw KMAPIError(ret);
+		auto total = std::max(count, have->Value.ul);
+		if (have->Value.ul < count) {
+			printf("Creating %u messages...\n", count - have->Value.ul);
+			t_fill(folder, count - have->Value.ul);
+		}
+
+		for (unsigned int r = 0; r <= runs; ++r) {
+			if (r == runs)
+				setenv("KOPANO_ICS_PREFETCH_FAIL", "1", true);
+			object_ptr<t_importer> imp(new t_importer);
+			imp->delay = delay;
+			auto secs = t_export(folder, imp);
+			printf("run %u%s: %u messages, %llu bytes in %.3f s: %.1f messages/sec\n",
+			       r, r == runs ? " (failing prefetches)" : "",
+			       imp->messages, imp->bytes, secs, imp->messages / secs);
+			if (imp->messages != total) {
+				fprintf(stderr, "FAIL: %u messages exported, expected %u\n", imp->messages, total);
+				return EXIT_FAILURE;
+			}
+		}
+		unsetenv("KOPANO_ICS_PREFETCH_FAIL");
+	} catch (const KMAPIError &e) {
+		fprintf(stderr, "Aborted because of exception: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
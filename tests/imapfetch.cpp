@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks that a FETCH of many messages, which kopano-gateway spreads over
+ * its fetch pool, returns the same responses in the same order as fetching
+ * the messages one by one, which the gateway always does on the connection
+ * thread. Run it against a gateway with imap_fetch_threads set, and a
+ * folder with some mails, including ones without generated IMAP data
+ * (such as mails delivered with dagent's add_imap_data off).
+ *
+ * Usage: imapfetch host port user password [folder]
+ *
+ * The folder is opened with EXAMINE, so that no flags change in between.
+ */
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static const char t_items[] = "(UID FLAGS RFC822.SIZE INTERNALDATE ENVELOPE BODYSTRUCTURE BODY.PEEK[HEADER] BODY.PEEK[])";
+
+class t_conn {
+	public:
+	int m_fd = -1;
+	unsigned int m_tag = 0;
+	std::string m_buf;
+
+	bool read_more()
+	{
+		char b[65536];
+		auto r = read(m_fd, b, sizeof(b));
+		if (r <= 0)
+			return false;
+		m_buf.append(b, r);
+		return true;
+	}
+
+	/* One response, with its literals, without the final CRLF */
+	bool response(std::string &out)
+	{
+		out.clear();
+		while (true) {
+			auto eol = m_buf.find("\r\n");
+			if (eol == std::string::npos) {
+				if (!read_more())
+					return false;
+				continue;
+			}
+			out.append(m_buf, 0, eol);
+			m_buf.erase(0, eol + 2);
+			auto open = out.rfind('{');
+			if (out.empty() || out.back() != '}' || open == std::string::npos)
+				return true;
+			size_t len = strtoul(out.c_str() + open + 1, nullptr, 10);
+			out += "\r\n";
+			while (m_buf.size() < len)
+				if (!read_more())
+					return false;
+			out.append(m_buf, 0, len);
+			m_buf.erase(0, len);
+		}
+	}
+
+	/* Sends @cmd, and returns its untagged responses */
+	std::vector<std::string> command(const std::string &cmd)
+	{
+		auto tag = "T" + std::to_string(++m_tag);
+		auto line = tag + " " + cmd + "\r\n";
+		if (write(m_fd, line.c_str(), line.size()) != static_cast<ssize_t>(line.size())) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		std::vector<std::string> untagged;
+		std::string resp;
+		while (response(resp)) {
+			if (resp.compare(0, 2, "* ") == 0) {
+				untagged.emplace_back(std::move(resp));
+				continue;
+			}
+			if (resp.compare(0, tag.size() + 4, tag + " OK ") == 0)
+				return untagged;
+			fprintf(stderr, "%s: %s\n", cmd.c_str(), resp.c_str());
+			exit(EXIT_FAILURE);
+		}
+		fprintf(stderr, "%s: connection lost\n", cmd.c_str());
+		exit(EXIT_FAILURE);
+	}
+};
+
+static int t_connect(const char *host, const char *port)
+{
+	struct addrinfo hints{}, *res = nullptr;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		return -1;
+	int fd = -1;
+	for (auto ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc < 5) {
+		fprintf(stderr, "Usage: %s host port user password [folder]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	t_conn c;
+	c.m_fd = t_connect(argv[1], argv[2]);
+	std::string resp;
+	if (c.m_fd < 0 || !c.response(resp)) {
+		fprintf(stderr, "Could not connect to %s:%s\n", argv[1], argv[2]);
+		return EXIT_FAILURE;
+	}
+	c.command(std::string("LOGIN \"") + argv[3] + "\" \"" + argv[4] + "\"");
+	unsigned int exists = 0;
+	for (const auto &r : c.command(std::string("EXAMINE \"") + (argc >= 6 ? argv[5] : "INBOX") + "\""))
+		if (r.size() > 9 && r.compare(r.size() - 7, 7, " EXISTS") == 0)
+			exists = strtoul(r.c_str() + 2, nullptr, 10);
+	if (exists < 2) {
+		fprintf(stderr, "The folder needs at least two mails\n");
+		return EXIT_FAILURE;
+	}
+
+	/* The pool goes first, so that it is the one to generate the mails */
+	auto pooled = c.command("FETCH 1:* " + std::string(t_items));
+	std::vector<std::string> serial;
+	for (unsigned int i = 1; i <= exists; ++i)
+		for (auto &r : c.command("FETCH " + std::to_string(i) + " " + t_items))
+			serial.emplace_back(std::move(r));
+	c.command("LOGOUT");
+
+	if (pooled.size() != serial.size()) {
+		fprintf(stderr, "FAIL: %zu responses, expected %zu\n", pooled.size(), serial.size());
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < serial.size(); ++i) {
+		if (pooled[i] == serial[i])
+			continue;
+		fprintf(stderr, "FAIL: response %zu differs\n--- one by one:\n%.400s\n--- at once:\n%.400s\n",
+		        i + 1, serial[i].c_str(), pooled[i].c_str());
+		return EXIT_FAILURE;
+	}
+	printf("ok: %zu responses\n", serial.size());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Bounds the peak memory used for converting a large RFC 5322 message.
+ *
+ * A message with one big base64 attachment is written to a temporary file,
+ * mapped the way kopano-dagent does it, and converted with IMToMAPI. The
+ * mapped pages are all touched before measuring, so that they count in the
+ * baseline; the growth of the peak RSS while converting must then stay
+ * within a small multiple of the message size, which leaves room for the
+ * decoded attachment but not for further copies of the message.
+ *
+ * Usage: imtomapi_mem [megabytes] [factor]
+ */
+#include <kopano/platform.h>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <inetmapi/inetmapi.h>
+#include <inetmapi/options.h>
+#include <mapiutil.h>
+#include <kopano/MAPIErrors.h>
+#include <kopano/fileutil.hpp>
+#include <kopano/hl.hpp>
+#include <kopano/UnixUtil.h>
+#include "tbi.hpp"
+
+using namespace KC;
+
+static long peak_rss_kb()
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+	return ru.ru_maxrss;
+}
+
+/* Bring all pages of the mapping in, so that they are part of the RSS */
+static unsigned int t_touch(const char *data, size_t size)
+{
+	unsigned int sum = 0;
+	for (size_t i = 0; i < size; i += 4096)
+		sum += static_cast<unsigned char>(data[i]);
+	return sum;
+}
+
+static bool t_write_message(FILE *fp, size_t mbytes)
+{
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	fputs("From: sender@example.com\r\n"
+	      "To: rcpt@example.com\r\n"
+	      "Subject: large attachment\r\n"
+	      "MIME-Version: 1.0\r\n"
+	      "Content-Type: multipart/mixed; boundary=\"bnd\"\r\n\r\n"
+	      "--bnd\r\n"
+	      "Content-Type: text/plain; charset=us-ascii\r\n\r\n"
+	      "See attachment.\r\n"
+	      "--bnd\r\n"
+	      "Content-Type: application/octet-stream\r\n"
+	      "Content-Disposition: attachment; filename=\"blob.bin\"\r\n"
+	      "Content-Transfer-Encoding: base64\r\n\r\n", fp);
+	std::string line;
+	for (unsigned int i = 0; i < 76; ++i)
+		line += b64[i % 64];
+	line += "\r\n";
+	for (size_t total = 0; total < mbytes << 20; total += line.size())
+		if (fwrite(line.c_str(), line.size(), 1, fp) != 1)
+			return false;
+	fputs("--bnd--\r\n", fp);
+	return fflush(fp) == 0;
+}
+
+int main(int argc, const char **argv)
+{
+	size_t mbytes = argc >= 2 ? strtoul(argv[1], nullptr, 0) : 64;
+	double factor = argc >= 3 ? strtod(argv[2], nullptr) : 1.5;
+	std::unique_ptr<FILE, file_deleter> fp(tmpfile());
+	if (fp == nullptr || !t_write_message(fp.get(), mbytes)) {
+		perror("tmpfile");
+		return EXIT_FAILURE;
+	}
+	rewind(fp.get());
+
+	try {
+		auto imsg = KSession().open_default_store().open_root(MAPI_MODIFY).create_message();
+		delivery_options dopt;
+		imopt_default_delivery_options(&dopt);
+		mapped_file mail;
+		auto ret = mail.map(fp.get());
+		if (ret != hrSuccess) {
+			fprintf(stderr, "map: %s\n", GetMAPIErrorMessage(ret));
+			return EXIT_FAILURE;
+		}
+		volatile unsigned int sum = t_touch(mail.data(), mail.size());
+		(void)sum;
+		auto before = peak_rss_kb();
+		ret = IMToMAPI(nullptr, nullptr, nullptr, imsg, mail.data(), mail.size(), dopt);
+		if (ret != hrSuccess) {
+			fprintf(stderr, "IMToMAPI: %s\n", GetMAPIErrorMessage(ret));
+			return EXIT_FAILURE;
+		}
+		auto growth = peak_rss_kb() - before;
+		auto limit = static_cast<long>(mail.size() / 1024 * factor);
+		printf("message %zu KB, peak RSS growth %ld KB, limit %ld KB\n",
+		       mail.size() / 1024, growth, limit);
+		if (growth > limit) {
+			fprintf(stderr, "Peak memory exceeds %.1f times the message size\n", factor);
+			return EXIT_FAILURE;
+		}
+	} catch (const KMAPIError &e) {
+		fprintf(stderr, "Aborted because of exception: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
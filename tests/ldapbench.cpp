@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Measures resolving a list of DNs (such as the members of a large group)
+ * one base search at a time, the way the LDAP plugin used to, against
+ * pipelining the base searches on one connection, and against OR-filters
+ * of 100 values. Run it against a local slapd loaded with the users of a
+ * big directory; with ldap:// to a remote server, the difference grows
+ * with the round-trip time.
+ *
+ * Usage: ldapbench uri base [filter] [depth] [runs]
+ *
+ * The filter (default: (objectClass=person)) selects the entries that are
+ * resolved; they are looked up again by DN and by their uid attribute.
+ */
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <ldap.h>
+
+using clk = std::chrono::steady_clock;
+static char t_uid[] = "uid", t_dn[] = "1.1";
+static char *t_attrs[] = {t_uid, nullptr}, *t_noattrs[] = {t_dn, nullptr};
+
+static void t_check(int rc, const char *what)
+{
+	if (rc == LDAP_SUCCESS)
+		return;
+	fprintf(stderr, "%s: %s\n", what, ldap_err2string(rc));
+	exit(EXIT_FAILURE);
+}
+
+static void t_collect(LDAP *ld, const char *base, const char *filter,
+    std::vector<std::string> &dns, std::vector<std::string> &uids)
+{
+	LDAPMessage *res = nullptr;
+	t_check(ldap_search_ext_s(ld, base, LDAP_SCOPE_SUBTREE, filter, t_attrs,
+	        0, nullptr, nullptr, nullptr, 0, &res), "ldap_search_ext_s");
+	for (auto e = ldap_first_entry(ld, res); e != nullptr; e = ldap_next_entry(ld, e)) {
+		auto dn = ldap_get_dn(ld, e);
+		auto vals = ldap_get_values_len(ld, e, t_uid);
+		if (dn != nullptr && vals != nullptr && vals[0] != nullptr) {
+			dns.emplace_back(dn);
+			uids.emplace_back(vals[0]->bv_val, vals[0]->bv_len);
+		}
+		ldap_value_free_len(vals);
+		ldap_memfree(dn);
+	}
+	ldap_msgfree(res);
+}
+
+static unsigned int t_serial(LDAP *ld, const std::vector<std::string> &dns)
+{
+	unsigned int found = 0;
+	for (const auto &dn : dns) {
+		LDAPMessage *res = nullptr;
+		if (ldap_search_ext_s(ld, dn.c_str(), LDAP_SCOPE_BASE, nullptr, t_noattrs,
+		    0, nullptr, nullptr, nullptr, 0, &res) == LDAP_SUCCESS)
+			found += ldap_count_entries(ld, res);
+		ldap_msgfree(res);
+	}
+	return found;
+}
+
+/* Issues @queries (base, filter, scope) with up to @depth outstanding. */
+static unsigned int t_pipelined(LDAP *ld,
+    const std::vector<std::pair<std::string, std::string>> &queries,
+    int scope, unsigned int depth)
+{
+	unsigned int found = 0;
+	size_t next = 0, pending = 0;
+	while (next < queries.size() || pending > 0) {
+		for (; next < queries.size() && pending < depth; ++next, ++pending) {
+			int msgid = 0;
+			const auto &q = queries[next];
+			t_check(ldap_search_ext(ld, q.first.c_str(), scope,
+			        q.second.empty() ? nullptr : q.second.c_str(),
+			        t_noattrs, 0, nullptr, nullptr, nullptr, 0, &msgid),
+			        "ldap_search_ext");
+		}
+		LDAPMessage *res = nullptr;
+		if (ldap_result(ld, LDAP_RES_ANY, LDAP_MSG_ALL, nullptr, &res) <= 0) {
+			fprintf(stderr, "ldap_result failed\n");
+			exit(EXIT_FAILURE);
+		}
+		found += ldap_count_entries(ld, res);
+		ldap_msgfree(res);
+		--pending;
+	}
+	return found;
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s uri base [filter] [depth] [runs]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	const char *filter = argc >= 4 ? argv[3] : "(objectClass=person)";
+	unsigned int depth = argc >= 5 ? strtoul(argv[4], nullptr, 0) : 32;
+	unsigned int runs = argc >= 6 ? strtoul(argv[5], nullptr, 0) : 3;
+	LDAP *ld = nullptr;
+	int version = LDAP_VERSION3;
+
+	t_check(ldap_initialize(&ld, argv[1]), "ldap_initialize");
+	ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version);
+	ldap_set_option(ld, LDAP_OPT_REFERRALS, LDAP_OPT_OFF);
+	berval cred{};
+	t_check(ldap_sasl_bind_s(ld, nullptr, LDAP_SASL_SIMPLE, &cred, nullptr, nullptr, nullptr), "bind");
+
+	std::vector<std::string> dns, uids;
+	t_collect(ld, argv[2], filter, dns, uids);
+	std::vector<std::pair<std::string, std::string>> by_dn, by_uid;
+	for (const auto &dn : dns)
+		by_dn.emplace_back(dn, "");
+	for (size_t i = 0; i < uids.size(); i += 100) {
+		std::string f = "(|";
+		for (size_t j = i; j < uids.size() && j < i + 100; ++j)
+			/* uids of test data need no escaping */
+			f += "(uid=" + uids[j] + ")";
+		by_uid.emplace_back(argv[2], f + ")");
+	}
+	printf("%zu entries\n", dns.size());
+
+	for (unsigned int r = 0; r < runs; ++r) {
+		auto start = clk::now();
+		auto n1 = t_serial(ld, dns);
+		auto t1 = std::chrono::duration<double>(clk::now() - start).count();
+		start = clk::now();
+		auto n2 = t_pipelined(ld, by_dn, LDAP_SCOPE_BASE, depth);
+		auto t2 = std::chrono::duration<double>(clk::now() - start).count();
+		start = clk::now();
+		auto n3 = t_pipelined(ld, by_uid, LDAP_SCOPE_SUBTREE, depth);
+		auto t3 = std::chrono::duration<double>(clk::now() - start).count();
+		printf("run %u: serial %u in %.3f s (%.0f/s), pipelined %u in %.3f s (%.0f/s), batched %u in %.3f s (%.0f/s)\n",
+		       r, n1, t1, n1 / t1, n2, t2, n2 / t2, n3, t3, n3 / t3);
+	}
+	ldap_unbind_ext_s(ld, nullptr, nullptr);
+	return EXIT_SUCCESS;
+}
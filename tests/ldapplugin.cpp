@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: AGPL-3.0-only */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Drives the LDAP user plugin the way the server does, with one plugin
+ * instance per thread, and checks its connection pool and batched
+ * member lookups: the member lists of all groups, resolved by many
+ * threads at once (pipelined base searches for DN membership, paged
+ * OR-filter batches otherwise), must equal the lists that one thread
+ * resolved first, and the threads must make do with the connections of
+ * the pool.
+ *
+ * Usage: ldapplugin ldap.cfg [threads] [rounds]
+ *
+ * The configuration file must point to a directory with groups. The test
+ * shrinks ldap_page_size to 7 and ldap_connection_pool_size to 2.
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <kopano/ECConfig.h>
+#include <kopano/ECPluginSharedData.h>
+#include "StatsClient.h"
+#include "LDAPUserPlugin.h"
+
+using namespace KC;
+
+class t_stats final : public ECStatsCollector {
+	public:
+	t_stats(std::shared_ptr<ECConfig> c) : ECStatsCollector(std::move(c))
+	{
+		AddStat(SCN_LDAP_CONNECTS, SCT_INTEGER, "ldap_connect");
+		AddStat(SCN_LDAP_RECONNECTS, SCT_INTEGER, "ldap_reconnect");
+	}
+};
+
+using t_members = std::map<std::string, std::vector<std::string>>;
+
+static t_members t_resolve(UserPlugin *up, const signatures_t &groups)
+{
+	t_members m;
+	for (const auto &g : groups) {
+		auto &ids = m[g.id.id];
+		for (const auto &s : up->getSubObjectsForObject(OBJECTRELATION_GROUP_MEMBER, g.id))
+			ids.emplace_back(s.id.id);
+		std::sort(ids.begin(), ids.end());
+	}
+	return m;
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s ldap.cfg [threads] [rounds]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	unsigned int nthreads = argc >= 3 ? strtoul(argv[2], nullptr, 0) : 8;
+	unsigned int rounds = argc >= 4 ? strtoul(argv[3], nullptr, 0) : 3;
+	const configsetting_t dfl[] = {
+		{"user_plugin_config", argv[1]},
+		{nullptr, nullptr},
+	};
+	std::shared_ptr<ECConfig> cfg(ECConfig::Create(dfl));
+	auto stats = std::make_shared<t_stats>(cfg);
+	ECPluginSharedData *shared = nullptr;
+	ECPluginSharedData::GetSingleton(&shared, cfg, stats, false, false);
+	std::mutex pluginlock;
+
+	try {
+		std::vector<std::unique_ptr<UserPlugin>> plugins;
+		for (unsigned int i = 0; i < std::max(nthreads, 1U); ++i) {
+			plugins.emplace_back(new LDAPUserPlugin(pluginlock, shared));
+			if (i > 0)
+				continue;
+			auto pcfg = shared->CreateConfig(nullptr);
+			if (pcfg == nullptr) {
+				fprintf(stderr, "Cannot load %s\n", argv[1]);
+				return EXIT_FAILURE;
+			}
+			pcfg->AddSetting("ldap_page_size", "7");
+			pcfg->AddSetting("ldap_connection_pool_size", "2");
+		}
+		for (auto &p : plugins)
+			p->InitPlugin(stats);
+
+		auto groups = plugins[0]->getAllObjects(objectid_t(), OBJECTCLASS_DISTLIST);
+		auto want = t_resolve(plugins[0].get(), groups);
+		size_t nmembers = 0;
+		for (const auto &g : want)
+			nmembers += g.second.size();
+		printf("%zu groups, %zu memberships\n", want.size(), nmembers);
+		if (nmembers == 0) {
+			fprintf(stderr, "The directory needs groups with members\n");
+			return EXIT_FAILURE;
+		}
+
+		std::atomic<unsigned int> bad{0};
+		std::vector<std::thread> threads;
+		for (auto &p : plugins)
+			threads.emplace_back([&, up = p.get()]() {
+				try {
+					for (unsigned int r = 0; r < rounds; ++r)
+						if (t_resolve(up, groups) != want)
+							++bad;
+				} catch (const std::exception &e) {
+					fprintf(stderr, "%s\n", e.what());
+					++bad;
+				}
+			});
+		for (auto &t : threads)
+			t.join();
+		if (bad > 0) {
+			fprintf(stderr, "FAIL: %u rounds with other members\n", bad.load());
+			return EXIT_FAILURE;
+		}
+		auto connects = atoi(stats->GetValue(SCN_LDAP_CONNECTS).c_str());
+		auto reconnects = atoi(stats->GetValue(SCN_LDAP_RECONNECTS).c_str());
+		if (connects > 2 + reconnects) {
+			fprintf(stderr, "FAIL: %d connections for a pool of 2 (%d reconnects)\n", connects, reconnects);
+			return EXIT_FAILURE;
+		}
+		printf("ok: %zu threads, %d connections\n", plugins.size(), connects);
+	} catch (const std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+	shared->Release();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks that the vectorized base64/quoted-printable codecs produce the
+ * same bytes as vmime's own encoders, for every kernel level the CPU
+ * supports, over random data, random line lengths, random read sizes and
+ * damaged input. With -b, also measures throughput against vmime.
+ *
+ * Usage: mimecodec [-b] [iterations]
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vmime/utility/encoder/b64Encoder.hpp>
+#include <vmime/utility/encoder/qpEncoder.hpp>
+#include <vmime/utility/inputStream.hpp>
+#include <vmime/utility/outputStreamStringAdapter.hpp>
+#include "inetmapi/mimeCodec.h"
+#include "inetmapi/simdcodec.h"
+
+using namespace KC;
+using clk = std::chrono::steady_clock;
+static std::mt19937 t_rng(1);
+
+/* Hands out the data in randomly sized pieces, like a socket or IStream would. */
+class t_input final : public vmime::utility::inputStream {
+	public:
+	t_input(const std::string &s, bool ragged) : m_data(s), m_ragged(ragged) {}
+	size_t read(vmime::byte_t *d, size_t n) override
+	{
+		if (m_ragged)
+			n = std::min(n, static_cast<size_t>(t_rng() % 97 + 1));
+		n = std::min(n, m_data.size() - m_pos);
+		memcpy(d, m_data.data() + m_pos, n);
+		m_pos += n;
+		return n;
+	}
+	size_t skip(size_t n) override
+	{
+		n = std::min(n, m_data.size() - m_pos);
+		m_pos += n;
+		return n;
+	}
+	void reset() override { m_pos = 0; }
+	bool eof() const override { return m_pos >= m_data.size(); }
+
+	private:
+	const std::string &m_data;
+	size_t m_pos = 0;
+	bool m_ragged;
+};
+
+static std::string t_random(size_t n, const char *alphabet = nullptr)
+{
+	std::string s(n, '\0');
+	for (auto &c : s)
+		c = alphabet == nullptr ? t_rng() : alphabet[t_rng() % strlen(alphabet)];
+	return s;
+}
+
+static std::string t_run(vmime::utility::encoder::encoder &enc, bool decode,
+    const std::string &in, bool ragged)
+{
+	std::string out;
+	t_input is(in, ragged);
+	vmime::utility::outputStreamStringAdapter os(out);
+	if (decode)
+		enc.decode(is, os);
+	else
+		enc.encode(is, os);
+	return out;
+}
+
+static bool t_base64(unsigned int iter)
+{
+	size_t len = t_rng() % (iter % 16 == 0 ? 100000 : 500);
+	auto data = t_random(len);
+	vmime::utility::encoder::b64Encoder ref;
+	b64_codec ours;
+	auto ml = t_rng() % 4;
+	if (ml != 0) {
+		size_t maxlen = ml == 1 ? t_rng() % 100 : 78;
+		ref.getProperties()["maxlinelength"] = maxlen;
+		ours.getProperties()["maxlinelength"] = maxlen;
+	}
+	auto ragged = t_rng() % 2;
+	auto enc = t_run(ref, false, data, ragged);
+	if (t_run(ours, false, data, ragged) != enc) {
+		fprintf(stderr, "base64 encode differs (%zu bytes)\n", len);
+		return false;
+	}
+	/* whitespace, padding in the middle, junk, truncation */
+	for (unsigned int k = t_rng() % 4; k > 0 && !enc.empty(); --k)
+		enc[t_rng() % enc.size()] = "= \r\n\t*\x80-AZ"[t_rng() % 10];
+	if (t_rng() % 5 == 0)
+		enc.resize(t_rng() % (enc.size() + 1));
+	if (t_run(ours, true, enc, ragged) != t_run(ref, true, enc, !ragged)) {
+		fprintf(stderr, "base64 decode differs (%zu bytes)\n", enc.size());
+		return false;
+	}
+	return true;
+}
+
+static bool t_qp(unsigned int iter)
+{
+	size_t len = t_rng() % (iter % 16 == 0 ? 100000 : 500);
+	auto data = t_random(len, "abcdefgh ==__\r\n09AFaf\x80\xff");
+	vmime::utility::encoder::qpEncoder ref;
+	qp_codec ours;
+	if (t_rng() % 2) {
+		ref.getProperties()["rfc2047"] = true;
+		ours.getProperties()["rfc2047"] = true;
+	}
+	auto ragged = t_rng() % 2;
+	if (t_run(ours, true, data, ragged) != t_run(ref, true, data, !ragged)) {
+		fprintf(stderr, "QP decode differs (%zu bytes)\n", len);
+		return false;
+	}
+	/* also real QP as vmime writes it */
+	auto enc = t_run(ref, false, t_random(len), false);
+	if (t_run(ours, true, enc, ragged) != t_run(ref, true, enc, false)) {
+		fprintf(stderr, "QP decode of encoded data differs (%zu bytes)\n", enc.size());
+		return false;
+	}
+	return true;
+}
+
+static double t_mbps(vmime::utility::encoder::encoder &enc, bool decode,
+    const std::string &in, size_t bytes)
+{
+	auto start = clk::now();
+	for (unsigned int i = 0; i < 10; ++i)
+		t_run(enc, decode, in, false);
+	return bytes * 10 / std::chrono::duration<double>(clk::now() - start).count() / 1048576;
+}
+
+static void t_bench()
+{
+	auto data = t_random(16 << 20);
+	vmime::utility::encoder::b64Encoder ref;
+	vmime::utility::encoder::qpEncoder qref;
+	b64_codec ours;
+	qp_codec qours;
+	ref.getProperties()["maxlinelength"] = 78;
+	ours.getProperties()["maxlinelength"] = 78;
+	auto b64 = t_run(ref, false, data, false);
+	auto text = t_random(16 << 20, "abcdefghijklmnopqrstuvwxyz      .,\n");
+	auto qp = t_run(qref, false, text, false);
+
+	printf("%-8s %12s %12s %12s\n", "# codec", "b64 enc", "b64 dec", "qp dec");
+	printf("%-8s %10.0f/s %10.0f/s %10.0f/s\n", "vmime",
+	       t_mbps(ref, false, data, data.size()), t_mbps(ref, true, b64, data.size()),
+	       t_mbps(qref, true, qp, text.size()));
+	for (auto l : {SIMD_SCALAR, SIMD_SSSE3, SIMD_AVX2}) {
+		if (simd_codec_select(l) != l)
+			continue;
+		printf("%-8s %10.0f/s %10.0f/s %10.0f/s\n",
+		       l == SIMD_AVX2 ? "avx2" : l == SIMD_SSSE3 ? "ssse3" : "scalar",
+		       t_mbps(ours, false, data, data.size()), t_mbps(ours, true, b64, data.size()),
+		       t_mbps(qours, true, qp, text.size()));
+	}
+	printf("(MiB of decoded data per second)\n");
+}
+
+int main(int argc, const char **argv)
+{
+	bool bench = argc >= 2 && strcmp(argv[1], "-b") == 0;
+	if (bench) {
+		--argc;
+		++argv;
+	}
+	unsigned int iters = argc >= 2 ? strtoul(argv[1], nullptr, 0) : 2000;
+	for (auto l : {SIMD_SCALAR, SIMD_SSSE3, SIMD_AVX2}) {
+		if (simd_codec_select(l) != l)
+			continue;
+		for (unsigned int i = 0; i < iters; ++i)
+			if (!t_base64(i) || !t_qp(i)) {
+				fprintf(stderr, "Mismatch at kernel level %d, iteration %u\n", l, i);
+				return EXIT_FAILURE;
+			}
+		printf("kernel level %d: %u rounds identical\n", l, iters);
+	}
+	if (bench)
+		t_bench();
+	return EXIT_SUCCESS;
+}
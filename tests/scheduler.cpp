@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks the ECScheduler timers, on a small wheel with a short tick so
+ * that turns of it go by quickly: one-shot timers do not fire early;
+ * periodic timers whose period is a whole number of turns fire once per
+ * period, also when they share their slot with another timer; cancelled
+ * timers stop; jitter postpones runs by up to its amount; and a periodic
+ * timer skips its turn while the previous run is still busy.
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <kopano/ECScheduler.h>
+
+using namespace KC;
+using namespace std::chrono;
+
+static constexpr milliseconds tick{20};
+static constexpr unsigned int slots = 8;
+static constexpr auto turn = slots * tick;
+
+static int t_fail(const char *what, long have, long want)
+{
+	fprintf(stderr, "FAIL: %s: %ld, expected %ld\n", what, have, want);
+	return EXIT_FAILURE;
+}
+
+static int t_turns()
+{
+	ECScheduler sched(1, tick, slots);
+	std::atomic<int> once{0}, one_turn{0}, two_turns{0}, neighbour{0};
+	std::atomic<long> once_ms{0};
+	auto start = steady_clock::now();
+
+	sched.add_timer(tick * 5 / 2, [&]() {
+		once_ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+		++once;
+	});
+	/* Same delay, so the same slot, each followed by a one-shot timer */
+	sched.add_timer(tick, [&]() { ++one_turn; }, turn);
+	sched.add_timer(tick, [&]() { ++neighbour; });
+	sched.add_timer(tick, [&]() { ++two_turns; }, 2 * turn);
+	sched.add_timer(tick, [&]() { ++neighbour; });
+
+	std::this_thread::sleep_until(start + 6 * tick);
+	if (once != 1)
+		return t_fail("one-shot runs", once, 1);
+	if (once_ms < (tick * 5 / 2).count())
+		return t_fail("one-shot fired after ms", once_ms, (tick * 5 / 2).count());
+	if (neighbour != 2)
+		return t_fail("neighbour runs", neighbour, 2);
+	if (one_turn != 1)
+		return t_fail("one-turn timer runs at first", one_turn, 1);
+	if (two_turns != 1)
+		return t_fail("two-turn timer runs at first", two_turns, 1);
+
+	std::this_thread::sleep_until(start + turn + 5 * tick);
+	if (one_turn != 2)
+		return t_fail("one-turn timer runs after one turn", one_turn, 2);
+	if (two_turns != 1)
+		return t_fail("two-turn timer runs after one turn", two_turns, 1);
+	return EXIT_SUCCESS;
+}
+
+static int t_cancel()
+{
+	ECScheduler sched(1, tick, slots);
+	std::atomic<int> once{0}, periodic{0}, fired{0};
+
+	auto id = sched.add_timer(4 * tick, [&]() { ++once; });
+	if (!sched.cancel_timer(id))
+		return t_fail("cancel of a pending timer", 0, 1);
+	if (sched.cancel_timer(id))
+		return t_fail("second cancel", 1, 0);
+	auto fid = sched.add_timer(tick, [&]() { ++fired; });
+	auto pid = sched.add_timer(tick, [&]() { ++periodic; }, 2 * tick);
+	std::this_thread::sleep_for(turn);
+	if (fired != 1 || sched.cancel_timer(fid))
+		return t_fail("cancel of a timer that fired", fired, 1);
+	if (!sched.cancel_timer(pid))
+		return t_fail("cancel of a periodic timer", 0, 1);
+	int runs = periodic;
+	if (runs < 2)
+		return t_fail("periodic runs before cancel", runs, 2);
+	std::this_thread::sleep_for(turn);
+	/* A run that was handed to the pool just before may still come */
+	if (periodic > runs + 1)
+		return t_fail("periodic runs after cancel", periodic, runs);
+	if (once != 0)
+		return t_fail("cancelled timer runs", once, 0);
+	return EXIT_SUCCESS;
+}
+
+static int t_jitter()
+{
+	static constexpr auto period = 2 * tick, jitter = 4 * tick;
+	ECScheduler sched(1, tick, slots);
+	std::mutex lock;
+	std::vector<steady_clock::time_point> runs;
+
+	auto id = sched.add_timer(tick, [&]() {
+		std::lock_guard<std::mutex> lk(lock);
+		runs.emplace_back(steady_clock::now());
+	}, period, jitter);
+	std::this_thread::sleep_for(50 * tick);
+	sched.cancel_timer(id);
+	std::lock_guard<std::mutex> lk(lock);
+	if (runs.size() < 8)
+		return t_fail("jittered runs", runs.size(), 8);
+	milliseconds lo = milliseconds::max(), hi{0};
+	for (size_t i = 1; i < runs.size(); ++i) {
+		auto d = duration_cast<milliseconds>(runs[i] - runs[i-1]);
+		lo = std::min(lo, d);
+		hi = std::max(hi, d);
+	}
+	/* Leeway of a tick for the rounding, more above for a busy machine */
+	if (lo < period - tick)
+		return t_fail("shortest interval", lo.count(), (period - tick).count());
+	if (hi > period + jitter + 5 * tick)
+		return t_fail("longest interval", hi.count(), (period + jitter).count());
+	if (hi - lo < tick)
+		return t_fail("spread of the intervals", (hi - lo).count(), tick.count());
+	return EXIT_SUCCESS;
+}
+
+static int t_busy()
+{
+	ECScheduler sched(2, tick, slots);
+	std::atomic<int> runs{0}, inside{0}, overlaps{0};
+
+	/* Due every tick, busy for five */
+	auto id = sched.add_timer(tick, [&]() {
+		if (++inside > 1)
+			++overlaps;
+		++runs;
+		std::this_thread::sleep_for(5 * tick);
+		--inside;
+	}, tick);
+	std::this_thread::sleep_for(25 * tick);
+	sched.cancel_timer(id);
+	if (overlaps != 0)
+		return t_fail("runs while the previous one was busy", overlaps, 0);
+	if (runs < 2 || runs > 6)
+		return t_fail("runs of a busy timer", runs, 5);
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	if (t_turns() != EXIT_SUCCESS || t_cancel() != EXIT_SUCCESS ||
+	    t_jitter() != EXIT_SUCCESS || t_busy() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	puts("ok");
+	return EXIT_SUCCESS;
+}
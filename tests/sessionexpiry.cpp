@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: AGPL-3.0-only */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks the expiry heap of the session buckets: only due entries are
+ * looked at, sessions with requests since are put back for their new
+ * expiry, persistent sessions are looked at again later, entries of
+ * sessions that are gone are dropped, and a pass stops at its deadline.
+ */
+#include <kopano/platform.h>
+#include <chrono>
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include "ECSessionExpiry.h"
+
+using namespace KC;
+using std::chrono::steady_clock;
+
+static int t_fail(const char *what, unsigned long long have, unsigned long long want)
+{
+	fprintf(stderr, "FAIL: %s: %llu, expected %llu\n", what, have, want);
+	return EXIT_FAILURE;
+}
+
+/* Sessions by id with the time they expire at, as of their last request */
+struct t_sessions {
+	std::map<ECSESSIONID, time_t> expiry;
+	std::set<ECSESSIONID> persistent;
+	unsigned int looked = 0;
+
+	bool expire(session_expiry &q, time_t now, std::vector<ECSESSIONID> &out,
+	    steady_clock::time_point deadline = steady_clock::time_point::max())
+	{
+		return q.expire(now, deadline,
+			[&](ECSESSIONID id, time_t *t) {
+				++looked;
+				auto i = expiry.find(id);
+				if (i == expiry.cend())
+					return false;
+				*t = i->second;
+				return true;
+			},
+			[&](ECSESSIONID id) { return persistent.count(id) > 0; },
+			out);
+	}
+};
+
+static int t_due()
+{
+	session_expiry q;
+	t_sessions s;
+	std::vector<ECSESSIONID> out;
+
+	for (ECSESSIONID id = 1; id <= 100; ++id) {
+		s.expiry[id] = 1000 + id;
+		q.add(id, 1000 + id);
+	}
+	/* Nothing is due: nothing is looked at */
+	if (s.expire(q, 1001, out) || !out.empty() || s.looked != 0)
+		return t_fail("sessions looked at before they are due", s.looked, 0);
+	if (s.expire(q, 1011, out) || out.size() != 10 || s.looked != 10)
+		return t_fail("due sessions", out.size(), 10);
+	for (ECSESSIONID id = 1; id <= 10; ++id)
+		if (out[id-1] != id)
+			return t_fail("order of expiry", out[id-1], id);
+	if (q.size() != 90)
+		return t_fail("entries left", q.size(), 90);
+	return EXIT_SUCCESS;
+}
+
+static int t_active()
+{
+	session_expiry q;
+	t_sessions s;
+	std::vector<ECSESSIONID> out;
+
+	s.expiry[1] = 100;
+	q.add(1, 100);
+	/* A request came in; the session now expires at 200 */
+	s.expiry[1] = 200;
+	s.expire(q, 150, out);
+	if (!out.empty() || q.size() != 1)
+		return t_fail("active session expired", out.size(), 0);
+	/* Put back for then, and not looked at again before */
+	s.looked = 0;
+	s.expire(q, 200, out);
+	if (s.looked != 0)
+		return t_fail("active session looked at before its new expiry", s.looked, 0);
+	s.expire(q, 201, out);
+	if (out.size() != 1 || out[0] != 1 || q.size() != 0)
+		return t_fail("session expired after its new expiry", out.size(), 1);
+	return EXIT_SUCCESS;
+}
+
+static int t_persistent()
+{
+	session_expiry q;
+	t_sessions s;
+	std::vector<ECSESSIONID> out;
+
+	s.expiry[1] = 100;
+	s.persistent.insert(1);
+	q.add(1, 100);
+	s.expire(q, 150, out);
+	if (!out.empty() || q.size() != 1)
+		return t_fail("persistent session expired", out.size(), 0);
+	s.looked = 0;
+	s.expire(q, 150 + session_expiry::RECHECK, out);
+	if (s.looked != 0)
+		return t_fail("persistent session looked at before the recheck", s.looked, 0);
+	s.expire(q, 151 + session_expiry::RECHECK, out);
+	if (s.looked != 1 || !out.empty())
+		return t_fail("persistent session rechecked", s.looked, 1);
+	/* No longer persistent */
+	s.persistent.clear();
+	s.expire(q, 152 + 2 * session_expiry::RECHECK, out);
+	if (out.size() != 1 || q.size() != 0)
+		return t_fail("session expired once not persistent", out.size(), 1);
+	return EXIT_SUCCESS;
+}
+
+static int t_removed()
+{
+	session_expiry q;
+	t_sessions s;
+	std::vector<ECSESSIONID> out;
+
+	for (ECSESSIONID id = 1; id <= 3; ++id) {
+		s.expiry[id] = 100;
+		q.add(id, 100);
+	}
+	s.expiry.erase(2);
+	s.expiry[3] = 500;
+	s.expire(q, 200, out);
+	if (out.size() != 1 || out[0] != 1)
+		return t_fail("sessions expired", out.size(), 1);
+	/* Entry 2 is dropped, entry 3 is back for 500 */
+	if (q.size() != 1)
+		return t_fail("entries left", q.size(), 1);
+	s.expiry.clear();
+	s.looked = 0;
+	s.expire(q, 1000, out);
+	if (q.size() != 0 || s.looked != 1 || out.size() != 1)
+		return t_fail("entries after their sessions were removed", q.size(), 0);
+	return EXIT_SUCCESS;
+}
+
+static int t_deadline()
+{
+	session_expiry q;
+	t_sessions s;
+	std::vector<ECSESSIONID> out;
+
+	for (ECSESSIONID id = 1; id <= 3; ++id) {
+		s.expiry[id] = 100;
+		q.add(id, 100);
+	}
+	/* A deadline that has passed still lets each pass handle one entry */
+	auto past = steady_clock::time_point::min();
+	for (unsigned int n = 1; n <= 3; ++n) {
+		/* Only the last pass finds nothing more due */
+		bool more = s.expire(q, 200, out, past);
+		if (more != (n < 3))
+			return t_fail("more entries due after a pass", more, n < 3);
+		if (out.size() != n)
+			return t_fail("entries handled by the passes", out.size(), n);
+	}
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	if (t_due() != EXIT_SUCCESS || t_active() != EXIT_SUCCESS ||
+	    t_persistent() != EXIT_SUCCESS || t_removed() != EXIT_SUCCESS ||
+	    t_deadline() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	puts("ok");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: AGPL-3.0-only */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks ECSharedViewManager: tables with the same key attach to the same
+ * view, and other locales or restrictions to another; table changes fan
+ * out to all views of the folder and no others; views go away with their
+ * last table; restrictions that depend on the session are not shared,
+ * also inside a subrestriction.
+ */
+#include <kopano/platform.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <mapidefs.h>
+#include <mapitags.h>
+#include <edkmdb.h>
+#include "soapH.h"
+#include "ECSharedView.h"
+
+using namespace KC;
+
+static int t_fail(const char *what, unsigned long long have, unsigned long long want)
+{
+	fprintf(stderr, "FAIL: %s: %llu, expected %llu\n", what, have, want);
+	return EXIT_FAILURE;
+}
+
+/* A view as a table leaves it after loading @ids */
+static void t_fill(ECSharedView &v, std::initializer_list<unsigned int> ids)
+{
+	v.m_ids = ids;
+	v.m_ids_valid = true;
+	for (auto id : ids)
+		v.m_rows[id].match = true;
+}
+
+static int t_fanout()
+{
+	ECSharedViewManager mgr;
+	auto a = mgr.get({1, MAPI_MESSAGE, 0, "en_US", "sig"});
+	auto a2 = mgr.get({1, MAPI_MESSAGE, 0, "en_US", "sig"});
+	auto other_locale = mgr.get({1, MAPI_MESSAGE, 0, "de_DE", "sig"});
+	auto other_sig = mgr.get({1, MAPI_MESSAGE, 0, "en_US", "sig2"});
+	auto assoc = mgr.get({1, MAPI_MESSAGE, MAPI_ASSOCIATED, "en_US", "sig"});
+	auto other_folder = mgr.get({2, MAPI_MESSAGE, 0, "en_US", "sig"});
+	if (a != a2)
+		return t_fail("tables with the same key share a view", 0, 1);
+	if (a == other_locale || a == other_sig)
+		return t_fail("tables with other locales or restrictions share a view", 1, 0);
+	if (mgr.size() != 5)
+		return t_fail("views", mgr.size(), 5);
+	for (auto v : {a, other_locale, other_sig, assoc, other_folder})
+		t_fill(*v, {10, 11, 12});
+
+	mgr.update(ECKeyTable::TABLE_ROW_ADD, 1, MAPI_MESSAGE, 0, {13});
+	mgr.update(ECKeyTable::TABLE_ROW_MODIFY, 1, MAPI_MESSAGE, 0, {10});
+	mgr.update(ECKeyTable::TABLE_ROW_DELETE, 1, MAPI_MESSAGE, 0, {11});
+	for (auto v : {a, other_locale, other_sig}) {
+		if (v->m_gen != 3)
+			return t_fail("changes counted", v->m_gen, 3);
+		if (v->m_ids != std::set<unsigned int>{10, 12, 13})
+			return t_fail("objects after add and delete", v->m_ids.size(), 3);
+		/* Changed rows are dropped, to be looked at again */
+		if (v->m_rows.size() != 1 || v->m_rows.count(12) != 1)
+			return t_fail("rows after modify and delete", v->m_rows.size(), 1);
+	}
+	for (auto v : {assoc, other_folder})
+		if (v->m_gen != 0 || v->m_ids.size() != 3 || v->m_rows.size() != 3)
+			return t_fail("changes that went to another folder's view", v->m_gen, 0);
+
+	mgr.update(ECKeyTable::TABLE_CHANGE, 2, MAPI_MESSAGE, 0, {});
+	if (other_folder->m_ids_valid || !other_folder->m_ids.empty() ||
+	    !other_folder->m_rows.empty() || other_folder->m_gen != 1)
+		return t_fail("view after a table change", other_folder->m_gen, 1);
+	/* Objects added while the view does not know the folder are not made up */
+	mgr.update(ECKeyTable::TABLE_ROW_ADD, 2, MAPI_MESSAGE, 0, {20});
+	if (!other_folder->m_ids.empty())
+		return t_fail("objects of an unloaded view", other_folder->m_ids.size(), 0);
+
+	/* Views go away with the last table that uses them */
+	a.reset();
+	if (mgr.size() != 5)
+		return t_fail("views while one table is left", mgr.size(), 5);
+	a2.reset();
+	other_locale.reset();
+	if (mgr.size() != 3)
+		return t_fail("views after the tables closed", mgr.size(), 3);
+	mgr.update(ECKeyTable::TABLE_ROW_ADD, 1, MAPI_MESSAGE, 0, {14});
+	if (other_sig->m_ids.count(14) != 1)
+		return t_fail("change after other views closed", other_sig->m_ids.count(14), 1);
+	auto fresh = mgr.get({1, MAPI_MESSAGE, 0, "en_US", "sig"});
+	if (fresh->m_gen != 0 || fresh->m_ids_valid)
+		return t_fail("view that was reopened", fresh->m_gen, 0);
+	return EXIT_SUCCESS;
+}
+
+static int t_signature()
+{
+	struct restrictExist ex{};
+	struct restrictSub sub{};
+	struct restrictTable inner{}, outer{};
+	std::string sig;
+
+	inner.ulType = RES_EXIST;
+	inner.lpExist = &ex;
+	sub.ulSubObject = PR_MESSAGE_RECIPIENTS;
+	sub.lpSubObject = &inner;
+	outer.ulType = RES_SUBRESTRICTION;
+	outer.lpSub = &sub;
+
+	ex.ulPropTag = PR_ACCESS;
+	if (ECSharedViewManager::signature(nullptr, &inner, sig))
+		return t_fail("restriction on PR_ACCESS shared", 1, 0);
+	if (ECSharedViewManager::signature(nullptr, &outer, sig))
+		return t_fail("subrestriction on PR_ACCESS shared", 1, 0);
+	ex.ulPropTag = PR_DISPLAY_NAME_A;
+	if (!ECSharedViewManager::signature(nullptr, &outer, sig) || sig.empty())
+		return t_fail("subrestriction on PR_DISPLAY_NAME shared", 0, 1);
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	if (t_fanout() != EXIT_SUCCESS || t_signature() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	puts("ok");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Sends mail through ECVMIMESender to a stub SMTP server on the loopback
+ * interface, and checks the connection pool and the pipelined envelope:
+ * connections are reused with RSET, replaced when RSET or the connection
+ * fails, and a recipient rejected in the middle of a pipelined envelope
+ * fails on its own without losing the message or the connection.
+ */
+#include <kopano/platform.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vmime/vmime.hpp>
+#include <vmime/platforms/posix/posixHandler.hpp>
+#include <mapicode.h>
+#include "inetmapi/ECVMIMEUtils.h"
+
+using namespace KC;
+
+/* A one-connection-at-a-time SMTP server that tells what it went through */
+class t_server {
+	public:
+	int m_listen = -1;
+	unsigned short m_port = 0;
+	std::atomic<bool> m_fail_next_rset{false}, m_drop_after_msg{false};
+	std::atomic<unsigned int> m_conns{0}, m_rsets{0}, m_msgs{0}, m_last_rcpts{0};
+	std::atomic<bool> m_unpipelined{false};
+
+	bool start()
+	{
+		struct sockaddr_in sin{};
+		socklen_t len = sizeof(sin);
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		m_listen = socket(AF_INET, SOCK_STREAM, 0);
+		if (m_listen < 0 || bind(m_listen, reinterpret_cast<struct sockaddr *>(&sin), sizeof(sin)) != 0 ||
+		    listen(m_listen, 4) != 0 ||
+		    getsockname(m_listen, reinterpret_cast<struct sockaddr *>(&sin), &len) != 0)
+			return false;
+		m_port = ntohs(sin.sin_port);
+		std::thread([this]() { run(); }).detach();
+		return true;
+	}
+
+	private:
+	int m_fd = -1;
+	std::string m_buf;
+
+	bool fill(int timeout_ms = -1)
+	{
+		struct pollfd p = {m_fd, POLLIN, 0};
+		if (poll(&p, 1, timeout_ms) <= 0)
+			return false;
+		char b[4096];
+		auto r = read(m_fd, b, sizeof(b));
+		if (r <= 0)
+			return false;
+		m_buf.append(b, r);
+		return true;
+	}
+
+	bool line(std::string &l)
+	{
+		size_t eol;
+		while ((eol = m_buf.find("\r\n")) == std::string::npos)
+			if (!fill())
+				return false;
+		l = m_buf.substr(0, eol);
+		m_buf.erase(0, eol + 2);
+		return true;
+	}
+
+	void reply(const char *r)
+	{
+		std::string s = std::string(r) + "\r\n";
+		if (write(m_fd, s.c_str(), s.size()) < 0)
+			/* the client went away */;
+	}
+
+	void run()
+	{
+		while ((m_fd = accept(m_listen, nullptr, nullptr)) >= 0) {
+			++m_conns;
+			m_buf.clear();
+			session();
+			close(m_fd);
+		}
+	}
+
+	void session()
+	{
+		unsigned int rcpts = 0;
+		std::string l;
+		reply("220 stub ESMTP");
+		while (line(l)) {
+			auto cmd = l.substr(0, 4);
+			if (cmd == "EHLO") {
+				reply("250-stub\r\n250-PIPELINING\r\n250 8BITMIME");
+			} else if (cmd == "HELO" || cmd == "NOOP") {
+				reply("250 ok");
+			} else if (cmd == "RSET") {
+				++m_rsets;
+				if (m_fail_next_rset.exchange(false)) {
+					reply("421 4.3.2 going away");
+					return;
+				}
+				rcpts = 0;
+				reply("250 ok");
+			} else if (cmd == "MAIL") {
+				/* With PIPELINING, the envelope arrives up to DATA before any reply */
+				while (m_buf.find("DATA\r\n") == std::string::npos)
+					if (!fill(2000)) {
+						m_unpipelined = true;
+						break;
+					}
+				rcpts = 0;
+				reply("250 ok");
+			} else if (cmd == "RCPT") {
+				if (l.find("<bad") != std::string::npos) {
+					reply("550 5.1.1 User unknown");
+				} else {
+					++rcpts;
+					reply("250 ok");
+				}
+			} else if (cmd == "DATA") {
+				if (rcpts == 0) {
+					reply("554 5.5.1 No valid recipients");
+					continue;
+				}
+				reply("354 go ahead");
+				size_t end;
+				while ((end = m_buf.find("\r\n.\r\n")) == std::string::npos)
+					if (!fill())
+						return;
+				m_buf.erase(0, end + 5);
+				m_last_rcpts = rcpts;
+				++m_msgs;
+				reply("250 2.0.0 queued");
+				if (m_drop_after_msg.exchange(false))
+					return;
+			} else if (cmd == "QUIT") {
+				reply("221 bye");
+				return;
+			} else {
+				reply("502 5.5.2 what?");
+			}
+		}
+	}
+};
+
+static int t_fail(const char *what, unsigned int have, unsigned int want)
+{
+	fprintf(stderr, "FAIL: %s: %u, expected %u\n", what, have, want);
+	return EXIT_FAILURE;
+}
+
+static HRESULT t_send(ECVMIMESender *s, const std::vector<const char *> &to)
+{
+	vmime::mailboxList rcpts;
+	for (auto r : to)
+		rcpts.appendMailbox(vmime::make_shared<vmime::mailbox>(r));
+	return s->sendData(vmime::mailbox("sender@example.com"), rcpts,
+	       "Subject: test\r\n\r\n.leading dot\r\nbody\r\n", false);
+}
+
+int main()
+{
+	vmime::platform::setHandler<vmime::platforms::posix::posixHandler>();
+	t_server srv;
+	if (!srv.start()) {
+		perror("stub server");
+		return EXIT_FAILURE;
+	}
+	smtp_pool_configure(1, 0, 0);
+	std::unique_ptr<ECSender> base(CreateSender("127.0.0.1", srv.m_port));
+	auto s = dynamic_cast<ECVMIMESender *>(base.get());
+	if (s == nullptr)
+		return t_fail("ECVMIMESender", 0, 1);
+
+	/* Second message goes over the first connection, after RSET */
+	if (t_send(s, {"a@example.com"}) != hrSuccess ||
+	    t_send(s, {"b@example.com"}) != hrSuccess)
+		return t_fail("messages sent", srv.m_msgs, 2);
+	if (srv.m_conns != 1)
+		return t_fail("connections for two messages", srv.m_conns, 1);
+	if (srv.m_rsets != 1)
+		return t_fail("RSETs for two messages", srv.m_rsets, 1);
+
+	/* A failed RSET costs a new connection, not the message */
+	srv.m_fail_next_rset = true;
+	if (t_send(s, {"c@example.com"}) != hrSuccess)
+		return t_fail("sent after failed RSET", srv.m_msgs, 3);
+	if (srv.m_conns != 2)
+		return t_fail("connections after failed RSET", srv.m_conns, 2);
+
+	/* The server closed the idle connection */
+	srv.m_drop_after_msg = true;
+	if (t_send(s, {"d@example.com"}) != hrSuccess ||
+	    t_send(s, {"e@example.com"}) != hrSuccess)
+		return t_fail("sent around a dropped connection", srv.m_msgs, 5);
+	if (srv.m_conns != 3)
+		return t_fail("connections after a drop", srv.m_conns, 3);
+
+	/* One rejected recipient in the pipelined envelope */
+	auto ret = t_send(s, {"f@example.com", "bad@example.com", "g@example.com"});
+	if (ret != MAPI_W_PARTIAL_COMPLETION)
+		return t_fail("result with a rejected recipient", ret, MAPI_W_PARTIAL_COMPLETION);
+	const auto &perm = s->getPermanentFailedRecipients();
+	if (perm.size() != 1 || perm[0].strRecipEmail != "bad@example.com" || perm[0].ulSMTPcode != 550)
+		return t_fail("permanently failed recipients", perm.size(), 1);
+	if (!s->getTemporaryFailedRecipients().empty())
+		return t_fail("temporarily failed recipients", s->getTemporaryFailedRecipients().size(), 0);
+	if (srv.m_msgs != 6 || srv.m_last_rcpts != 2)
+		return t_fail("recipients of the message", srv.m_last_rcpts, 2);
+	if (srv.m_conns != 3)
+		return t_fail("connections after a rejected recipient", srv.m_conns, 3);
+	if (srv.m_unpipelined)
+		return t_fail("envelopes not pipelined", 1, 0);
+
+	/* All rejected: the message is cancelled */
+	ret = t_send(s, {"bad1@example.com", "bad2@example.com"});
+	if (ret != MAPI_W_CANCEL_MESSAGE)
+		return t_fail("result with all recipients rejected", ret, MAPI_W_CANCEL_MESSAGE);
+	if (srv.m_msgs != 6)
+		return t_fail("messages after all recipients rejected", srv.m_msgs, 6);
+
+	smtp_pool_configure(0, 0, 0);
+	puts("ok");
+	return EXIT_SUCCESS;
+}
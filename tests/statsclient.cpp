@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks the bucket arithmetic of ECHistogram (index, lower bound,
+ * quantiles), and that sharded stats add up and can be set while other
+ * threads count.
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "StatsClient.h"
+
+using namespace KC;
+
+static int t_fail(const char *what, unsigned long long have, unsigned long long want)
+{
+	fprintf(stderr, "FAIL: %s: %llu, expected %llu\n", what, have, want);
+	return EXIT_FAILURE;
+}
+
+class t_stats final : public ECStatsCollector {
+	public:
+	t_stats() : ECStatsCollector(nullptr)
+	{
+		AddStat(SCN_SERVER_CONNECTIONS, SCT_INTEGER, "connections");
+		AddStat(SCN_SOAP_REQUESTS, SCT_HISTOGRAM, "soap_request");
+	}
+};
+
+static ECHistogram t_hist(const std::vector<uint64_t> &samples)
+{
+	ECHistogram h;
+	h.n.assign(ECHistogram::BUCKETS, 0);
+	for (auto v : samples) {
+		++h.n[ECHistogram::index(v)];
+		++h.count;
+		h.sum += v;
+		h.max = std::max(h.max, v);
+	}
+	return h;
+}
+
+static int t_buckets()
+{
+	static const struct { uint64_t v; unsigned int i; } known[] = {
+		{0, 0}, {3, 3}, {4, 4}, {5, 5}, {7, 7}, {8, 8}, {9, 8}, {10, 9},
+		{15, 11}, {16, 12}, {1000, 35}, {UINT64_MAX, ECHistogram::BUCKETS - 1},
+	};
+	for (const auto &k : known)
+		if (ECHistogram::index(k.v) != k.i)
+			return t_fail(("index of " + std::to_string(k.v)).c_str(), ECHistogram::index(k.v), k.i);
+	for (unsigned int i = 1; i < ECHistogram::BUCKETS; ++i) {
+		if (ECHistogram::lower(i) <= ECHistogram::lower(i - 1))
+			return t_fail("lower bounds increasing", ECHistogram::lower(i), ECHistogram::lower(i - 1) + 1);
+		/* A bucket's lower bound is in that bucket, and the value just below in the one before */
+		if (ECHistogram::index(ECHistogram::lower(i)) != i)
+			return t_fail("index of a lower bound", ECHistogram::index(ECHistogram::lower(i)), i);
+		if (ECHistogram::index(ECHistogram::lower(i) - 1) != i - 1)
+			return t_fail("index below a lower bound", ECHistogram::index(ECHistogram::lower(i) - 1), i - 1);
+	}
+	/* Two bits of precision: a bucket is at most a quarter of its lower bound wide */
+	for (unsigned int i = 8; i + 1 < ECHistogram::BUCKETS; ++i)
+		if (ECHistogram::lower(i + 1) - ECHistogram::lower(i) > ECHistogram::lower(i) / 4)
+			return t_fail("bucket width", ECHistogram::lower(i + 1) - ECHistogram::lower(i), ECHistogram::lower(i) / 4);
+	return EXIT_SUCCESS;
+}
+
+static int t_quantiles()
+{
+	if (t_hist({}).quantile(0.5) != 0)
+		return t_fail("quantile of nothing", t_hist({}).quantile(0.5), 0);
+	if (t_hist({7}).quantile(0.5) != 7)
+		return t_fail("quantile of one sample", t_hist({7}).quantile(0.5), 7);
+
+	std::vector<uint64_t> s;
+	for (uint64_t v = 1; v <= 1000; ++v)
+		s.push_back(v);
+	auto h = t_hist(s);
+	static const struct { double q; uint64_t exact; } qs[] = {
+		{0.01, 10}, {0.5, 500}, {0.9, 900}, {0.99, 990},
+	};
+	for (const auto &q : qs) {
+		auto v = h.quantile(q.q);
+		if (v < q.exact || v > q.exact + q.exact / 4)
+			return t_fail(("quantile " + std::to_string(q.q)).c_str(), v, q.exact);
+	}
+	if (h.quantile(1) != 1000)
+		return t_fail("quantile 1", h.quantile(1), 1000);
+	/* Never above the largest sample */
+	if (t_hist({1000, 1001}).quantile(0.99) != 1001)
+		return t_fail("quantile capped by max", t_hist({1000, 1001}).quantile(0.99), 1001);
+	return EXIT_SUCCESS;
+}
+
+static int t_shards()
+{
+	auto sc = std::make_unique<t_stats>();
+	std::vector<std::thread> thr;
+	for (unsigned int i = 0; i < 2 * SC_SHARDS; ++i)
+		thr.emplace_back([&]() {
+			for (unsigned int j = 0; j < 1000; ++j) {
+				sc->inc(SCN_SERVER_CONNECTIONS);
+				sc->sample(SCN_SOAP_REQUESTS, j);
+			}
+		});
+	for (auto &t : thr)
+		t.join();
+	thr.clear();
+	auto v = strtoull(sc->GetValue(SCN_SERVER_CONNECTIONS).c_str(), nullptr, 10);
+	if (v != 2 * SC_SHARDS * 1000)
+		return t_fail("sum of shards", v, 2 * SC_SHARDS * 1000);
+	auto hv = sc->GetValue(SCN_SOAP_REQUESTS);
+	auto want = "count=" + std::to_string(2 * SC_SHARDS * 1000) + " avg=499 ";
+	if (hv.compare(0, want.size(), want) != 0 || hv.find(" max=999") == std::string::npos) {
+		fprintf(stderr, "FAIL: histogram \"%s\"\n", hv.c_str());
+		return EXIT_FAILURE;
+	}
+
+	/* After a set(), the increments of all shards count from the new value */
+	std::atomic<bool> go{false};
+	for (unsigned int i = 0; i < SC_SHARDS; ++i)
+		thr.emplace_back([&]() {
+			while (!go)
+				std::this_thread::yield();
+			for (unsigned int j = 0; j < 1000; ++j)
+				sc->inc(SCN_SERVER_CONNECTIONS);
+		});
+	sc->set(SCN_SERVER_CONNECTIONS, 0LL);
+	go = true;
+	for (auto &t : thr)
+		t.join();
+	v = strtoull(sc->GetValue(SCN_SERVER_CONNECTIONS).c_str(), nullptr, 10);
+	if (v != SC_SHARDS * 1000)
+		return t_fail("set, then increments", v, SC_SHARDS * 1000);
+	sc->set(SCN_SERVER_CONNECTIONS, 42LL);
+	v = strtoull(sc->GetValue(SCN_SERVER_CONNECTIONS).c_str(), nullptr, 10);
+	if (v != 42)
+		return t_fail("set", v, 42);
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	if (t_buckets() != EXIT_SUCCESS || t_quantiles() != EXIT_SUCCESS ||
+	    t_shards() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	puts("ok");
+	return EXIT_SUCCESS;
+}
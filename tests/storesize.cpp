@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: AGPL-3.0-only */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks the store size cache: sizes are kept only when no change was
+ * busy or ended while they were read, committed additions are applied,
+ * new sizes, rollbacks and refused subtractions forget the size, and
+ * sizes expire MAX_AGE after they were read.
+ */
+#include <kopano/platform.h>
+#include <cstdio>
+#include <cstdlib>
+#include "ECStoreSize.h"
+
+using namespace KC;
+
+static int t_fail(const char *what, long long have, long long want)
+{
+	fprintf(stderr, "FAIL: %s: %lld, expected %lld\n", what, have, want);
+	return EXIT_FAILURE;
+}
+
+/* Reads @size for store 1 from "the database" at @now */
+static bool t_load(store_size_cache &c, long long size, time_t now)
+{
+	unsigned int gen = 0;
+	if (!c.loading(1, &gen))
+		return false;
+	c.loaded(1, gen, size, now);
+	return true;
+}
+
+static int t_read()
+{
+	store_size_cache c;
+	long long size = 0;
+
+	if (c.get(1, 100, &size))
+		return t_fail("size of an unknown store", 1, 0);
+	if (!t_load(c, 1000, 100) || !c.get(1, 100, &size) || size != 1000)
+		return t_fail("size read", size, 1000);
+	/* Changes do not restart the clock */
+	c.begin(1);
+	c.end(1, false, 10, true);
+	if (!c.get(1, 100 + store_size_cache::MAX_AGE - 1, &size) || size != 1010)
+		return t_fail("size just before it expires", size, 1010);
+	if (c.get(1, 100 + store_size_cache::MAX_AGE, &size))
+		return t_fail("expired size", 1, 0);
+	auto st = c.get_stats();
+	if (st.req != 4 || st.hit != 2 || st.items != 1)
+		return t_fail("hits", st.hit, 2);
+	c.purge();
+	if (c.get(1, 100, &size) || c.get_stats().items != 0)
+		return t_fail("sizes after a purge", c.get_stats().items, 0);
+	return EXIT_SUCCESS;
+}
+
+static int t_busy()
+{
+	store_size_cache c;
+	long long size = 0;
+	unsigned int gen = 0;
+
+	/* Not kept while a change is busy */
+	c.begin(1);
+	if (t_load(c, 1000, 100) || c.get(1, 100, &size))
+		return t_fail("size read while busy", 1, 0);
+	/* Nor when a change ends during the read */
+	c.end(1, false, 10, true);
+	if (!c.loading(1, &gen))
+		return t_fail("reading after the change", 0, 1);
+	c.begin(1);
+	c.end(1, false, 10, true);
+	c.loaded(1, gen, 1010, 100);
+	if (c.get(1, 100, &size))
+		return t_fail("size read across a change", size, 0);
+	/* Nor when a change began during it */
+	if (!c.loading(1, &gen))
+		return t_fail("reading after the second change", 0, 1);
+	c.begin(1);
+	c.loaded(1, gen, 1020, 100);
+	c.end(1, false, 10, true);
+	if (c.get(1, 100, &size))
+		return t_fail("size read while a change began", size, 0);
+	/* A purge keeps what running changes need */
+	c.begin(1);
+	c.purge();
+	if (t_load(c, 1030, 100))
+		return t_fail("size read while busy after a purge", 1, 0);
+	c.end(1, false, 10, true);
+	if (!t_load(c, 1040, 100) || !c.get(1, 100, &size) || size != 1040)
+		return t_fail("size read after all changes", size, 1040);
+	return EXIT_SUCCESS;
+}
+
+static int t_end()
+{
+	store_size_cache c;
+	long long size = 0;
+
+	t_load(c, 1000, 100);
+	/* Two overlapping transactions, ending in either order */
+	c.begin(1);
+	c.begin(1);
+	c.end(1, false, -300, true);
+	c.end(1, false, 200, true);
+	if (!c.get(1, 100, &size) || size != 900)
+		return t_fail("size after additions", size, 900);
+	c.begin(1);
+	c.end(1, false, 500, false);
+	if (c.get(1, 100, &size))
+		return t_fail("size after a rollback", size, 0);
+
+	t_load(c, 1000, 100);
+	c.begin(1);
+	c.end(1, true, 50, true);
+	if (c.get(1, 100, &size))
+		return t_fail("size after a new one was set", size, 0);
+
+	/* The database refuses to go below 0 */
+	t_load(c, 100, 100);
+	c.begin(1);
+	c.end(1, false, -200, true);
+	if (c.get(1, 100, &size))
+		return t_fail("size after a subtraction below 0", size, 0);
+	/* An unknown size stays unknown */
+	c.begin(1);
+	c.end(1, false, 10, true);
+	if (c.get(1, 100, &size))
+		return t_fail("unknown size after an addition", size, 0);
+	/* Other stores are not affected */
+	unsigned int gen = 0;
+	if (!c.loading(2, &gen))
+		return t_fail("reading another store", 0, 1);
+	c.loaded(2, gen, 7, 100);
+	c.begin(1);
+	c.end(1, false, 10, false);
+	if (!c.get(2, 100, &size) || size != 7)
+		return t_fail("size of another store", size, 7);
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	if (t_read() != EXIT_SUCCESS || t_busy() != EXIT_SUCCESS ||
+	    t_end() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	puts("ok");
+	return EXIT_SUCCESS;
+}
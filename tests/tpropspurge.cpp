@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: AGPL-3.0-only */
+/* Copyright 2018, Kopano and its licensors */
+/*
+ * Checks the bookkeeping of the deferred tproperties purger: counting
+ * records as they are added, moved and purged, counting a folder again
+ * after a purge that found nothing, which folders are queued for the
+ * workers and when, and the batching of the statements that add records.
+ */
+#include <kopano/platform.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include "ECTPropsPurge.h"
+
+using namespace KC;
+
+static int t_fail(const char *what, unsigned long long have, unsigned long long want)
+{
+	fprintf(stderr, "FAIL: %s: %llu, expected %llu\n", what, have, want);
+	return EXIT_FAILURE;
+}
+
+static int t_counts()
+{
+	deferred_backlog b;
+	b.added(1, 3, 100);
+	b.added(1, 2, 150);
+	b.added(2, 0, 150);
+	auto st = b.stats(200);
+	if (st.records != 5 || st.folders != 1)
+		return t_fail("records after adding", st.records, 5);
+	if (st.max_age != 100)
+		return t_fail("age of the first record", st.max_age, 100);
+
+	/* What is left after a purge is newer than the purge */
+	b.purged(1, 2, 300);
+	if (b.records(1) != 3 || b.stats(300).max_age != 0)
+		return t_fail("records after a purge", b.records(1), 3);
+	b.purged(1, 5, 310);
+	if (b.stats(310).folders != 0)
+		return t_fail("folders after purging all", b.stats(310).folders, 0);
+
+	/* Of 3 records moved to folder 2, 2 were in folder 1 (2 rows each) and 1 is new */
+	b.added(1, 4, 400);
+	b.moved(2, 1, 3, 5, 410);
+	if (b.records(1) != 2 || b.records(2) != 3)
+		return t_fail("records of the source folder after a move", b.records(1), 2);
+	b.moved(2, 1, 3, 9, 420);
+	if (b.records(1) != 0 || b.stats(420).folders != 1)
+		return t_fail("records of the emptied source folder", b.records(1), 0);
+
+	/* Counted after a rollback, or again after records came in */
+	b.counted(2, 0, 500);
+	if (b.stats(500).folders != 0)
+		return t_fail("folders counted empty", b.stats(500).folders, 0);
+	b.added(3, 50, 500);
+	b.counted(3, 7, 510);
+	if (b.records(3) != 7 || b.stats(510).max_age != 10)
+		return t_fail("records counted", b.records(3), 7);
+
+	/* Counting the table keeps the age of known folders only */
+	b.load({{3, 8}, {4, 1}}, 600);
+	st = b.stats(600);
+	if (st.folders != 2 || b.records(3) != 8 || b.records(4) != 1)
+		return t_fail("folders loaded", st.folders, 2);
+	if (st.max_age != 100 || st.max_folder != 3)
+		return t_fail("age after loading", st.max_age, 100);
+	return EXIT_SUCCESS;
+}
+
+static std::vector<unsigned int> t_drain(deferred_backlog &b)
+{
+	std::vector<unsigned int> q;
+	while (b.queued())
+		q.emplace_back(b.next());
+	return q;
+}
+
+static int t_schedule()
+{
+	deferred_backlog b;
+	b.added(1, 10, 0);
+	b.added(2, 6, 0);
+	b.added(3, 3, 0);
+	b.added(4, 1, 90);
+
+	/* Nothing over any limit */
+	if (b.schedule(100, 0, 11, 0) || b.queued())
+		return t_fail("queued under the limits", 1, 0);
+	/* Folder 1 by its own count, folder 2 to get the total below 18 */
+	if (!b.schedule(100, 18, 10, 0))
+		return t_fail("queued over the limits", 0, 1);
+	auto q = t_drain(b);
+	if (q != std::vector<unsigned int>{1, 2})
+		return t_fail("folders queued", q.size(), 2);
+	/* Busy folders are not queued twice */
+	if (!b.busy(1) || b.schedule(100, 0, 10, 0))
+		return t_fail("busy folder queued again", 1, 0);
+	b.done(1);
+	b.done(2);
+	/* By age; folder 4 is younger */
+	b.schedule(150, 0, 0, 100);
+	q = t_drain(b);
+	std::sort(q.begin(), q.end());
+	if (q != std::vector<unsigned int>{1, 2, 3})
+		return t_fail("folders queued by age", q.size(), 3);
+	for (auto f : q)
+		b.done(f);
+
+	/* A folder that is counted again waits a while */
+	b.counted(1, 10, 200);
+	if (b.schedule(205, 0, 10, 0) || !b.schedule(210, 0, 10, 0))
+		return t_fail("queued while waiting to retry", 1, 0);
+	if (b.next() != 1)
+		return t_fail("folder queued after retrying", 0, 1);
+	return EXIT_SUCCESS;
+}
+
+static unsigned int t_tuples(const std::string &q)
+{
+	return std::count(q.cbegin(), q.cend(), '(') - 1;
+}
+
+static int t_queries()
+{
+	if (!deferred_update_queries(7, 0, {}).empty())
+		return t_fail("statements for nothing", deferred_update_queries(7, 0, {}).size(), 0);
+	std::vector<unsigned int> objs;
+	for (unsigned int i = 1; i <= DEFERRED_PURGE_BATCH + 1; ++i)
+		objs.emplace_back(i);
+	auto q = deferred_update_queries(7, 0, objs);
+	if (q.size() != 2)
+		return t_fail("statements", q.size(), 2);
+	if (t_tuples(q[0]) != DEFERRED_PURGE_BATCH || t_tuples(q[1]) != 1)
+		return t_fail("records in the first statement", t_tuples(q[0]), DEFERRED_PURGE_BATCH);
+	auto last = "VALUES(" + std::to_string(DEFERRED_PURGE_BATCH + 1) + ",7,7)";
+	if (q[1].compare(0, 12, "INSERT IGNOR") != 0 || q[1].find(last) == std::string::npos) {
+		fprintf(stderr, "FAIL: \"%s\"\n", q[1].c_str());
+		return EXIT_FAILURE;
+	}
+	/* A move keeps the source folder of existing records */
+	q = deferred_update_queries(7, 3, {1, 2});
+	if (q.size() != 1 || q[0].find("VALUES(1,3,7),(2,3,7) ON DUPLICATE KEY UPDATE folderid = 7") == std::string::npos) {
+		fprintf(stderr, "FAIL: \"%s\"\n", q.empty() ? "" : q[0].c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	if (t_counts() != EXIT_SUCCESS || t_schedule() != EXIT_SUCCESS ||
+	    t_queries() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	puts("ok");
+	return EXIT_SUCCESS;
+}